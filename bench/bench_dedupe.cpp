@@ -0,0 +1,48 @@
+#include "harness.h"
+#include "network/protocol.h"
+#include "utils/dedupe_window.h"
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace Clipd;
+
+CLIPD_BENCHMARK( Dedupe )
+{
+    // Look ups are timed with as many IDs in the window as a busy session sees in one slice.
+    for( const size_t held : {size_t( 100 ), size_t( 1000 )} )
+    {
+        const auto now = Utils::DedupeWindow::Clock::now();
+        Utils::DedupeWindow window;
+        std::vector<Utils::Uuid> ids;
+        for( size_t i = 0; i < held; ++i )
+        {
+            ids.push_back( Utils::Uuid::random() );
+            window.insert( ids.back(), now );
+        }
+        const std::string suffix = "/" + std::to_string( held );
+
+        size_t next = 0;
+        runner.run( "dedupe/contains_hit" + suffix, [&] {
+            Bench::doNotOptimize( window.contains( ids[next++ % ids.size()], now ) );
+        } );
+        const auto missing = Utils::Uuid::random();
+        runner.run( "dedupe/contains_miss" + suffix,
+                    [&] { Bench::doNotOptimize( window.contains( missing, now ) ); } );
+
+        // An exact set, which remembers every ID, for comparison.
+        std::unordered_set<Utils::Uuid> exact( ids.begin(), ids.end() );
+        runner.run( "dedupe/unordered_set_hit" + suffix, [&] {
+            Bench::doNotOptimize( exact.count( ids[next++ % ids.size()] ) );
+        } );
+    }
+
+    const auto now = Utils::DedupeWindow::Clock::now();
+    Utils::DedupeWindow window;
+    Utils::Version version {1, Utils::Uuid::random()};
+    runner.run( "dedupe/insert", [&] {
+        ++version.timestamp;
+        window.insert( Network::Protocol::messageId( version ), now );
+    } );
+}
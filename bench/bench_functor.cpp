@@ -0,0 +1,106 @@
+#include "clipboard/item.h"
+#include "harness.h"
+#include "utils/delegate.h"
+#include "utils/functor.h"
+
+#include <functional>
+#include <string>
+
+using namespace Clipd;
+
+namespace
+{
+int g_sink = 0;
+
+void freeFunction( int x )
+{
+    g_sink += x;
+}
+
+struct Subscriber
+{
+    int total = 0;
+
+    void add( int x )
+    {
+        total += x;
+    }
+
+    void observe( const Clipboard::Item& item )
+    {
+        total += static_cast<int>( item.contents.size() );
+    }
+};
+} // namespace
+
+CLIPD_BENCHMARK( FunctorConstruction )
+{
+    Subscriber subscriber;
+    runner.run( "functor/construct/free_function", [] {
+        Utils::Functor<void( int )> f = Utils::Functor<void( int )>::from<&freeFunction>();
+        Bench::doNotOptimize( f );
+    } );
+    runner.run( "functor/construct/method", [&] {
+        Utils::Functor<void( int )> f( subscriber, &Subscriber::add );
+        Bench::doNotOptimize( f );
+    } );
+    runner.run( "functor/construct/lambda", [&] {
+        Utils::Functor<void( int )> f( [&subscriber]( int x ) { subscriber.total += x; } );
+        Bench::doNotOptimize( f );
+    } );
+    runner.run( "std_function/construct/lambda", [&] {
+        std::function<void( int )> f( [&subscriber]( int x ) { subscriber.total += x; } );
+        Bench::doNotOptimize( f );
+    } );
+}
+
+CLIPD_BENCHMARK( FunctorInvocation )
+{
+    Subscriber subscriber;
+    int x = 1;
+
+    const auto free_function = Utils::Functor<void( int )>::from<&freeFunction>();
+    runner.run( "functor/invoke/free_function", [&] {
+        Bench::doNotOptimize( x );
+        free_function( x );
+    } );
+
+    const Utils::Functor<void( int )> method( subscriber, &Subscriber::add );
+    runner.run( "functor/invoke/method", [&] {
+        Bench::doNotOptimize( x );
+        method( x );
+    } );
+
+    const Utils::Functor<void( int )> lambda( [&subscriber]( int y ) { subscriber.total += y; } );
+    runner.run( "functor/invoke/lambda", [&] {
+        Bench::doNotOptimize( x );
+        lambda( x );
+    } );
+
+    const std::function<void( int )> function( [&subscriber]( int y ) { subscriber.total += y; } );
+    runner.run( "std_function/invoke/lambda", [&] {
+        Bench::doNotOptimize( x );
+        function( x );
+    } );
+    Bench::doNotOptimize( subscriber.total );
+    Bench::doNotOptimize( g_sink );
+}
+
+CLIPD_BENCHMARK( DelegateFanOut )
+{
+    const Clipboard::Item item {{}, Utils::Payload( std::string( "contents" ) )};
+
+    for( const size_t count : {size_t( 1 ), size_t( 2 ), size_t( 4 ), size_t( 16 )} )
+    {
+        std::vector<Subscriber> subscribers( count );
+        Utils::Delegate<void( const Clipboard::Item& )> delegate;
+        for( auto& subscriber : subscribers )
+        {
+            delegate.subscribe( Utils::Functor<void( const Clipboard::Item& )>(
+                subscriber, &Subscriber::observe ) );
+        }
+
+        runner.run( "delegate/fan_out/" + std::to_string( count ), [&] { delegate( item ); } );
+        Bench::doNotOptimize( subscribers.front().total );
+    }
+}
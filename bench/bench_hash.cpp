@@ -0,0 +1,52 @@
+#include "harness.h"
+#include "utils/hash.h"
+#include "utils/uuid.h"
+
+#include <functional>
+#include <random>
+#include <string>
+
+using namespace Clipd;
+
+CLIPD_BENCHMARK( Hashing )
+{
+    for( const size_t size : Bench::payloadSizes() )
+    {
+        const std::string contents( size, 'x' );
+        runner.run(
+            "hash64/" + std::to_string( size ),
+            [&] {
+                Bench::doNotOptimize( contents.data() );
+                Bench::doNotOptimize( Utils::hash64( contents ) );
+            },
+            size );
+        runner.run(
+            "std_hash/" + std::to_string( size ),
+            [&] {
+                Bench::doNotOptimize( contents.data() );
+                Bench::doNotOptimize( std::hash<std::string> {}( contents ) );
+            },
+            size );
+    }
+}
+
+CLIPD_BENCHMARK( Identifiers )
+{
+    for( const size_t bytes : {size_t( 4 ), size_t( 8 ), size_t( 16 )} )
+    {
+        runner.run( "random_hex/" + std::to_string( bytes ),
+                    [&] { Bench::doNotOptimize( Utils::random_hex( bytes ) ); } );
+    }
+    runner.run( "uuid/random", [] { Bench::doNotOptimize( Utils::Uuid::random() ); } );
+
+    // The per-thread generator, against the shared std::mt19937 random_hex() used to draw from.
+    runner.run( "random/fast", [] { Bench::doNotOptimize( Utils::threadRandom()() ); } );
+    std::mt19937 mt( 1 );
+    std::uniform_int_distribution<uint64_t> dist;
+    runner.run( "random/mt19937", [&] { Bench::doNotOptimize( dist( mt ) ); } );
+
+    const auto uuid = Utils::Uuid::random();
+    const std::string hex = uuid.hex();
+    runner.run( "uuid/from_hex", [&] { Bench::doNotOptimize( Utils::Uuid::fromHex( hex ) ); } );
+    runner.run( "uuid/hex", [&] { Bench::doNotOptimize( uuid.hex() ); } );
+}
@@ -0,0 +1,103 @@
+#include "harness.h"
+#include "network/capabilities.h"
+#include "network/message.h"
+#include "network/protocol.h"
+#include "utils/hlc.h"
+
+#include <string>
+
+using namespace Clipd;
+using namespace Clipd::Network;
+
+namespace
+{
+//! @brief Synthesize the ENTER event Zyre delivers when a current clipd peer joins.
+zmsg_t* enterMessage( const Utils::Uuid& uuid )
+{
+    zhash_t* headers = zhash_new();
+    for( const auto& [key, value] : Capabilities::local().toHeaders() )
+    {
+        zhash_insert( headers, key.c_str(), const_cast<char*>( value.c_str() ) ); // NOLINT
+    }
+    zframe_t* packed = zhash_pack( headers );
+    zhash_destroy( &headers );
+
+    zmsg_t* msg = zmsg_new();
+    zmsg_addstr( msg, "ENTER" );
+    zmsg_addstr( msg, uuid.hex().c_str() );
+    zmsg_addstr( msg, "bench-peer" );
+    zmsg_append( msg, &packed );
+    zmsg_addstr( msg, "tcp://192.168.1.2:49152" );
+    return msg;
+}
+
+//! @brief Synthesize the SHOUT event Zyre delivers when a peer shouts an item.
+zmsg_t* shoutMessage( const Utils::Uuid& uuid, const Clipboard::Item& item )
+{
+    zmsg_t* msg = Messages::toMessage( Protocol::encodeItem( item ) );
+    zmsg_pushstr( msg, Protocol::sessionGroup( "bench" ).c_str() );
+    zmsg_pushstr( msg, "bench-peer" );
+    zmsg_pushstr( msg, uuid.hex().c_str() );
+    zmsg_pushstr( msg, "SHOUT" );
+    return msg;
+}
+} // namespace
+
+CLIPD_BENCHMARK( MessageParsing )
+{
+    const auto uuid = Utils::Uuid::random();
+
+    zmsg_t* enter = enterMessage( uuid );
+    runner.run( "messages/enter", [&] {
+        zmsg_t* msg = zmsg_dup( enter );
+        if( Messages::parseMessageType( msg ) == Messages::MessageType::Enter )
+        {
+            const Messages::Enter parsed( msg );
+            Bench::doNotOptimize( parsed );
+        }
+        zmsg_destroy( &msg );
+    } );
+    zmsg_destroy( &enter );
+
+    Utils::HybridLogicalClock clock;
+    for( const size_t size : Bench::payloadSizes() )
+    {
+        const Clipboard::Item item {{clock.now(), uuid},
+                                    Utils::Payload( std::string( size, 'x' ) )};
+        zmsg_t* shout = shoutMessage( uuid, item );
+
+        // Every parse works on a fresh copy of the message, like the ones libzmq hands to Zyre, so
+        // report the cost of the copy on its own too.
+        runner.run(
+            "messages/dup/" + std::to_string( size ),
+            [&] {
+                zmsg_t* msg = zmsg_dup( shout );
+                zmsg_destroy( &msg );
+            },
+            size );
+
+        runner.run(
+            "messages/shout/" + std::to_string( size ),
+            [&] {
+                zmsg_t* msg = zmsg_dup( shout );
+                if( Messages::parseMessageType( msg ) == Messages::MessageType::Shout )
+                {
+                    const Messages::Shout parsed( msg );
+                    Bench::doNotOptimize( parsed.frames );
+                }
+                zmsg_destroy( &msg );
+            },
+            size );
+        zmsg_destroy( &shout );
+
+        const auto frames = Protocol::encodeItem( item );
+        runner.run(
+            "protocol/decode_item/" + std::to_string( size ),
+            [&] { Bench::doNotOptimize( Protocol::decodeItem( frames ) ); },
+            size );
+        runner.run(
+            "protocol/encode_item/" + std::to_string( size ),
+            [&] { Bench::doNotOptimize( Protocol::encodeItem( item ) ); },
+            size );
+    }
+}
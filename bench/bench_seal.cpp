@@ -0,0 +1,72 @@
+#include "harness.h"
+#include "network/session_key.h"
+
+#include <sodium.h>
+
+#include <string>
+#include <vector>
+
+using namespace Clipd;
+
+/**
+ * @details The sender's encryption cost of shouting an item to a session of N peers. CURVE
+ * encrypts each link with its own key, so the sender pays for N crypto_box encryptions, modelled
+ * here with libsodium's, which are what libzmq uses when built with it. A sealed session seals the
+ * message once with its SessionKey, and shouts the same ciphertext to every peer.
+ */
+CLIPD_BENCHMARK( Seal )
+{
+    if( sodium_init() < 0 )
+    {
+        return;
+    }
+    const auto key = Network::SessionKey::derive(
+        std::vector<uint8_t>( Network::SessionKey::secret_size, 7 ), "bench" );
+    for( const size_t size : {size_t( 4 * 1024 ), size_t( 1024 * 1024 )} )
+    {
+        const std::vector<Utils::Payload> frames = {Utils::Payload( std::string( 48, 'h' ) ),
+                                                    Utils::Payload( std::string( size, 'x' ) )};
+        std::string ciphertext( size + 48 + crypto_box_MACBYTES, '\0' );
+        const std::string plaintext = frames[0].str() + frames[1].str();
+        for( const size_t peers : {size_t( 1 ), size_t( 8 ), size_t( 32 )} )
+        {
+            const std::string suffix = "/" + std::to_string( size ) + "/" + std::to_string( peers );
+
+            // Each link's key is precomputed when it's established, so only the boxes are timed.
+            std::vector<std::vector<unsigned char>> links;
+            for( size_t i = 0; i < peers; ++i )
+            {
+                unsigned char public_key[crypto_box_PUBLICKEYBYTES];
+                unsigned char secret_key[crypto_box_SECRETKEYBYTES];
+                crypto_box_keypair( public_key, secret_key );
+                links.emplace_back( crypto_box_BEFORENMBYTES );
+                crypto_box_beforenm( links.back().data(), public_key, secret_key );
+            }
+            unsigned char nonce[crypto_box_NONCEBYTES] = {};
+            runner.run(
+                "seal/per_link" + suffix,
+                [&] {
+                    for( const auto& link : links )
+                    {
+                        ++nonce[0];
+                        crypto_box_easy_afternm(
+                            reinterpret_cast<unsigned char*>( ciphertext.data() ),
+                            reinterpret_cast<const unsigned char*>( plaintext.data() ),
+                            plaintext.size(), nonce, link.data() );
+                    }
+                    Bench::doNotOptimize( ciphertext.data() );
+                },
+                size );
+
+            runner.run(
+                "seal/once" + suffix,
+                [&] { Bench::doNotOptimize( key->seal( frames ).size() ); }, size );
+        }
+
+        // What each receiver pays, in either mode.
+        const auto sealed = key->seal( frames );
+        runner.run(
+            "seal/open/" + std::to_string( size ),
+            [&] { Bench::doNotOptimize( key->open( sealed )->size() ); }, size );
+    }
+}
@@ -0,0 +1,290 @@
+#pragma once
+#include "common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <malloc.h>
+#include <unistd.h>
+
+namespace Clipd::Bench
+{
+/**
+ * @brief Prevent the compiler from optimizing away the computation of the given value.
+ */
+template <typename T>
+inline void doNotOptimize( T const& value )
+{
+    asm volatile( "" : : "r,m"( value ) : "memory" );
+}
+
+//! @brief Prevent the compiler from assuming memory is unchanged across this point.
+inline void clobberMemory()
+{
+    asm volatile( "" : : : "memory" );
+}
+
+//! @brief The bytes allocated, and not yet freed, by the whole process.
+inline size_t heapBytes()
+{
+    return mallinfo2().uordblks;
+}
+
+//! @brief Write the given string as a quoted JSON string.
+inline void writeJsonString( std::ostream& o, std::string_view s )
+{
+    o << '"';
+    for( const char c : s )
+    {
+        if( c == '"' || c == '\\' )
+        {
+            o << '\\';
+        }
+        o << c;
+    }
+    o << '"';
+}
+
+/**
+ * @brief Describe where the results came from, so they can be compared over time.
+ *
+ * @details Writes the timestamp, host, CPU count, and compiler as the fields of a JSON object,
+ * without the surrounding braces.
+ */
+inline void writeContextFields( std::ostream& o )
+{
+    char host[256] = {};
+    gethostname( host, sizeof( host ) - 1 );
+
+    char timestamp[32] = {};
+    const std::time_t now = std::time( nullptr );
+    std::tm utc = {};
+    gmtime_r( &now, &utc );
+    std::strftime( timestamp, sizeof( timestamp ), "%Y-%m-%dT%H:%M:%SZ", &utc );
+
+    o << "\"timestamp\":";
+    writeJsonString( o, timestamp );
+    o << ",\"host\":";
+    writeJsonString( o, host );
+    o << ",\"cpus\":" << sysconf( _SC_NPROCESSORS_ONLN ) << ",\"compiler\":";
+    writeJsonString( o, __VERSION__ );
+}
+
+enum class Format
+{
+    Json, //!< One JSON object per line, for tracking results over time.
+    Text, //!< A human readable table.
+};
+
+struct Options
+{
+    std::string filter;          //!< Only run benchmarks whose name contains this.
+    Format format = Format::Json;
+    double min_time_s = 0.5;     //!< The minimum total time to spend timing each benchmark.
+    size_t repetitions = 5;      //!< The number of timed batches each benchmark is run in.
+};
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations;  //!< The number of operations in each timed batch.
+    size_t repetitions;   //!< The number of timed batches.
+    double ns_per_op;     //!< The median time per operation over the batches.
+    double min_ns_per_op;
+    double max_ns_per_op;
+    size_t bytes_per_op;  //!< The number of bytes each operation processes, if meaningful.
+};
+
+/**
+ * @brief Times operations, and reports the results as they complete.
+ *
+ * @details Each operation is first calibrated, by doubling the number of iterations in a batch
+ * until one batch takes a `1 / repetitions` share of the minimum time. Then that batch is timed
+ * `repetitions` times, and the median, fastest, and slowest time per operation are reported. The
+ * median is robust against the odd batch that was interrupted by the scheduler.
+ */
+class Runner
+{
+public:
+    Runner( Options options, std::ostream& out ) : m_options( std::move( options ) ), m_out( out )
+    {
+        if( m_options.format == Format::Json )
+        {
+            writeContext();
+        }
+        else
+        {
+            m_out << std::left << std::setw( 40 ) << "benchmark" << std::right << std::setw( 14 )
+                  << "ns/op" << std::setw( 14 ) << "min" << std::setw( 14 ) << "max"
+                  << std::setw( 12 ) << "iterations" << std::setw( 12 ) << "MB/s"
+                  << "\n";
+        }
+    }
+
+    /**
+     * @brief Time the given operation, unless it's filtered out.
+     *
+     * @param name The name to report the benchmark as, like `hash64/4096`.
+     * @param op The operation to time. Called many times.
+     * @param bytes_per_op The number of bytes each call processes, to report a throughput.
+     */
+    template <typename Op>
+    void run( const std::string& name, Op&& op, size_t bytes_per_op = 0 )
+    {
+        if( name.find( m_options.filter ) == std::string::npos )
+        {
+            return;
+        }
+
+        const auto batch_target =
+            std::chrono::duration<double>( m_options.min_time_s ) / m_options.repetitions;
+        uint64_t iterations = 1;
+        for( ;; )
+        {
+            const auto elapsed = timeBatch( op, iterations );
+            if( elapsed >= batch_target || iterations >= max_iterations )
+            {
+                break;
+            }
+            // Aim a little past the target, so that the next batch is likely the last.
+            const double scale = elapsed.count() > 0 ? 1.2 * batch_target / elapsed : 10.0;
+            iterations = std::clamp( static_cast<uint64_t>( static_cast<double>( iterations ) *
+                                                            std::min( scale, 10.0 ) ),
+                                     iterations * 2, max_iterations );
+        }
+
+        std::vector<double> ns_per_op;
+        ns_per_op.reserve( m_options.repetitions );
+        for( size_t i = 0; i < m_options.repetitions; ++i )
+        {
+            const auto elapsed = timeBatch( op, iterations );
+            ns_per_op.push_back( elapsed.count() * 1e9 / static_cast<double>( iterations ) );
+        }
+        std::sort( ns_per_op.begin(), ns_per_op.end() );
+
+        Result result {name,
+                       iterations,
+                       m_options.repetitions,
+                       ns_per_op[ns_per_op.size() / 2],
+                       ns_per_op.front(),
+                       ns_per_op.back(),
+                       bytes_per_op};
+        write( result );
+        m_results.push_back( std::move( result ) );
+    }
+
+    [[nodiscard]] const std::vector<Result>& results() const noexcept
+    {
+        return m_results;
+    }
+
+private:
+    static constexpr uint64_t max_iterations = 1'000'000'000;
+
+    template <typename Op>
+    static std::chrono::duration<double> timeBatch( Op& op, uint64_t iterations )
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for( uint64_t i = 0; i < iterations; ++i )
+        {
+            op();
+        }
+        clobberMemory();
+        return std::chrono::steady_clock::now() - start;
+    }
+
+    void writeContext()
+    {
+        m_out << "{\"context\":{";
+        writeContextFields( m_out );
+        m_out << ",\"min_time_s\":" << m_options.min_time_s
+              << ",\"repetitions\":" << m_options.repetitions << "}}\n";
+    }
+
+    void write( const Result& result )
+    {
+        const double ops_per_s = 1e9 / result.ns_per_op;
+        const double bytes_per_s = ops_per_s * static_cast<double>( result.bytes_per_op );
+        if( m_options.format == Format::Json )
+        {
+            m_out << "{\"name\":";
+            writeJsonString( m_out, result.name );
+            m_out << std::fixed << std::setprecision( 3 ) << ",\"iterations\":" << result.iterations
+                  << ",\"repetitions\":" << result.repetitions
+                  << ",\"ns_per_op\":" << result.ns_per_op
+                  << ",\"min_ns_per_op\":" << result.min_ns_per_op
+                  << ",\"max_ns_per_op\":" << result.max_ns_per_op
+                  << ",\"ops_per_s\":" << ops_per_s << ",\"bytes_per_op\":" << result.bytes_per_op
+                  << ",\"bytes_per_s\":" << bytes_per_s << "}\n";
+        }
+        else
+        {
+            m_out << std::left << std::setw( 40 ) << result.name << std::right << std::fixed
+                  << std::setprecision( 1 ) << std::setw( 14 ) << result.ns_per_op
+                  << std::setw( 14 ) << result.min_ns_per_op << std::setw( 14 )
+                  << result.max_ns_per_op << std::setw( 12 ) << result.iterations;
+            if( result.bytes_per_op > 0 )
+            {
+                m_out << std::setw( 12 ) << bytes_per_s / 1e6;
+            }
+            m_out << "\n";
+        }
+        m_out.flush();
+    }
+
+    Options m_options;
+    std::ostream& m_out;
+    std::vector<Result> m_results;
+};
+
+//! @brief A function that registers its benchmarks with the Runner.
+using Suite = void ( * )( Runner& );
+
+inline std::vector<std::pair<const char*, Suite>>& suites()
+{
+    static std::vector<std::pair<const char*, Suite>> registered;
+    return registered;
+}
+
+struct Registration
+{
+    Registration( const char* name, Suite suite )
+    {
+        suites().emplace_back( name, suite );
+    }
+};
+
+/**
+ * @brief The payload sizes to run size dependent benchmarks at.
+ *
+ * @details From a short string through a large image, past the lazy pull threshold.
+ */
+inline const std::vector<size_t>& payloadSizes()
+{
+    static const std::vector<size_t> sizes = {16, 256, 4096, 65536, 1 << 20, 4 << 20};
+    return sizes;
+}
+} // namespace Clipd::Bench
+
+/**
+ * @brief Define a suite of benchmarks, run by the bench binary.
+ *
+ * @code
+ * CLIPD_BENCHMARK( Hashing )
+ * {
+ *     runner.run( "hash64/16", [&] { Bench::doNotOptimize( Utils::hash64( data ) ); }, 16 );
+ * }
+ * @endcode
+ */
+#define CLIPD_BENCHMARK( suite )                                                                   \
+    static void suite( Clipd::Bench::Runner& runner );                                             \
+    static const Clipd::Bench::Registration suite##_registration( #suite, suite );                 \
+    static void suite( Clipd::Bench::Runner& runner )
@@ -0,0 +1,237 @@
+#include "harness.h"
+#include "network/peer_discovery.h"
+#include "network/sim_network.h"
+#include "utils/log.h"
+
+#include <clipp.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Clipd;
+using namespace std::chrono;
+
+namespace
+{
+//! The bytes a ZRE beacon takes on the wire: 22 bytes of UDP payload, and the UDP, IPv4, and
+//! Ethernet headers around it.
+constexpr double beacon_bytes = 22 + 8 + 20 + 18;
+
+struct Config
+{
+    std::vector<size_t> nodes = {100, 250, 500, 1000};
+    size_t session_size = 10;         //!< The nodes in each session.
+    uint32_t beacon_ms = 1000;        //!< The beacon interval of meshed nodes, Zyre's default.
+    uint32_t scaled_beacon_ms = 5000; //!< The beacon interval of scaled nodes, as --lan-scale.
+    Network::SimNetwork::Config network;
+    bool text = false;
+};
+
+struct Result
+{
+    size_t nodes;
+    bool scaled;
+    double ready_s;     //!< The virtual time it took every node to discover its session's peers.
+    double peers;       //!< The peers each node discovered, and holds state for, on average.
+    double sockets;     //!< The TCP connections each node holds, one each way to every peer.
+    double heap_kib;    //!< Heap memory per simulated node, including the simulation's.
+    double control_kib; //!< The HELLO and JOIN messages each node sent while discovering peers.
+    double beacon_bps;  //!< The beacon bytes each node sends and receives per second.
+    double handled;     //!< The beacons per second each node's Zyre node handles.
+};
+
+Result run( const Config& config, size_t count, bool scaled )
+{
+    using Network::PeerDiscoveryDaemon;
+    using Network::SimNetwork;
+
+    Result result {};
+    result.nodes = count;
+    result.scaled = scaled;
+    const uint32_t beacon_ms = scaled ? config.scaled_beacon_ms : config.beacon_ms;
+    SimNetwork::Config network_config = config.network;
+    network_config.beacon = milliseconds( beacon_ms );
+
+    const size_t heap_start = Bench::heapBytes();
+    SimNetwork network( network_config );
+    std::vector<std::unique_ptr<PeerDiscoveryDaemon>> nodes;
+    for( size_t i = 0; i < count; ++i )
+    {
+        // Meshed nodes all discover each other, and join GLOBAL, while scaled nodes only
+        // discover the nodes of their own session.
+        const std::string session = "session" + std::to_string( i / config.session_size );
+        nodes.push_back( std::make_unique<PeerDiscoveryDaemon>(
+            network.createTransport( "node" + std::to_string( i ), scaled ? session : "" ),
+            session, Network::Coalescer::Config {}, Network::FanoutTree::Config {},
+            Network::LaneScheduler::Config {}, !scaled ) );
+        network.attach( nodes.back()->uuid(),
+                        SimNetwork::Step( nodes.back().get(), &PeerDiscoveryDaemon::step ) );
+    }
+
+    const auto start = network.now();
+    const auto ready = [&] {
+        for( size_t i = 0; i < count; ++i )
+        {
+            const size_t first = i / config.session_size * config.session_size;
+            const size_t members = std::min( first + config.session_size, count ) - first;
+            if( nodes[i]->sessionPeers() != members - 1 )
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    while( !ready() && network.now() - start < minutes( 10 ) )
+    {
+        network.runFor( milliseconds( 100 ) );
+    }
+    result.ready_s = duration<double>( network.now() - start ).count();
+    network.runUntilIdle( minutes( 1 ) );
+
+    const size_t heap = Bench::heapBytes();
+    const double n = static_cast<double>( count );
+    result.heap_kib = static_cast<double>( heap - std::min( heap_start, heap ) ) / n / 1024;
+    size_t peers = 0;
+    for( const auto& node : nodes )
+    {
+        peers += network.connections( node->uuid() );
+    }
+    result.peers = static_cast<double>( peers ) / n;
+    result.sockets = 2 * result.peers;
+    result.control_kib = static_cast<double>( network.stats().control ) / n / 1024;
+
+    // Beacons are broadcast, so every node on the LAN receives every beacon, whatever port it's
+    // sent to. Beacons to other ports are dropped by the kernel, rather than handled by Zyre.
+    const double interval_s = beacon_ms / 1000.0;
+    result.beacon_bps = n * beacon_bytes / interval_s;
+    result.handled = ( result.peers + 1 ) / interval_s;
+    return result;
+}
+
+void writeJson( std::ostream& o, const Config& config, const Result& r )
+{
+    o << std::fixed << std::setprecision( 3 ) << "{\"nodes\":" << r.nodes
+      << ",\"mode\":" << ( r.scaled ? "\"scaled\"" : "\"mesh\"" )
+      << ",\"session_size\":" << config.session_size << ",\"ready_s\":" << r.ready_s
+      << ",\"peers\":" << r.peers << ",\"tcp_sockets\":" << r.sockets
+      << ",\"heap_kib\":" << r.heap_kib << ",\"control_kib\":" << r.control_kib
+      << ",\"beacon_bytes_per_s\":" << r.beacon_bps << ",\"beacons_handled_per_s\":" << r.handled
+      << "}\n";
+}
+
+void writeText( std::ostream& o, const Result& r )
+{
+    o << std::fixed << std::setprecision( 1 ) << std::setw( 6 ) << r.nodes << std::setw( 8 )
+      << ( r.scaled ? "scaled" : "mesh" ) << std::setw( 10 ) << r.ready_s << std::setw( 10 )
+      << r.peers << std::setw( 10 ) << r.sockets << std::setw( 12 ) << r.heap_kib
+      << std::setw( 12 ) << r.control_kib << std::setw( 12 ) << r.beacon_bps << std::setw( 10 )
+      << r.handled << "\n";
+}
+
+std::vector<size_t> parseCounts( const std::string& list, size_t minimum )
+{
+    std::vector<size_t> counts;
+    std::stringstream ss( list );
+    for( std::string count; std::getline( ss, count, ',' ); )
+    {
+        const size_t n = std::strtoul( count.c_str(), nullptr, 10 );
+        if( n >= minimum )
+        {
+            counts.push_back( n );
+        }
+    }
+    return counts;
+}
+} // namespace
+
+int main( int argc, const char** argv )
+{
+    static const std::string description =
+        "\tSimulates N clipd network daemons on one LAN, in sessions of a few nodes each, and "
+        "measures what each node spends on discovery, with every node meshed with every other, "
+        "and with each node only discovering its own session's peers, as with --lan-scale.";
+    Config config;
+    std::string nodes = "100,250,500,1000";
+    bool help = false;
+
+    auto cli = ( clipp::option( "-h", "--help" ).set( help ).doc( "Show this help page." ),
+                 ( clipp::option( "-n", "--nodes" ) & clipp::value( "counts", nodes ) ) %
+                     "The comma separated node counts to simulate.",
+                 ( clipp::option( "--session-size" ) &
+                   clipp::value( "nodes", config.session_size ) ) %
+                     "The nodes in each session.",
+                 ( clipp::option( "--beacon-interval" ) &
+                   clipp::value( "ms", config.beacon_ms ) ) %
+                     "The beacon interval of meshed nodes.",
+                 ( clipp::option( "--scaled-beacon-interval" ) &
+                   clipp::value( "ms", config.scaled_beacon_ms ) ) %
+                     "The beacon interval of scaled nodes.",
+                 ( clipp::option( "--seed" ) & clipp::value( "seed", config.network.seed ) ) %
+                     "Seeds the simulation.",
+                 clipp::option( "-t", "--text" )
+                     .set( config.text )
+                     .doc( "Write a human readable table instead of JSON." ) );
+
+    // The clipp parser doesn't like const, so pretend it's not.
+    if( !clipp::parse( argc, const_cast<char**>( argv ), cli ) || help ) // NOLINT
+    {
+        std::cout
+            // NOLINTNEXTLINE
+            << clipp::make_man_page( cli, argv[0] ).prepend_section( "DESCRIPTION", description );
+        return help ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    config.nodes = parseCounts( nodes, 2 );
+    config.session_size = std::max<size_t>( config.session_size, 2 );
+    if( config.beacon_ms == 0 || config.scaled_beacon_ms == 0 )
+    {
+        std::cerr << "Nodes must beacon to be discovered.\n";
+        return EXIT_FAILURE;
+    }
+
+    Utils::Log::Logger::instance().setLevel( Utils::Log::Level::Warn );
+    Utils::Log::Writer log( stderr );
+    log.start();
+
+    if( config.text )
+    {
+        std::cout << std::setw( 6 ) << "nodes" << std::setw( 8 ) << "mode" << std::setw( 10 )
+                  << "ready s" << std::setw( 10 ) << "peers" << std::setw( 10 ) << "tcp"
+                  << std::setw( 12 ) << "KiB/node" << std::setw( 12 ) << "ctrl KiB"
+                  << std::setw( 12 ) << "beacon B/s" << std::setw( 10 ) << "handled/s"
+                  << "\n";
+    }
+    else
+    {
+        std::cout << "{\"context\":{";
+        Bench::writeContextFields( std::cout );
+        std::cout << ",\"session_size\":" << config.session_size
+                  << ",\"beacon_ms\":" << config.beacon_ms
+                  << ",\"scaled_beacon_ms\":" << config.scaled_beacon_ms << "}}\n";
+    }
+
+    for( const size_t count : config.nodes )
+    {
+        for( const bool scaled : {false, true} )
+        {
+            const Result result = run( config, count, scaled );
+            if( config.text )
+            {
+                writeText( std::cout, result );
+            }
+            else
+            {
+                writeJson( std::cout, config, result );
+            }
+            std::cout.flush();
+        }
+    }
+
+    log.stop();
+    log.join();
+    return EXIT_SUCCESS;
+}
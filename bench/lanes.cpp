@@ -0,0 +1,284 @@
+#include "harness.h"
+#include "../tests/sim_fixture.h"
+#include "network/peer_discovery.h"
+#include "network/sim_network.h"
+#include "utils/hlc.h"
+#include "utils/log.h"
+
+#include <clipp.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace Clipd;
+using namespace std::chrono;
+
+namespace
+{
+struct Config
+{
+    std::vector<size_t> nodes = {2, 4, 8};
+    size_t size = 256;                //!< The size of each small clipboard update, in bytes.
+    uint32_t interval_ms = 20;        //!< The time between small updates.
+    size_t bulk = 1024 * 1024;        //!< The size of each bulk transfer, in bytes.
+    uint32_t bulk_interval_ms = 1000; //!< The time between bulk transfers.
+    uint32_t duration_s = 20;         //!< The virtual time to copy updates for.
+    Network::SimNetwork::Config network;
+    bool text = false;
+};
+
+struct Result
+{
+    size_t nodes;
+    bool paced;
+    uint64_t delivered;      //!< Small updates delivered, to every node but the origin.
+    uint64_t expected;       //!< Every small update delivered to every other node.
+    double p50_ms;           //!< The virtual time from copying a small update to each delivery.
+    double p99_ms;           //!< The 99th percentile of those deliveries.
+    double max_ms;           //!< The slowest delivery.
+    uint64_t bulk_delivered; //!< Bulk transfers delivered, to every node but the origin.
+    uint64_t bulk_expected;  //!< Every bulk transfer delivered to every other node.
+};
+
+//! @brief When each small update was copied, and how long each delivery of it took.
+struct Deliveries
+{
+    const Network::SimNetwork& network;
+    std::unordered_map<uint64_t, Network::SimNetwork::Clock::time_point> copied;
+    std::vector<double> latencies_ms;
+    uint64_t bulk = 0;
+
+    void receive( const Clipboard::Item& item )
+    {
+        const auto found = copied.find( item.version.timestamp );
+        if( found != copied.end() )
+        {
+            latencies_ms.push_back(
+                duration<double, std::milli>( network.now() - found->second ).count() );
+        }
+    }
+
+    void receiveBulk( const Clipboard::Item& )
+    {
+        ++bulk;
+    }
+};
+
+Result run( const Config& config, size_t count, bool paced )
+{
+    using Network::PeerDiscoveryDaemon;
+    using Network::SimNetwork;
+
+    Result result {};
+    result.nodes = count;
+    result.paced = paced;
+    // Every update is sent as soon as it's copied, so only the lanes decide what waits.
+    Network::Coalescer::Config coalescing;
+    coalescing.debounce = milliseconds( 0 );
+    Network::LaneScheduler::Config lanes;
+    lanes.rate = paced ? config.network.bandwidth : 0;
+
+    SimNetwork network( config.network );
+    Deliveries deliveries {network, {}, {}, 0};
+    std::vector<std::unique_ptr<PeerDiscoveryDaemon>> nodes;
+    for( size_t i = 0; i < count; ++i )
+    {
+        nodes.push_back( std::make_unique<PeerDiscoveryDaemon>(
+            network.createTransport( "node" + std::to_string( i ) ), "interactive", coalescing,
+            Network::FanoutTree::Config {}, lanes ) );
+        nodes.back()->addSession( "bulk" );
+        nodes.back()->registerOnRemoteClipboardUpdate(
+            Utils::Functor<void( const Clipboard::Item& )>( deliveries, &Deliveries::receive ) );
+        nodes.back()->registerOnRemoteClipboardUpdate(
+            "bulk", Utils::Functor<void( const Clipboard::Item& )>( deliveries,
+                                                                    &Deliveries::receiveBulk ) );
+        network.attach( nodes.back()->uuid(),
+                        SimNetwork::Step( nodes.back().get(), &PeerDiscoveryDaemon::step ) );
+    }
+    network.runFor( seconds( 5 ) );
+
+    // Node 0 copies small updates at a steady rate, while it also sends large items in another
+    // session, as if a file were being copied alongside a chat.
+    std::mt19937_64 random( config.network.seed );
+    const std::string bulk = Tests::incompressible( config.bulk, random() );
+    Utils::HybridLogicalClock clock;
+    const auto& origin = nodes.front();
+    const auto start = network.now();
+    auto next_bulk = start;
+    uint64_t small = 0;
+    uint64_t transfers = 0;
+    while( network.now() - start < seconds( config.duration_s ) )
+    {
+        if( network.now() >= next_bulk )
+        {
+            std::string contents = bulk;
+            contents[0] = static_cast<char>( transfers++ );
+            origin->receiveLocalClipboardUpdate(
+                "bulk", Clipboard::Item {{clock.now(), origin->uuid()},
+                                         Utils::Payload( std::move( contents ) )} );
+            next_bulk += milliseconds( config.bulk_interval_ms );
+        }
+        const Clipboard::Item item {{clock.now(), origin->uuid()},
+                                    Utils::Payload( Tests::incompressible( config.size, random() ) )};
+        deliveries.copied.emplace( item.version.timestamp, network.now() );
+        origin->receiveLocalClipboardUpdate( item );
+        ++small;
+        network.runFor( milliseconds( config.interval_ms ) );
+    }
+    network.runUntilIdle( minutes( 1 ) );
+
+    result.delivered = deliveries.latencies_ms.size();
+    result.expected = small * ( count - 1 );
+    result.bulk_delivered = deliveries.bulk;
+    result.bulk_expected = transfers * ( count - 1 );
+
+    auto& latencies = deliveries.latencies_ms;
+    std::sort( latencies.begin(), latencies.end() );
+    const auto percentile = [&latencies]( double p ) {
+        const double last = static_cast<double>( std::max<size_t>( latencies.size(), 1 ) - 1 );
+        return latencies.empty() ? 0.0 : latencies[static_cast<size_t>( p * last )];
+    };
+    result.p50_ms = percentile( 0.5 );
+    result.p99_ms = percentile( 0.99 );
+    result.max_ms = percentile( 1.0 );
+    return result;
+}
+
+void writeJson( std::ostream& o, const Config& config, const Result& r )
+{
+    o << std::fixed << std::setprecision( 3 ) << "{\"nodes\":" << r.nodes
+      << ",\"lanes\":" << ( r.paced ? "\"paced\"" : "\"fifo\"" ) << ",\"size\":" << config.size
+      << ",\"bulk\":" << config.bulk << ",\"delivered\":" << r.delivered
+      << ",\"expected\":" << r.expected << ",\"latency_ms\":{\"p50\":" << r.p50_ms
+      << ",\"p99\":" << r.p99_ms << ",\"max\":" << r.max_ms
+      << "},\"bulk_delivered\":" << r.bulk_delivered << ",\"bulk_expected\":" << r.bulk_expected
+      << "}\n";
+}
+
+void writeText( std::ostream& o, const Result& r )
+{
+    o << std::fixed << std::setprecision( 1 ) << std::setw( 6 ) << r.nodes << std::setw( 8 )
+      << ( r.paced ? "paced" : "fifo" ) << std::setw( 10 ) << r.delivered << std::setw( 10 )
+      << r.expected << std::setw( 10 ) << r.p50_ms << std::setw( 10 ) << r.p99_ms
+      << std::setw( 10 ) << r.max_ms << std::setw( 10 ) << r.bulk_delivered << std::setw( 10 )
+      << r.bulk_expected << "\n";
+}
+
+std::vector<size_t> parseCounts( const std::string& list, size_t minimum )
+{
+    std::vector<size_t> counts;
+    std::stringstream ss( list );
+    for( std::string count; std::getline( ss, count, ',' ); )
+    {
+        const size_t n = std::strtoul( count.c_str(), nullptr, 10 );
+        if( n >= minimum )
+        {
+            counts.push_back( n );
+        }
+    }
+    return counts;
+}
+} // namespace
+
+int main( int argc, const char** argv )
+{
+    static const std::string description =
+        "\tSimulates clipd network daemons on an in-process network, in virtual time, and "
+        "measures how long small clipboard updates take to arrive while one node is also sending "
+        "large ones, with and without pacing its lanes to its uplink.";
+    Config config;
+    std::string nodes = "2,4,8";
+    uint32_t latency_ms = 1;
+    double bandwidth_mbps = 10;
+    bool help = false;
+
+    auto cli = ( clipp::option( "-h", "--help" ).set( help ).doc( "Show this help page." ),
+                 ( clipp::option( "-n", "--nodes" ) & clipp::value( "counts", nodes ) ) %
+                     "The comma separated node counts to simulate.",
+                 ( clipp::option( "-s", "--size" ) & clipp::value( "bytes", config.size ) ) %
+                     "The size of each small clipboard update.",
+                 ( clipp::option( "--interval" ) & clipp::value( "ms", config.interval_ms ) ) %
+                     "The virtual time between small updates.",
+                 ( clipp::option( "--bulk" ) & clipp::value( "bytes", config.bulk ) ) %
+                     "The size of each large clipboard update.",
+                 ( clipp::option( "--bulk-interval" ) &
+                   clipp::value( "ms", config.bulk_interval_ms ) ) %
+                     "The virtual time between large updates.",
+                 ( clipp::option( "-d", "--duration" ) &
+                   clipp::value( "s", config.duration_s ) ) %
+                     "The virtual time to copy updates for.",
+                 ( clipp::option( "--latency" ) & clipp::value( "ms", latency_ms ) ) %
+                     "The one way delay between any two nodes.",
+                 ( clipp::option( "--bandwidth" ) & clipp::value( "MB/s", bandwidth_mbps ) ) %
+                     "Each node's uplink bandwidth, which the paced lanes are paced to.",
+                 ( clipp::option( "--seed" ) & clipp::value( "seed", config.network.seed ) ) %
+                     "Seeds the simulation.",
+                 clipp::option( "-t", "--text" )
+                     .set( config.text )
+                     .doc( "Write a human readable table instead of JSON." ) );
+
+    // The clipp parser doesn't like const, so pretend it's not.
+    if( !clipp::parse( argc, const_cast<char**>( argv ), cli ) || help ) // NOLINT
+    {
+        std::cout
+            // NOLINTNEXTLINE
+            << clipp::make_man_page( cli, argv[0] ).prepend_section( "DESCRIPTION", description );
+        return help ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    config.nodes = parseCounts( nodes, 2 );
+    config.network.latency = milliseconds( latency_ms );
+    config.network.bandwidth = bandwidth_mbps * 1e6;
+    if( config.network.bandwidth <= 0 )
+    {
+        std::cerr << "The lanes can only be paced to a limited uplink.\n";
+        return EXIT_FAILURE;
+    }
+
+    Utils::Log::Logger::instance().setLevel( Utils::Log::Level::Warn );
+    Utils::Log::Writer log( stderr );
+    log.start();
+
+    if( config.text )
+    {
+        std::cout << std::setw( 6 ) << "nodes" << std::setw( 8 ) << "lanes" << std::setw( 10 )
+                  << "recv" << std::setw( 10 ) << "expected" << std::setw( 10 ) << "p50 ms"
+                  << std::setw( 10 ) << "p99 ms" << std::setw( 10 ) << "max ms" << std::setw( 10 )
+                  << "bulk" << std::setw( 10 ) << "expected"
+                  << "\n";
+    }
+    else
+    {
+        std::cout << "{\"context\":{";
+        Bench::writeContextFields( std::cout );
+        std::cout << ",\"duration_s\":" << config.duration_s << ",\"latency_ms\":" << latency_ms
+                  << ",\"bandwidth_mbps\":" << bandwidth_mbps << "}}\n";
+    }
+
+    for( const size_t count : config.nodes )
+    {
+        for( const bool paced : {false, true} )
+        {
+            const Result result = run( config, count, paced );
+            if( config.text )
+            {
+                writeText( std::cout, result );
+            }
+            else
+            {
+                writeJson( std::cout, config, result );
+            }
+            std::cout.flush();
+        }
+    }
+
+    log.stop();
+    log.join();
+    return EXIT_SUCCESS;
+}
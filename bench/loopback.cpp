@@ -0,0 +1,421 @@
+#include "harness.h"
+#include "network/peer_discovery.h"
+#include "network/zyre_transport.h"
+#include "utils/hlc.h"
+#include "utils/log.h"
+#include "utils/metrics.h"
+#include "utils/uuid.h"
+
+#include <clipp.h>
+#include <czmq.h>
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Clipd;
+using namespace std::chrono;
+
+namespace
+{
+struct Config
+{
+    std::vector<size_t> nodes = {2, 4, 8, 16, 32, 50};
+    size_t size = 1024;       //!< The size of each clipboard update, in bytes.
+    double rate = 100;        //!< Clipboard updates per second. Zero sends as fast as possible.
+    double duration_s = 5;    //!< How long to send updates for, at each node count.
+    double drain_s = 5;       //!< The longest to wait for updates in flight after sending stops.
+    double ready_s = 60;      //!< The longest to wait for the nodes to discover each other.
+    uint16_t port = 47000;    //!< The gossip hub port. Node i listens on `port + 1 + i`.
+    uint32_t debounce_ms = 0; //!< The coalescing window. Zero disables coalescing.
+    //! How the nodes encrypt their traffic: not at all, CURVE on every link, or a sealed session.
+    std::string encryption = "none";
+    //! The port small updates are multicast on, as with clipd's `--multicast`. Zero shouts them.
+    uint16_t multicast_port = 0;
+    std::string interface; //!< The multicast capable interface to multicast on.
+    bool text = false;
+};
+
+struct Result
+{
+    size_t nodes;
+    double ready_s; //!< How long it took every node to discover every other node.
+    uint64_t sent;
+    uint64_t expected; //!< Every update sent, delivered to every other node.
+    uint64_t delivered;
+    double elapsed_s; //!< From the first update sent, to the last update delivered.
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+    double cpu_s;    //!< The CPU time used by the whole process while sending and draining.
+    double window_s; //!< The wall time spent sending and draining.
+    //! Bytes of contents every node together copied, per update sent.
+    double copied_per_update;
+};
+
+//! @brief The first bytes of every update: when, and in which order, it was sent.
+struct Stamp
+{
+    uint64_t sequence;
+    int64_t sent_ns;
+};
+
+//! @brief Counts the updates delivered to the nodes, and how long they took.
+struct Deliveries
+{
+    std::atomic<uint64_t> delivered = 0;
+    std::atomic<int64_t> last_ns = 0;
+    Utils::Metrics::Histogram latency;
+    Utils::Uuid origin;
+    size_t size = 0;
+
+    void receive( const Clipboard::Item& item )
+    {
+        const int64_t now = steady_clock::now().time_since_epoch().count();
+        if( item.version.origin != origin || item.contents.size() != size )
+        {
+            return;
+        }
+        Stamp stamp {};
+        std::memcpy( &stamp, item.contents.data(), sizeof( stamp ) );
+        latency.record( static_cast<uint64_t>( std::max<int64_t>( now - stamp.sent_ns, 0 ) ) );
+        delivered.fetch_add( 1, std::memory_order_relaxed );
+
+        int64_t last = last_ns.load( std::memory_order_relaxed );
+        while( now > last &&
+               !last_ns.compare_exchange_weak( last, now, std::memory_order_relaxed ) )
+        {
+        }
+    }
+};
+
+double cpuSeconds()
+{
+    rusage usage = {};
+    getrusage( RUSAGE_SELF, &usage );
+    const auto seconds = []( const timeval& tv ) {
+        return static_cast<double>( tv.tv_sec ) + static_cast<double>( tv.tv_usec ) / 1e6;
+    };
+    return seconds( usage.ru_utime ) + seconds( usage.ru_stime );
+}
+
+/**
+ * @brief Every node holds a Zyre connection to every other node, so 50 nodes in one process need
+ * a few thousand sockets and file descriptors.
+ */
+void raiseSocketLimits()
+{
+    rlimit limit = {};
+    if( getrlimit( RLIMIT_NOFILE, &limit ) == 0 && limit.rlim_cur < limit.rlim_max )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit( RLIMIT_NOFILE, &limit );
+    }
+    // Must be set before CZMQ creates its context. Zero allows as many as the OS does.
+    zsys_set_max_sockets( 0 );
+}
+
+Result run( const Config& config, size_t count )
+{
+    using Network::PeerDiscoveryDaemon;
+
+    const std::string session = "loopback-" + Utils::random_hex( 4 );
+    const std::string hub = "tcp://127.0.0.1:" + std::to_string( unsigned( config.port ) );
+    Network::Coalescer::Config coalescing;
+    coalescing.debounce = milliseconds( config.debounce_ms );
+
+    // Every node shares one certificate, as a sealed session requires.
+    zcert_t* certificate = config.encryption == "none" ? nullptr : zcert_new();
+    std::vector<uint8_t> secret;
+    if( certificate && config.encryption == "once" )
+    {
+        const auto* secret_key = zcert_secret_key( certificate );
+        secret.assign( secret_key, secret_key + Network::SessionKey::secret_size );
+    }
+
+    std::vector<std::unique_ptr<PeerDiscoveryDaemon>> nodes;
+    for( size_t i = 0; i < count; ++i )
+    {
+        Network::ZyreTransport::Discovery discovery;
+        discovery.endpoint = "tcp://127.0.0.1:" + std::to_string( config.port + 1 + i );
+        discovery.multicast_port = config.multicast_port;
+        discovery.interface = config.interface;
+        if( i == 0 )
+        {
+            discovery.gossip_bind = hub;
+        }
+        else
+        {
+            discovery.gossip_connect = hub;
+        }
+        // Sealed sessions still encrypt every link, as clipd does with --encrypt-once.
+        zcert_t* link_certificate = certificate ? zcert_dup( certificate ) : nullptr;
+        nodes.push_back( std::make_unique<PeerDiscoveryDaemon>(
+            std::make_unique<Network::ZyreTransport>( discovery, link_certificate ), session,
+            coalescing ) );
+        if( !secret.empty() )
+        {
+            nodes.back()->setSessionSecret( secret );
+        }
+    }
+    zcert_destroy( &certificate );
+
+    Deliveries deliveries;
+    deliveries.origin = nodes.front()->uuid();
+    deliveries.size = config.size;
+    for( size_t i = 1; i < count; ++i )
+    {
+        nodes[i]->registerOnRemoteClipboardUpdate( Utils::Functor<void( const Clipboard::Item& )>(
+            deliveries, &Deliveries::receive ) );
+    }
+
+    const auto start = steady_clock::now();
+    for( auto& node : nodes )
+    {
+        node->start();
+    }
+    const auto ready = [&] {
+        for( const auto& node : nodes )
+        {
+            if( node->sessionPeers() < count - 1 )
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    const auto ready_deadline = start + duration<double>( config.ready_s );
+    while( !ready() && steady_clock::now() < ready_deadline )
+    {
+        std::this_thread::sleep_for( milliseconds( 10 ) );
+    }
+    Result result {};
+    result.nodes = count;
+    result.ready_s = duration<double>( steady_clock::now() - start ).count();
+    if( !ready() )
+    {
+        CLIPD_LOG_WARN( "Only some of the " << count << " nodes discovered each other after "
+                                            << result.ready_s << "s" );
+    }
+
+    // Random contents, so that the updates are as expensive to compress as real ones can be.
+    std::string contents( std::max( config.size, sizeof( Stamp ) ), '\0' );
+    std::mt19937_64 random( count );
+    for( auto& c : contents )
+    {
+        c = static_cast<char>( random() );
+    }
+
+    Utils::HybridLogicalClock clock;
+    const auto& copied = Utils::Metrics::Registry::global().counter( "payload.bytes_copied" );
+    const uint64_t copied_start = copied.value();
+    const double cpu_start = cpuSeconds();
+    const auto load_start = steady_clock::now();
+    const auto load_end =
+        load_start + duration_cast<steady_clock::duration>( duration<double>( config.duration_s ) );
+    const auto interval = config.rate > 0 ? duration<double>( 1.0 / config.rate )
+                                          : duration<double>::zero();
+    auto next = load_start;
+    for( auto now = load_start; now < load_end; now = steady_clock::now() )
+    {
+        if( now < next )
+        {
+            std::this_thread::sleep_until( next );
+            continue;
+        }
+        next += duration_cast<steady_clock::duration>( interval );
+
+        const Stamp stamp {result.sent++, steady_clock::now().time_since_epoch().count()};
+        std::memcpy( contents.data(), &stamp, sizeof( stamp ) );
+        nodes.front()->receiveLocalClipboardUpdate( Clipboard::Item {
+            {clock.now(), deliveries.origin}, Utils::Payload( std::string( contents ) ),
+            steady_clock::now()} );
+    }
+
+    result.expected = result.sent * ( count - 1 );
+    const auto drain_deadline = steady_clock::now() + duration<double>( config.drain_s );
+    while( deliveries.delivered.load() < result.expected && steady_clock::now() < drain_deadline )
+    {
+        std::this_thread::sleep_for( milliseconds( 1 ) );
+    }
+    result.cpu_s = cpuSeconds() - cpu_start;
+    result.window_s = duration<double>( steady_clock::now() - load_start ).count();
+    result.copied_per_update = static_cast<double>( copied.value() - copied_start ) /
+                               static_cast<double>( std::max<uint64_t>( result.sent, 1 ) );
+
+    for( auto& node : nodes )
+    {
+        node->stop();
+    }
+    for( auto& node : nodes )
+    {
+        node->join();
+    }
+
+    result.delivered = deliveries.delivered.load();
+    const steady_clock::time_point last_delivery(
+        steady_clock::duration( deliveries.last_ns.load() ) );
+    result.elapsed_s = duration<double>( std::max( last_delivery, load_end ) - load_start ).count();
+    result.p50_ns = deliveries.latency.percentile( 0.5 );
+    result.p99_ns = deliveries.latency.percentile( 0.99 );
+    result.p999_ns = deliveries.latency.percentile( 0.999 );
+    result.max_ns = deliveries.latency.max();
+    return result;
+}
+
+void writeJson( std::ostream& o, const Config& config, const Result& r )
+{
+    const double updates_per_s = static_cast<double>( r.delivered ) / r.elapsed_s;
+    o << std::fixed << std::setprecision( 3 ) << "{\"nodes\":" << r.nodes
+      << ",\"size\":" << config.size << ",\"rate\":" << config.rate
+      << ",\"ready_s\":" << r.ready_s << ",\"sent\":" << r.sent << ",\"expected\":" << r.expected
+      << ",\"delivered\":" << r.delivered << ",\"elapsed_s\":" << r.elapsed_s
+      << ",\"updates_per_s\":" << updates_per_s
+      << ",\"mb_per_s\":" << updates_per_s * static_cast<double>( config.size ) / 1e6
+      << ",\"latency_ns\":{\"p50\":" << r.p50_ns << ",\"p99\":" << r.p99_ns
+      << ",\"p999\":" << r.p999_ns << ",\"max\":" << r.max_ns << "}"
+      << ",\"cpu_pct\":" << 100 * r.cpu_s / r.window_s
+      << ",\"cpu_pct_per_node\":" << 100 * r.cpu_s / r.window_s / static_cast<double>( r.nodes )
+      << ",\"copied_per_update\":" << r.copied_per_update << "}\n";
+}
+
+void writeText( std::ostream& o, const Config& config, const Result& r )
+{
+    const double updates_per_s = static_cast<double>( r.delivered ) / r.elapsed_s;
+    const auto us = []( uint64_t ns ) { return static_cast<double>( ns ) / 1e3; };
+    o << std::fixed << std::setprecision( 1 ) << std::setw( 6 ) << r.nodes << std::setw( 10 )
+      << r.ready_s << std::setw( 10 ) << r.delivered << std::setw( 10 ) << r.expected
+      << std::setw( 12 ) << updates_per_s << std::setw( 10 )
+      << updates_per_s * static_cast<double>( config.size ) / 1e6 << std::setw( 12 )
+      << us( r.p50_ns ) << std::setw( 12 ) << us( r.p99_ns ) << std::setw( 12 )
+      << us( r.p999_ns ) << std::setw( 12 )
+      << 100 * r.cpu_s / r.window_s / static_cast<double>( r.nodes ) << std::setw( 12 )
+      << r.copied_per_update << "\n";
+}
+
+std::vector<size_t> parseCounts( const std::string& list )
+{
+    std::vector<size_t> counts;
+    std::stringstream ss( list );
+    for( std::string count; std::getline( ss, count, ',' ); )
+    {
+        const size_t n = std::strtoul( count.c_str(), nullptr, 10 );
+        if( n >= 2 )
+        {
+            counts.push_back( n );
+        }
+    }
+    return counts;
+}
+} // namespace
+
+int main( int argc, const char** argv )
+{
+    static const std::string description =
+        "\tStarts N clipd network daemons in this process, connected over the loopback interface, "
+        "and measures how fast clipboard updates from one of them reach all of the others.";
+    Config config;
+    std::string nodes = "2,4,8,16,32,50";
+    bool help = false;
+
+    auto cli = ( clipp::option( "-h", "--help" ).set( help ).doc( "Show this help page." ),
+                 ( clipp::option( "-n", "--nodes" ) & clipp::value( "counts", nodes ) ) %
+                     "The comma separated node counts to measure.",
+                 ( clipp::option( "-s", "--size" ) & clipp::value( "bytes", config.size ) ) %
+                     "The size of each clipboard update.",
+                 ( clipp::option( "-r", "--rate" ) & clipp::value( "hz", config.rate ) ) %
+                     "Clipboard updates per second. Zero sends as fast as possible.",
+                 ( clipp::option( "-d", "--duration" ) &
+                   clipp::value( "seconds", config.duration_s ) ) %
+                     "How long to send updates for, at each node count.",
+                 ( clipp::option( "-p", "--port" ) & clipp::value( "port", config.port ) ) %
+                     "The first of the N + 1 loopback ports to use.",
+                 ( clipp::option( "--debounce" ) & clipp::value( "ms", config.debounce_ms ) ) %
+                     "Coalesce updates closer together than this. Zero disables.",
+                 ( clipp::option( "-e", "--encryption" ) &
+                   clipp::value( "mode", config.encryption ) ) %
+                     "How to encrypt traffic: none (the default), curve, which encrypts every "
+                     "link, or once, which also seals each update with the session's key.",
+                 ( clipp::option( "--multicast" ) &
+                   clipp::value( "port", config.multicast_port ) ) %
+                     "Multicast updates small enough to fit in a datagram on this port, rather "
+                     "than shouting them. Zero disables.",
+                 ( clipp::option( "-i", "--interface" ) &
+                   clipp::value( "name", config.interface ) ) %
+                     "The multicast capable interface to multicast on.",
+                 clipp::option( "-t", "--text" )
+                     .set( config.text )
+                     .doc( "Write a human readable table instead of JSON." ) );
+
+    // The clipp parser doesn't like const, so pretend it's not.
+    if( !clipp::parse( argc, const_cast<char**>( argv ), cli ) || help ) // NOLINT
+    {
+        std::cout
+            // NOLINTNEXTLINE
+            << clipp::make_man_page( cli, argv[0] ).prepend_section( "DESCRIPTION", description );
+        return help ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if( config.encryption != "none" && config.encryption != "curve" &&
+        config.encryption != "once" )
+    {
+        std::cerr << "Unknown encryption mode '" << config.encryption << "'\n";
+        return EXIT_FAILURE;
+    }
+    if( config.encryption == "curve" && config.multicast_port != 0 )
+    {
+        std::cerr << "Datagrams aren't encrypted, so multicasting requires --encryption once\n";
+        return EXIT_FAILURE;
+    }
+    config.nodes = parseCounts( nodes );
+    config.size = std::max( config.size, sizeof( Stamp ) );
+
+    raiseSocketLimits();
+    Utils::Log::Logger::instance().setLevel( Utils::Log::Level::Warn );
+    Utils::Log::Writer log( stderr );
+    log.start();
+
+    if( config.text )
+    {
+        std::cout << std::setw( 6 ) << "nodes" << std::setw( 10 ) << "ready s" << std::setw( 10 )
+                  << "recv" << std::setw( 10 ) << "expected" << std::setw( 12 ) << "updates/s"
+                  << std::setw( 10 ) << "MB/s" << std::setw( 12 ) << "p50 us" << std::setw( 12 )
+                  << "p99 us" << std::setw( 12 ) << "p999 us" << std::setw( 12 ) << "cpu%/node"
+                  << std::setw( 12 ) << "copied B" << "\n";
+    }
+    else
+    {
+        std::cout << "{\"context\":{";
+        Bench::writeContextFields( std::cout );
+        std::cout << ",\"duration_s\":" << config.duration_s << ",\"debounce_ms\":"
+                  << config.debounce_ms << ",\"encryption\":\"" << config.encryption
+                  << "\",\"multicast_port\":" << config.multicast_port << "}}\n";
+    }
+
+    for( const size_t count : config.nodes )
+    {
+        const Result result = run( config, count );
+        if( config.text )
+        {
+            writeText( std::cout, config, result );
+        }
+        else
+        {
+            writeJson( std::cout, config, result );
+        }
+        std::cout.flush();
+    }
+
+    log.stop();
+    log.join();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,63 @@
+#include "harness.h"
+
+#include <clipp.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace Clipd;
+
+int main( int argc, const char** argv )
+{
+    static const std::string description =
+        "\tMicrobenchmarks for the clipd hot paths. By default, each result is written as one JSON "
+        "object per line, after a line describing the host and build.";
+    Bench::Options options;
+    bool help = false;
+    bool text = false;
+    bool list = false;
+
+    auto cli = ( clipp::option( "-h", "--help" ).set( help ).doc( "Show this help page." ),
+                 clipp::option( "-l", "--list" ).set( list ).doc( "List the benchmark suites." ),
+                 clipp::option( "-t", "--text" )
+                     .set( text )
+                     .doc( "Write a human readable table instead of JSON." ),
+                 ( clipp::option( "-f", "--filter" ) &
+                   clipp::value( "substring", options.filter ) ) %
+                     "Only run benchmarks whose name contains the given substring.",
+                 ( clipp::option( "--min-time" ) & clipp::value( "seconds", options.min_time_s ) ) %
+                     "The minimum time to spend timing each benchmark.",
+                 ( clipp::option( "--repetitions" ) &
+                   clipp::value( "count", options.repetitions ) ) %
+                     "The number of timed batches to report the median of." );
+
+    // The clipp parser doesn't like const, so pretend it's not.
+    if( !clipp::parse( argc, const_cast<char**>( argv ), cli ) || help ) // NOLINT
+    {
+        std::cout
+            // NOLINTNEXTLINE
+            << clipp::make_man_page( cli, argv[0] ).prepend_section( "DESCRIPTION", description );
+        return help ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if( list )
+    {
+        for( const auto& [name, suite] : Bench::suites() )
+        {
+            std::cout << name << "\n";
+        }
+        return EXIT_SUCCESS;
+    }
+
+    options.format = text ? Bench::Format::Text : Bench::Format::Json;
+    options.repetitions = std::max<size_t>( options.repetitions, 1 );
+
+    Bench::Runner runner( options, std::cout );
+    for( const auto& [name, suite] : Bench::suites() )
+    {
+        suite( runner );
+    }
+
+    return EXIT_SUCCESS;
+}
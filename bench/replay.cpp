@@ -0,0 +1,213 @@
+#include "clipboard/clipboard_daemon.h"
+#include "clipboard/memory_backend.h"
+#include "harness.h"
+#include "network/peer_discovery.h"
+#include "network/recording.h"
+#include "utils/log.h"
+#include "utils/metrics.h"
+
+#include <clipp.h>
+
+#include <sys/resource.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace Clipd;
+using namespace std::chrono;
+
+namespace
+{
+struct Config
+{
+    std::string path;
+    double speed = 1;            //!< How many times faster than recorded. Zero is flat out.
+    uint32_t debounce_ms = 100;  //!< The coalescing window, like clipd's --debounce.
+    uint32_t max_delay_ms = 500; //!< Like clipd's --max-delay.
+    uint32_t settle_ms = 1000;   //!< How long to let the daemons finish, after the last record.
+    bool text = false;
+};
+
+struct Result
+{
+    uint64_t local = 0;    //!< Local copies written to the clipboard.
+    uint64_t events = 0;   //!< Events injected into the transport.
+    uint64_t received = 0; //!< Bytes of shouts and whispers injected.
+    double recorded_s = 0; //!< The time between the first and last record, when recorded.
+    double replay_s = 0;   //!< The time it took to replay every record.
+    double cpu_s = 0;      //!< The CPU time used by the whole process while replaying.
+    Network::ReplayTransport::Stats sent;
+};
+
+double cpuSeconds()
+{
+    rusage usage = {};
+    getrusage( RUSAGE_SELF, &usage );
+    return static_cast<double>( usage.ru_utime.tv_sec + usage.ru_stime.tv_sec ) +
+           static_cast<double>( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) / 1e6;
+}
+
+/**
+ * @brief Replay a recording through a clipboard daemon and a network daemon, wired together like
+ * clipd wires them, on a memory clipboard and a transport that only the recording talks to.
+ */
+Result replay( const Config& config, Network::Recording& recording )
+{
+    Result result;
+    auto backend = std::make_shared<Clipboard::MemoryBackend>();
+    auto transport = std::make_unique<Network::ReplayTransport>( recording.node );
+    auto& network = *transport;
+
+    Network::Coalescer::Config coalescing;
+    coalescing.debounce = milliseconds( config.debounce_ms );
+    coalescing.max_delay = milliseconds( config.max_delay_ms );
+    Network::PeerDiscoveryDaemon discoveryd( std::move( transport ), recording.session,
+                                             coalescing );
+    Clipboard::ClipboardDaemon clipd( recording.node, backend );
+    clipd.registerOnTextUpdate( Utils::Functor<void( const Clipboard::Item& )>(
+        &discoveryd, &Network::PeerDiscoveryDaemon::receiveLocalClipboardUpdate ) );
+    discoveryd.registerOnRemoteClipboardUpdate( Utils::Functor<void( const Clipboard::Item& )>(
+        &clipd, &Clipboard::ClipboardDaemon::receiveRemoteClipboardUpdate ) );
+    clipd.start();
+    discoveryd.start();
+
+    // Received items are versioned as if they had been received during the replay.
+    const double cpu_start = cpuSeconds();
+    const auto start = steady_clock::now();
+    recording.retime( Clipboard::Trace::wallClockMicros(), config.speed );
+    for( const auto& record : recording.records )
+    {
+        if( config.speed > 0 )
+        {
+            const duration<double, std::micro> offset(
+                static_cast<double>( record.time.count() ) / config.speed );
+            std::this_thread::sleep_until( start +
+                                           duration_cast<steady_clock::duration>( offset ) );
+        }
+        switch( record.kind )
+        {
+            case Network::Record::Kind::Local:
+                ++result.local;
+                backend->setText( record.contents.str() );
+                break;
+            case Network::Record::Kind::Event:
+                ++result.events;
+                for( const auto& frame : record.event.frames )
+                {
+                    result.received += frame.size();
+                }
+                network.inject( record.event );
+                break;
+        }
+    }
+    std::this_thread::sleep_for( milliseconds( config.settle_ms ) );
+    result.replay_s = duration<double>( steady_clock::now() - start ).count();
+    result.cpu_s = cpuSeconds() - cpu_start;
+    result.sent = network.stats();
+
+    clipd.stop();
+    discoveryd.stop();
+    clipd.join();
+    discoveryd.join();
+
+    if( !recording.records.empty() )
+    {
+        result.recorded_s =
+            duration<double>( recording.records.back().time - recording.records.front().time )
+                .count();
+    }
+    return result;
+}
+
+void writeJson( std::ostream& o, const Result& r )
+{
+    o << std::fixed << std::setprecision( 3 ) << "{\"local\":" << r.local
+      << ",\"events\":" << r.events << ",\"received_bytes\":" << r.received
+      << ",\"recorded_s\":" << r.recorded_s << ",\"replay_s\":" << r.replay_s
+      << ",\"cpu_s\":" << r.cpu_s << ",\"shouts\":" << r.sent.shouts
+      << ",\"whispers\":" << r.sent.whispers << ",\"sent_bytes\":" << r.sent.bytes
+      << ",\"metrics\":";
+    Utils::Metrics::Registry::global().snapshot().writeJson( o );
+    o << "}\n";
+}
+
+void writeText( std::ostream& o, const Result& r )
+{
+    o << std::fixed << std::setprecision( 3 ) << "local copies   " << r.local << "\n"
+      << "events         " << r.events << " (" << r.received << " bytes)\n"
+      << "recorded       " << r.recorded_s << " s\n"
+      << "replayed       " << r.replay_s << " s, " << r.cpu_s << " s of CPU\n"
+      << "sent           " << r.sent.shouts << " shouts, " << r.sent.whispers << " whispers ("
+      << r.sent.bytes << " bytes)\n\n";
+    Utils::Metrics::Registry::global().snapshot().writeText( o );
+}
+} // namespace
+
+int main( int argc, const char** argv )
+{
+    static const std::string description =
+        "\tReplays a recording made by clipd --record through a clipboard daemon and a network "
+        "daemon, at the recorded speed or faster, and reports what they did.";
+    Config config;
+    bool help = false;
+
+    auto cli = ( clipp::option( "-h", "--help" ).set( help ).doc( "Show this help page." ),
+                 clipp::value( "recording", config.path ),
+                 ( clipp::option( "--speed" ) & clipp::value( "factor", config.speed ) ) %
+                     "Replay this many times faster than recorded. Zero replays as fast as "
+                     "possible.",
+                 ( clipp::option( "--debounce" ) & clipp::value( "ms", config.debounce_ms ) ) %
+                     "Coalesce clipboard updates closer together than this. Zero disables.",
+                 ( clipp::option( "--max-delay" ) & clipp::value( "ms", config.max_delay_ms ) ) %
+                     "The longest a coalesced clipboard update may be held back.",
+                 ( clipp::option( "--settle" ) & clipp::value( "ms", config.settle_ms ) ) %
+                     "How long to let the daemons finish after the last record.",
+                 clipp::option( "-t", "--text" )
+                     .set( config.text )
+                     .doc( "Write a human readable summary instead of JSON." ) );
+
+    // The clipp parser doesn't like const, so pretend it's not.
+    if( !clipp::parse( argc, const_cast<char**>( argv ), cli ) || help ) // NOLINT
+    {
+        std::cout
+            // NOLINTNEXTLINE
+            << clipp::make_man_page( cli, argv[0] ).prepend_section( "DESCRIPTION", description );
+        return help ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::ifstream file( config.path, std::ios::binary );
+    auto recording = Network::Recording::read( file );
+    if( !recording )
+    {
+        std::cerr << "'" << config.path << "' isn't a clipd recording." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Utils::Log::Logger::instance().setLevel( Utils::Log::Level::Warn );
+    Utils::Log::Writer log( stderr );
+    log.start();
+
+    const Result result = replay( config, *recording );
+    if( config.text )
+    {
+        writeText( std::cout, result );
+    }
+    else
+    {
+        std::cout << "{\"context\":{";
+        Bench::writeContextFields( std::cout );
+        std::cout << ",\"recording\":";
+        Bench::writeJsonString( std::cout, config.path );
+        std::cout << ",\"records\":" << recording->records.size()
+                  << ",\"speed\":" << config.speed << "}}\n";
+        writeJson( std::cout, result );
+    }
+
+    log.stop();
+    log.join();
+    return EXIT_SUCCESS;
+}
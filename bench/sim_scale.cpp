@@ -0,0 +1,333 @@
+#include "harness.h"
+#include "network/peer_discovery.h"
+#include "network/sim_network.h"
+#include "utils/hlc.h"
+#include "utils/log.h"
+
+#include <clipp.h>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace Clipd;
+using namespace std::chrono;
+
+namespace
+{
+struct Config
+{
+    std::vector<size_t> nodes = {100, 250, 500, 1000};
+    size_t size = 1024;         //!< The size of each clipboard update, in bytes.
+    size_t updates = 20;        //!< Clipboard updates, each copied on a random node.
+    uint32_t interval_ms = 500; //!< The time between updates, longer than the debounce window.
+    //! The FanoutTree degrees to compare, where zero shouts every update.
+    std::vector<size_t> fanouts = {0};
+    Network::SimNetwork::Config network;
+    bool text = false;
+};
+
+struct Result
+{
+    size_t nodes;
+    size_t fanout;
+    double ready_s;        //!< The virtual time it took every node to discover every other node.
+    uint64_t delivered;    //!< Updates delivered, to every node but their origin.
+    uint64_t expected;     //!< Every update delivered to every other node.
+    double messages;       //!< Messages sent per update, counting each copy of a shout.
+    double amplification;  //!< Bytes sent per byte of each update.
+    double egress;         //!< Bytes the origin sent per byte of each update.
+    double p50_ms;         //!< The virtual time until an update reached every other node.
+    double p99_ms;         //!< Only counts the updates that reached every other node.
+    double max_ms;         //!< The slowest update to reach every other node.
+    double bytes_per_peer; //!< Heap memory per simulated node, including the simulation's.
+    double wall_s;         //!< The real time it took to simulate the updates.
+};
+
+//! @brief When each update was copied, and when it reached each node.
+struct Convergence
+{
+    struct Update
+    {
+        Network::SimNetwork::Clock::time_point copied;
+        Network::SimNetwork::Clock::time_point last;
+        size_t delivered = 0;
+    };
+
+    const Network::SimNetwork& network;
+    std::unordered_map<uint64_t, Update> updates;
+    uint64_t delivered = 0;
+
+    void receive( const Clipboard::Item& item )
+    {
+        const auto found = updates.find( item.version.timestamp );
+        if( found == updates.end() )
+        {
+            return;
+        }
+        found->second.last = network.now();
+        ++found->second.delivered;
+        ++delivered;
+    }
+};
+
+//! @brief Every simulated node has an eventfd, to wake its network thread, if it had one.
+void raiseFileLimit()
+{
+    rlimit limit = {};
+    if( getrlimit( RLIMIT_NOFILE, &limit ) == 0 && limit.rlim_cur < limit.rlim_max )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit( RLIMIT_NOFILE, &limit );
+    }
+}
+
+Result run( const Config& config, size_t count, size_t fanout )
+{
+    using Network::PeerDiscoveryDaemon;
+    using Network::SimNetwork;
+
+    Result result {};
+    result.nodes = count;
+    result.fanout = fanout;
+    Network::FanoutTree::Config tree;
+    tree.degree = fanout;
+    tree.threshold = 0;
+
+    const size_t heap_start = Bench::heapBytes();
+    SimNetwork network( config.network );
+    Convergence convergence {network, {}, 0};
+    std::vector<std::unique_ptr<PeerDiscoveryDaemon>> nodes;
+    for( size_t i = 0; i < count; ++i )
+    {
+        nodes.push_back( std::make_unique<PeerDiscoveryDaemon>(
+            network.createTransport( "node" + std::to_string( i ) ), "scale",
+            Network::Coalescer::Config {}, tree ) );
+        nodes.back()->registerOnRemoteClipboardUpdate(
+            Utils::Functor<void( const Clipboard::Item& )>( convergence,
+                                                            &Convergence::receive ) );
+        network.attach( nodes.back()->uuid(),
+                        SimNetwork::Step( nodes.back().get(), &PeerDiscoveryDaemon::step ) );
+    }
+
+    const auto start = network.now();
+    const auto ready = [&] {
+        return std::all_of( nodes.begin(), nodes.end(),
+                            [&]( const auto& node ) { return node->sessionPeers() == count - 1; } );
+    };
+    while( !ready() && network.now() - start < minutes( 10 ) )
+    {
+        network.runFor( milliseconds( 100 ) );
+    }
+    result.ready_s = duration<double>( network.now() - start ).count();
+
+    // Random contents, so that the updates are as expensive to send as real ones can be.
+    std::string contents( config.size, '\0' );
+    std::mt19937_64 random( config.network.seed );
+    Utils::HybridLogicalClock clock;
+    const auto messages_start = network.stats().messages;
+    const auto bytes_start = network.stats().bytes;
+    uint64_t egress = 0;
+    const auto wall_start = steady_clock::now();
+    for( size_t i = 0; i < config.updates; ++i )
+    {
+        const auto& origin = nodes[random() % count];
+        for( auto& c : contents )
+        {
+            c = static_cast<char>( random() );
+        }
+        const Clipboard::Item item {{clock.now(), origin->uuid()},
+                                    Utils::Payload( std::string( contents ) )};
+        convergence.updates.emplace( item.version.timestamp,
+                                     Convergence::Update {network.now(), network.now(), 0} );
+        const uint64_t sent = network.bytesSent( origin->uuid() );
+        origin->receiveLocalClipboardUpdate( item );
+        network.runFor( milliseconds( config.interval_ms ) );
+        egress += network.bytesSent( origin->uuid() ) - sent;
+    }
+    network.runUntilIdle( minutes( 1 ) );
+    result.wall_s = duration<double>( steady_clock::now() - wall_start ).count();
+    const size_t heap = Bench::heapBytes();
+    result.bytes_per_peer = static_cast<double>( heap - std::min( heap_start, heap ) ) /
+                            static_cast<double>( count );
+
+    const double updates = static_cast<double>( std::max<size_t>( config.updates, 1 ) );
+    result.delivered = convergence.delivered;
+    result.expected = config.updates * ( count - 1 );
+    result.messages = static_cast<double>( network.stats().messages - messages_start ) / updates;
+    result.amplification = static_cast<double>( network.stats().bytes - bytes_start ) / updates /
+                           static_cast<double>( std::max<size_t>( config.size, 1 ) );
+    result.egress = static_cast<double>( egress ) / updates /
+                    static_cast<double>( std::max<size_t>( config.size, 1 ) );
+
+    std::vector<double> converged;
+    for( const auto& [timestamp, update] : convergence.updates )
+    {
+        if( update.delivered == count - 1 )
+        {
+            converged.push_back(
+                duration<double, std::milli>( update.last - update.copied ).count() );
+        }
+    }
+    std::sort( converged.begin(), converged.end() );
+    const auto percentile = [&converged]( double p ) {
+        const double last = static_cast<double>( std::max<size_t>( converged.size(), 1 ) - 1 );
+        return converged.empty() ? 0.0 : converged[static_cast<size_t>( p * last )];
+    };
+    result.p50_ms = percentile( 0.5 );
+    result.p99_ms = percentile( 0.99 );
+    result.max_ms = percentile( 1.0 );
+    return result;
+}
+
+void writeJson( std::ostream& o, const Config& config, const Result& r )
+{
+    o << std::fixed << std::setprecision( 3 ) << "{\"nodes\":" << r.nodes
+      << ",\"fanout\":" << r.fanout << ",\"size\":" << config.size
+      << ",\"ready_s\":" << r.ready_s << ",\"delivered\":" << r.delivered
+      << ",\"expected\":" << r.expected << ",\"messages_per_update\":" << r.messages
+      << ",\"amplification\":" << r.amplification << ",\"origin_egress\":" << r.egress
+      << ",\"convergence_ms\":{\"p50\":" << r.p50_ms << ",\"p99\":" << r.p99_ms
+      << ",\"max\":" << r.max_ms << "},\"bytes_per_peer\":" << r.bytes_per_peer
+      << ",\"wall_s\":" << r.wall_s << "}\n";
+}
+
+void writeText( std::ostream& o, const Result& r )
+{
+    o << std::fixed << std::setprecision( 1 ) << std::setw( 6 ) << r.nodes << std::setw( 8 )
+      << r.fanout << std::setw( 10 ) << r.ready_s << std::setw( 10 ) << r.delivered
+      << std::setw( 10 ) << r.expected << std::setw( 12 ) << r.messages << std::setw( 10 )
+      << r.amplification << std::setw( 10 ) << r.egress << std::setw( 10 ) << r.p50_ms
+      << std::setw( 10 ) << r.p99_ms << std::setw( 10 ) << r.max_ms << std::setw( 12 )
+      << r.bytes_per_peer / 1024 << std::setw( 10 ) << r.wall_s << "\n";
+}
+
+std::vector<size_t> parseCounts( const std::string& list, size_t minimum )
+{
+    std::vector<size_t> counts;
+    std::stringstream ss( list );
+    for( std::string count; std::getline( ss, count, ',' ); )
+    {
+        const size_t n = std::strtoul( count.c_str(), nullptr, 10 );
+        if( n >= minimum )
+        {
+            counts.push_back( n );
+        }
+    }
+    return counts;
+}
+} // namespace
+
+int main( int argc, const char** argv )
+{
+    static const std::string description =
+        "\tSimulates N clipd network daemons on an in-process network, in virtual time, and "
+        "measures how clipboard updates copied on random nodes spread to all of the others.";
+    Config config;
+    std::string nodes = "100,250,500,1000";
+    std::string fanouts = "0";
+    uint32_t latency_ms = 1;
+    uint32_t jitter_ms = 0;
+    double bandwidth_mbps = 0;
+    bool help = false;
+
+    auto cli = ( clipp::option( "-h", "--help" ).set( help ).doc( "Show this help page." ),
+                 ( clipp::option( "-n", "--nodes" ) & clipp::value( "counts", nodes ) ) %
+                     "The comma separated node counts to simulate.",
+                 ( clipp::option( "-s", "--size" ) & clipp::value( "bytes", config.size ) ) %
+                     "The size of each clipboard update.",
+                 ( clipp::option( "-u", "--updates" ) & clipp::value( "count", config.updates ) ) %
+                     "The number of clipboard updates to copy.",
+                 ( clipp::option( "--fanout" ) & clipp::value( "degrees", fanouts ) ) %
+                     "The comma separated FanoutTree degrees to compare, where 0 shouts.",
+                 ( clipp::option( "--interval" ) & clipp::value( "ms", config.interval_ms ) ) %
+                     "The virtual time between updates.",
+                 ( clipp::option( "--latency" ) & clipp::value( "ms", latency_ms ) ) %
+                     "The one way delay between any two nodes.",
+                 ( clipp::option( "--jitter" ) & clipp::value( "ms", jitter_ms ) ) %
+                     "Up to this much extra delay for each message.",
+                 ( clipp::option( "--bandwidth" ) & clipp::value( "MB/s", bandwidth_mbps ) ) %
+                     "Each node's uplink bandwidth. Zero is unlimited.",
+                 ( clipp::option( "--loss" ) & clipp::value( "fraction", config.network.loss ) ) %
+                     "The fraction of messages delayed by a retransmission.",
+                 clipp::option( "--multicast" )
+                     .set( config.network.multicast )
+                     .doc( "Multicast updates that fit in a datagram, like clipd --multicast." ),
+                 ( clipp::option( "--datagram-loss" ) &
+                   clipp::value( "fraction", config.network.datagram_loss ) ) %
+                     "The fraction of multicast datagrams each node loses.",
+                 ( clipp::option( "--seed" ) & clipp::value( "seed", config.network.seed ) ) %
+                     "Seeds the simulation.",
+                 clipp::option( "-t", "--text" )
+                     .set( config.text )
+                     .doc( "Write a human readable table instead of JSON." ) );
+
+    // The clipp parser doesn't like const, so pretend it's not.
+    if( !clipp::parse( argc, const_cast<char**>( argv ), cli ) || help ) // NOLINT
+    {
+        std::cout
+            // NOLINTNEXTLINE
+            << clipp::make_man_page( cli, argv[0] ).prepend_section( "DESCRIPTION", description );
+        return help ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    config.nodes = parseCounts( nodes, 2 );
+    config.fanouts = parseCounts( fanouts, 0 );
+    config.network.latency = milliseconds( latency_ms );
+    config.network.jitter = milliseconds( jitter_ms );
+    config.network.bandwidth = bandwidth_mbps * 1e6;
+
+    raiseFileLimit();
+    Utils::Log::Logger::instance().setLevel( Utils::Log::Level::Warn );
+    Utils::Log::Writer log( stderr );
+    log.start();
+
+    if( config.text )
+    {
+        std::cout << std::setw( 6 ) << "nodes" << std::setw( 8 ) << "fanout" << std::setw( 10 )
+                  << "ready s" << std::setw( 10 ) << "recv" << std::setw( 10 ) << "expected"
+                  << std::setw( 12 ) << "msgs/update" << std::setw( 10 ) << "amplify"
+                  << std::setw( 10 ) << "egress" << std::setw( 10 ) << "p50 ms"
+                  << std::setw( 10 ) << "p99 ms" << std::setw( 10 ) << "max ms" << std::setw( 12 )
+                  << "KiB/peer" << std::setw( 10 ) << "wall s"
+                  << "\n";
+    }
+    else
+    {
+        std::cout << "{\"context\":{";
+        Bench::writeContextFields( std::cout );
+        std::cout << ",\"updates\":" << config.updates << ",\"latency_ms\":" << latency_ms
+                  << ",\"jitter_ms\":" << jitter_ms << ",\"bandwidth_mbps\":" << bandwidth_mbps
+                  << ",\"loss\":" << config.network.loss
+                  << ",\"multicast\":" << ( config.network.multicast ? "true" : "false" )
+                  << ",\"datagram_loss\":" << config.network.datagram_loss << "}}\n";
+    }
+
+    for( const size_t count : config.nodes )
+    {
+        for( const size_t fanout : config.fanouts )
+        {
+            const Result result = run( config, count, fanout );
+            if( config.text )
+            {
+                writeText( std::cout, result );
+            }
+            else
+            {
+                writeJson( std::cout, config, result );
+            }
+            std::cout.flush();
+        }
+    }
+
+    log.stop();
+    log.join();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,690 @@
+#include "harness.h"
+#include "network/peer_discovery.h"
+#include "network/recording.h"
+#include "network/sim_network.h"
+#include "network/zyre_transport.h"
+#include "utils/hlc.h"
+#include "utils/log.h"
+#include "utils/uuid.h"
+
+#include <clipp.h>
+#include <czmq.h>
+
+#include <malloc.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// glibc's own allocator, which the counting allocator below forwards to.
+extern "C"
+{
+    void* __libc_malloc( size_t size );                      // NOLINT
+    void* __libc_calloc( size_t count, size_t size );        // NOLINT
+    void* __libc_realloc( void* ptr, size_t size );          // NOLINT
+    void* __libc_memalign( size_t alignment, size_t size );  // NOLINT
+    void __libc_free( void* ptr );                           // NOLINT
+}
+
+using namespace Clipd;
+using namespace std::chrono;
+
+namespace
+{
+/**
+ * @brief Counts every allocation made by the process, including those made by CZMQ, libzmq, and
+ * Zyre, by interposing malloc() and friends.
+ *
+ * @details The counters are constant initialized, so they're safe to use before main(), and are
+ * only ever updated with relaxed atomics, so counting costs a few nanoseconds per allocation.
+ */
+struct HeapCounters
+{
+    std::atomic<uint64_t> allocations = 0;
+    std::atomic<uint64_t> frees = 0;
+    std::atomic<int64_t> live_bytes = 0;
+};
+
+HeapCounters heap;
+
+void* counted( void* ptr )
+{
+    if( ptr )
+    {
+        heap.allocations.fetch_add( 1, std::memory_order_relaxed );
+        heap.live_bytes.fetch_add( static_cast<int64_t>( malloc_usable_size( ptr ) ),
+                                   std::memory_order_relaxed );
+    }
+    return ptr;
+}
+
+void uncounted( void* ptr )
+{
+    if( ptr )
+    {
+        heap.frees.fetch_add( 1, std::memory_order_relaxed );
+        heap.live_bytes.fetch_sub( static_cast<int64_t>( malloc_usable_size( ptr ) ),
+                                   std::memory_order_relaxed );
+    }
+}
+} // namespace
+
+extern "C"
+{
+    void* malloc( size_t size )
+    {
+        return counted( __libc_malloc( size ) );
+    }
+
+    void* calloc( size_t count, size_t size )
+    {
+        return counted( __libc_calloc( count, size ) );
+    }
+
+    void* realloc( void* ptr, size_t size )
+    {
+        uncounted( ptr );
+        void* resized = __libc_realloc( ptr, size );
+        if( !resized && ptr && size > 0 )
+        {
+            // The original allocation is untouched when realloc() fails.
+            return counted( ptr );
+        }
+        return counted( resized );
+    }
+
+    void free( void* ptr )
+    {
+        uncounted( ptr );
+        __libc_free( ptr );
+    }
+
+    void* memalign( size_t alignment, size_t size )
+    {
+        return counted( __libc_memalign( alignment, size ) );
+    }
+
+    void* aligned_alloc( size_t alignment, size_t size )
+    {
+        return counted( __libc_memalign( alignment, size ) );
+    }
+
+    int posix_memalign( void** ptr, size_t alignment, size_t size )
+    {
+        if( alignment % sizeof( void* ) != 0 || ( alignment & ( alignment - 1 ) ) != 0 )
+        {
+            return EINVAL;
+        }
+        *ptr = counted( __libc_memalign( alignment, size ) );
+        return *ptr || size == 0 ? 0 : ENOMEM;
+    }
+}
+
+namespace
+{
+struct Config
+{
+    size_t nodes = 4;
+    uint64_t updates = 1000000;
+    std::vector<size_t> sizes = {32, 256, 2048, 16384}; //!< Each update is one of these, at random.
+    size_t batch = 1000;           //!< Updates sent by each node in turn, before the next node.
+    size_t window = 256;           //!< The most updates in flight, not yet delivered everywhere.
+    double ready_s = 60;           //!< The longest to wait for the nodes to discover each other.
+    double stall_s = 10;           //!< The longest to wait for a delivery, before giving up.
+    uint16_t port = 47200;         //!< The gossip hub port. Node i listens on `port + 1 + i`.
+    double max_heap_growth_mb = 8; //!< The most the live heap may grow after warming up.
+    double max_rss_growth_mb = 64; //!< The most the resident set may grow after warming up.
+    double max_allocs = 0;         //!< The most allocations per delivery. Zero doesn't check.
+    //! A file holding the allocations per delivery to check against, recorded if it doesn't exist.
+    std::string baseline;
+    double headroom = 0.1; //!< How far above the baseline, as a fraction, deliveries may go.
+    bool measure = false;  //!< Measure the allocations per delivery, without checking.
+    bool simulated = false;        //!< Run the nodes on a SimNetwork, rather than over Zyre.
+    bool text = false;
+};
+
+//! @brief The process' memory use at some point in the soak.
+struct Usage
+{
+    uint64_t updates = 0; //!< Updates sent so far.
+    double elapsed_s = 0;
+    uint64_t rss = 0;
+    int64_t heap = 0;
+    uint64_t allocations = 0;
+    uint64_t delivered = 0;
+};
+
+struct Result
+{
+    uint64_t sent = 0;
+    uint64_t expected = 0; //!< Every update sent, delivered to every other node.
+    uint64_t delivered = 0;
+    double ready_s = 0;
+    double elapsed_s = 0;
+    bool stalled = false; //!< Deliveries stopped, so the soak stopped early.
+    Usage warm;           //!< Once the first tenth of the updates were delivered.
+    Usage end;            //!< Once every update was delivered, with the nodes still running.
+    uint64_t peak_rss = 0;
+    std::vector<Usage> samples;
+
+    [[nodiscard]] double allocsPerUpdate() const
+    {
+        const uint64_t updates = end.updates - warm.updates;
+        return updates ? static_cast<double>( end.allocations - warm.allocations ) /
+                             static_cast<double>( updates )
+                       : 0;
+    }
+
+    [[nodiscard]] double allocsPerDelivery() const
+    {
+        const uint64_t deliveries = end.delivered - warm.delivered;
+        return deliveries ? static_cast<double>( end.allocations - warm.allocations ) /
+                                static_cast<double>( deliveries )
+                          : 0;
+    }
+};
+
+uint64_t residentBytes()
+{
+    std::ifstream statm( "/proc/self/statm" );
+    uint64_t size = 0;
+    uint64_t resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<uint64_t>( sysconf( _SC_PAGESIZE ) );
+}
+
+double mib( double bytes )
+{
+    return bytes / ( 1024.0 * 1024.0 );
+}
+
+//! @brief See bench/loopback.cpp.
+void raiseSocketLimits()
+{
+    rlimit limit = {};
+    if( getrlimit( RLIMIT_NOFILE, &limit ) == 0 && limit.rlim_cur < limit.rlim_max )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit( RLIMIT_NOFILE, &limit );
+    }
+    zsys_set_max_sockets( 0 );
+}
+
+//! @brief Counts the updates delivered to every node.
+struct Deliveries
+{
+    std::atomic<uint64_t> delivered = 0;
+
+    void receive( const Clipboard::Item& /*item*/ )
+    {
+        delivered.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    /**
+     * @brief Wait until the given number of updates have been delivered.
+     *
+     * @param pass Lets the given time pass, while the nodes deliver updates.
+     * @return False if no update was delivered for the given time.
+     */
+    template <typename Pass>
+    bool waitFor( uint64_t target, double stall_s, Pass&& pass ) const
+    {
+        uint64_t last = delivered.load();
+        auto progress = steady_clock::now();
+        while( last < target )
+        {
+            pass( microseconds( 200 ) );
+            const uint64_t now = delivered.load();
+            if( now != last )
+            {
+                last = now;
+                progress = steady_clock::now();
+            }
+            else if( steady_clock::now() - progress > duration<double>( stall_s ) )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Send updates of mixed sizes from every node in turn, and measure how the process' memory
+ * grows while they're delivered.
+ *
+ * @details Each node sends a batch of updates, all of which are delivered before the next node
+ * sends, so that no node ever receives an update older than the last one it applied. Within a
+ * batch, at most a window of updates is in flight, so the soak measures steady state, rather than
+ * how much the transport can queue.
+ *
+ * Simulated nodes are stepped on this thread, by the SimNetwork, rather than on their own threads,
+ * so their allocations are counted just the same, without needing Zyre or the loopback interface.
+ */
+Result run( const Config& config )
+{
+    using Network::PeerDiscoveryDaemon;
+    using Network::SimNetwork;
+
+    const std::string session = "soak-" + Utils::random_hex( 4 );
+    const std::string hub = "tcp://127.0.0.1:" + std::to_string( unsigned( config.port ) );
+    Network::Coalescer::Config coalescing;
+    coalescing.debounce = milliseconds( 0 );
+
+    Deliveries deliveries;
+    std::optional<SimNetwork> network;
+    if( config.simulated )
+    {
+        network.emplace();
+    }
+    const auto pass = [&network]( SimNetwork::Clock::duration duration ) {
+        if( network )
+        {
+            network->runFor( duration );
+        }
+        else
+        {
+            std::this_thread::sleep_for( duration );
+        }
+    };
+
+    std::vector<std::unique_ptr<PeerDiscoveryDaemon>> nodes;
+    for( size_t i = 0; i < config.nodes; ++i )
+    {
+        std::unique_ptr<Network::Transport> transport;
+        if( network )
+        {
+            transport = network->createTransport( "node" + std::to_string( i ) );
+        }
+        else
+        {
+            Network::ZyreTransport::Discovery discovery;
+            discovery.endpoint = "tcp://127.0.0.1:" + std::to_string( config.port + 1 + i );
+            if( i == 0 )
+            {
+                discovery.gossip_bind = hub;
+            }
+            else
+            {
+                discovery.gossip_connect = hub;
+            }
+            transport = std::make_unique<Network::ZyreTransport>( discovery, nullptr );
+        }
+        nodes.push_back(
+            std::make_unique<PeerDiscoveryDaemon>( std::move( transport ), session, coalescing ) );
+        nodes.back()->registerOnRemoteClipboardUpdate(
+            Utils::Functor<void( const Clipboard::Item& )>( deliveries, &Deliveries::receive ) );
+    }
+
+    Result result;
+    const auto start = steady_clock::now();
+    for( auto& node : nodes )
+    {
+        if( network )
+        {
+            network->attach( node->uuid(),
+                             SimNetwork::Step( node.get(), &PeerDiscoveryDaemon::step ) );
+        }
+        else
+        {
+            node->start();
+        }
+    }
+    const auto ready = [&] {
+        for( const auto& node : nodes )
+        {
+            if( node->sessionPeers() < config.nodes - 1 )
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    const auto ready_deadline = start + duration<double>( config.ready_s );
+    while( !ready() && steady_clock::now() < ready_deadline )
+    {
+        pass( milliseconds( 10 ) );
+    }
+    result.ready_s = duration<double>( steady_clock::now() - start ).count();
+    if( !ready() )
+    {
+        CLIPD_LOG_WARN( "Only some of the " << config.nodes << " nodes discovered each other after "
+                                            << result.ready_s << "s" );
+    }
+
+    // Text-like contents, each stamped with its sequence number so that no two are equal.
+    std::vector<std::string> contents;
+    for( const size_t size : config.sizes )
+    {
+        contents.push_back( Network::Recording::synthesize( std::max( size, sizeof( uint64_t ) ),
+                                                            contents.size() ) );
+    }
+    std::mt19937_64 random( config.nodes );
+    std::uniform_int_distribution<size_t> pick( 0, contents.size() - 1 );
+
+    const uint64_t peers = config.nodes - 1;
+    const uint64_t warm_up = config.updates / 10;
+    const uint64_t sample_every = std::max<uint64_t>( config.updates / 20, 1 );
+    const auto load_start = steady_clock::now();
+    const auto usage = [&] {
+        Usage u;
+        u.updates = result.sent;
+        u.elapsed_s = duration<double>( steady_clock::now() - load_start ).count();
+        u.rss = residentBytes();
+        u.heap = heap.live_bytes.load();
+        u.allocations = heap.allocations.load();
+        u.delivered = deliveries.delivered.load();
+        result.peak_rss = std::max( result.peak_rss, u.rss );
+        return u;
+    };
+
+    Utils::HybridLogicalClock clock;
+    while( result.sent < config.updates )
+    {
+        const uint64_t sequence = result.sent;
+        if( sequence % config.batch == 0 || sequence == warm_up )
+        {
+            // Let every update sent by the previous node arrive, before the next node sends.
+            if( !deliveries.waitFor( sequence * peers, config.stall_s, pass ) )
+            {
+                result.stalled = true;
+                break;
+            }
+            if( sequence == warm_up )
+            {
+                result.warm = usage();
+            }
+        }
+        else if( sequence > config.window &&
+                 !deliveries.waitFor( ( sequence - config.window ) * peers, config.stall_s,
+                                      pass ) )
+        {
+            result.stalled = true;
+            break;
+        }
+        if( sequence % sample_every == 0 )
+        {
+            result.samples.push_back( usage() );
+        }
+
+        auto& node = *nodes[( sequence / config.batch ) % nodes.size()];
+        std::string& update = contents[pick( random )];
+        std::memcpy( update.data(), &sequence, sizeof( sequence ) );
+        node.receiveLocalClipboardUpdate(
+            Clipboard::Item {{clock.now(), node.uuid()}, Utils::Payload( std::string( update ) ),
+                             steady_clock::now()} );
+        ++result.sent;
+    }
+
+    result.expected = result.sent * peers;
+    if( !result.stalled && !deliveries.waitFor( result.expected, config.stall_s, pass ) )
+    {
+        result.stalled = true;
+    }
+    result.elapsed_s = duration<double>( steady_clock::now() - load_start ).count();
+    result.end = usage();
+    result.samples.push_back( result.end );
+    result.delivered = deliveries.delivered.load();
+
+    if( network )
+    {
+        return result;
+    }
+    for( auto& node : nodes )
+    {
+        node->stop();
+    }
+    for( auto& node : nodes )
+    {
+        node->join();
+    }
+    return result;
+}
+
+/**
+ * @brief Check the result against the configured bounds.
+ *
+ * @return A description of each bound exceeded.
+ */
+std::vector<std::string> failures( const Config& config, const Result& r )
+{
+    std::vector<std::string> failed;
+    std::ostringstream o;
+    o << std::fixed << std::setprecision( 2 );
+    const auto fail = [&] {
+        failed.push_back( o.str() );
+        o.str( "" );
+    };
+
+    if( r.stalled || r.delivered < r.expected )
+    {
+        o << "Only " << r.delivered << " of " << r.expected << " deliveries arrived";
+        fail();
+    }
+    const double heap_growth = mib( static_cast<double>( r.end.heap - r.warm.heap ) );
+    if( heap_growth > config.max_heap_growth_mb )
+    {
+        o << "The live heap grew by " << heap_growth << " MiB after warming up, more than "
+          << config.max_heap_growth_mb << " MiB";
+        fail();
+    }
+    const double rss_growth =
+        mib( static_cast<double>( r.end.rss ) - static_cast<double>( r.warm.rss ) );
+    if( rss_growth > config.max_rss_growth_mb )
+    {
+        o << "The resident set grew by " << rss_growth << " MiB after warming up, more than "
+          << config.max_rss_growth_mb << " MiB";
+        fail();
+    }
+    if( config.max_allocs > 0 && r.allocsPerDelivery() > config.max_allocs )
+    {
+        o << r.allocsPerDelivery() << " allocations per delivery, more than "
+          << config.max_allocs;
+        fail();
+    }
+    return failed;
+}
+
+void writeJson( std::ostream& o, const Result& r, const std::vector<std::string>& failed )
+{
+    const auto writeUsage = [&o]( const Usage& u ) {
+        o << "{\"updates\":" << u.updates << ",\"elapsed_s\":" << u.elapsed_s
+          << ",\"rss_mb\":" << mib( static_cast<double>( u.rss ) )
+          << ",\"heap_mb\":" << mib( static_cast<double>( u.heap ) )
+          << ",\"allocations\":" << u.allocations << ",\"delivered\":" << u.delivered << "}";
+    };
+
+    o << std::fixed << std::setprecision( 3 ) << "{\"ready_s\":" << r.ready_s
+      << ",\"sent\":" << r.sent << ",\"expected\":" << r.expected
+      << ",\"delivered\":" << r.delivered << ",\"elapsed_s\":" << r.elapsed_s
+      << ",\"updates_per_s\":" << static_cast<double>( r.sent ) / r.elapsed_s
+      << ",\"allocs_per_update\":" << r.allocsPerUpdate()
+      << ",\"allocs_per_delivery\":" << r.allocsPerDelivery()
+      << ",\"peak_rss_mb\":" << mib( static_cast<double>( r.peak_rss ) ) << ",\"warm\":";
+    writeUsage( r.warm );
+    o << ",\"end\":";
+    writeUsage( r.end );
+    o << ",\"samples\":[";
+    for( size_t i = 0; i < r.samples.size(); ++i )
+    {
+        o << ( i ? "," : "" );
+        writeUsage( r.samples[i] );
+    }
+    o << "],\"failures\":[";
+    for( size_t i = 0; i < failed.size(); ++i )
+    {
+        o << ( i ? "," : "" );
+        Bench::writeJsonString( o, failed[i] );
+    }
+    o << "]}\n";
+}
+
+void writeText( std::ostream& o, const Result& r )
+{
+    o << std::fixed << std::setprecision( 1 ) << std::setw( 10 ) << "updates" << std::setw( 10 )
+      << "seconds" << std::setw( 12 ) << "delivered" << std::setw( 10 ) << "RSS MiB"
+      << std::setw( 10 ) << "heap MiB" << std::setw( 14 ) << "allocations" << "\n";
+    for( const auto& u : r.samples )
+    {
+        o << std::setw( 10 ) << u.updates << std::setw( 10 ) << u.elapsed_s << std::setw( 12 )
+          << u.delivered << std::setw( 10 ) << mib( static_cast<double>( u.rss ) )
+          << std::setw( 10 ) << mib( static_cast<double>( u.heap ) ) << std::setw( 14 )
+          << u.allocations << "\n";
+    }
+    o << "\ndelivered      " << r.delivered << " of " << r.expected << " in " << r.elapsed_s
+      << " s\n"
+      << "heap growth    " << mib( static_cast<double>( r.end.heap - r.warm.heap ) )
+      << " MiB after warming up\n"
+      << "RSS growth     "
+      << mib( static_cast<double>( r.end.rss ) - static_cast<double>( r.warm.rss ) )
+      << " MiB after warming up, " << mib( static_cast<double>( r.peak_rss ) ) << " MiB peak\n"
+      << "allocations    " << r.allocsPerUpdate() << " per update, " << r.allocsPerDelivery()
+      << " per delivery\n";
+}
+
+std::vector<size_t> parseSizes( const std::string& list )
+{
+    std::vector<size_t> sizes;
+    std::stringstream ss( list );
+    for( std::string size; std::getline( ss, size, ',' ); )
+    {
+        const size_t n = std::strtoul( size.c_str(), nullptr, 10 );
+        if( n > 0 )
+        {
+            sizes.push_back( n );
+        }
+    }
+    return sizes;
+}
+} // namespace
+
+int main( int argc, const char** argv )
+{
+    static const std::string description =
+        "\tStarts N clipd network daemons in this process, connected over the loopback interface, "
+        "and has them exchange millions of clipboard updates of mixed sizes, while counting every "
+        "allocation the process makes. Fails if the heap or resident set keeps growing once warmed "
+        "up, if updates go missing, or if each delivery needs more allocations than allowed.";
+    Config config;
+    std::string sizes = "32,256,2048,16384";
+    bool help = false;
+
+    auto cli = ( clipp::option( "-h", "--help" ).set( help ).doc( "Show this help page." ),
+                 ( clipp::option( "-n", "--nodes" ) & clipp::value( "count", config.nodes ) ) %
+                     "The number of nodes.",
+                 ( clipp::option( "-u", "--updates" ) & clipp::value( "count", config.updates ) ) %
+                     "The number of clipboard updates to send, in total.",
+                 ( clipp::option( "-s", "--sizes" ) & clipp::value( "bytes", sizes ) ) %
+                     "The comma separated sizes of the clipboard updates, picked at random.",
+                 ( clipp::option( "-p", "--port" ) & clipp::value( "port", config.port ) ) %
+                     "The first of the N + 1 loopback ports to use.",
+                 ( clipp::option( "--max-heap-growth" ) &
+                   clipp::value( "MiB", config.max_heap_growth_mb ) ) %
+                     "Fail if the live heap grows by more than this after warming up.",
+                 ( clipp::option( "--max-rss-growth" ) &
+                   clipp::value( "MiB", config.max_rss_growth_mb ) ) %
+                     "Fail if the resident set grows by more than this after warming up.",
+                 ( clipp::option( "--max-allocs" ) & clipp::value( "count", config.max_allocs ) ) %
+                     "Fail if delivering an update takes more allocations than this, on average. "
+                     "Overrides --baseline.",
+                 ( clipp::option( "--baseline" ) & clipp::value( "path", config.baseline ) ) %
+                     "Fail if delivering an update takes more allocations than the baseline in "
+                     "this file, plus the headroom. If the file doesn't exist, record the "
+                     "allocations per delivery measured by this run in it instead.",
+                 ( clipp::option( "--headroom" ) & clipp::value( "fraction", config.headroom ) ) %
+                     "How far above the baseline deliveries may go, like 0.1 for 10%.",
+                 clipp::option( "--measure" )
+                     .set( config.measure )
+                     .doc( "Only measure the allocations per delivery, rather than checking them." ),
+                 clipp::option( "--simulated" )
+                     .set( config.simulated )
+                     .doc( "Run the nodes on a simulated network in this thread, rather than over "
+                           "Zyre on the loopback interface." ),
+                 clipp::option( "-t", "--text" )
+                     .set( config.text )
+                     .doc( "Write a human readable summary instead of JSON." ) );
+
+    // The clipp parser doesn't like const, so pretend it's not.
+    if( !clipp::parse( argc, const_cast<char**>( argv ), cli ) || help ) // NOLINT
+    {
+        std::cout
+            // NOLINTNEXTLINE
+            << clipp::make_man_page( cli, argv[0] ).prepend_section( "DESCRIPTION", description );
+        return help ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    config.sizes = parseSizes( sizes );
+    if( config.nodes < 2 || config.updates == 0 || config.sizes.empty() )
+    {
+        std::cerr << "The soak needs at least 2 nodes, an update, and a size." << std::endl;
+        return EXIT_FAILURE;
+    }
+    // A soak that doesn't check the allocations per delivery wouldn't catch a leak that's freed
+    // on exit, so it's only allowed when measuring them, or recording the baseline to check later
+    // runs against.
+    if( config.max_allocs <= 0 && !config.baseline.empty() )
+    {
+        std::ifstream file( config.baseline );
+        double baseline = 0;
+        if( file >> baseline && baseline > 0 )
+        {
+            config.max_allocs = baseline * ( 1 + config.headroom );
+        }
+    }
+    const bool record = config.max_allocs <= 0 && !config.baseline.empty();
+    if( config.max_allocs <= 0 && !record && !config.measure )
+    {
+        std::cerr << "The soak needs a --baseline to check against, or record, or --max-allocs."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    raiseSocketLimits();
+    Utils::Log::Logger::instance().setLevel( Utils::Log::Level::Warn );
+    Utils::Log::Writer log( stderr );
+    log.start();
+
+    const Result result = run( config );
+    const auto failed = failures( config, result );
+    if( config.text )
+    {
+        writeText( std::cout, result );
+    }
+    else
+    {
+        std::cout << "{\"context\":{";
+        Bench::writeContextFields( std::cout );
+        std::cout << ",\"nodes\":" << config.nodes << ",\"updates\":" << config.updates
+                  << ",\"sizes\":";
+        Bench::writeJsonString( std::cout, sizes );
+        std::cout << "}}\n";
+        writeJson( std::cout, result, failed );
+    }
+    for( const auto& failure : failed )
+    {
+        std::cerr << "FAILED: " << failure << std::endl;
+    }
+    // Only a run that passed is a baseline worth checking later runs against.
+    if( record && failed.empty() )
+    {
+        std::ofstream( config.baseline ) << std::fixed << std::setprecision( 2 )
+                                         << result.allocsPerDelivery() << "\n";
+        std::cerr << "Recorded a baseline of " << result.allocsPerDelivery()
+                  << " allocations per delivery in " << config.baseline << std::endl;
+    }
+
+    log.stop();
+    log.join();
+    return failed.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
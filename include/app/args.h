@@ -1,6 +1,10 @@
 #pragma once
 #include "common.h"
 
+#include <string>
+#include <utility>
+#include <vector>
+
 // For some reason the standard feature test macros aren't defined?
 // #if defined(__cpp_lib_filesystem)
 #if __has_include( <filesystem>)
@@ -21,12 +25,58 @@ struct CommandlineArgs_t
     bool verbose = false;        //!< Whether to use verbose output
     bool help = false;           //!< Whether user requested the help option.
     uint16_t discovery_port = 0; //!< The port to perform peer discovery on.
+    std::string interface;       //!< The network interface to perform peer discovery on.
+    std::string endpoint;        //!< The endpoint to listen on, when using gossip discovery.
+    std::string gossip_bind;     //!< The gossip endpoint to bind, if this peer is a gossip hub.
+    std::string gossip_connect;  //!< The gossip endpoint to connect to.
+    //! Whether to only discover, and connect to, peers in our own session, without joining the
+    //! GLOBAL group, and beacon less often, for LANs with hundreds of clipd hosts.
+    bool lan_scale = false;
+    uint32_t beacon_interval_ms = 0; //!< How often to beacon. Zero uses Zyre's default.
+    uint32_t evasive_ms = 0;         //!< How long before a silent peer is pinged. Zero is default.
+    uint32_t expired_ms = 0;         //!< How long before a silent peer is dropped. Zero is default.
+
+    //! The endpoint a gateway's gossip node listens on. Empty unless this peer is a gateway.
+    std::string relay_endpoint;
+    std::string relay_gossip_bind;    //!< The gossip endpoint the gateway binds, if it's the hub.
+    std::string relay_gossip_connect; //!< The gossip endpoint the gateway connects to.
 
     bool generate_certificate = false; //!< Whether to generate a CURVE certificate.
     bool encrypt_traffic = false;      //!< Whether to encrypt traffic with a CURVE certificate.
     fs::path certificate;              //!< The path to the certificate public key.
+    //! Whether to also seal sessions' items with a key derived from the certificate.
+    //! @see Network::PeerDiscoveryDaemon::setSessionSecret()
+    bool encrypt_once = false;
 
     std::string session = "global"; //!< The session ID for this peer to join.
+    //! More sessions to host on the same node, each with the name of its clipboard backend.
+    std::vector<std::pair<std::string, std::string>> gateway;
+
+    uint32_t debounce_ms = 100;  //!< Clipboard updates closer together than this are coalesced.
+    uint32_t max_delay_ms = 500; //!< The longest a coalesced clipboard update may be held back.
+    //! How many peers each node forwards large items to, rather than shouting them. Zero shouts.
+    size_t fanout = 0;
+    //! The uplink, in MB/s, that updates are paced to, so small ones overtake large ones. Zero
+    //! doesn't pace them.
+    double uplink_mbps = 0;
+    //! The port to multicast clipboard updates that fit in a datagram on. Zero shouts them.
+    uint16_t multicast_port = 0;
+    //! The clipboard updates per second each peer may send us. Zero doesn't limit them.
+    double peer_rate = 0;
+    //! The clipboard updates per second each session may send, or receive. Zero doesn't limit them.
+    double session_rate = 0;
+    //! The largest clipboard update to accept, in bytes. Zero accepts any size.
+    uint64_t max_payload = 0;
+
+    //! The clipboard backend, `x11` or `memory`. Defaults to `memory` with a load generator.
+    std::string backend;
+    std::string loadgen; //!< The LoadGenerator specification. Empty disables it.
+
+    fs::path metrics; //!< Where to write JSON metrics snapshots. Empty disables them.
+    fs::path trace;   //!< Where to write sampled Chrome traces. Empty disables them.
+
+    fs::path record; //!< Where to record local copies and received events. Empty disables it.
+    std::string record_contents = "hash"; //!< How much of the contents to record.
 };
 
 /**
@@ -0,0 +1,51 @@
+#pragma once
+#include "app/args.h"
+#include "common.h"
+#include "utils/daemon.h"
+#include "utils/metrics.h"
+
+#include <atomic>
+
+namespace Clipd::App
+{
+/**
+ * @brief Dumps the global metrics, and the sampled traces, on request.
+ *
+ * @details Writing to a stream isn't async-signal-safe, so the SIGUSR1 handler only calls
+ * requestDump(), and this daemon does the writing. A dump prints a human readable table to
+ * stderr, and atomically replaces the snapshot file with a JSON snapshot of the metrics, and the
+ * trace file with the sampled traces, if either path was given. A final dump is written to the
+ * files when the daemon stops.
+ */
+class MetricsReporter : public Utils::Daemon
+{
+public:
+    /**
+     * @param snapshot_path Where to write the JSON snapshots. Empty disables them.
+     * @param trace_path Where to write the Chrome trace. Empty disables it.
+     */
+    explicit MetricsReporter( fs::path snapshot_path, fs::path trace_path = {} ) :
+        m_snapshot_path( std::move( snapshot_path ) ),
+        m_trace_path( std::move( trace_path ) )
+    {}
+
+    /**
+     * @brief Ask the reporter to dump the metrics. Safe to call from a signal handler.
+     */
+    static void requestDump() noexcept
+    {
+        s_dump_requested.store( true, std::memory_order_relaxed );
+    }
+
+protected:
+    void loop() override;
+    void teardown() override;
+
+private:
+    void writeFiles( const Utils::Metrics::Snapshot& snapshot ) const;
+
+    const fs::path m_snapshot_path;
+    const fs::path m_trace_path;
+    static inline std::atomic<bool> s_dump_requested = false;
+};
+} // namespace Clipd::App
@@ -0,0 +1,96 @@
+#pragma once
+#include "common.h"
+#include "utils/payload.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace Clipd::Clipboard
+{
+/**
+ * @brief The clipboard the ClipboardDaemon reads local copies from, and writes remote items to.
+ *
+ * @details The backend is read and written from the clipboard thread, and may be written from
+ * other threads, like a LoadGenerator.
+ */
+class Backend
+{
+public:
+    virtual ~Backend() = default;
+
+    /**
+     * @brief Get the current clipboard contents as plain text.
+     */
+    [[nodiscard]] virtual std::string getText() = 0;
+
+    /**
+     * @brief Replace the clipboard contents.
+     */
+    virtual void setText( const Utils::Payload& contents ) = 0;
+
+    /**
+     * @brief Block until the contents may have changed since the last getText(), the backend is
+     * woken, or the timeout passes.
+     *
+     * @details Backends that can't be notified of changes are polled, so by default this just
+     * sleeps for the timeout, unless it's woken.
+     */
+    virtual void waitForChange( std::chrono::milliseconds timeout )
+    {
+        std::unique_lock lock( m_wake_mutex );
+        m_woken.wait_for( lock, timeout, [this] { return m_wake; } );
+        m_wake = false;
+    }
+
+    /**
+     * @brief Return from the current, or next, waitForChange() early, so that the clipboard thread
+     * applies a remote item without waiting for the next poll. May be called from any thread.
+     */
+    virtual void wake()
+    {
+        {
+            const std::lock_guard lock( m_wake_mutex );
+            m_wake = true;
+        }
+        m_woken.notify_all();
+    }
+
+private:
+    std::mutex m_wake_mutex;
+    std::condition_variable m_woken;
+    bool m_wake = false;
+};
+
+/**
+ * @brief The X11 CLIPBOARD selection.
+ *
+ * @details X11 doesn't notify clients of clipboard changes without the XFixes extension, so the
+ * clipboard is polled.
+ */
+class X11Backend : public Backend
+{
+public:
+    [[nodiscard]] std::string getText() override;
+    void setText( const Utils::Payload& contents ) override;
+};
+
+//! @brief The prefix of a FileBackend's name, followed by the path of its file.
+constexpr std::string_view file_prefix = "file:";
+
+/**
+ * @brief Create the backend with the given name: `x11`, `memory`, or `file:<path>`.
+ *
+ * @return The new backend, or null if the name is unknown.
+ */
+std::shared_ptr<Backend> createBackend( std::string_view name );
+
+/**
+ * @brief Whether createBackend() knows the given name, without creating the backend.
+ */
+bool isBackend( std::string_view name );
+} // namespace Clipd::Clipboard
@@ -1,9 +1,17 @@
 #pragma once
+#include "clipboard/backend.h"
+#include "clipboard/item.h"
+#include "clipboard/sync_state.h"
 #include "common.h"
 #include "utils/daemon.h"
 #include "utils/delegate.h"
 #include "utils/functor.h"
+#include "utils/metrics.h"
+#include "utils/uuid.h"
 
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 
 namespace Clipd::Clipboard
@@ -11,20 +19,44 @@ namespace Clipd::Clipboard
 class ClipboardDaemon : public Utils::Daemon
 {
 public:
+    /**
+     * @brief Construct a new Clipboard Daemon object.
+     *
+     * @param origin The uuid stamped on the versions of items copied on this peer.
+     * @param backend The clipboard to synchronize.
+     */
+    explicit ClipboardDaemon( Utils::Uuid origin = Utils::Uuid::random(),
+                              std::shared_ptr<Backend> backend = std::make_shared<X11Backend>() );
+
     /**
      * @brief Register a callback to be called whenever a text update occurs.
      *
+     * @details The callbacks share a single, immutable, copy of the clipboard contents. Only
+     * local copies are reported; contents received from the network are never reported again.
+     *
      * @param callback The callback to call with any text updates.
      */
-    void registerOnTextUpdate( Utils::Functor<void( const std::string& )> callback );
+    void registerOnTextUpdate( Utils::Functor<void( const Item& )> callback );
 
-    //! @todo Think about how to handle conflicts and timing issues (What happens when two peers are
-    //! running on the same host?)
-    void receiveRemoteClipboardUpdate( const std::string& update );
+    /**
+     * @brief Set the local clipboard to a remote item, if it is newer than the current one.
+     *
+     * @details This may be called from any thread, and never blocks on the clipboard. The item is
+     * left for the clipboard thread, which sets the clipboard the next time it wakes. Only the
+     * latest item left is set, so a flood of remote items costs the clipboard one write per poll,
+     * however fast they arrive.
+     *
+     * Two clipd instances on the same host share the X11 clipboard. Whichever applies a
+     * remote item first changes the clipboard under the other, which then recognizes the
+     * contents as received from the network, rather than a new copy to broadcast.
+     *
+     * @see SyncState for the versioning rules.
+     */
+    void receiveRemoteClipboardUpdate( const Item& update );
 
 protected:
     /**
-     * @brief Get the current X11 clipboard contents as plaintext.
+     * @brief Get the current clipboard contents as plaintext from the backend.
      *
      * @details This method is defined, and is marked as virtual to allow a unit testing
      * framework to mock it, and provide their own values rather than querying the clipboard.
@@ -36,9 +68,34 @@ private:
      * @brief The clipboard listener event loop body.
      */
     void loop() override;
+    /**
+     * @brief Set the local clipboard to a remote item on the clipboard thread, if it is newer
+     * than the current one.
+     */
+    void apply( const Item& update );
 
 private:
-    size_t m_curr_text_hash = 0;
-    Utils::Delegate<void( const std::string& )> m_text_delegate;
+    //! How long to wait for the clipboard to change before polling it again.
+    static constexpr std::chrono::milliseconds poll_interval = std::chrono::milliseconds( 50 );
+
+    const std::shared_ptr<Backend> m_backend;
+    SyncState m_sync;
+    Utils::Delegate<void( const Item& )> m_text_delegate;
+    //! The latest remote item, waiting for the clipboard thread to apply it.
+    std::mutex m_mailbox_mutex;
+    std::optional<Item> m_mailbox;
+
+    Utils::Metrics::Counter& m_updates_captured =
+        Utils::Metrics::Registry::global().counter( "clipboard.updates_captured" );
+    Utils::Metrics::Counter& m_updates_applied =
+        Utils::Metrics::Registry::global().counter( "clipboard.updates_applied" );
+    Utils::Metrics::Counter& m_dedupe_hits =
+        Utils::Metrics::Registry::global().counter( "clipboard.dedupe_hits" );
+    //! Remote items replaced by a newer one before the clipboard thread applied them.
+    Utils::Metrics::Counter& m_mailbox_coalesced =
+        Utils::Metrics::Registry::global().counter( "clipboard.mailbox.coalesced" );
+    //! From receiving an item off the network, to setting the clipboard.
+    Utils::Metrics::Histogram& m_receive_to_set =
+        Utils::Metrics::Registry::global().histogram( "clipboard.receive_to_set_ns" );
 };
 } // namespace Clipd::Clipboard
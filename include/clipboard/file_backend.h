@@ -0,0 +1,53 @@
+#pragma once
+#include "clipboard/backend.h"
+#include "common.h"
+
+#include <sys/types.h>
+
+#include <ctime>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace Clipd::Clipboard
+{
+/**
+ * @brief A clipboard kept in a file.
+ *
+ * @details This lets a user reach a session hosted by a gateway, on a host without their X
+ * server: writing the file copies, and reading it pastes. Remote items are written in place, so
+ * the file keeps the owner and mode its user gave it. A missing file is created readable and
+ * writable only by the gateway's user.
+ *
+ * The file is polled, but only read again once its size or modification time changes.
+ */
+class FileBackend : public Backend
+{
+public:
+    explicit FileBackend( std::string path );
+
+    [[nodiscard]] std::string getText() override;
+    void setText( const Utils::Payload& contents ) override;
+
+private:
+    //! @brief Identifies a version of the file, without reading it.
+    struct Stamp
+    {
+        ino_t inode = 0;
+        off_t size = 0;
+        timespec modified = {};
+    };
+
+    //! @brief The file's current stamp, or nothing if it doesn't exist.
+    [[nodiscard]] std::optional<Stamp> stamp() const;
+
+    static bool same( const Stamp& lhs, const Stamp& rhs );
+
+private:
+    const std::string m_path;
+    std::mutex m_mutex;
+    //! The file's contents, as of m_stamp.
+    std::string m_contents;
+    Stamp m_stamp;
+};
+} // namespace Clipd::Clipboard
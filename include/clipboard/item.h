@@ -0,0 +1,23 @@
+#pragma once
+#include "clipboard/trace.h"
+#include "common.h"
+#include "utils/hlc.h"
+#include "utils/payload.h"
+
+#include <chrono>
+
+namespace Clipd::Clipboard
+{
+/**
+ * @brief A versioned snapshot of the clipboard contents.
+ */
+struct Item
+{
+    Utils::Version version; //!< When, and by which peer, the contents were copied.
+    Utils::Payload contents; //!< The plaintext clipboard contents.
+    //! When this node captured the item from its clipboard, or received it from the network.
+    //! This is local bookkeeping for the latency metrics, and is never sent.
+    std::chrono::steady_clock::time_point observed = {};
+    Trace trace = {}; //!< Where the time went, from the copy on the origin, until now.
+};
+} // namespace Clipd::Clipboard
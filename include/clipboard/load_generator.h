@@ -0,0 +1,81 @@
+#pragma once
+#include "clipboard/backend.h"
+#include "common.h"
+#include "utils/daemon.h"
+#include "utils/metrics.h"
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Clipd::Clipboard
+{
+/**
+ * @brief Writes synthetic contents to a clipboard Backend on a schedule, like a busy user.
+ *
+ * @details Run against a MemoryBackend, this stresses a whole clipd process, including its
+ * network and every peer it syncs with, without an X server. Contents are written in bursts of
+ * back to back copies, which exercise coalescing. Some of the writes can re-copy recent contents,
+ * which exercise deduplication.
+ */
+class LoadGenerator : public Utils::Daemon
+{
+public:
+    struct Config
+    {
+        double rate = 1.0;                //!< Bursts per second.
+        size_t burst = 1;                 //!< Writes per burst, made back to back.
+        std::vector<size_t> sizes = {64}; //!< Each write picks one of these sizes, in bytes.
+        double duplicates = 0.0;          //!< The fraction of writes that re-copy recent contents.
+        uint64_t count = 0;               //!< Stop after this many writes. Zero never stops.
+        std::optional<uint64_t> seed;     //!< Seed for reproducible contents.
+
+        /**
+         * @brief Parse a comma separated list of `key=value` pairs, like
+         * `rate=20,burst=5,sizes=64:4096:1048576,duplicates=0.1,count=1000,seed=1`.
+         *
+         * @details Lists of sizes are colon separated. Omitted keys keep their defaults.
+         *
+         * @return The parsed configuration, or nothing if the specification is invalid.
+         */
+        static std::optional<Config> parse( std::string_view spec );
+    };
+
+    LoadGenerator( const Config& config, std::shared_ptr<Backend> backend );
+
+    /**
+     * @brief Generate the contents of the next write.
+     */
+    std::string next();
+
+protected:
+    void setup() override;
+    void loop() override;
+
+private:
+    //! How many recent contents duplicates are picked from.
+    static constexpr size_t history_size = 16;
+
+    const Config m_config;
+    const std::shared_ptr<Backend> m_backend;
+    std::mt19937_64 m_random;
+    //! Random words that generated contents are cut from.
+    std::string m_text;
+    std::deque<std::string> m_history;
+    uint64_t m_generated = 0;
+    uint64_t m_written = 0;
+    std::chrono::steady_clock::time_point m_next_burst;
+
+    Utils::Metrics::Counter& m_writes =
+        Utils::Metrics::Registry::global().counter( "loadgen.writes" );
+    Utils::Metrics::Counter& m_duplicates =
+        Utils::Metrics::Registry::global().counter( "loadgen.duplicates" );
+    Utils::Metrics::Counter& m_bytes =
+        Utils::Metrics::Registry::global().counter( "loadgen.bytes" );
+};
+} // namespace Clipd::Clipboard
@@ -0,0 +1,42 @@
+#pragma once
+#include "clipboard/backend.h"
+#include "common.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+namespace Clipd::Clipboard
+{
+/**
+ * @brief A clipboard that only exists in memory.
+ *
+ * @details This lets whole clipd processes run on machines without an X server, like CI boxes
+ * and containers, with their clipboard driven by a LoadGenerator. Unlike X11, changes wake the
+ * clipboard thread immediately, so every write is observed, however fast they are made.
+ */
+class MemoryBackend : public Backend
+{
+public:
+    [[nodiscard]] std::string getText() override;
+    void setText( const Utils::Payload& contents ) override;
+    void waitForChange( std::chrono::milliseconds timeout ) override;
+    void wake() override;
+
+    /**
+     * @brief Replace the clipboard contents, like a local copy.
+     */
+    void setText( std::string contents );
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::string m_contents;
+    //! Incremented by every write.
+    uint64_t m_generation = 0;
+    //! The generation last returned by getText().
+    uint64_t m_read_generation = 0;
+    //! Whether wake() was called since the last waitForChange() returned.
+    bool m_woken = false;
+};
+} // namespace Clipd::Clipboard
@@ -0,0 +1,104 @@
+#pragma once
+#include "clipboard/item.h"
+#include "common.h"
+#include "utils/hlc.h"
+#include "utils/uuid.h"
+
+#include <array>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace Clipd::Clipboard
+{
+/**
+ * @brief Decides which clipboard changes are broadcast, and which remote items are applied.
+ *
+ * @details Every clipboard item is stamped with a Utils::Version made of a hybrid logical clock
+ * timestamp and the uuid of the peer that copied it. Peers converge on the item with the largest
+ * version, and echoes are suppressed with two rules.
+ *
+ * 1. A remote item is only applied if its version is strictly newer than the current one.
+ * 2. A local clipboard change is only broadcast if its contents weren't recently received from the
+ *    network. This covers both reading back our own clipboard after applying a remote item, and a
+ *    second, lagging, clipd instance on the same host applying a stale item to the shared X11
+ *    clipboard. The window is short, so deliberately copying something that was received a while
+ *    ago is still broadcast.
+ *
+ * The contents found on the clipboard at startup are versioned with a zero timestamp, so that a
+ * peer joining a session adopts the session's current item, rather than overwriting it.
+ *
+ * This class holds no clipboard or network state of its own, so the convergence of many peers
+ * can be tested without an X server or sockets. It is safe to call observeLocal() on the clipboard
+ * thread and receiveRemote() on the network thread.
+ */
+class SyncState
+{
+public:
+    /**
+     * @param origin The uuid stamped on items copied on this peer.
+     * @param physical The physical clock used by the hybrid logical clock.
+     */
+    explicit SyncState(
+        Utils::Uuid origin,
+        Utils::HybridLogicalClock::PhysicalClock physical =
+            &Utils::HybridLogicalClock::wallClockMillis );
+
+    /**
+     * @brief Observe the current contents of the local clipboard.
+     *
+     * @param contents The local clipboard contents.
+     * @return A newly versioned item to broadcast, if the contents are a new local copy.
+     */
+    std::optional<Item> observeLocal( std::string&& contents );
+
+    /**
+     * @brief Receive an item from a remote peer.
+     *
+     * @param item The received item.
+     * @return Whether the local clipboard needs to be set to the item's contents.
+     */
+    bool receiveRemote( const Item& item );
+
+    /**
+     * @brief The version of the item currently on the clipboard.
+     */
+    [[nodiscard]] Utils::Version current() const;
+
+    /**
+     * @brief The uuid stamped on items copied on this peer.
+     */
+    [[nodiscard]] const Utils::Uuid& origin() const noexcept
+    {
+        return m_origin;
+    }
+
+private:
+    [[nodiscard]] bool receivedFromNetwork( uint64_t digest ) const;
+
+private:
+    //! How many recently received digests to remember for echo suppression.
+    static constexpr size_t num_remote_digests = 16;
+    //! How long a received digest suppresses local broadcasts of the same contents.
+    static constexpr uint64_t echo_window_ms = 2000;
+
+    struct RemoteDigest
+    {
+        uint64_t digest = 0;
+        uint64_t received_ms = 0;
+    };
+
+    const Utils::Uuid m_origin;
+    const Utils::HybridLogicalClock::PhysicalClock m_physical;
+    Utils::HybridLogicalClock m_clock;
+
+    mutable std::mutex m_mutex;
+    Utils::Version m_current;
+    uint64_t m_current_digest = 0;
+    bool m_has_current = false;
+
+    //! A small ring of digests of contents recently received from the network.
+    std::array<RemoteDigest, num_remote_digests> m_remote_digests {};
+    size_t m_next_remote_digest = 0;
+};
+} // namespace Clipd::Clipboard
@@ -0,0 +1,119 @@
+#pragma once
+#include "common.h"
+#include "utils/metrics.h"
+#include "utils/uuid.h"
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+
+namespace Clipd::Clipboard
+{
+struct Item;
+
+/**
+ * @brief The timings of a clipboard item, from being copied on its origin, to being received.
+ *
+ * @details The origin's timings are in the origin's wall clock, and are sent with the item. The
+ * receiver fills in the rest, including its estimate of the offset between the two clocks, so
+ * that the whole copy to paste-ready path can be laid out on the receiver's clock.
+ */
+struct Trace
+{
+    //! @name Measured by the origin, and sent with the item.
+    //! @{
+    uint64_t captured_us = 0; //!< When the clipboard read started. Zero if the item isn't traced.
+    uint32_t read_us = 0;     //!< How long reading the X11 clipboard took.
+    uint32_t hash_us = 0;     //!< How long hashing and versioning the contents took.
+    uint64_t sent_us = 0;     //!< When the item was handed to Zyre.
+    //! @}
+
+    //! @name Measured by the receiver.
+    //! @{
+    std::optional<int64_t> offset_us; //!< The receiver's clock minus the origin's clock.
+    uint64_t received_us = 0;         //!< When the item was received.
+    uint32_t decode_us = 0;           //!< How long decoding the item took.
+    //! @}
+
+    //! @brief The wall clock, in microseconds since the epoch, that traces are measured with.
+    static uint64_t wallClockMicros()
+    {
+        using namespace std::chrono;
+        return static_cast<uint64_t>(
+            duration_cast<microseconds>( system_clock::now().time_since_epoch() ).count() );
+    }
+};
+
+/**
+ * @brief Collects the traces of the items received from remote peers.
+ *
+ * @details Every completed trace is broken into its stages: the X11 read, hashing, queueing
+ * (including coalescing) on the origin, transit from the origin's send to our receive, decoding,
+ * and `clip::set_text()`. Each stage, and the end to end latency, is recorded to a `trace.*_ns`
+ * latency histogram in the metrics registry, and a sample of the traces is kept to be exported
+ * in the Chrome trace event format, which can be loaded in `chrome://tracing` or Perfetto.
+ */
+class Tracer
+{
+public:
+    /**
+     * @param capacity The number of sampled traces to keep.
+     * @param sample_every Keep one in this many traces.
+     * @param registry The registry to record the stage histograms to.
+     */
+    explicit Tracer( size_t capacity = 256, size_t sample_every = 1,
+                     Utils::Metrics::Registry& registry = Utils::Metrics::Registry::global() );
+
+    //! @brief The tracer the clipd daemons record to.
+    static Tracer& global();
+
+    /**
+     * @brief Complete the trace of an item that has been set on the local clipboard.
+     *
+     * @param item The item, with its trace filled in by the origin and the network.
+     * @param set_text_us How long setting the clipboard took.
+     * @param applied_us When the clipboard had been set, on the local wall clock.
+     */
+    void complete( const Item& item, uint32_t set_text_us, uint64_t applied_us );
+
+    /**
+     * @brief Write the sampled traces in the Chrome trace event JSON format.
+     */
+    void writeChromeTrace( std::ostream& o ) const;
+
+private:
+    //! @brief A completed trace, laid out on the local clock.
+    struct Sample
+    {
+        Utils::Uuid origin;
+        uint64_t version;
+        uint64_t size;
+        bool offset_known;
+        uint64_t captured_us;
+        uint64_t read_us;
+        uint64_t hash_us;
+        uint64_t queue_us;
+        uint64_t transit_us;
+        uint64_t decode_us;
+        uint64_t set_text_us;
+    };
+
+    const size_t m_capacity;
+    const size_t m_sample_every;
+    size_t m_completed = 0;
+
+    mutable std::mutex m_mutex;
+    std::deque<Sample> m_samples;
+
+    Utils::Metrics::Histogram& m_read;
+    Utils::Metrics::Histogram& m_hash;
+    Utils::Metrics::Histogram& m_queue;
+    Utils::Metrics::Histogram& m_transit;
+    Utils::Metrics::Histogram& m_decode;
+    Utils::Metrics::Histogram& m_set_text;
+    Utils::Metrics::Histogram& m_end_to_end;
+};
+} // namespace Clipd::Clipboard
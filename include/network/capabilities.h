@@ -0,0 +1,80 @@
+#pragma once
+#include "common.h"
+#include "network/codec.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Clipd::Network
+{
+/**
+ * @brief What a peer has advertised it supports.
+ *
+ * @details Each node advertises its capabilities as Zyre headers, which every other node receives
+ * in the peer's ENTER event. Peers that don't advertise anything are legacy peers, which only
+ * understand clipboard contents shouted as a single plain text frame.
+ *
+ * | Header               | Example                    |
+ * |----------------------|----------------------------|
+ * | X-CLIPD-PROTOCOL     | `1`                        |
+ * | X-CLIPD-CODECS       | `raw,deflate`              |
+ * | X-CLIPD-MAX-PAYLOAD  | `16777216`                 |
+ * | X-CLIPD-CHUNKING     | `1`                        |
+ * | X-CLIPD-LAZY-PULL    | `1`                        |
+ * | X-CLIPD-FANOUT       | `1`                        |
+ * | X-CLIPD-MULTICAST    | `1`                        |
+ * | X-CLIPD-TIMING       | `1`                        |
+ * | X-CLIPD-FORMATS      | `text/plain;charset=utf-8` |
+ *
+ * Unknown headers, codecs, and formats are ignored, so newer nodes can advertise more without
+ * breaking older ones.
+ */
+struct Capabilities
+{
+    //! The clipd protocol version the peer speaks, or zero for legacy peers.
+    uint8_t protocol = 0;
+    //! A bitmask of `1 << Codec` the peer can decode.
+    uint32_t codecs = 1U << static_cast<unsigned>( Codec::Raw );
+    //! The largest item contents, in bytes, the peer accepts, or zero if it accepts any.
+    uint64_t max_payload = 0;
+    //! Whether the peer can reassemble items sent in chunks.
+    bool chunking = false;
+    //! Whether the peer will PULL the contents of an item it has only been sent the digest of.
+    bool lazy_pull = false;
+    //! Whether the peer forwards items sent down a FanoutTree to its children.
+    bool fanout = false;
+    //! Whether the peer receives its sessions' datagrams. @see Protocol::Datagram
+    bool multicast = false;
+    //! Whether the peer reads a Timing frame after a message's body. @see Protocol::Timing
+    bool timing = false;
+    //! The clipboard formats the peer understands, as MIME types.
+    std::vector<std::string> formats;
+
+    [[nodiscard]] bool supports( Codec codec ) const noexcept
+    {
+        return codecs & ( 1U << static_cast<unsigned>( codec ) );
+    }
+
+    //! @brief Whether the peer accepts items this large. Peers without a limit accept any.
+    [[nodiscard]] bool accepts( uint64_t size ) const noexcept
+    {
+        return max_payload == 0 || size <= max_payload;
+    }
+
+    /**
+     * @brief The capabilities of this build of clipd, which accepts items of any size.
+     */
+    static Capabilities local();
+
+    /**
+     * @brief Parse the capabilities advertised in a peer's ENTER headers.
+     */
+    static Capabilities fromHeaders( const std::map<std::string, std::string>& headers );
+
+    /**
+     * @brief Format the capabilities as Zyre headers.
+     */
+    [[nodiscard]] std::map<std::string, std::string> toHeaders() const;
+};
+} // namespace Clipd::Network
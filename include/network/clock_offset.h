@@ -0,0 +1,59 @@
+#pragma once
+#include "common.h"
+
+#include <chrono>
+#include <optional>
+
+namespace Clipd::Network
+{
+/**
+ * @brief Estimates the offset between our wall clock and a peer's, from the messages we exchange.
+ *
+ * @details Every clipd message carries its sender's wall clock time of sending. The delay we
+ * measure for a message from the peer is its one-way network delay, plus the offset between the
+ * two clocks. The peer measures the same for our messages, with the offset the other way around,
+ * and reports the smallest delay it has measured back to us. Assuming the fastest messages took as
+ * long in both directions, the offset is half the difference between the two smallest delays.
+ *
+ * The minimums are taken over a sliding window, so the estimate follows the clocks as they drift.
+ */
+class ClockOffset
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    //! The smallest delays are taken over one to two of these windows.
+    static constexpr Clock::duration window = std::chrono::minutes( 1 );
+
+    /**
+     * @brief A message from the peer took the given delay to arrive, as measured by our clock.
+     */
+    void sample( int64_t delay_us, Clock::time_point now );
+
+    /**
+     * @brief The peer measured the given smallest delay for our messages, by its clock.
+     */
+    void report( int64_t delay_us )
+    {
+        m_reported = delay_us;
+    }
+
+    /**
+     * @brief The smallest delay we've measured for the peer's messages recently, to report back.
+     */
+    [[nodiscard]] std::optional<int64_t> delay() const;
+
+    /**
+     * @brief Our clock minus the peer's clock, in microseconds.
+     *
+     * @return The estimate, or nothing if we haven't exchanged messages in both directions yet.
+     */
+    [[nodiscard]] std::optional<int64_t> offset() const;
+
+private:
+    Clock::time_point m_window_start;
+    std::optional<int64_t> m_current;
+    std::optional<int64_t> m_previous;
+    std::optional<int64_t> m_reported;
+};
+} // namespace Clipd::Network
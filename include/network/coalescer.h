@@ -0,0 +1,89 @@
+#pragma once
+#include "clipboard/item.h"
+#include "common.h"
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+
+namespace Clipd::Network
+{
+/**
+ * @brief Coalesces rapid clipboard updates so that only the latest one is broadcast.
+ *
+ * @details Some applications rewrite the clipboard many times per second. Broadcasting every
+ * intermediate value to the whole session wastes bandwidth, and makes every remote peer set its
+ * clipboard just as often.
+ *
+ * The first update after a quiet period is released immediately, so a single interactive copy sees
+ * no added latency. Updates arriving within the debounce window after that are held back, and each
+ * one replaces the previously held update (latest-wins). The held update is released once no new
+ * update has arrived for the debounce window, or once it has been held for the maximum delay,
+ * whichever comes first.
+ *
+ * The Coalescer does not own a thread or a clock. The network thread offers updates to it, polls
+ * it whenever its deadline() passes, and sends whatever it releases.
+ */
+class Coalescer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config
+    {
+        //! Updates closer together than this are coalesced. Zero disables coalescing.
+        std::chrono::milliseconds debounce = std::chrono::milliseconds( 100 );
+        //! The longest a coalesced update may be held back before it is released.
+        std::chrono::milliseconds max_delay = std::chrono::milliseconds( 500 );
+    };
+
+    struct Stats
+    {
+        std::atomic<uint64_t> offered = 0; //!< Updates offered to the coalescer.
+        std::atomic<uint64_t> released = 0; //!< Updates released to be sent.
+        std::atomic<uint64_t> dropped = 0; //!< Held updates replaced by a newer one.
+    };
+
+    Coalescer() = default;
+    explicit Coalescer( const Config& config ) : m_config( config ) {}
+
+    /**
+     * @brief Offer a new update.
+     *
+     * @param update The new clipboard item.
+     * @param now The current time.
+     * @return The update to send immediately, if it shouldn't be held back.
+     */
+    std::optional<Clipboard::Item> offer( Clipboard::Item update, Clock::time_point now );
+
+    /**
+     * @brief Release the held update, if its deadline has passed.
+     *
+     * @param now The current time.
+     * @return The update to send, if one is due.
+     */
+    std::optional<Clipboard::Item> poll( Clock::time_point now );
+
+    /**
+     * @brief The time at which the held update will be due, if there is one.
+     */
+    [[nodiscard]] std::optional<Clock::time_point> deadline() const;
+
+    [[nodiscard]] const Stats& stats() const noexcept
+    {
+        return m_stats;
+    }
+
+private:
+    Clipboard::Item release( Clipboard::Item update, Clock::time_point now );
+
+private:
+    Config m_config;
+    Stats m_stats;
+
+    std::optional<Clipboard::Item> m_pending;
+    Clock::time_point m_first_pending;
+    Clock::time_point m_last_offer;
+    std::optional<Clock::time_point> m_last_release;
+};
+} // namespace Clipd::Network
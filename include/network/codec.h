@@ -0,0 +1,45 @@
+#pragma once
+#include "common.h"
+#include "utils/payload.h"
+
+#include <optional>
+#include <string_view>
+
+namespace Clipd::Network
+{
+/**
+ * @brief The encodings a clipboard item's contents may be sent with.
+ *
+ * @details The values are carried on the wire, and advertised as a bitmask of `1 << codec`.
+ */
+enum class Codec : uint8_t
+{
+    Raw = 0,     //!< The contents, as is.
+    Deflate = 1, //!< The contents, compressed with zlib.
+};
+
+//! @brief The name a codec is advertised with.
+std::string_view codecName( Codec codec );
+
+//! @brief Parse an advertised codec name.
+std::optional<Codec> parseCodec( std::string_view name );
+
+/**
+ * @brief Encode the given contents.
+ *
+ * @return The encoded contents, or nothing if encoding wouldn't make them smaller. Raw encoding
+ * returns the contents themselves, without copying.
+ */
+std::optional<Utils::Payload> encode( Codec codec, const Utils::Payload& contents );
+
+/**
+ * @brief Decode the given contents.
+ *
+ * @param codec The codec the contents were encoded with.
+ * @param encoded The encoded contents.
+ * @param size The size of the decoded contents.
+ * @return The decoded contents, or nothing if they couldn't be decoded, or the size is more than
+ * the codec could have encoded into them.
+ */
+std::optional<Utils::Payload> decode( Codec codec, const Utils::Payload& encoded, uint64_t size );
+} // namespace Clipd::Network
@@ -0,0 +1,106 @@
+#pragma once
+#include "clipboard/item.h"
+#include "common.h"
+#include "utils/event_fd.h"
+#include "utils/mpsc_queue.h"
+#include "utils/probes.h"
+
+#include <atomic>
+#include <string>
+
+namespace Clipd::Network
+{
+/**
+ * @brief An outbound operation to be performed by the network thread.
+ */
+struct Command
+{
+    enum class Type
+    {
+        Shout,   //!< Broadcast the item to the target group.
+        Whisper, //!< Send the item to the target peer.
+    };
+
+    Type type;
+    std::string target; //!< The group or peer uuid, depending on the command type.
+    Clipboard::Item item;
+};
+
+/**
+ * @brief Posts Commands from any thread to the thread that owns the Zyre node.
+ *
+ * @details ZeroMQ sockets must not be shared between threads, so every outbound operation is
+ * queued here and performed by the network thread. Posting never blocks: it is a lock-free push,
+ * plus an eventfd write if the network thread hasn't already been woken.
+ *
+ * The network thread polls fd() alongside the Zyre socket, and drains the whole queue each time it
+ * wakes, so that bursts of commands are handled in a single batch.
+ */
+class CommandQueue
+{
+public:
+    /**
+     * @brief Queue the given command for the network thread. Safe to call from any thread.
+     */
+    void post( Command command )
+    {
+        CLIPD_PROBE2( network_enqueue, command.item.version.timestamp,
+                      command.item.contents.size() );
+        m_queue.push( std::move( command ) );
+        // Pairs with the fence in drain(), so that either drain() sees the command, or we see the
+        // flag it cleared, and notify again.
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        // Only the first post after a drain needs to pay for the syscall.
+        if( !m_wake_pending.exchange( true, std::memory_order_acq_rel ) )
+        {
+            m_wakeup.notify();
+        }
+    }
+
+    /**
+     * @brief Wake the network thread without posting a command.
+     */
+    void wake()
+    {
+        m_wakeup.notify();
+    }
+
+    /**
+     * @brief Pop and handle every queued command. Must only be called from the network thread.
+     *
+     * @param handler Called with each command, in the order they were posted.
+     * @return The number of commands handled.
+     */
+    template <typename Handler>
+    size_t drain( Handler&& handler )
+    {
+        m_wakeup.drain();
+        m_wake_pending.store( false, std::memory_order_release );
+        // Without the fence, the pops below could be reordered before the store, and miss a command
+        // whose post() still saw the flag set, and didn't notify. With it, and the fence in post(),
+        // any command the pops miss is posted after the flag is cleared, and notifies again.
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        size_t handled = 0;
+        while( auto command = m_queue.pop() )
+        {
+            CLIPD_PROBE2( network_dequeue, command->item.version.timestamp,
+                          command->item.contents.size() );
+            handler( *command );
+            ++handled;
+        }
+        return handled;
+    }
+
+    //! @brief The file descriptor that becomes readable when commands have been posted.
+    [[nodiscard]] int fd() const noexcept
+    {
+        return m_wakeup.fd();
+    }
+
+private:
+    Utils::MpscQueue<Command> m_queue;
+    Utils::EventFd m_wakeup;
+    std::atomic<bool> m_wake_pending = false;
+};
+} // namespace Clipd::Network
@@ -0,0 +1,77 @@
+#pragma once
+#include "common.h"
+#include "utils/uuid.h"
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+namespace Clipd::Network
+{
+/**
+ * @brief A k-ary spanning tree over the members of a session, rooted at the origin of an item.
+ *
+ * @details Shouting to a session sends a separate copy to every member, so the origin's uplink
+ * carries the item once per peer. Sending it down a tree instead has the origin send it to its
+ * `degree` children, each of which forwards it to its own children, so no node sends more than
+ * `degree` copies, and the item reaches every member in about log<sub>degree</sub>(N) hops.
+ *
+ * Every node builds the tree from its own view of the session: the members are sorted by uuid,
+ * rotated to start at the root, and laid out like a binary heap, so that the node at position `i`
+ * has the children at positions `degree * i + 1` through `degree * i + degree`. Nodes that agree
+ * on the membership agree on the tree, without ever exchanging it. Nodes that briefly disagree,
+ * like while a peer is joining, may leave a subtree out, which repairs itself by pulling the item.
+ *
+ * @see PeerDiscoveryDaemon for how items are sent down the tree.
+ */
+class FanoutTree
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config
+    {
+        //! How many peers each node forwards an item to. Zero shouts every item instead.
+        size_t degree = 0;
+        //! Smaller items are shouted, since they don't load the origin's uplink.
+        size_t threshold = 64 * 1024;
+        //! How long a node waits for an announced item, per hop from the root, before pulling it.
+        std::chrono::milliseconds repair = std::chrono::milliseconds( 250 );
+    };
+
+    /**
+     * @brief Build the tree over the given members.
+     *
+     * @param members The session's members. The root is added if it's missing, and duplicates
+     * are ignored.
+     * @param root The node the tree is rooted at, usually the item's origin.
+     * @param degree The most children each node has. Zero is treated as one.
+     */
+    FanoutTree( std::vector<Utils::Uuid> members, const Utils::Uuid& root, size_t degree );
+
+    /**
+     * @brief The nodes the given node forwards items to, or none if it isn't in the tree.
+     */
+    [[nodiscard]] std::vector<Utils::Uuid> children( const Utils::Uuid& node ) const;
+
+    /**
+     * @brief The number of hops from the root to the given node, if it's in the tree.
+     */
+    [[nodiscard]] std::optional<size_t> depth( const Utils::Uuid& node ) const;
+
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return m_members.size();
+    }
+
+private:
+    //! @brief The given node's position in the tree, with the root at zero.
+    [[nodiscard]] std::optional<size_t> position( const Utils::Uuid& node ) const;
+
+    //! The members, sorted by uuid.
+    std::vector<Utils::Uuid> m_members;
+    //! The index of the root in m_members.
+    size_t m_root = 0;
+    size_t m_degree;
+};
+} // namespace Clipd::Network
@@ -0,0 +1,134 @@
+#pragma once
+#include "common.h"
+#include "network/command_queue.h"
+#include "network/protocol.h"
+#include "network/transport.h"
+#include "utils/payload.h"
+
+#include <array>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Clipd::Network
+{
+/**
+ * @brief The classes of outbound clipd messages, in priority order.
+ */
+enum class Lane : uint8_t
+{
+    Control = 0,     //!< Digests, pulls, and other messages without contents.
+    Interactive = 1, //!< Items small enough to send in one message.
+    Bulk = 2,        //!< The chunks of large items.
+};
+
+//! @brief The name a lane's metrics are labelled with.
+std::string_view laneName( Lane lane );
+
+/**
+ * @brief A clipd message waiting in a Lane to be sent.
+ */
+struct Outgoing
+{
+    Command::Type type = Command::Type::Shout;
+    std::string target;  //!< The group or peer uuid, depending on the type.
+    std::string session; //!< The hosted session the message is about.
+    //! The message, without the Timing frame, which is added when it's sent.
+    std::vector<Utils::Payload> frames;
+    //! The origin's trace of the item, if the message carries one of ours. The rest of the Timing
+    //! frame is filled in when it's sent.
+    Protocol::Timing timing;
+    //! The bytes the message costs the sender's uplink, counting every copy of a shout.
+    uint64_t cost = 0;
+    Transport::Clock::time_point queued;
+    Lane lane = Lane::Control; //!< The lane it was queued in.
+};
+
+/**
+ * @brief Schedules outbound messages so that a large transfer doesn't hold up the small messages
+ * sent after it.
+ *
+ * @details Zyre sends everything to a peer over one TCP connection, in order, so a message handed
+ * to it waits for every message handed to it before. Rather than handing a large item over all at
+ * once, the daemon splits it into chunks, and queues messages in three lanes. The Control lane has
+ * strict priority. The Interactive and Bulk lanes share what's left by deficit round robin, in
+ * proportion to their weights, so bulk transfers still make progress behind a stream of small
+ * items.
+ *
+ * Reordering only helps if messages wait here, rather than in the transport's buffers. So the
+ * interactive and bulk lanes can be paced to the sender's uplink, by a token bucket, and only a
+ * few milliseconds of them are handed to the transport ahead of the wire. Control messages are
+ * never held back, but they use up tokens too.
+ *
+ * The scheduler doesn't own a clock, or a thread. The network thread pushes messages, pops them
+ * whenever it wakes, and sleeps until wait() says the next can be sent.
+ */
+class LaneScheduler
+{
+public:
+    using Clock = Transport::Clock;
+
+    struct Config
+    {
+        //! Items whose encoded body is at least this large are bulk, sent in chunks this large.
+        size_t chunk = 64 * 1024;
+        //! The sender's uplink, in bytes per second. Zero doesn't pace the lanes at all, so
+        //! every message is handed to the transport at once, and the lanes don't reorder any.
+        double rate = 0;
+        //! The share of the uplink the interactive lane gets when both lanes are busy.
+        size_t interactive_weight = 4;
+        //! The share of the uplink the bulk lane gets when both lanes are busy.
+        size_t bulk_weight = 1;
+    };
+
+    LaneScheduler() = default;
+    explicit LaneScheduler( const Config& config ) : m_config( config ) {}
+
+    [[nodiscard]] const Config& config() const noexcept
+    {
+        return m_config;
+    }
+
+    /**
+     * @brief Queue a message to be sent after the messages already in its lane.
+     */
+    void push( Lane lane, Outgoing message );
+
+    /**
+     * @brief The next message to send, if one may be sent yet.
+     */
+    std::optional<Outgoing> pop( Clock::time_point now );
+
+    /**
+     * @brief How long until pop() returns a message, if any are queued.
+     */
+    [[nodiscard]] std::optional<Clock::duration> wait( Clock::time_point now ) const;
+
+    //! @brief The messages queued in the given lane.
+    [[nodiscard]] size_t queued( Lane lane ) const noexcept
+    {
+        return m_lanes[static_cast<size_t>( lane )].messages.size();
+    }
+
+private:
+    struct Queue
+    {
+        std::deque<Outgoing> messages;
+        //! The bytes the lane may send before its turn passes, in deficit round robin.
+        uint64_t deficit = 0;
+    };
+
+    //! @brief The tokens the bucket holds at the given time.
+    [[nodiscard]] double tokens( Clock::time_point now ) const;
+    Outgoing take( Queue& queue, Clock::time_point now );
+
+    Config m_config;
+    std::array<Queue, 3> m_lanes;
+    //! The weighted lane whose turn it is.
+    Lane m_turn = Lane::Interactive;
+    double m_tokens = 0;
+    Clock::time_point m_refilled;
+};
+} // namespace Clipd::Network
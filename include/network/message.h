@@ -1,9 +1,13 @@
 #pragma once
+#include "utils/payload.h"
+
 #include <zyre.h>
 
 #include <iostream>
+#include <map>
 #include <string>
 #include <variant>
+#include <vector>
 
 namespace Clipd::Network::Messages
 {
@@ -19,19 +23,73 @@ enum class MessageType
     Unknown, //!< Something else has happend?!
 };
 
+//! @brief Convert a zframe_t to a string.
+inline std::string parseFrameStr( zframe_t* frame )
+{
+    return std::string( reinterpret_cast<char*>( zframe_data( frame ) ), zframe_size( frame ) );
+}
+
+/**
+ * @brief Pop the next frame from the message as a string.
+ *
+ * @details Unlike zmsg_popstr(), which returns a copy the caller has to zstr_free(), the frame's
+ * contents are copied straight into the string, and the frame destroyed.
+ *
+ * @return The frame's contents, or an empty string if the message has no frames left.
+ */
+inline std::string popString( zmsg_t* msg )
+{
+    zframe_t* frame = zmsg_pop( msg );
+    if( !frame )
+    {
+        return {};
+    }
+    std::string str = parseFrameStr( frame );
+    zframe_destroy( &frame );
+    return str;
+}
+
+/**
+ * @brief Unpack the headers a peer set with zyre_set_header() from an ENTER frame.
+ *
+ * @param frame The packed zhash_t frame. Ownership is taken.
+ */
+inline std::map<std::string, std::string> parseHeaders( zframe_t* frame )
+{
+    std::map<std::string, std::string> headers;
+    if( !frame )
+    {
+        return headers;
+    }
+
+    zhash_t* hash = zhash_unpack( frame );
+    zframe_destroy( &frame );
+    if( !hash )
+    {
+        return headers;
+    }
+    for( auto* value = static_cast<const char*>( zhash_first( hash ) ); value;
+         value = static_cast<const char*>( zhash_next( hash ) ) )
+    {
+        headers.emplace( zhash_cursor( hash ), value );
+    }
+    zhash_destroy( &hash );
+    return headers;
+}
+
 struct Enter
 {
     std::string uuid;
     std::string name;
-    std::string headers;
+    std::map<std::string, std::string> headers;
     std::string address;
 
     Enter( zmsg_t* msg )
     {
-        uuid = std::string( zmsg_popstr( msg ) );
-        name = std::string( zmsg_popstr( msg ) );
-        headers = std::string( zmsg_popstr( msg ) );
-        address = std::string( zmsg_popstr( msg ) );
+        uuid = popString( msg );
+        name = popString( msg );
+        headers = parseHeaders( zmsg_pop( msg ) );
+        address = popString( msg );
     }
 };
 
@@ -42,8 +100,8 @@ struct Exit
 
     Exit( zmsg_t* msg )
     {
-        uuid = std::string( zmsg_popstr( msg ) );
-        name = std::string( zmsg_popstr( msg ) );
+        uuid = popString( msg );
+        name = popString( msg );
     }
 };
 
@@ -54,8 +112,8 @@ struct Evasive
 
     Evasive( zmsg_t* msg )
     {
-        uuid = std::string( zmsg_popstr( msg ) );
-        name = std::string( zmsg_popstr( msg ) );
+        uuid = popString( msg );
+        name = popString( msg );
     }
 };
 
@@ -67,9 +125,9 @@ struct Join
 
     Join( zmsg_t* msg )
     {
-        uuid = std::string( zmsg_popstr( msg ) );
-        name = std::string( zmsg_popstr( msg ) );
-        groupname = std::string( zmsg_popstr( msg ) );
+        uuid = popString( msg );
+        name = popString( msg );
+        groupname = popString( msg );
     }
 };
 
@@ -81,23 +139,91 @@ struct Leave
 
     Leave( zmsg_t* msg )
     {
-        uuid = std::string( zmsg_popstr( msg ) );
-        name = std::string( zmsg_popstr( msg ) );
-        groupname = std::string( zmsg_popstr( msg ) );
+        uuid = popString( msg );
+        name = popString( msg );
+        groupname = popString( msg );
     }
 };
 
+/**
+ * @brief Take ownership of the given frame, and wrap its contents in a Payload without copying.
+ *
+ * @param frame The frame to wrap. May be null, in which case an empty Payload is returned.
+ */
+inline Utils::Payload wrapFrame( zframe_t* frame )
+{
+    if( !frame )
+    {
+        return Utils::Payload();
+    }
+
+    const auto* data = reinterpret_cast<const char*>( zframe_data( frame ) );
+    const size_t size = zframe_size( frame );
+    return Utils::Payload( data, size, std::shared_ptr<const void>( frame, []( zframe_t* f ) {
+                               zframe_destroy( &f );
+                           } ) );
+}
+
+//! @brief The zframe_frommem() release callback. Drops the frame's reference to the Payload.
+inline void releasePayload( void** hint )
+{
+    delete static_cast<Utils::Payload*>( *hint );
+    *hint = nullptr;
+}
+
+/**
+ * @brief Create a frame referencing the given Payload without copying its contents.
+ *
+ * @details The frame holds a reference to the Payload's buffer until CZMQ calls the release
+ * callback, which may happen on a libzmq I/O thread.
+ */
+inline zframe_t* toFrame( const Utils::Payload& payload )
+{
+    auto* hint = new Utils::Payload( payload );
+    // The buffer is never written through, despite the zframe_frommem() signature.
+    return zframe_frommem( const_cast<char*>( hint->data() ), hint->size(), // NOLINT
+                           releasePayload, hint );
+}
+
+/**
+ * @brief Take ownership of every remaining frame in the message, without copying their contents.
+ */
+inline std::vector<Utils::Payload> wrapFrames( zmsg_t* msg )
+{
+    std::vector<Utils::Payload> frames;
+    frames.reserve( zmsg_size( msg ) );
+    while( zframe_t* frame = zmsg_pop( msg ) )
+    {
+        frames.push_back( wrapFrame( frame ) );
+    }
+    return frames;
+}
+
+/**
+ * @brief Create a message referencing the given frames without copying their contents.
+ */
+inline zmsg_t* toMessage( const std::vector<Utils::Payload>& frames )
+{
+    zmsg_t* msg = zmsg_new();
+    for( const auto& payload : frames )
+    {
+        zframe_t* frame = toFrame( payload );
+        zmsg_append( msg, &frame );
+    }
+    return msg;
+}
+
 struct Whisper
 {
     std::string uuid;
     std::string name;
-    std::string message;
+    std::vector<Utils::Payload> frames; //!< The message content frames.
 
     Whisper( zmsg_t* msg )
     {
-        uuid = std::string( zmsg_popstr( msg ) );
-        name = std::string( zmsg_popstr( msg ) );
-        message = std::string( zmsg_popstr( msg ) );
+        uuid = popString( msg );
+        name = popString( msg );
+        frames = wrapFrames( msg );
     }
 };
 
@@ -106,33 +232,32 @@ struct Shout
     std::string uuid;
     std::string name;
     std::string groupname;
-    std::string message;
+    std::vector<Utils::Payload> frames; //!< The message content frames.
 
     Shout( zmsg_t* msg )
     {
-        uuid = std::string( zmsg_popstr( msg ) );
-        name = std::string( zmsg_popstr( msg ) );
-        groupname = std::string( zmsg_popstr( msg ) );
-        message = std::string( zmsg_popstr( msg ) );
+        uuid = popString( msg );
+        name = popString( msg );
+        groupname = popString( msg );
+        frames = wrapFrames( msg );
     }
 };
 
-//! @brief Convert a zframe_t to a string.
-static std::string parseFrameStr( zframe_t* frame )
-{
-    return std::string( reinterpret_cast<char*>( zframe_data( frame ) ), zframe_size( frame ) );
-}
-
 /**
  * @brief Parse the first frame from the message to determine the Zyre message type.
  *
  * @param msg The message to parse as a Zyre message.
  * @return The type of the Zyre message
  */
-MessageType parseMessageType( zmsg_t* msg )
+inline MessageType parseMessageType( zmsg_t* msg )
 {
     zframe_t* frame = zmsg_pop( msg );
-    std::string type = parseFrameStr( frame );
+    if( !frame )
+    {
+        return MessageType::Unknown;
+    }
+    const std::string type = parseFrameStr( frame );
+    zframe_destroy( &frame );
 
     if( type == "ENTER" )
     {
@@ -166,66 +291,75 @@ MessageType parseMessageType( zmsg_t* msg )
     return MessageType::Unknown;
 }
 
-std::ostream& operator<<( std::ostream& o, const Enter& msg )
+inline std::ostream& operator<<( std::ostream& o, const Enter& msg )
 {
-    o << "Enter:" << std::endl;
-    o << "\tuuid: " << msg.uuid << std::endl;
-    o << "\tname: " << msg.name << std::endl;
-    o << "\theaders: " << msg.headers << std::endl;
-    o << "\taddress: " << msg.address << std::endl;
+    o << "Enter:" << "\n";
+    o << "\tuuid: " << msg.uuid << "\n";
+    o << "\tname: " << msg.name << "\n";
+    for( const auto& [key, value] : msg.headers )
+    {
+        o << "\theader: " << key << "=" << value << "\n";
+    }
+    o << "\taddress: " << msg.address << "\n";
 
     return o;
 }
-std::ostream& operator<<( std::ostream& o, const Exit& msg )
+inline std::ostream& operator<<( std::ostream& o, const Exit& msg )
 {
-    o << "Exit:" << std::endl;
-    o << "\tuuid: " << msg.uuid << std::endl;
-    o << "\tname: " << msg.name << std::endl;
+    o << "Exit:" << "\n";
+    o << "\tuuid: " << msg.uuid << "\n";
+    o << "\tname: " << msg.name << "\n";
 
     return o;
 }
-std::ostream& operator<<( std::ostream& o, const Evasive& msg )
+inline std::ostream& operator<<( std::ostream& o, const Evasive& msg )
 {
-    o << "Evasive:" << std::endl;
-    o << "\tuuid: " << msg.uuid << std::endl;
-    o << "\tname: " << msg.name << std::endl;
+    o << "Evasive:" << "\n";
+    o << "\tuuid: " << msg.uuid << "\n";
+    o << "\tname: " << msg.name << "\n";
 
     return o;
 }
-std::ostream& operator<<( std::ostream& o, const Join& msg )
+inline std::ostream& operator<<( std::ostream& o, const Join& msg )
 {
-    o << "Join:" << std::endl;
-    o << "\tuuid: " << msg.uuid << std::endl;
-    o << "\tname: " << msg.name << std::endl;
-    o << "\tgroupname: " << msg.groupname << std::endl;
+    o << "Join:" << "\n";
+    o << "\tuuid: " << msg.uuid << "\n";
+    o << "\tname: " << msg.name << "\n";
+    o << "\tgroupname: " << msg.groupname << "\n";
 
     return o;
 }
-std::ostream& operator<<( std::ostream& o, const Leave& msg )
+inline std::ostream& operator<<( std::ostream& o, const Leave& msg )
 {
-    o << "Leave:" << std::endl;
-    o << "\tuuid: " << msg.uuid << std::endl;
-    o << "\tname: " << msg.name << std::endl;
-    o << "\tgroupname: " << msg.groupname << std::endl;
+    o << "Leave:" << "\n";
+    o << "\tuuid: " << msg.uuid << "\n";
+    o << "\tname: " << msg.name << "\n";
+    o << "\tgroupname: " << msg.groupname << "\n";
 
     return o;
 }
-std::ostream& operator<<( std::ostream& o, const Whisper& msg )
+inline std::ostream& operator<<( std::ostream& o, const Whisper& msg )
 {
-    o << "Whisper:" << std::endl;
-    o << "\tuuid: " << msg.uuid << std::endl;
-    o << "\tname: " << msg.name << std::endl;
-    o << "\tmessage: " << msg.message << std::endl;
+    o << "Whisper:" << "\n";
+    o << "\tuuid: " << msg.uuid << "\n";
+    o << "\tname: " << msg.name << "\n";
+    for( const auto& frame : msg.frames )
+    {
+        o << "\tframe: " << frame.size() << " bytes" << "\n";
+    }
 
     return o;
 }
-std::ostream& operator<<( std::ostream& o, const Shout& msg )
+inline std::ostream& operator<<( std::ostream& o, const Shout& msg )
 {
-    o << "Shout:" << std::endl;
-    o << "\tuuid: " << msg.uuid << std::endl;
-    o << "\tname: " << msg.name << std::endl;
-    o << "\tgroupname: " << msg.groupname << std::endl;
-    o << "\tmessage: " << msg.message << std::endl;
+    o << "Shout:" << "\n";
+    o << "\tuuid: " << msg.uuid << "\n";
+    o << "\tname: " << msg.name << "\n";
+    o << "\tgroupname: " << msg.groupname << "\n";
+    for( const auto& frame : msg.frames )
+    {
+        o << "\tframe: " << frame.size() << " bytes" << "\n";
+    }
 
     return o;
 }
@@ -1,12 +1,29 @@
 #pragma once
+#include "clipboard/item.h"
 #include "common.h"
+#include "network/coalescer.h"
+#include "network/command_queue.h"
+#include "network/fanout.h"
+#include "network/lanes.h"
+#include "network/peer_table.h"
+#include "network/protocol.h"
+#include "network/session_key.h"
+#include "network/throttle.h"
+#include "network/transport.h"
 #include "utils/daemon.h"
+#include "utils/dedupe_window.h"
 #include "utils/delegate.h"
 #include "utils/functor.h"
+#include "utils/metrics.h"
 
-#include <czmq.h>
-#include <zcert.h>
-#include <zyre.h>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace Clipd::Network
 {
@@ -36,7 +53,32 @@ namespace Clipd::Network
  * explicitly. A single Zyre node may only use one or the other discovery protocol, but there is no
  * limitation that a single peer implement only one Zyre node.
  *
- * @note This application uses UDP broadcasts, not explicitly configured gossiping.
+ * @note This application uses UDP broadcasts by default. Gossiping is configured by giving the
+ * node an explicit endpoint, and a gossip endpoint to bind or connect to. A gateway runs both: a
+ * daemon on its own subnet, and a second daemon gossiping with the other gateways, with a Relay
+ * between them.
+ * @see ZyreTransport::Discovery and Relay.
+ *
+ * @par Transports
+ *
+ * The daemon talks to its peers through a Transport. The ZyreTransport is a Zyre node on the real
+ * network. The SimTransport is a node on a SimNetwork, which simulates thousands of nodes in one
+ * process, in virtual time. Time is read from the transport, so that the same daemon code runs in
+ * either.
+ *
+ * @par Threading
+ *
+ * The transport is owned by the daemon's background thread: it is started in setup(), polled in
+ * loop(), and stopped in teardown(). Other threads never touch it. Instead, outbound operations
+ * like receiveLocalClipboardUpdate() post a Command to a lock-free queue that the network thread
+ * polls alongside the transport, so capturing the clipboard never waits on the network.
+ *
+ * A simulation doesn't start the daemon's thread. Instead, the SimNetwork calls step() whenever
+ * the node has something to do.
+ *
+ * Clipboard updates shouted to a session pass through a Coalescer on the network thread, so that
+ * a burst of rapid updates is broadcast as the first and the latest update, rather than every
+ * intermediate one.
  *
  * @par Sessions
  *
@@ -48,6 +90,89 @@ namespace Clipd::Network
  * A peer's session can be configured through the application's `--session <session name>` argument.
  * By default, a peer will join the "global" session.
  *
+ * Every peer also joins the "GLOBAL" group, so that any node can see every clipd node on the
+ * network. Joining a group costs a JOIN message to every connected peer, and a place in every
+ * peer's table, so on a large network the daemon can leave it out, and only be known to the peers
+ * it shares a session with. @see ZyreTransport::Discovery::scope
+ *
+ * @par Gateways
+ *
+ * A single daemon may host more than one session, each routed to its own local clipboard, so that
+ * a shared host serving many users runs one Zyre node, with one set of beacons and peer
+ * connections, rather than one per user. Each hosted session is an entry in a routing table, from
+ * the session's groups to its current item and its subscribers. Shouts are routed by the group
+ * they were shouted to, and whispers by the session in their header. @see addSession()
+ *
+ * @par Clipboard Items
+ *
+ * Clipboard updates are shouted to the session as Clipboard::Item messages: a fixed-size header
+ * frame carrying the item's hybrid logical clock version and origin uuid, followed by the contents.
+ * Receivers only apply strictly newer versions, and never re-broadcast contents they received from
+ * the network. @see Clipboard::SyncState and Protocol::Header for details.
+ *
+ * An item can reach a node more than once, like from two gateways, or down a FanoutTree and from a
+ * repair. Each node remembers the IDs of the items it received recently in a Utils::DedupeWindow,
+ * and drops a copy of an item it has already received before decoding it, if it isn't newer than
+ * the session's current item. @see Protocol::messageId()
+ *
+ * @par Capabilities
+ *
+ * Each node advertises its Capabilities as Zyre headers, read from the ENTER event of every peer.
+ * Protocol messages are shouted to a separate group, so that legacy peers, which advertise
+ * nothing, are only ever sent the plain text contents. Items are shouted with the codec most of
+ * the session supports, and whispered separately to the peers that can't decode it. Large items
+ * are shouted as a digest instead, if every peer in the session will lazily PULL the contents.
+ *
+ * @par Fan-out
+ *
+ * Shouting sends a separate copy to every member of the session, so in a large session a big item
+ * saturates the origin's uplink. With a FanoutTree degree configured, items at least as large as
+ * the threshold are instead announced by shouting their digest, and whispered to just `degree`
+ * peers, which forward them down a tree rooted at the origin. Every node forwards an item once,
+ * and only delivers it if it's newer than what it already has. A node that was announced an item,
+ * but hasn't received it within the repair timeout for its depth, PULLs it from the origin, and
+ * forwards it down its own subtree, so a subtree cut off by a slow or departed parent converges.
+ *
+ * @par Lanes
+ *
+ * Every message to a peer travels over the same TCP connection, so a large item would hold up
+ * every message sent after it. Outbound messages are instead queued by a LaneScheduler: control
+ * messages, like digests and pulls, go first, and small items share the rest of the uplink with
+ * large ones, which are split into Protocol::Chunk messages for peers that can reassemble them.
+ * With the lanes paced to the uplink, a small copy made during a large transfer waits behind at
+ * most a chunk, rather than the whole item.
+ *
+ * @par Multicast
+ *
+ * If the transport can multicast, each session's group is also joined for datagrams, and nodes
+ * advertise that they receive them. A small item shouted to a session whose peers all do is then
+ * multicast as a single Protocol::Datagram, rather than a copy over each peer's TCP connection.
+ * Datagrams are numbered in sequence for each session, and a receiver that sees a gap, in a later
+ * datagram or one of the heartbeats that follow the sender's last, whispers a Nack. The sender
+ * whispers the messages back from a short history, over the reliable path, and anything older
+ * has been superseded by the session's later items anyway. After a gap longer than that history,
+ * the receiver only asks for the end of it, and carries on from the sender's new sequence number.
+ * A sealed session seals each datagram's sender and sequence number with its frames, so they
+ * can't be forged. Datagrams don't travel over the transport's encrypted links, so an unsealed
+ * session on an encrypted transport doesn't multicast at all.
+ *
+ * @par Tracing
+ *
+ * Protocol messages end with a Timing frame, holding the sender's send time, and the smallest
+ * delay it has measured for messages from the recipients, from which each recipient estimates its
+ * clock offset from the sender. Whispers carry the recipient's delay, and shouts carry every
+ * member's delay once every delays_interval. Items sent by their origin also carry the origin's
+ * capture time and stage timings, so the receiver can trace the item from copy to paste-ready.
+ * Peers that don't advertise the Timing capability drop messages with frames they don't expect,
+ * so messages to them are sent without one.
+ *
+ * @par Catching Up
+ *
+ * Every node keeps a PeerTable of the peers it has discovered, and remembers the latest item it
+ * has sent or received. When a peer joins our session, we WHISPER it the digest of that item. The
+ * joining peer only WHISPERs back a PULL request if the digest is newer than its own item, and only
+ * to the first peer that offered it, so the contents are sent once, to the peer that needs them.
+ *
  * @par Peer-to-Peer Messaging
  *
  * The ZRE protocol defines the following message types:
@@ -79,61 +204,225 @@ public:
     /**
      * @brief Construct a new Peer Discovery Daemon object.
      *
-     * @note The discovery port must match for peers to be discovered. The TCP
-     * port used to communicate between discovered peers is automatically chosen.
+     * The constructor advertises our capabilities and joins our session's groups, but defers
+     * starting the transport until the start() method has been called.
      *
-     * The constructor creates the Zyre node, and configures the port, session, and certificate
-     * used, but defers starting peer discovery until the start() method has been called.
-     *
-     * @param discovery_port The port to perform UDP peer discovery broadcasts on.
-     * @param certificate The CURVE certificate to use for encrypting the TCP
-     * traffic between hosts. If null, no encryption will be used.
+     * @param transport How to discover, and message, peers.
      * @param session The session ID to use for this peer.
-     * @param verbose Whether to enable more verbose output.
+     * @param coalescing The debounce and maximum delay windows for coalescing clipboard updates.
+     * @param fanout How to send large items down a tree, rather than shouting them.
+     * @param lanes How to chunk large items, and pace outbound messages.
+     * @param join_global Whether to join the GLOBAL group as well as our session's groups.
      */
-    PeerDiscoveryDaemon( uint16_t discovery_port, zcert_t* certificate, const std::string& session,
-                         bool verbose = false );
+    PeerDiscoveryDaemon( std::unique_ptr<Transport> transport, const std::string& session,
+                         const Coalescer::Config& coalescing = {},
+                         const FanoutTree::Config& fanout = {},
+                         const LaneScheduler::Config& lanes = {}, bool join_global = true );
 
     /**
      * @brief Destroy the Peer Discovery Daemon object
      *
-     * @note **Important!** The stop() method **must** be called to perform cleanup.
-     * There are important threading implications that I do not completely understand.
-     * All I can say is that putting the cleanup in the destructor runs at the wrong time,
-     * and possibly in the wring thread.
+     * @note A started daemon must be stopped and joined first. The transport is stopped by
+     * teardown() on the network thread, which is the only thread allowed to use it.
+     */
+    ~PeerDiscoveryDaemon();
+
+    /**
+     * @brief Host another session on this node, routed to another local clipboard.
+     *
+     * @details The session shares the node's transport, and joins its groups. Sessions must be
+     * added before the daemon is started, or stepped.
+     */
+    void addSession( const std::string& session );
+
+    /**
+     * @brief Seal every hosted session with a SessionKey derived from the given secret.
+     *
+     * @details Sessions added afterwards are sealed too. The secret must be shared by every member
+     * of the session, like the secret key of their common certificate. Only the bodies of items,
+     * and datagrams, are sealed, so the transport should still encrypt its links, which carry
+     * everything else. Must be called before the daemon is started, or stepped.
+     *
+     * @return Whether the secret could be used.
+     */
+    bool setSessionSecret( const std::vector<uint8_t>& secret );
+
+    /**
+     * @brief Limit the clipboard items each peer, and each session, may send us, and that we may
+     * send each session, per second.
+     *
+     * @details Items over the limit are held back, and only the latest held item from each peer is
+     * delivered, or sent, once the limit allows. An item delivered ahead of held ones from other
+     * peers drops those older than it. Must be called before the daemon is started, or stepped.
+     * @see Throttle
+     */
+    void setThrottle( const Throttle::Config& config );
+
+    /**
+     * @brief Drop, rather than receive, clipboard items larger than the given size, and advertise
+     * the limit so that peers don't send them.
+     *
+     * @details Items of any size are received by default. Must be called before the daemon is
+     * started, or stepped.
+     *
+     * @param bytes The largest item contents to receive, or zero for any size.
      */
-    ~PeerDiscoveryDaemon() {}
+    void setMaxPayload( uint64_t bytes );
 
     /**
      * @brief Notify the networking component of this peer that the local clipboard has changed.
      *
-     * @param contents The new plaintext contents of the local clipboard.
+     * @details This may be called from any thread, and never blocks on the network. The update is
+     * queued for the network thread, which hands it to the transport without copying; the
+     * outgoing frame holds a reference to the contents until it has been sent.
+     *
+     * @param item The new, versioned, contents of the local clipboard.
+     */
+    void receiveLocalClipboardUpdate( const Clipboard::Item& item );
+    /**
+     * @brief Notify the networking component that the clipboard of the given hosted session has
+     * changed. May be called from any thread.
      */
-    void receiveLocalClipboardUpdate( const std::string& contents );
+    void receiveLocalClipboardUpdate( const std::string& session, const Clipboard::Item& item );
+    /**
+     * @brief This node's transport uuid, which local items should be stamped with, so that peers
+     * can tell which items they received from the item's origin.
+     */
+    [[nodiscard]] const Utils::Uuid& uuid() const noexcept
+    {
+        return m_uuid;
+    }
+
+    /**
+     * @brief The number of discovered peers in our session that speak the clipd protocol.
+     *
+     * @details This may be called from any thread.
+     */
+    [[nodiscard]] size_t sessionPeers() const noexcept
+    {
+        return m_sessions.front().peers.load( std::memory_order_relaxed );
+    }
+    /**
+     * @brief The number of discovered peers in the given hosted session that speak the clipd
+     * protocol. May be called from any thread.
+     */
+    [[nodiscard]] size_t sessionPeers( const std::string& session ) const;
+
     /**
      * @brief Register a callback to receive clipboard updates from a connected remote host.
      *
      * @param callback The callback to receive updates.
      */
-    void registerOnRemoteClipboardUpdate( Utils::Functor<void( const std::string& )> callback );
-
+    void registerOnRemoteClipboardUpdate( Utils::Functor<void( const Clipboard::Item& )> callback );
     /**
-     * @brief Start the Zyre node listening for p2p communications.
+     * @brief Register a callback to receive clipboard updates for the given hosted session.
      */
-    void start() override;
+    void registerOnRemoteClipboardUpdate( const std::string& session,
+                                          Utils::Functor<void( const Clipboard::Item& )> callback );
+
     /**
-     * @brief Stop the Zyre node, and perform cleanup.
+     * @brief Stop the network thread.
      *
-     * @see ~PeerDiscoveryDaemon() for details on why this is not done in the destructor.
+     * @details The transport is stopped by teardown() on the network thread once the current
+     * loop() iteration wakes up.
      */
     void stop() override;
 
+    /**
+     * @brief Handle every received event and queued command, and send any coalesced updates,
+     * held items, repairs, and queued messages that are due, without blocking.
+     *
+     * @details loop() calls this every time the network thread wakes. A simulated node isn't
+     * started, and is stepped by its SimNetwork instead.
+     *
+     * @return The time until the next coalesced update, held item, repair, or queued message is
+     * due, if there is one.
+     */
+    std::optional<Transport::Clock::duration> step();
+
 protected:
+    /**
+     * @brief A session hosted by this node.
+     */
+    struct Session
+    {
+        std::string name;
+        //! The group protocol messages for the session are shouted to.
+        std::string protocol_group;
+        std::atomic<size_t> peers = 0;
+        //! The latest item sent or received, offered to peers joining the session.
+        std::optional<Clipboard::Item> current;
+        //! An item requested from a peer with a PULL, which it may never answer.
+        struct Pull
+        {
+            Utils::Version version;
+            std::string from; //!< The peer it was pulled from.
+            //! The other peers that announced it, to pull it from if that one doesn't answer.
+            std::vector<std::string> others;
+            Transport::Clock::time_point deadline;
+            size_t attempts = 0;
+        };
+        //! The item requested from a peer, if a PULL is outstanding.
+        std::optional<Pull> pending_pull;
+        //! The latest item forwarded down a FanoutTree.
+        std::optional<Utils::Version> forwarded;
+        //! An item announced as on its way down a FanoutTree, to pull if it doesn't arrive.
+        struct Repair
+        {
+            Utils::Version version;
+            std::string from; //!< The peer that announced it.
+            uint8_t degree;   //!< The degree of the tree it's on its way down.
+            Transport::Clock::time_point deadline;
+            bool pulled = false; //!< Whether it's been pulled, to forward once it arrives.
+        };
+        std::optional<Repair> repair;
+        //! The key the session's messages are sealed with, if they are.
+        std::optional<SessionKey> key;
+        //! When the next shout to the session carries the delays measured from its members.
+        Transport::Clock::time_point delays_at;
+        //! An item being received in chunks.
+        struct Assembly
+        {
+            Utils::Version version;
+            uint64_t total = 0; //!< The size of the encoded body.
+            std::string body;
+        };
+        //! The item each peer is sending us in chunks, by the peer's uuid.
+        std::unordered_map<std::string, Assembly> assemblies;
+        //! Whether the session's group was joined for multicast. @see Protocol::Datagram
+        bool multicast = false;
+        //! The sequence number of the last datagram multicast to the session.
+        uint64_t sequence = 0;
+        //! The messages most recently multicast, by sequence number, to whisper to peers that
+        //! lost them.
+        std::deque<std::pair<uint64_t, std::vector<Utils::Payload>>> multicast_history;
+        //! When the last datagram was multicast, and how many heartbeats have followed it.
+        Transport::Clock::time_point multicast_at;
+        size_t heartbeats = 0;
+        //! The sequence number expected next from each peer multicasting to the session, by uuid.
+        std::unordered_map<std::string, uint64_t> expected;
+        //! The latest item received over the session's Throttle from each peer, by uuid, to
+        //! deliver once the throttle allows.
+        std::unordered_map<std::string, Clipboard::Item> throttled_in;
+        //! The latest local item over the session's Throttle, to send once the throttle allows.
+        std::optional<Clipboard::Item> throttled_out;
+        Utils::Delegate<void( const Clipboard::Item& )> remote_update_delegate;
+    };
+
+    /**
+     * @brief Start the transport listening for p2p communications on the network thread.
+     */
+    void setup() override;
+    /**
+     * @brief Stop the transport, and perform cleanup on the network thread.
+     */
+    void teardown() override;
     /**
      * @brief The method to run in the event loop for this thread.
      *
-     * Roughly, this thread blocks and listens for messages from peers. These fall into several
-     * categories:
+     * Roughly, this thread blocks until either queued Commands have been posted, or messages from
+     * peers arrive. Every pending command and message is handled before blocking again.
+     * Messages fall into several categories:
      * * **ENTER** the network.
      * * The node can be marked as **EVASIVE**, indicating it hasn't been heard from recently.
      * * **EXIT** the network.
@@ -144,19 +433,342 @@ protected:
      */
     void loop() override;
     /**
-     * @brief Receive a message from a connected peer, parse, and dispatch on its type.
+     * @brief Dispatch an event received by the transport on its type.
+     */
+    void handleEvent( const Event& event );
+    /**
+     * @brief Perform a queued outbound Command.
+     */
+    void handleCommand( const Command& command );
+    /**
+     * @brief Send any coalesced updates whose deadline has passed.
+     *
+     * @return The time until the next coalesced update is due, if there is one.
+     */
+    std::optional<Coalescer::Clock::duration> flushCoalesced();
+    /**
+     * @brief Pull any announced items that haven't arrived down their FanoutTree in time.
+     *
+     * @return The time until the next repair is due, if there is one.
+     */
+    std::optional<Transport::Clock::duration> flushRepairs();
+    /**
+     * @brief Pull any pulled items that haven't arrived in time again.
+     *
+     * @return The time until the next pull times out, if there is one.
+     */
+    std::optional<Transport::Clock::duration> flushPulls();
+    /**
+     * @brief Send a PULL for the given version to the given peer.
+     */
+    void pull( Session& session, const Utils::Version& version, const std::string& from );
+    /**
+     * @brief Pull the session's pending item from the next peer that announced it, or give up on
+     * it, so that the next digest for it is pulled again.
      *
-     * @param msg The message received from the connected peer.
+     * @param exited Whether the peer it was pulled from left, rather than didn't answer in time.
      */
-    void parseMessage( zmsg_t* msg );
+    void repull( Session& session, bool exited );
+    /**
+     * @brief Multicast the heartbeats that are due.
+     *
+     * @return The time until the next heartbeat is due, if there is one.
+     */
+    std::optional<Transport::Clock::duration> flushHeartbeats();
+    /**
+     * @brief Send the queued messages the LaneScheduler allows.
+     *
+     * @return The time until the next queued message may be sent, if there is one.
+     */
+    std::optional<Transport::Clock::duration> flushLanes();
+    /**
+     * @brief Deliver, and send, the items held back by the throttles, once they allow.
+     *
+     * @return The time until the next held item may pass, if there is one.
+     */
+    std::optional<Transport::Clock::duration> flushThrottled();
+    /**
+     * @brief Count the bytes received from a peer.
+     *
+     * @return The number of bytes in the frames.
+     */
+    uint64_t countReceived( const std::string& sender, const std::vector<Utils::Payload>& frames );
+    /**
+     * @brief The hosted session with the given name, or protocol group.
+     *
+     * @return The session, or null if this node doesn't host it.
+     */
+    Session* findSession( const std::string& group );
+    /**
+     * @brief The hosted session a whisper with the given header is about.
+     *
+     * @details Peers that don't tag their whispers with a session only ever whisper about the one
+     * session they're in, so those whispers are for the first session we share with the sender.
+     */
+    Session* whisperedSession( const Protocol::Header& header, const Peer* sender );
+    /**
+     * @brief Handle a clipd protocol message shouted to one of our sessions, or whispered to this
+     * node.
+     *
+     * @param group The group the message was shouted to, or empty if it was whispered.
+     * @param received The message's frames. Items in sealed sessions are opened once they're
+     * known to be new.
+     */
+    void receiveMessage( const std::string& sender, const std::string& group,
+                         const std::vector<Utils::Payload>& received );
+    /**
+     * @brief Handle a datagram multicast to one of our sessions' groups, and ask its sender to
+     * whisper any datagrams we've missed.
+     */
+    void receiveDatagram( const std::string& group, const std::vector<Utils::Payload>& frames );
+    /**
+     * @brief Whisper the given peer the messages it missed, of those multicast recently.
+     */
+    void repairDatagrams( Session& session, const std::string& peer, const Protocol::Nack& nack );
+    /**
+     * @brief Add a chunk from the given peer to the item it's sending us.
+     *
+     * @return The frames of the whole item, once its last chunk arrives.
+     */
+    std::vector<Utils::Payload> assemble( Session& session, const std::string& sender,
+                                          const Protocol::Header& header,
+                                          const std::vector<Utils::Payload>& frames );
+    /**
+     * @brief Handle an item received from the session, and pass it on to the session's clipboard,
+     * unless the peer it came from, or the session, is over its Throttle.
+     *
+     * @param sender The uuid of the peer that sent us the item, which isn't always its origin.
+     */
+    void receiveItem( Session& session, const Clipboard::Item& item, const std::string& sender );
+    /**
+     * @brief Pass an item the receive Throttle let through on to the session's clipboard, and drop
+     * the held items it supersedes.
+     */
+    void deliverThrottled( Session& session, const Clipboard::Item& item );
+    /**
+     * @brief Handle an item sent down a FanoutTree: forward it to our children, unless we already
+     * have, and pass it on to the session's clipboard, unless it already has it.
+     *
+     * @param frames The frames the item was received in, which are forwarded as they are, if
+     * each child can decode them.
+     * @param sender The uuid of our parent in the tree, which sent us the item.
+     */
+    void receiveForwarded( Session& session, const Clipboard::Item& item, uint8_t degree,
+                           const std::vector<Utils::Payload>& frames, const std::string& sender );
+    /**
+     * @brief Send a local item to every peer in the given session, in the best encoding each
+     * of them supports.
+     */
+    void publish( const std::string& session, const Clipboard::Item& item );
+    /**
+     * @brief Publish a local item, unless the session is over its Throttle, in which case it
+     * replaces any item held back for the session.
+     */
+    void release( const std::string& session, const Clipboard::Item& item );
+    /**
+     * @brief Announce a large local item to the session, and send it down a FanoutTree.
+     *
+     * @return Whether the item was sent, or should be shouted instead.
+     */
+    bool disseminate( Session& session, const Clipboard::Item& item );
+    /**
+     * @brief The FanoutTree over the session's members that forward items, rooted at the given
+     * node.
+     */
+    [[nodiscard]] FanoutTree fanoutTree( const Session& session, const Utils::Uuid& root,
+                                         size_t degree ) const;
+    /**
+     * @brief Send an item to our children in the given tree.
+     *
+     * @param received The frames the item was received in, if it wasn't ours.
+     */
+    void forward( Session& session, const Clipboard::Item& item, const FanoutTree& tree,
+                  uint8_t degree, const std::vector<Utils::Payload>* received = nullptr );
+    /**
+     * @brief The most efficient codec to send the given item to the given peer with.
+     */
+    [[nodiscard]] Codec codecFor( const Peer& peer, const Clipboard::Item& item ) const;
+    /**
+     * @brief Queue a clipd protocol message in the lane for its kind and size, split into chunks
+     * if it's a large item.
+     *
+     * @param session The session the message is about, which whispers are tagged with.
+     * @param item The item the message is about. Its origin timings are only sent by its origin.
+     */
+    void sendTimed( Command::Type type, const std::string& target, const Session& session,
+                    std::vector<Utils::Payload> frames, const Clipboard::Item* item = nullptr );
+    /**
+     * @brief Seal the body of an item with its session's key, if the session has one, and the
+     * body isn't sealed already.
+     */
+    static void sealItem( const Session& session, std::vector<Utils::Payload>& frames );
+    /**
+     * @brief Open an item sealed with its session's key.
+     *
+     * @return The item's header and encoded body, or nothing if the body wasn't sealed with the
+     * session's key.
+     */
+    static std::optional<std::vector<Utils::Payload>>
+    openItem( const Session& session, const std::vector<Utils::Payload>& frames );
+    /**
+     * @brief Send a queued message, ending with a Timing frame.
+     */
+    void transmit( Outgoing& message );
+    /**
+     * @brief Join the session's group for datagrams, if the transport can multicast, unless its
+     * links are encrypted, and the session isn't sealed.
+     */
+    void joinMulticast( Session& session );
+    /**
+     * @brief Whether every peer in the session receives its datagrams.
+     */
+    [[nodiscard]] bool multicasts( const Session& session ) const;
+    /**
+     * @brief Multicast a message to the session as the next datagram in its sequence, if it fits
+     * in one.
+     *
+     * @param frames The message, as it's sent.
+     * @param repair The message, without its Timing frame, to whisper to peers that lose it.
+     * @return Whether the message was multicast.
+     */
+    [[nodiscard]] bool multicast( Session& session, const std::vector<Utils::Payload>& frames,
+                    std::vector<Utils::Payload> repair );
+    /**
+     * @brief Hand the given frames to the transport without copying them.
+     */
+    void send( Command::Type type, const std::string& target,
+               const std::vector<Utils::Payload>& frames );
+    /**
+     * @brief Call the function with every peer a message to the target would be sent to.
+     *
+     * @details A shout goes to each member of the group, and a whisper to the peer with that
+     * uuid, which is looked up rather than compared to every peer's.
+     */
+    template <typename Function>
+    void forEachRecipient( Command::Type type, const std::string& target,
+                           Function&& function ) const;
+    /**
+     * @brief Advertise our capabilities in the transport's headers.
+     */
+    void advertise();
+    /**
+     * @brief Recount the peers in our sessions, after a peer joined or left one.
+     */
+    void countSessionPeers();
+    /**
+     * @brief Whether we accept an item this large from the given peer, counting and logging the
+     * items we don't.
+     */
+    bool acceptsSize( const std::string& sender, uint64_t size );
+    /**
+     * @brief Release the peer's labelled counters, once the peer has exited.
+     */
+    static void releaseCounters( const Peer& peer );
 
 private:
-    uint16_t m_discovery_port;
-    const bool m_verbose;
-    const std::string& m_session;
-    zcert_t* m_zcert;
-    zyre_t* m_znode;
+    const std::unique_ptr<Transport> m_transport;
+    const Transport::Handler m_on_event;
+    //! Our own transport uuid, which peers report their measured delays to us by.
+    const Utils::Uuid m_uuid;
+    Capabilities m_capabilities;
+    //! Stamps items received from legacy peers, which aren't versioned.
+    Utils::HybridLogicalClock m_clock;
+
+    //! Items at least this large are compressed for peers that support it.
+    static constexpr size_t compression_threshold = 1024;
+    //! Items at least this large are announced by digest, for peers that support lazy pulls.
+    static constexpr size_t lazy_pull_threshold = 1024 * 1024;
+    //! How long a pulled item may take to start arriving, or between its chunks, before it's
+    //! pulled again.
+    static constexpr std::chrono::seconds pull_timeout = std::chrono::seconds( 2 );
+    //! How many times an item is pulled before giving up on it.
+    static constexpr size_t max_pull_attempts = 4;
+    //! How often shouts carry the delays measured from every member of their session.
+    static constexpr std::chrono::seconds delays_interval = std::chrono::seconds( 10 );
+
+    CommandQueue m_commands;
+    const Coalescer::Config m_coalescing;
+    //! The coalescing stage for each group that clipboard updates are shouted to.
+    std::unordered_map<std::string, Coalescer> m_coalescers;
+    const FanoutTree::Config m_fanout;
+    LaneScheduler m_lanes;
+    //! Limit the items we send, and the items each peer sends us.
+    Throttle m_send_throttle;
+    Throttle m_receive_throttle;
+
+    PeerTable m_peers;
+    //! The secret session keys are derived from, if sessions are sealed.
+    std::vector<uint8_t> m_session_secret;
+    //! The items recently received, so that copies arriving by another path aren't decoded again.
+    Utils::DedupeWindow m_seen;
+    //! The hosted sessions, starting with the one the daemon was constructed with. A deque, so
+    //! that the routes to them stay valid as sessions are added.
+    std::deque<Session> m_sessions;
+    //! Each hosted session, by its name and by its protocol group.
+    std::unordered_map<std::string, Session*> m_routes;
 
-    Utils::Delegate<void( const std::string& )> m_remote_update_delegate;
+    Utils::Metrics::Gauge& m_hosted_sessions =
+        Utils::Metrics::Registry::global().gauge( "network.sessions" );
+    Utils::Metrics::Counter& m_poll_wakeups =
+        Utils::Metrics::Registry::global().counter( "network.poll_wakeups" );
+    Utils::Metrics::Counter& m_bytes_sent =
+        Utils::Metrics::Registry::global().counter( "network.bytes_sent" );
+    Utils::Metrics::Counter& m_bytes_received =
+        Utils::Metrics::Registry::global().counter( "network.bytes_received" );
+    //! The number of commands posted, but not yet handled, by the network thread.
+    Utils::Metrics::Gauge& m_queue_depth =
+        Utils::Metrics::Registry::global().gauge( "network.command_queue.depth" );
+    //! The number of commands handled each time the network thread is woken.
+    Utils::Metrics::Histogram& m_commands_drained =
+        Utils::Metrics::Registry::global().histogram( "network.command_queue.drained" );
+    //! Items forwarded to a child in a FanoutTree, including the origin's own.
+    Utils::Metrics::Counter& m_fanout_forwarded =
+        Utils::Metrics::Registry::global().counter( "network.fanout.forwarded" );
+    //! Items received down a FanoutTree that had already been forwarded, or pulled.
+    Utils::Metrics::Counter& m_fanout_duplicates =
+        Utils::Metrics::Registry::global().counter( "network.fanout.duplicates" );
+    //! Announced items that didn't arrive down the tree in time, and were pulled instead.
+    Utils::Metrics::Counter& m_fanout_repairs =
+        Utils::Metrics::Registry::global().counter( "network.fanout.repairs" );
+    //! Pulled items that didn't arrive in time, or whose sender left, and were pulled again.
+    Utils::Metrics::Counter& m_pull_retries =
+        Utils::Metrics::Registry::global().counter( "network.pulls.retried" );
+    //! Copies of items already received, dropped before they were decoded.
+    Utils::Metrics::Counter& m_duplicates =
+        Utils::Metrics::Registry::global().counter( "network.duplicates" );
+    //! Items dropped because they weren't sealed with their session's key, or were sealed for a
+    //! session that isn't sealed here, and datagrams that weren't sealed with their session's.
+    Utils::Metrics::Counter& m_unsealed =
+        Utils::Metrics::Registry::global().counter( "network.unsealed" );
+    //! Items, digests, and chunked items dropped because they were larger than we accept.
+    Utils::Metrics::Counter& m_oversized =
+        Utils::Metrics::Registry::global().counter( "network.oversized" );
+    //! Datagrams multicast, counting each once, and datagrams received.
+    Utils::Metrics::Counter& m_datagrams_sent =
+        Utils::Metrics::Registry::global().counter( "network.multicast.sent" );
+    Utils::Metrics::Counter& m_datagrams_received =
+        Utils::Metrics::Registry::global().counter( "network.multicast.received" );
+    //! Datagrams we noticed we missed, and asked their senders for.
+    Utils::Metrics::Counter& m_datagrams_missed =
+        Utils::Metrics::Registry::global().counter( "network.multicast.missed" );
+    //! Datagrams whispered to peers that missed them.
+    Utils::Metrics::Counter& m_datagrams_repaired =
+        Utils::Metrics::Registry::global().counter( "network.multicast.repaired" );
+    //! Items held back by a Throttle, by the direction they were going.
+    Utils::Metrics::Counter& m_throttle_held_out = Utils::Metrics::Registry::global().counter(
+        Utils::Metrics::labelled( "network.throttle.held", "direction", "send" ) );
+    Utils::Metrics::Counter& m_throttle_held_in = Utils::Metrics::Registry::global().counter(
+        Utils::Metrics::labelled( "network.throttle.held", "direction", "receive" ) );
+    //! Held items dropped for a newer one, which was held back in their place, or delivered ahead
+    //! of them.
+    Utils::Metrics::Counter& m_throttle_coalesced_out = Utils::Metrics::Registry::global().counter(
+        Utils::Metrics::labelled( "network.throttle.coalesced", "direction", "send" ) );
+    Utils::Metrics::Counter& m_throttle_coalesced_in = Utils::Metrics::Registry::global().counter(
+        Utils::Metrics::labelled( "network.throttle.coalesced", "direction", "receive" ) );
+    //! How long messages waited in each lane, by Lane.
+    std::array<Utils::Metrics::Histogram*, 3> m_lane_waits = {};
+    //! From capturing an item from the clipboard, to sending it to the session.
+    Utils::Metrics::Histogram& m_capture_to_send =
+        Utils::Metrics::Registry::global().histogram( "network.capture_to_send_ns" );
 };
 } // namespace Clipd::Network
@@ -0,0 +1,99 @@
+#pragma once
+#include "common.h"
+#include "network/capabilities.h"
+#include "network/clock_offset.h"
+#include "utils/metrics.h"
+#include "utils/uuid.h"
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Clipd::Network
+{
+/**
+ * @brief Everything this node knows about a remote peer.
+ */
+struct Peer
+{
+    using Clock = std::chrono::steady_clock;
+
+    Utils::Uuid uuid;
+    std::string name;
+    std::string address;
+    std::vector<std::string> groups; //!< The groups (sessions) the peer has joined.
+    Clock::time_point last_seen;
+    //! Whether Zyre has reported the peer as evasive since it was last heard.
+    bool evasive = false;
+    Capabilities capabilities;
+    ClockOffset clock; //!< The offset between our clock and the peer's.
+    Utils::Metrics::Counter* bytes_sent = nullptr;     //!< Set by the owner of the table.
+    Utils::Metrics::Counter* bytes_received = nullptr; //!< Set by the owner of the table.
+
+    [[nodiscard]] bool inGroup( std::string_view group ) const;
+};
+
+/**
+ * @brief A table of the known peers, keyed by uuid.
+ *
+ * @details The table is kept up to date from the Zyre ENTER, EXIT, EVASIVE, JOIN, and LEAVE
+ * events, and every message received from a peer refreshes its last-seen time.
+ *
+ * Peers are keyed by Utils::Uuid rather than by their 32 character string form, so looking a peer
+ * up on the message path hashes two integers and never allocates. The table is owned by the
+ * network thread, and is not thread safe.
+ */
+class PeerTable
+{
+public:
+    using Clock = Peer::Clock;
+
+    //! @brief A peer has entered the network.
+    Peer& enter( const Utils::Uuid& uuid, std::string_view name, std::string_view address,
+                 Clock::time_point now );
+    //! @brief A peer has left the network.
+    void exit( const Utils::Uuid& uuid );
+    //! @brief A peer hasn't been heard from recently.
+    void evasive( const Utils::Uuid& uuid );
+    //! @brief A peer has joined a group.
+    void join( const Utils::Uuid& uuid, std::string_view group, Clock::time_point now );
+    //! @brief A peer has left a group.
+    void leave( const Utils::Uuid& uuid, std::string_view group, Clock::time_point now );
+    //! @brief A message has been received from the peer.
+    void touch( const Utils::Uuid& uuid, Clock::time_point now );
+
+    /**
+     * @brief Look up a peer by uuid.
+     *
+     * @return The peer, or null if it isn't known. The pointer is invalidated when the peer
+     * exits.
+     */
+    [[nodiscard]] const Peer* find( const Utils::Uuid& uuid ) const;
+    [[nodiscard]] Peer* find( const Utils::Uuid& uuid );
+
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return m_peers.size();
+    }
+
+    //! @brief The number of peers in the given group, without iterating over every peer.
+    [[nodiscard]] size_t members( const std::string& group ) const;
+
+    [[nodiscard]] auto begin() const noexcept
+    {
+        return m_peers.begin();
+    }
+
+    [[nodiscard]] auto end() const noexcept
+    {
+        return m_peers.end();
+    }
+
+private:
+    std::unordered_map<Utils::Uuid, Peer> m_peers;
+    //! The number of peers in each group, kept up to date as peers join, leave, and exit.
+    std::unordered_map<std::string, size_t> m_members;
+};
+} // namespace Clipd::Network
@@ -0,0 +1,329 @@
+#pragma once
+#include "clipboard/item.h"
+#include "common.h"
+#include "network/codec.h"
+#include "utils/hlc.h"
+#include "utils/payload.h"
+#include "utils/uuid.h"
+
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Clipd::Network::Protocol
+{
+/**
+ * @brief The clipd application protocol version, carried in every message header.
+ */
+constexpr uint8_t protocol_version = 1;
+
+/**
+ * @brief The Zyre group that protocol messages for the given session are shouted to.
+ *
+ * @details Legacy peers only join the session group itself, and set their clipboard to the first
+ * frame of anything shouted to it. So protocol messages get their own group, and legacy peers are
+ * only ever sent the plain text contents.
+ */
+std::string sessionGroup( std::string_view session );
+
+/**
+ * @brief The kind of clipd message.
+ */
+enum class Kind : uint8_t
+{
+    Item = 1,   //!< A versioned clipboard item. The body frame holds the contents.
+    Digest = 2, //!< The header of the sender's current item, without the contents.
+    Pull = 3,   //!< A request for the recipient's current item, if it has the given version.
+    Chunk = 4,  //!< A piece of an item's encoded body, at the Chunk position in the next frame.
+    Nack = 5,   //!< A request to whisper the datagrams in the Nack range in the next frame.
+};
+
+/**
+ * @brief The fixed-size binary header frame that starts every clipd message.
+ *
+ * @details The header is encoded as
+ *
+ * | Offset | Size | Field                                         |
+ * |--------|------|-----------------------------------------------|
+ * | 0      | 4    | Magic "CLPD"                                  |
+ * | 4      | 1    | Protocol version                              |
+ * | 5      | 1    | Kind                                          |
+ * | 6      | 1    | Codec of the body, high bit set if sealed     |
+ * | 7      | 1    | Degree of the FanoutTree it's sent down, or 0 |
+ * | 8      | 8    | HLC timestamp of the item                     |
+ * | 16     | 16   | Origin uuid of the item                       |
+ * | 32     | 8    | hash64() digest of the item contents          |
+ * | 40     | 8    | Size of the (decoded) item contents in bytes  |
+ * | 48     | n    | Session, whispers only                        |
+ *
+ * with all integers little-endian. Any frames after the header form the message body, which may
+ * be followed by a Timing frame.
+ *
+ * Shouts are sent to a session's group, but whispers aren't sent to any group, so a node hosting
+ * several sessions tells which session a whisper is about by the session at the end of its header.
+ * Older peers ignore anything after the first 48 bytes.
+ *
+ * The body of an item in a sealed session is its encoded contents, sealed with the session's
+ * SessionKey. Older peers don't know the codec with the high bit set, so they drop the item.
+ *
+ * An item sent down a FanoutTree is forwarded to the receiver's children in the tree of the given
+ * degree, rooted at the item's origin. A digest with a degree announces an item that is on its
+ * way down the tree, which the receiver only pulls if it doesn't arrive in time. Older peers
+ * ignore the degree, and treat both like any other item and digest.
+ */
+struct Header
+{
+    Kind kind = Kind::Item;
+    Codec codec = Codec::Raw;
+    Utils::Version version;
+    uint64_t digest = 0;
+    uint64_t size = 0;
+    uint8_t fanout = 0;  //!< The degree of the FanoutTree the item is sent down, or zero.
+    bool sealed = false; //!< Whether the body is sealed with its session's SessionKey.
+    std::string session; //!< The session a whisper is about. Empty for shouts.
+};
+
+//! The size of a header without a session.
+constexpr size_t header_size = 48;
+
+/**
+ * @brief The optional frame that ends a clipd message, with the timings used for tracing.
+ *
+ * @details The frame is encoded as
+ *
+ * | Offset | Size   | Field                                                  |
+ * |--------|--------|--------------------------------------------------------|
+ * | 0      | 4      | Magic "CLPT"                                           |
+ * | 4      | 2      | Number of delays                                       |
+ * | 6      | 2      | Reserved, zero                                         |
+ * | 8      | 8      | Sender wall clock time the message was sent            |
+ * | 16     | 8      | Origin wall clock time the item was captured, or zero  |
+ * | 24     | 4      | Origin X11 read duration                               |
+ * | 28     | 4      | Origin hash duration                                   |
+ * | 32     | 24 * n | Peer uuid, and the smallest delay measured from it     |
+ *
+ * with all times in microseconds, and all integers little-endian. Nodes built before the frame
+ * was added reject items with it, so it's only sent to peers that advertise the Timing
+ * capability.
+ */
+struct Timing
+{
+    uint64_t sent_us = 0;
+    uint64_t captured_us = 0;
+    uint32_t read_us = 0;
+    uint32_t hash_us = 0;
+    //! The smallest delay the sender has measured for messages from each peer, so that they can
+    //! estimate their clock offset from the sender. @see ClockOffset
+    std::vector<std::pair<Utils::Uuid, int64_t>> delays;
+};
+
+//! The most delays a Timing frame carries.
+constexpr size_t max_timing_delays = 64;
+
+/**
+ * @brief Where the piece of an item's encoded body in a Chunk message goes.
+ *
+ * @details Large items are sent as several Chunk messages, so that smaller messages to the same
+ * peer can be sent between them, rather than waiting for the whole item. Each message has the
+ * item's header, with the Chunk kind, then this frame, then the piece of the body. The frame is
+ * encoded as
+ *
+ * | Offset | Size | Field                                    |
+ * |--------|------|------------------------------------------|
+ * | 0      | 8    | Offset of the piece in the encoded body  |
+ * | 8      | 8    | Size of the whole encoded body           |
+ *
+ * with all integers little-endian. The chunks of an item are sent in order, to peers that
+ * advertise chunking, which reassemble them and handle the item like any other.
+ */
+struct Chunk
+{
+    uint64_t offset = 0;
+    uint64_t total = 0;
+};
+
+//! The size of a Chunk frame.
+constexpr size_t chunk_frame_size = 16;
+
+/**
+ * @brief A message multicast to a session as a single UDP datagram.
+ *
+ * @details Small items can be sent to the whole session with one datagram, rather than a copy
+ * over each peer's TCP connection. The datagram is encoded as
+ *
+ * | Offset | Size | Field                                                    |
+ * |--------|------|----------------------------------------------------------|
+ * | 0      | 4    | Magic "CLPM"                                             |
+ * | 4      | 16   | Sender uuid                                              |
+ * | 20     | 8    | hash64() of the group it was multicast to                |
+ * | 28     | 8    | Sequence number of the datagram in the session           |
+ * | 36     | n    | The message's frames                                     |
+ *
+ * where each frame is its size, as a little-endian 32-bit integer, followed by its bytes. A
+ * datagram without frames is a heartbeat, which only announces the sender's last sequence number.
+ * A sealed session's datagrams hold a single frame, the message sealed with the session's
+ * SessionKey and the first 36 bytes as associated data, and its heartbeats seal an empty message.
+ *
+ * Datagrams may be lost, so each sender numbers the datagrams it sends each session, and a
+ * receiver that sees a gap whispers the sender a Nack for the missing ones, which it whispers
+ * back. Datagrams aren't part of Zyre, so the sender's uuid is carried in the datagram, and a
+ * datagram is only accepted from a peer Zyre has discovered. Groups may share a multicast address,
+ * so the datagram also says which group it's for.
+ */
+struct Datagram
+{
+    Utils::Uuid sender;
+    uint64_t group = 0;
+    uint64_t sequence = 0;
+    //! The message, or nothing for a heartbeat. Decoded frames share the datagram's Payload.
+    std::vector<Utils::Payload> frames;
+};
+
+//! The largest datagram to send, which fits in an Ethernet frame with its IP and UDP headers.
+constexpr size_t max_datagram_size = 1472;
+
+/**
+ * @brief The range of sequence numbers in a Nack message, both inclusive.
+ *
+ * @details The frame is encoded as two little-endian 64-bit integers.
+ */
+struct Nack
+{
+    uint64_t first = 0;
+    uint64_t last = 0;
+};
+
+//! The size of a Nack frame.
+constexpr size_t nack_frame_size = 16;
+
+/**
+ * @brief The 128-bit ID of every message carrying the item with the given version.
+ *
+ * @details Items are never sent with a random ID, since a relayed, forwarded, or pulled copy of an
+ * item is the same item, and should be recognized as a duplicate however it arrived. Versions are
+ * unique, since an origin never stamps two items with the same timestamp, so their IDs are too.
+ */
+inline Utils::Uuid messageId( const Utils::Version& version )
+{
+    return Utils::Uuid {version.origin.hi ^ version.timestamp, version.origin.lo};
+}
+
+/**
+ * @brief Encode a clipboard item as a list of frames, ready to be sent.
+ *
+ * @details Raw contents are not copied; the body frame shares the item's Payload. If the given
+ * codec doesn't make the contents smaller, they are sent raw instead.
+ *
+ * @param item The item to encode.
+ * @param codec The preferred codec for the body.
+ */
+std::vector<Utils::Payload> encodeItem( const Clipboard::Item& item, Codec codec = Codec::Raw );
+
+/**
+ * @brief Encode a message header frame.
+ */
+Utils::Payload encodeHeader( const Header& header );
+
+/**
+ * @brief Encode the digest of a clipboard item: its header, but not its contents.
+ *
+ * @details Digests are whispered to peers joining the session, so that they only pull the
+ * contents if they don't already have a newer item.
+ */
+std::vector<Utils::Payload> encodeDigest( const Clipboard::Item& item );
+
+/**
+ * @brief Encode a request for the item with the given version.
+ */
+std::vector<Utils::Payload> encodePull( const Utils::Version& version );
+
+/**
+ * @brief Split an encoded item into Chunk messages.
+ *
+ * @details The pieces share the body frame's Payload, rather than copying it.
+ *
+ * @param item The frames of an encoded item: its header, and its body.
+ * @param size The largest piece of the body to put in each chunk.
+ * @return The chunks, in the order they must be sent, or nothing if the frames aren't an item.
+ */
+std::vector<std::vector<Utils::Payload>> encodeChunks( const std::vector<Utils::Payload>& item,
+                                                       size_t size );
+
+/**
+ * @brief Encode a Chunk frame.
+ */
+Utils::Payload encodeChunk( const Chunk& chunk );
+
+/**
+ * @brief Decode a Chunk frame.
+ *
+ * @return The chunk's position, or nothing if the frame isn't a Chunk frame.
+ */
+std::optional<Chunk> decodeChunk( const Utils::Payload& frame );
+
+/**
+ * @brief The size of the datagram the given message would be encoded in.
+ */
+size_t datagramSize( const std::vector<Utils::Payload>& frames );
+
+/**
+ * @brief Encode a message as a single datagram.
+ */
+Utils::Payload encodeDatagram( const Datagram& datagram );
+
+/**
+ * @brief Decode a datagram.
+ *
+ * @return The datagram, or nothing if it isn't a clipd datagram, or is truncated.
+ */
+std::optional<Datagram> decodeDatagram( const Utils::Payload& datagram );
+
+/**
+ * @brief Encode a request for the datagrams in the given range.
+ */
+std::vector<Utils::Payload> encodeNack( const Nack& nack );
+
+/**
+ * @brief Decode a Nack frame.
+ *
+ * @return The range, or nothing if the frame isn't a Nack frame, or the range is empty.
+ */
+std::optional<Nack> decodeNack( const Utils::Payload& frame );
+
+/**
+ * @brief Encode a Timing frame.
+ */
+Utils::Payload encodeTiming( const Timing& timing );
+
+/**
+ * @brief Decode a Timing frame.
+ *
+ * @return The timings, or nothing if the frame isn't a Timing frame.
+ */
+std::optional<Timing> decodeTiming( const Utils::Payload& frame );
+
+/**
+ * @brief Decode a message header.
+ *
+ * @return The header, or nothing if the frame isn't a clipd header of a known version.
+ */
+std::optional<Header> decodeHeader( const Utils::Payload& frame );
+
+/**
+ * @brief Decode a clipboard item from the given frames.
+ *
+ * @details Raw contents are not copied; the item shares the body frame's Payload. The item's
+ * trace is not filled in.
+ *
+ * @param max_size The largest item to accept, like Capabilities::max_payload. The size in the
+ * header is checked before anything is allocated for the contents.
+ * @return The item, or nothing if the frames don't hold a valid item, it is larger than the
+ * given size, it was encoded with a codec this build doesn't support, its body is sealed, or its
+ * contents don't match the digest in its header.
+ */
+std::optional<Clipboard::Item>
+decodeItem( const std::vector<Utils::Payload>& frames,
+            uint64_t max_size = std::numeric_limits<uint64_t>::max() );
+} // namespace Clipd::Network::Protocol
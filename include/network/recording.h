@@ -0,0 +1,274 @@
+#pragma once
+#include "clipboard/item.h"
+#include "common.h"
+#include "network/transport.h"
+#include "utils/event_fd.h"
+#include "utils/metrics.h"
+#include "utils/payload.h"
+#include "utils/uuid.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Clipd::Network
+{
+/**
+ * @brief How much of the clipboard contents a Recorder keeps.
+ *
+ * @details Only the contents are redacted. Protocol headers and Timing frames are always recorded,
+ * so that a replay sends the daemon the same versions, codecs, and sizes as the original run.
+ */
+enum class RecordedContents : uint8_t
+{
+    Full = 0,     //!< The contents, as is. Replays are exact.
+    Hashed = 1,   //!< The size and hash64() of the contents. Replays keep duplicates duplicated.
+    Redacted = 2, //!< Only the size of the contents. Replays make every copy distinct.
+};
+
+//! @brief Parse `full`, `hash`, or `redact`.
+std::optional<RecordedContents> parseRecordedContents( std::string_view name );
+
+/**
+ * @brief Something that happened to a recorded node: a local copy, or a received event.
+ */
+struct Record
+{
+    enum class Kind
+    {
+        Local, //!< The local clipboard was copied to.
+        Event, //!< The transport received an event.
+    };
+
+    Kind kind = Kind::Event;
+    //! When it happened, since the recording started.
+    std::chrono::microseconds time = std::chrono::microseconds::zero();
+    Utils::Payload contents; //!< Local records only.
+    Event event;             //!< Event records only.
+};
+
+/**
+ * @brief A recorded workload, ready to be replayed.
+ *
+ * @details A recording is a compact binary file, starting with the header
+ *
+ * | Offset | Size | Field                                           |
+ * |--------|------|-------------------------------------------------|
+ * | 0      | 4    | Magic "CLPR"                                    |
+ * | 4      | 1    | Format version                                  |
+ * | 5      | 1    | RecordedContents                                |
+ * | 6      | 2    | Reserved, zero                                  |
+ * | 8      | 8    | Wall clock time the recording started, in us    |
+ * | 16     | 16   | The recorded node's uuid                        |
+ * | 32     | n    | The node's session, as a string                 |
+ *
+ * followed by the records, each of which is
+ *
+ * | Field     | Encoding                                                     |
+ * |-----------|--------------------------------------------------------------|
+ * | Time      | Varint microseconds since the previous record                |
+ * | Type      | Byte. Zero for a local copy, otherwise Event::Type plus one  |
+ * | Peer      | 16 byte uuid. Events only                                    |
+ * | Name      | String. Enter and Exit only                                  |
+ * | Address   | String. Enter only                                           |
+ * | Headers   | Varint count, then a name and value string each. Enter only  |
+ * | Group     | String. Join, Leave, and Shout only                          |
+ * | Frames    | Varint count, then each frame. Local copies, Whisper, Shout  |
+ *
+ * where a string is a varint length and its bytes, all integers are little-endian, and each frame
+ * is a byte for its RecordedContents, a varint size, then the frame itself, its 8 byte hash, or
+ * nothing. The contents of a protocol message are every frame between its header and its Timing
+ * frame. A hashed item is hashed by the digest in its header, so the same contents have the same
+ * hash whether they were copied locally, or received raw or deflated.
+ *
+ * A datagram is recorded as a Shout of the message it carries, to the group it was multicast to,
+ * and heartbeats aren't recorded at all.
+ *
+ * A recording cut short by a crash is read up to its last complete record.
+ */
+struct Recording
+{
+    Utils::Uuid node;
+    std::string session;
+    RecordedContents contents = RecordedContents::Full;
+    uint64_t started_us = 0;
+    std::vector<Record> records;
+
+    /**
+     * @brief Read a recording, replacing any redacted contents with synthetic contents of the
+     * same size.
+     *
+     * @details Synthetic contents are text-like, so they compress roughly like text. Hashed
+     * contents are generated from their hash, so equal contents are replayed as equal contents.
+     * Redacted items are re-encoded around their synthetic contents, with their recorded version
+     * and codec.
+     *
+     * @return The recording, or nothing if the stream doesn't start with a recording header.
+     */
+    static std::optional<Recording> read( std::istream& in );
+
+    /**
+     * @brief Shift the recorded wall clock times, and the versions of the recorded items, as if
+     * the recording had started at the given time, and ran at the given speed.
+     *
+     * @details A replay's local copies are versioned when they're replayed, so the items received
+     * by the recording have to be versioned as if they were received then too, or every local
+     * copy would be newer than every received item.
+     *
+     * @param start_us The wall clock time the replay started, in microseconds.
+     * @param speed How many times faster than recorded the replay runs. Zero, for a replay that
+     * runs as fast as possible, keeps the recorded spacing.
+     */
+    void retime( uint64_t start_us, double speed );
+
+    //! @brief Text-like contents of the given size, generated from the given seed.
+    static std::string synthesize( size_t size, uint64_t seed );
+};
+
+/**
+ * @brief Records a node's local copies, and the events its transport receives, to a stream.
+ *
+ * @details Local copies are recorded on the clipboard thread, and events on the network thread.
+ * Each record is encoded, and its contents hashed, without a lock, then appended to a shared
+ * buffer, which is written to the stream in large chunks, and by flush().
+ */
+class Recorder
+{
+public:
+    /**
+     * @param out The stream to write the recording to. Must outlive the recorder.
+     * @param node The recorded node's uuid.
+     * @param session The recorded node's session.
+     * @param contents How much of the clipboard contents to record.
+     */
+    Recorder( std::ostream& out, const Utils::Uuid& node, const std::string& session,
+              RecordedContents contents );
+    //! @brief Flush the buffered records.
+    ~Recorder();
+
+    Recorder( const Recorder& ) = delete;
+    Recorder& operator=( const Recorder& ) = delete;
+
+    //! @brief Record a local copy. May be called from any thread.
+    void recordLocal( const Clipboard::Item& item );
+    //! @brief Record a received event. May be called from any thread.
+    void recordEvent( const Event& event );
+    //! @brief Write the buffered records to the stream.
+    void flush();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    //! @brief Append a record of the given type and encoded fields, timed now.
+    void append( uint8_t type, const std::string& fields );
+    //! @brief Encode the given frames, redacting their contents.
+    void encodeFrames( std::string& fields, const std::vector<Utils::Payload>& frames ) const;
+    void encodeFrame( std::string& fields, const Utils::Payload& frame, uint64_t hash,
+                      bool contents ) const;
+
+    //! The buffer is written to the stream once it's this large.
+    static constexpr size_t flush_threshold = 64 * 1024;
+
+    std::ostream& m_out;
+    const RecordedContents m_contents;
+    const Clock::time_point m_start;
+    std::mutex m_mutex;
+    std::string m_buffer;
+    //! The time of the previous record, which each record's time is relative to.
+    std::chrono::microseconds m_previous = std::chrono::microseconds::zero();
+
+    Utils::Metrics::Counter& m_records =
+        Utils::Metrics::Registry::global().counter( "recording.records" );
+    Utils::Metrics::Counter& m_bytes =
+        Utils::Metrics::Registry::global().counter( "recording.bytes" );
+};
+
+/**
+ * @brief A Transport that records every event it receives, and is otherwise the given transport.
+ */
+class RecordingTransport : public Transport
+{
+public:
+    RecordingTransport( std::unique_ptr<Transport> transport, Recorder& recorder );
+
+    [[nodiscard]] Utils::Uuid uuid() const override;
+    void setHeader( const std::string& name, const std::string& value ) override;
+    void join( const std::string& group ) override;
+    bool start() override;
+    void stop() override;
+    void shout( const std::string& group, const std::vector<Utils::Payload>& frames ) override;
+    void whisper( const std::string& peer, const std::vector<Utils::Payload>& frames ) override;
+    bool joinMulticast( const std::string& group ) override;
+    void multicast( const std::string& group, const Utils::Payload& datagram ) override;
+    [[nodiscard]] bool encrypted() const override;
+    bool wait( std::chrono::milliseconds timeout, int wake_fd ) override;
+    size_t receive( const Handler& handler ) override;
+    [[nodiscard]] Clock::time_point now() const override;
+    [[nodiscard]] uint64_t wallClockMicros() const override;
+
+private:
+    void forward( const Event& event );
+
+    const std::unique_ptr<Transport> m_transport;
+    Recorder& m_recorder;
+    const Handler m_on_event;
+    //! The handler passed to receive(), while it's receiving.
+    const Handler* m_handler = nullptr;
+};
+
+/**
+ * @brief A Transport that receives the events injected into it, and sends nowhere.
+ *
+ * @details Replaying a recording injects its events at their recorded times, from another thread,
+ * into the transport of an otherwise ordinary PeerDiscoveryDaemon.
+ */
+class ReplayTransport : public Transport
+{
+public:
+    struct Stats
+    {
+        uint64_t shouts = 0;
+        uint64_t whispers = 0;
+        uint64_t bytes = 0; //!< The bytes shouted and whispered.
+    };
+
+    explicit ReplayTransport( const Utils::Uuid& uuid ) : m_uuid( uuid ) {}
+
+    //! @brief Receive the given event. May be called from any thread.
+    void inject( Event event );
+    [[nodiscard]] Stats stats() const;
+
+    [[nodiscard]] Utils::Uuid uuid() const override
+    {
+        return m_uuid;
+    }
+    void setHeader( const std::string& /*name*/, const std::string& /*value*/ ) override {}
+    void join( const std::string& /*group*/ ) override {}
+    bool start() override
+    {
+        return true;
+    }
+    void stop() override {}
+    void shout( const std::string& group, const std::vector<Utils::Payload>& frames ) override;
+    void whisper( const std::string& peer, const std::vector<Utils::Payload>& frames ) override;
+    bool wait( std::chrono::milliseconds timeout, int wake_fd ) override;
+    size_t receive( const Handler& handler ) override;
+
+private:
+    const Utils::Uuid m_uuid;
+    std::mutex m_mutex;
+    std::deque<Event> m_inbox;
+    Utils::EventFd m_ready;
+    std::atomic<uint64_t> m_shouts = 0;
+    std::atomic<uint64_t> m_whispers = 0;
+    std::atomic<uint64_t> m_bytes = 0;
+};
+} // namespace Clipd::Network
@@ -0,0 +1,66 @@
+#pragma once
+#include "clipboard/item.h"
+#include "common.h"
+#include "network/peer_discovery.h"
+#include "utils/hlc.h"
+#include "utils/metrics.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Clipd::Network
+{
+/**
+ * @brief Relays the items of the given sessions between two daemons: a node on the local subnet,
+ * usually discovering its peers by UDP beacons, and a node gossiping with the gateways of other
+ * subnets.
+ *
+ * @details UDP beacons don't cross subnets, so a session spanning several VLANs needs a gateway on
+ * each of them. Every item received on one side is copied to the other side, as if it had been
+ * copied locally, but with its original version, so every peer in the session still orders it by
+ * its origin's clock.
+ *
+ * Gateways only gossip with each other, so an item shouted to the remote side crosses each link
+ * between gateways once, rather than once per peer on the far subnet. Daemons never re-broadcast
+ * items they received, and the relay only forwards items strictly newer than the latest item it
+ * has seen of the session from either side, so an item that comes back, like from a second
+ * gateway on the same subnet, or the lazy PULL of an item it already has, stops at the relay.
+ *
+ * Items are received on each daemon's network thread, and forwarded through the other daemon's
+ * command queue, so the relay never blocks either network thread on the other.
+ *
+ * @note The relay must outlive both daemons' threads. It adds its sessions to both daemons, so it
+ * must be constructed before they're started.
+ */
+class Relay
+{
+public:
+    Relay( PeerDiscoveryDaemon& local, PeerDiscoveryDaemon& remote,
+           const std::vector<std::string>& sessions );
+
+    Relay( const Relay& ) = delete;
+    Relay& operator=( const Relay& ) = delete;
+
+private:
+    //! @brief Forward the given item to the given daemon, unless it's been seen already.
+    void forward( PeerDiscoveryDaemon& to, const std::string& session,
+                  const Clipboard::Item& item );
+
+    PeerDiscoveryDaemon& m_local;
+    PeerDiscoveryDaemon& m_remote;
+
+    std::mutex m_mutex;
+    //! The latest version of each session seen from either side.
+    std::unordered_map<std::string, Utils::Version> m_latest;
+
+    Utils::Metrics::Counter& m_to_local = Utils::Metrics::Registry::global().counter(
+        Utils::Metrics::labelled( "relay.forwarded", "to", "local" ) );
+    Utils::Metrics::Counter& m_to_remote = Utils::Metrics::Registry::global().counter(
+        Utils::Metrics::labelled( "relay.forwarded", "to", "remote" ) );
+    //! Items received that were no newer than the latest item relayed.
+    Utils::Metrics::Counter& m_duplicates =
+        Utils::Metrics::Registry::global().counter( "relay.duplicates" );
+};
+} // namespace Clipd::Network
@@ -0,0 +1,91 @@
+#pragma once
+#include "common.h"
+#include "utils/payload.h"
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Clipd::Network
+{
+/**
+ * @brief A symmetric key shared by every member of a session, which seals each clipboard item once,
+ * at its origin.
+ *
+ * @details The key is derived from the secret key of the certificate every member of the session
+ * shares, and the session's name, with BLAKE2b. The links between peers stay encrypted by CURVE,
+ * and an item's body is sealed on top, once, so it stays sealed end to end as it's forwarded and
+ * relayed, and every peer is sent the same ciphertext. Datagrams don't travel over the encrypted
+ * links, so they're sealed whole.
+ *
+ * A sealed message is a single frame, encoded as
+ *
+ * | Offset | Size | Field                                                     |
+ * |--------|------|-----------------------------------------------------------|
+ * | 0      | 4    | Magic "CLPS"                                              |
+ * | 4      | 8    | ID of the session key, a digest of the key                |
+ * | 12     | 24   | Random nonce                                              |
+ * | 36     | n    | The message's frames, encrypted, then a 16 byte MAC       |
+ *
+ * where each of the message's frames is its size, as a little-endian 32-bit integer, followed by
+ * its bytes. The frames are encrypted with XChaCha20-Poly1305, whose 192-bit nonces are safe to
+ * pick at random, and the first 12 bytes are authenticated along with them. The sender may also
+ * authenticate data that travels beside the sealed frame, like a datagram's sequence number, which
+ * the receiver must give open() to open it.
+ */
+class SessionKey
+{
+public:
+    //! The size of the secret keys are derived from.
+    static constexpr size_t secret_size = 32;
+
+    /**
+     * @brief Derive the key for the given session.
+     *
+     * @param secret The secret, shared by every member of the session, of secret_size bytes.
+     * @return The key, or nothing if the secret is the wrong size, or libsodium couldn't be
+     * initialized.
+     */
+    [[nodiscard]] static std::optional<SessionKey> derive( const std::vector<uint8_t>& secret,
+                                                           const std::string& session );
+
+    /**
+     * @brief Encrypt the given message into a single frame.
+     *
+     * @param associated Data sent beside the frame, which is authenticated, but not encrypted.
+     */
+    [[nodiscard]] Utils::Payload seal( const std::vector<Utils::Payload>& frames,
+                                       std::string_view associated = {} ) const;
+
+    /**
+     * @brief Decrypt a message sealed with this key.
+     *
+     * @param associated The data the message was sealed with.
+     * @return The message's frames, or nothing if the frame wasn't sealed with this key, or it or
+     * the associated data were tampered with.
+     */
+    [[nodiscard]] std::optional<std::vector<Utils::Payload>>
+    open( const Utils::Payload& sealed, std::string_view associated = {} ) const;
+
+    //! @brief The ID sealed messages are tagged with, so receivers can tell which key opens them.
+    [[nodiscard]] uint64_t id() const noexcept
+    {
+        return m_id;
+    }
+
+    /**
+     * @brief The ID of the key the given frame was sealed with.
+     *
+     * @return The key ID, or nothing if the frame isn't sealed.
+     */
+    [[nodiscard]] static std::optional<uint64_t> sealedWith( const Utils::Payload& frame );
+
+private:
+    SessionKey() = default;
+
+    std::array<unsigned char, 32> m_key = {};
+    uint64_t m_id = 0;
+};
+} // namespace Clipd::Network
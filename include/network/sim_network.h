@@ -0,0 +1,304 @@
+#pragma once
+#include "common.h"
+#include "network/transport.h"
+#include "utils/functor.h"
+#include "utils/uuid.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Clipd::Network
+{
+/**
+ * @brief A deterministic, in-process simulation of a Zyre network, for running hundreds or
+ * thousands of nodes in one process.
+ *
+ * @details Each simulated node is a SimTransport, usually driven by a PeerDiscoveryDaemon that
+ * isn't started. The network runs in virtual time: runUntil() pops the next scheduled delivery,
+ * advances the clock to it, and steps the daemon it was delivered to. Nothing depends on the real
+ * clock, the scheduler, or a random device, so the same seed always produces the same run.
+ *
+ * The simulation models what the daemon can observe of Zyre:
+ * * Peers discover each other within a beacon interval of starting, with an ENTER event followed
+ *   by a JOIN for each of their groups.
+ * * A SHOUT is sent as a separate copy to every peer in the group, like Zyre does, so shouting to
+ *   a large group is limited by the sender's uplink bandwidth.
+ * * Messages between a pair of peers arrive in order, like they do over Zyre's TCP connections.
+ *   A lost packet delays the message, and every message behind it, by a retransmission timeout.
+ * * Peers that can't reach each other, because one of them was silenced or the network was
+ *   partitioned, drop the messages between them. They report each other EVASIVE after the evasive
+ *   timeout, and EXIT after the expired timeout. Peers that can reach each other again, but have
+ *   already expired, discover each other again.
+ * * Nodes given different discovery scopes never discover each other, like Zyre nodes beaconing
+ *   on different ports. The membership events are counted, with an estimate of the bytes of the
+ *   ZRE messages behind them, but the beacons themselves aren't simulated.
+ * * If the network supports multicast, a datagram costs the sender's uplink once, however many
+ *   nodes joined its group, and each of them may lose it, without it being retransmitted.
+ *
+ * @note The network must outlive its transports. Nodes are never removed, only stopped.
+ */
+class SimNetwork
+{
+public:
+    using Clock = Transport::Clock;
+    using Step = Utils::Functor<std::optional<Clock::duration>()>;
+
+    struct Config
+    {
+        //! The one way delay between any two nodes.
+        Clock::duration latency = std::chrono::milliseconds( 1 );
+        //! Up to this much extra delay, picked at random for each message.
+        Clock::duration jitter = Clock::duration::zero();
+        //! Each node's uplink, in bytes per second. Zero is unlimited.
+        double bandwidth = 0;
+        //! The fraction of messages that lose a packet, and wait for it to be retransmitted.
+        double loss = 0;
+        //! How long a lost packet delays a message.
+        Clock::duration retransmit = std::chrono::milliseconds( 200 );
+        //! The longest a started node takes to be discovered. Zyre's default beacon interval.
+        Clock::duration beacon = std::chrono::seconds( 1 );
+        //! How long an unreachable peer takes to be reported EVASIVE. Zyre's default.
+        Clock::duration evasive = std::chrono::seconds( 5 );
+        //! How long an unreachable peer takes to be reported EXIT. Zyre's default.
+        Clock::duration expired = std::chrono::seconds( 30 );
+        //! Whether nodes can join multicast groups, and send datagrams to them.
+        bool multicast = false;
+        //! The fraction of datagrams each receiver loses.
+        double datagram_loss = 0;
+        //! Whether the links between nodes are encrypted, as with a CURVE certificate.
+        bool encrypted = false;
+        //! Seeds every random choice, including the nodes' uuids.
+        uint64_t seed = 1;
+    };
+
+    struct Stats
+    {
+        uint64_t messages = 0;    //!< Shouts and whispers sent, counting every copy of a shout.
+        uint64_t bytes = 0;       //!< The bytes in those messages.
+        uint64_t membership = 0;  //!< ENTER, EXIT, EVASIVE, JOIN, and LEAVE events sent.
+        uint64_t control = 0;     //!< The bytes of the ZRE HELLO, JOIN, and LEAVE messages sent.
+        uint64_t retransmits = 0; //!< Messages delayed by a lost packet.
+        uint64_t dropped = 0;     //!< Messages lost to a partition, or a silenced node.
+        uint64_t delivered = 0;   //!< Events delivered to nodes.
+        uint64_t datagrams = 0;   //!< Datagrams multicast, counting each once.
+        uint64_t lost = 0;        //!< Copies of datagrams lost by their receivers.
+    };
+
+    SimNetwork();
+    explicit SimNetwork( const Config& config );
+
+    /**
+     * @brief Create a transport for a new node, which joins the network when it's started.
+     *
+     * @param scope Only nodes with the same scope discover each other.
+     * @see ZyreTransport::Discovery::scope
+     */
+    std::unique_ptr<Transport> createTransport( const std::string& name,
+                                                const std::string& scope = {} );
+
+    /**
+     * @brief Start the given node, and step the given callback whenever it receives an event,
+     * or the time it asked to be stepped again has come.
+     *
+     * @param step Usually PeerDiscoveryDaemon::step(). Returns how long until it wants to be
+     * stepped again, if it does.
+     */
+    void attach( const Utils::Uuid& node, Step step );
+    //! @brief Stop the given node, which tells its peers it has left.
+    void stop( const Utils::Uuid& node );
+
+    //! @brief Cut the given nodes off from every other node, until heal() is called.
+    void partition( const std::vector<Utils::Uuid>& side );
+    //! @brief Reconnect every partitioned node.
+    void heal();
+    //! @brief Drop every message to or from the given node, as if it hung, until resume().
+    void silence( const Utils::Uuid& node );
+    void resume( const Utils::Uuid& node );
+
+    /**
+     * @brief Step every attached node, then deliver everything scheduled up to the deadline.
+     *
+     * @details Stepping every node first lets them handle commands posted since the last run.
+     */
+    void runUntil( Clock::time_point deadline );
+    void runFor( Clock::duration duration )
+    {
+        runUntil( m_now + duration );
+    }
+    /**
+     * @brief Run until nothing is left to deliver, or the given duration has passed.
+     *
+     * @return Whether the network went idle.
+     */
+    bool runUntilIdle( Clock::duration limit );
+
+    //! @brief The virtual time, which starts an arbitrary hour after the clock's epoch.
+    [[nodiscard]] Clock::time_point now() const noexcept
+    {
+        return m_now;
+    }
+    [[nodiscard]] uint64_t wallClockMicros() const;
+    [[nodiscard]] const Stats& stats() const noexcept
+    {
+        return m_stats;
+    }
+    //! @brief The bytes the given node has sent, counting every copy of its shouts.
+    [[nodiscard]] uint64_t bytesSent( const Utils::Uuid& node ) const;
+    //! @brief The peers the given node has discovered, each of which Zyre connects to.
+    [[nodiscard]] size_t connections( const Utils::Uuid& node ) const;
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return m_nodes.size();
+    }
+
+private:
+    friend class SimTransport;
+
+    struct Node
+    {
+        Utils::Uuid uuid;
+        std::string name;
+        std::string scope; //!< Nodes only discover the nodes with the same scope.
+        std::map<std::string, std::string> headers;
+        std::set<std::string> groups;
+        std::set<std::string> multicast_groups;
+        Step step;
+        bool started = false;
+        bool silent = false;
+        int side = 0; //!< Nodes on different sides of a partition can't reach each other.
+        //! When the node's uplink is done sending what has already been sent.
+        Clock::time_point uplink_free;
+        uint64_t bytes_sent = 0;
+        //! When the node asked to be stepped again, if it did.
+        std::optional<Clock::time_point> wake;
+        //! Whether this node has discovered each other node, by index.
+        std::vector<bool> known;
+        std::deque<Event> inbox;
+    };
+
+    struct Scheduled
+    {
+        enum class Kind
+        {
+            Deliver,  //!< Deliver the event to the node.
+            Wake,     //!< Step the node.
+            Liveness, //!< Report an unreachable peer as evasive or expired, if it still is.
+        };
+
+        Clock::time_point time;
+        Kind kind;
+        size_t to;
+        size_t from;
+        uint64_t cut; //!< Which time the link was cut, for liveness checks.
+        Event event;
+    };
+
+    //! @brief A small handle to a Scheduled slot, so that the heap doesn't shuffle whole events.
+    struct Pending
+    {
+        Clock::time_point time;
+        uint64_t sequence; //!< Breaks ties in the order things were scheduled.
+        size_t slot;
+
+        bool operator>( const Pending& rhs ) const noexcept
+        {
+            return time > rhs.time || ( time == rhs.time && sequence > rhs.sequence );
+        }
+    };
+
+    [[nodiscard]] size_t indexOf( const Utils::Uuid& uuid ) const;
+    [[nodiscard]] bool reachable( size_t a, size_t b ) const;
+    [[nodiscard]] bool knows( size_t observer, size_t peer ) const;
+    void setKnown( size_t observer, size_t peer, bool known );
+
+    void start( size_t node );
+    void stop( size_t node );
+    void release( size_t node );
+    void join( size_t node, const std::string& group );
+    void shout( size_t from, const std::string& group, const std::vector<Utils::Payload>& frames );
+    void whisper( size_t from, const std::string& peer, const std::vector<Utils::Payload>& frames );
+    bool joinMulticast( size_t node, const std::string& group );
+    void multicast( size_t from, const std::string& group, const Utils::Payload& datagram );
+    size_t receive( size_t node, const Transport::Handler& handler );
+
+    //! @brief An event about the given node, of the given type.
+    [[nodiscard]] Event describe( size_t node, Event::Type type ) const;
+    //! @brief Send the Enter and Join events that introduce one node to another.
+    void introduce( size_t from, size_t to, Clock::duration delay );
+    void send( size_t from, size_t to, Event event, Clock::duration delay = {} );
+    //! @brief When the given bytes, sent by the given node no sooner than the given time, have
+    //! left its uplink.
+    Clock::time_point transmit( size_t from, uint64_t bytes, Clock::time_point departure );
+    void schedule( Scheduled scheduled );
+    void wake( size_t node );
+    //! @brief Whether each pair of nodes can reach each other, by `a * size() + b`.
+    [[nodiscard]] std::vector<bool> reachability() const;
+    //! @brief Schedule liveness checks for peers that can no longer reach each other, and
+    //! rediscovery for expired peers that can.
+    void topologyChanged( const std::vector<bool>& before );
+    //! @brief Deliver everything scheduled up to the deadline.
+    void process( Clock::time_point deadline );
+    [[nodiscard]] static uint64_t link( size_t from, size_t to )
+    {
+        return ( static_cast<uint64_t>( from ) << 32U ) | to;
+    }
+
+    const Config m_config;
+    std::mt19937_64 m_random;
+    Clock::time_point m_now;
+    const Clock::time_point m_epoch;
+    uint64_t m_sequence = 0;
+    std::vector<Node> m_nodes;
+    std::unordered_map<Utils::Uuid, size_t> m_indices;
+    //! When the last message sent over each link arrives, to keep them in order. Only needed, and
+    //! only tracked, when jitter or loss can reorder them.
+    std::unordered_map<uint64_t, Clock::time_point> m_last_arrival;
+    //! How many times each link has been cut, so that liveness checks end when it's restored.
+    std::unordered_map<uint64_t, uint64_t> m_cuts;
+    std::priority_queue<Pending, std::vector<Pending>, std::greater<>> m_schedule;
+    std::vector<Scheduled> m_slots;
+    std::vector<size_t> m_free_slots;
+    Stats m_stats;
+};
+
+/**
+ * @brief A node on a SimNetwork.
+ */
+class SimTransport : public Transport
+{
+public:
+    SimTransport( SimNetwork& network, size_t index ) : m_network( network ), m_index( index ) {}
+    ~SimTransport() override;
+
+    SimTransport( const SimTransport& ) = delete;
+    SimTransport& operator=( const SimTransport& ) = delete;
+
+    [[nodiscard]] Utils::Uuid uuid() const override;
+    void setHeader( const std::string& name, const std::string& value ) override;
+    void join( const std::string& group ) override;
+    bool start() override;
+    void stop() override;
+    void shout( const std::string& group, const std::vector<Utils::Payload>& frames ) override;
+    void whisper( const std::string& peer, const std::vector<Utils::Payload>& frames ) override;
+    bool joinMulticast( const std::string& group ) override;
+    void multicast( const std::string& group, const Utils::Payload& datagram ) override;
+    [[nodiscard]] bool encrypted() const override;
+    //! @brief Simulated nodes are stepped by the network, so there's never anything to wait for.
+    bool wait( std::chrono::milliseconds timeout, int wake_fd ) override;
+    size_t receive( const Handler& handler ) override;
+    [[nodiscard]] Clock::time_point now() const override;
+    [[nodiscard]] uint64_t wallClockMicros() const override;
+
+private:
+    SimNetwork& m_network;
+    const size_t m_index;
+};
+} // namespace Clipd::Network
@@ -0,0 +1,101 @@
+#pragma once
+#include "common.h"
+#include "network/transport.h"
+
+#include <string>
+#include <unordered_map>
+
+namespace Clipd::Network
+{
+/**
+ * @brief A token bucket, which lets a steady rate of items through, and bursts of a few more.
+ */
+class TokenBucket
+{
+public:
+    using Clock = Transport::Clock;
+
+    TokenBucket() = default;
+    /**
+     * @param rate The tokens added per second. Zero lets everything through.
+     * @param burst The most tokens the bucket holds, which it starts with.
+     */
+    TokenBucket( double rate, double burst ) : m_rate( rate ), m_burst( burst ), m_tokens( burst )
+    {}
+
+    //! @brief Take a token, if the bucket holds one at the given time.
+    bool take( Clock::time_point now );
+    //! @brief How long until the bucket holds a token.
+    [[nodiscard]] Clock::duration wait( Clock::time_point now ) const;
+
+private:
+    [[nodiscard]] double tokens( Clock::time_point now ) const;
+
+    double m_rate = 0;
+    double m_burst = 1;
+    double m_tokens = 1;
+    Clock::time_point m_refilled;
+};
+
+/**
+ * @brief Limits how many clipboard items each peer, and each session, may pass per second.
+ *
+ * @details A script rewriting the clipboard in a loop would otherwise have every node in its
+ * session decode, and set its clipboard to, every one of its updates. An item only passes if both
+ * its peer's bucket and its session's bucket hold a token, so one peer can't use up a session's
+ * whole budget, and many peers together can't exceed it either.
+ *
+ * The throttle only decides. Its owner holds back the items it refuses, keeping only the latest
+ * one from each peer, and offers it again once wait() has passed, so a flood is delivered as a
+ * steady trickle of its latest items, rather than queueing without bound.
+ *
+ * The throttle doesn't own a clock, or a thread, and isn't thread safe.
+ */
+class Throttle
+{
+public:
+    using Clock = TokenBucket::Clock;
+
+    struct Config
+    {
+        //! Items per second from each peer. Zero is unlimited.
+        double peer_rate = 0;
+        //! Items per second in each session, from every peer together. Zero is unlimited.
+        double session_rate = 0;
+        //! How many items beyond the rate may pass back to back.
+        double burst = 4;
+    };
+
+    Throttle() = default;
+    explicit Throttle( const Config& config ) : m_config( config ) {}
+
+    [[nodiscard]] bool enabled() const noexcept
+    {
+        return m_config.peer_rate > 0 || m_config.session_rate > 0;
+    }
+
+    /**
+     * @brief Let an item from the given peer, in the given session, through, if both of their
+     * buckets hold a token, which it takes.
+     */
+    bool admit( const std::string& session, const std::string& peer, Clock::time_point now );
+
+    /**
+     * @brief How long until admit() would let an item from the given peer through.
+     */
+    [[nodiscard]] Clock::duration wait( const std::string& session, const std::string& peer,
+                                        Clock::time_point now ) const;
+
+    //! @brief Forget the bucket of a peer that left.
+    void forget( const std::string& peer );
+
+private:
+    [[nodiscard]] static Clock::duration wait( const std::unordered_map<std::string, TokenBucket>&
+                                                   buckets,
+                                               const std::string& key, Clock::time_point now );
+
+    Config m_config;
+    std::unordered_map<std::string, TokenBucket> m_peers;
+    std::unordered_map<std::string, TokenBucket> m_sessions;
+};
+} // namespace Clipd::Network
@@ -0,0 +1,136 @@
+#pragma once
+#include "clipboard/trace.h"
+#include "common.h"
+#include "utils/functor.h"
+#include "utils/payload.h"
+#include "utils/uuid.h"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Clipd::Network
+{
+/**
+ * @brief Something that happened on the peer-to-peer network, received by a Transport.
+ *
+ * @details Events mirror the ZRE events that Zyre reports, apart from Datagram events, which
+ * aren't from Zyre, and don't say which peer sent them. Which fields are set depends on the
+ * event's type.
+ */
+struct Event
+{
+    enum class Type
+    {
+        Enter,    //!< A peer was discovered.
+        Exit,     //!< A peer left the network, or hasn't been heard from in too long.
+        Evasive,  //!< A peer hasn't been heard from recently.
+        Join,     //!< A peer joined a group.
+        Leave,    //!< A peer left a group.
+        Whisper,  //!< A peer sent a message to this node.
+        Shout,    //!< A peer sent a message to a group this node is in.
+        Datagram, //!< A datagram was multicast to a group this node joined with joinMulticast().
+    };
+
+    Type type = Type::Enter;
+    std::string peer;                           //!< The peer's uuid, as 32 hex characters.
+    std::string name;                           //!< The peer's name.
+    std::string group;                          //!< Join, Leave, Shout, and Datagram only.
+    std::string address;                        //!< Enter only.
+    std::map<std::string, std::string> headers; //!< Enter only.
+    std::vector<Utils::Payload> frames;         //!< Whisper, Shout, and Datagram only.
+};
+
+/**
+ * @brief How a PeerDiscoveryDaemon discovers, and messages, its peers.
+ *
+ * @details The daemon only ever uses its transport from the network thread, or from whatever
+ * drives PeerDiscoveryDaemon::step() in a simulation. The ZyreTransport is the real network; the
+ * SimTransport simulates one, so that thousands of nodes can be run deterministically in a single
+ * process.
+ *
+ * The transport is also the daemon's clock, so that a simulated network can run in virtual time.
+ */
+class Transport
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Handler = Utils::Functor<void( const Event& )>;
+
+    virtual ~Transport() = default;
+
+    //! @brief This node's uuid, which peers identify it by.
+    [[nodiscard]] virtual Utils::Uuid uuid() const = 0;
+    //! @brief Advertise a header to peers in our Enter event. Must be set before start().
+    virtual void setHeader( const std::string& name, const std::string& value ) = 0;
+    //! @brief Join a group, to receive the messages shouted to it.
+    virtual void join( const std::string& group ) = 0;
+
+    /**
+     * @brief Start discovering, and being discovered by, peers.
+     *
+     * @return Whether the transport started.
+     */
+    virtual bool start() = 0;
+    //! @brief Leave the network, and release the transport's resources.
+    virtual void stop() = 0;
+
+    //! @brief Send the given frames to every peer in the given group.
+    virtual void shout( const std::string& group, const std::vector<Utils::Payload>& frames ) = 0;
+    //! @brief Send the given frames to the given peer.
+    virtual void whisper( const std::string& peer, const std::vector<Utils::Payload>& frames ) = 0;
+
+    /**
+     * @brief Receive the datagrams multicast to the given group, as Datagram events.
+     *
+     * @details Multicast is an optional, unreliable, fast path alongside Zyre's TCP connections.
+     * Transports that don't support it, or haven't been configured to, never join a group.
+     *
+     * @return Whether the group was joined, so that datagrams can be multicast to it.
+     */
+    virtual bool joinMulticast( const std::string& /*group*/ )
+    {
+        return false;
+    }
+    /**
+     * @brief Send a datagram to every node that joined the given multicast group, including any
+     * on this host, which may lose or reorder it.
+     */
+    virtual void multicast( const std::string& /*group*/, const Utils::Payload& /*datagram*/ ) {}
+    /**
+     * @brief Whether the links between nodes are encrypted.
+     *
+     * @details Datagrams aren't sent over those links, so they aren't encrypted either.
+     */
+    [[nodiscard]] virtual bool encrypted() const
+    {
+        return false;
+    }
+
+    /**
+     * @brief Block until an event has been received, the given file descriptor is readable, or
+     * the timeout has passed.
+     *
+     * @return Whether there's anything to handle.
+     */
+    virtual bool wait( std::chrono::milliseconds timeout, int wake_fd ) = 0;
+    /**
+     * @brief Handle every event received so far, without blocking.
+     *
+     * @return The number of events handled.
+     */
+    virtual size_t receive( const Handler& handler ) = 0;
+
+    //! @brief The current time, to schedule and measure the daemon's work by.
+    [[nodiscard]] virtual Clock::time_point now() const
+    {
+        return Clock::now();
+    }
+    //! @brief The current wall clock time, to send to peers, in microseconds since the epoch.
+    [[nodiscard]] virtual uint64_t wallClockMicros() const
+    {
+        return Clipboard::Trace::wallClockMicros();
+    }
+};
+} // namespace Clipd::Network
@@ -0,0 +1,135 @@
+#pragma once
+#include "common.h"
+#include "network/transport.h"
+
+#include <czmq.h>
+#include <zcert.h>
+#include <zyre.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace Clipd::Network
+{
+/**
+ * @brief The Transport for real networks, implemented with a Zyre node.
+ *
+ * @details The node is created, and configured, by the constructor, started by start(), and
+ * stopped and destroyed by stop(). Between start() and stop(), only the network thread may use it.
+ *
+ * On a large network, every node meshing with every other costs each node a TCP connection, and
+ * the peer's state, for every clipd host on the LAN, whether or not they share a session. Giving
+ * the nodes a discovery scope, like their session, has each one beacon on a port derived from it,
+ * so nodes only discover, and connect to, nodes with the same scope. Beacons can be sent less
+ * often too, as long as the evasive timeout is longer than the beacon interval, since a beacon
+ * is what keeps a quiet peer from being pinged.
+ *
+ * Multicast groups are plain UDP sockets alongside the Zyre node, one for each group, bound to an
+ * address in the organization-local scope 239.255.0.0/16 picked by a hash of the group's name, on
+ * the configured port and interface. Datagrams aren't sent beyond the local network, and are
+ * looped back to other nodes on the same host.
+ */
+class ZyreTransport : public Transport
+{
+public:
+    /**
+     * @brief How the Zyre node discovers, and is reachable by, its peers.
+     */
+    struct Discovery
+    {
+        //! The port to perform UDP peer discovery broadcasts on. Zero uses Zyre's default, 5670.
+        uint16_t port = 0;
+        //! The network interface to broadcast on, like `eth0`. Empty lets Zyre pick one.
+        std::string interface;
+        //! The endpoint to listen for peers on, like `tcp://10.0.0.2:5671`, instead of an
+        //! ephemeral port. Setting an endpoint replaces UDP broadcasts with gossip discovery.
+        std::string endpoint;
+        //! The gossip endpoint to bind, if this node is a gossip hub.
+        std::string gossip_bind;
+        //! The gossip endpoint to connect to, to learn the endpoints of the other peers.
+        std::string gossip_connect;
+        //! Only discover nodes with the same scope, by beaconing on a port derived from it and the
+        //! discovery port. Empty discovers every node beaconing on the discovery port.
+        std::string scope;
+        //! How often to broadcast a beacon. Zero uses Zyre's default, a second.
+        std::chrono::milliseconds beacon_interval {0};
+        //! How long a silent peer takes to be reported EVASIVE, and pinged. Zero uses Zyre's
+        //! default, 5 seconds.
+        std::chrono::milliseconds evasive_timeout {0};
+        //! How long a silent peer takes to be reported EXIT. Zero uses Zyre's default, 30 seconds.
+        std::chrono::milliseconds expired_timeout {0};
+        //! The UDP port to multicast datagrams to groups on. Zero disables multicast.
+        uint16_t multicast_port = 0;
+    };
+
+    /**
+     * @brief Create and configure the Zyre node.
+     *
+     * @param discovery How to discover peers.
+     * @param certificate The CURVE certificate to encrypt the TCP traffic between hosts with, if
+     * any. The transport takes ownership of it.
+     * @param verbose Whether to enable Zyre's verbose output.
+     */
+    ZyreTransport( const Discovery& discovery, zcert_t* certificate, bool verbose = false );
+
+    /**
+     * @brief The port nodes with the given scope beacon on.
+     *
+     * @details The port is picked by a hash of the scope from the 4096 ports above the discovery
+     * port, so scopes may share a port. Nodes with scopes that collide discover each other, which
+     * only costs them the connections the scope was meant to save.
+     */
+    static uint16_t beaconPort( uint16_t port, const std::string& scope );
+    ~ZyreTransport() override;
+
+    ZyreTransport( const ZyreTransport& ) = delete;
+    ZyreTransport& operator=( const ZyreTransport& ) = delete;
+
+    [[nodiscard]] Utils::Uuid uuid() const override
+    {
+        return m_uuid;
+    }
+    void setHeader( const std::string& name, const std::string& value ) override;
+    void join( const std::string& group ) override;
+    bool start() override;
+    void stop() override;
+    void shout( const std::string& group, const std::vector<Utils::Payload>& frames ) override;
+    void whisper( const std::string& peer, const std::vector<Utils::Payload>& frames ) override;
+    bool joinMulticast( const std::string& group ) override;
+    void multicast( const std::string& group, const Utils::Payload& datagram ) override;
+    [[nodiscard]] bool encrypted() const override
+    {
+        return m_encrypted;
+    }
+    bool wait( std::chrono::milliseconds timeout, int wake_fd ) override;
+    size_t receive( const Handler& handler ) override;
+
+private:
+    /**
+     * @brief Parse a message from the Zyre socket into an Event.
+     *
+     * @return Whether the message was a known event type.
+     */
+    static bool parseMessage( zmsg_t* msg, Event& event );
+    //! @brief Handle every datagram received on the given group's socket.
+    size_t receiveDatagrams( const std::string& group, int fd, const Handler& handler );
+
+    struct MulticastGroup
+    {
+        std::string group;
+        int fd = -1;
+        uint32_t address = 0; //!< The group's IPv4 address, in network byte order.
+    };
+
+    zcert_t* m_zcert;
+    const bool m_encrypted; //!< Whether m_zcert was given, since stop() destroys it.
+    zyre_t* m_znode;
+    const Utils::Uuid m_uuid;
+    const std::string m_interface;
+    const uint16_t m_multicast_port;
+    std::vector<MulticastGroup> m_multicast;
+    //! Reused by wait(), so that polling doesn't allocate.
+    std::vector<zmq_pollitem_t> m_poll_items;
+};
+} // namespace Clipd::Network
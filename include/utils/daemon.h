@@ -17,8 +17,9 @@ public:
     /**
      * @brief Start the daemon thread in the background.
      *
-     * @details The started thread repeatedly calls Daemon::loop() as fast as possible. This is a
-     * non-blocking function call.
+     * @details The started thread calls Daemon::setup(), then repeatedly calls Daemon::loop() as
+     * fast as possible, and finally calls Daemon::teardown() once stopped. This is a non-blocking
+     * function call.
      */
     virtual void start()
     {
@@ -29,10 +30,12 @@ public:
 
         m_is_running = true;
         m_thread = std::thread( [this]() {
+            this->setup();
             while( this->m_is_running )
             {
                 this->loop();
             }
+            this->teardown();
         } );
     }
 
@@ -56,11 +59,24 @@ public:
     }
 
 protected:
+    /**
+     * @brief Called on the background thread before the first Daemon::loop() iteration.
+     *
+     * @details Resources that must only be used from a single thread (like ZeroMQ sockets) should
+     * be started here, and released in Daemon::teardown().
+     */
+    virtual void setup() {}
+
     /**
      * @brief The background loop body.
      */
     virtual void loop() = 0;
 
+    /**
+     * @brief Called on the background thread after the last Daemon::loop() iteration.
+     */
+    virtual void teardown() {}
+
 private:
     std::thread m_thread;
     std::atomic<bool> m_is_running;
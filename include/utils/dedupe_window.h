@@ -0,0 +1,178 @@
+#pragma once
+#include "common.h"
+#include "utils/uuid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+namespace Clipd::Utils
+{
+/**
+ * @brief Remembers which message IDs have been seen recently, in a fixed amount of memory.
+ *
+ * @details Messages can arrive by more than one path, like from two gateways, or down a FanoutTree
+ * and from a repair, and the copies are best dropped before they're decoded. Remembering every ID
+ * would grow without bound, so the window is a ring of Bloom filters, each covering an equal slice
+ * of the window. IDs are added to the newest filter, looked up in all of them, and the oldest
+ * filter is cleared as each slice of time passes. So an ID is remembered for at least
+ * `window * ( buckets - 1 ) / buckets`, and at most `window`, and memory never grows.
+ *
+ * Like any Bloom filter, contains() has no false negatives, but has false positives, more of them
+ * the more IDs are added per slice. A caller that can't afford to drop a message wrongly should
+ * only consult the window for messages it has some other reason to suspect, like an item that
+ * isn't newer than the one it has.
+ *
+ * The window doesn't own a clock, and isn't thread safe.
+ */
+class DedupeWindow
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config
+    {
+        //! The longest an ID is remembered for.
+        Clock::duration window = std::chrono::seconds( 30 );
+        //! How many slices the window is split into. More slices expire IDs more precisely.
+        size_t buckets = 4;
+        //! The bits in each slice's filter, rounded up to a power of two.
+        size_t bits = 16 * 1024;
+        //! The bits set for each ID.
+        size_t hashes = 4;
+    };
+
+    DedupeWindow() : DedupeWindow( Config {} ) {}
+    explicit DedupeWindow( const Config& config ) :
+        m_config( config ),
+        m_mask( roundUp( std::max<size_t>( config.bits, 64 ) ) - 1 ),
+        m_words_per_bucket( ( m_mask + 1 ) / 64 ),
+        m_words( std::max<size_t>( config.buckets, 1 ) * m_words_per_bucket, 0 )
+    {
+        m_config.buckets = std::max<size_t>( config.buckets, 1 );
+        m_config.hashes = std::max<size_t>( config.hashes, 1 );
+    }
+
+    /**
+     * @brief Whether the given ID has probably been inserted within the window.
+     */
+    [[nodiscard]] bool contains( const Uuid& id, Clock::time_point now )
+    {
+        advance( now );
+        const auto [h1, h2] = hashes( id );
+        for( size_t bucket = 0; bucket < m_config.buckets; ++bucket )
+        {
+            const uint64_t* words = &m_words[bucket * m_words_per_bucket];
+            bool all = true;
+            for( size_t i = 0; i < m_config.hashes && all; ++i )
+            {
+                const uint64_t bit = ( h1 + i * h2 ) & m_mask;
+                all = ( words[bit / 64] >> ( bit % 64 ) & 1 ) != 0;
+            }
+            if( all )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Remember the given ID for the rest of the window.
+     */
+    void insert( const Uuid& id, Clock::time_point now )
+    {
+        advance( now );
+        const auto [h1, h2] = hashes( id );
+        uint64_t* words = &m_words[m_current * m_words_per_bucket];
+        for( size_t i = 0; i < m_config.hashes; ++i )
+        {
+            const uint64_t bit = ( h1 + i * h2 ) & m_mask;
+            words[bit / 64] |= uint64_t( 1 ) << ( bit % 64 );
+        }
+    }
+
+    /**
+     * @brief Remember the given ID.
+     *
+     * @return Whether it was new, or had probably been seen already.
+     */
+    bool insertIfNew( const Uuid& id, Clock::time_point now )
+    {
+        if( contains( id, now ) )
+        {
+            return false;
+        }
+        insert( id, now );
+        return true;
+    }
+
+    //! @brief The bytes used by the filters, which never changes.
+    [[nodiscard]] size_t memory() const noexcept
+    {
+        return m_words.size() * sizeof( uint64_t );
+    }
+
+private:
+    static size_t roundUp( size_t bits )
+    {
+        size_t rounded = 1;
+        while( rounded < bits )
+        {
+            rounded <<= 1;
+        }
+        return rounded;
+    }
+
+    static uint64_t mix( uint64_t z )
+    {
+        z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+        z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+        return z ^ ( z >> 31 );
+    }
+
+    //! @brief Two independent hashes of the ID, combined to pick each bit, as Kirsch and
+    //! Mitzenmacher suggest. IDs needn't be random, so both halves are mixed.
+    static std::pair<uint64_t, uint64_t> hashes( const Uuid& id )
+    {
+        const uint64_t h1 = mix( id.hi ^ mix( id.lo ) );
+        const uint64_t h2 = mix( id.lo + 0x9e3779b97f4a7c15ULL * id.hi ) | 1;
+        return {h1, h2};
+    }
+
+    //! @brief Clear the slices that have fallen out of the window.
+    void advance( Clock::time_point now )
+    {
+        const auto slice = std::max( m_config.window / static_cast<int>( m_config.buckets ),
+                                     Clock::duration( 1 ) );
+        if( m_started == Clock::time_point {} )
+        {
+            m_started = now;
+            return;
+        }
+        size_t expired = 0;
+        while( now - m_started >= slice && expired < m_config.buckets )
+        {
+            m_current = ( m_current + 1 ) % m_config.buckets;
+            const auto first = static_cast<std::ptrdiff_t>( m_current * m_words_per_bucket );
+            std::fill_n( m_words.begin() + first, m_words_per_bucket, 0 );
+            m_started += slice;
+            ++expired;
+        }
+        // After a long quiet period, every slice has been cleared, so skip ahead.
+        if( now - m_started >= slice )
+        {
+            m_started = now;
+        }
+    }
+
+    Config m_config;
+    const uint64_t m_mask;
+    const size_t m_words_per_bucket;
+    std::vector<uint64_t> m_words;
+    //! The slice IDs are inserted into, and when it started.
+    size_t m_current = 0;
+    Clock::time_point m_started;
+};
+} // namespace Clipd::Utils
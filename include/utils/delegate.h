@@ -1,5 +1,6 @@
 #pragma once
 #include "utils/functor.h"
+#include "utils/probes.h"
 
 #include <list>
 #include <mutex>
@@ -47,7 +48,9 @@ public:
         std::unique_lock<std::mutex> lock( m_functors_mutex );
         for( const auto& functor : m_functors )
         {
+            CLIPD_PROBE2( delegate_invoke, this, &functor );
             functor( args... );
+            CLIPD_PROBE2( delegate_return, this, &functor );
         }
     }
 
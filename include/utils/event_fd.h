@@ -0,0 +1,57 @@
+#pragma once
+#include "common.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace Clipd::Utils
+{
+/**
+ * @brief A pollable, non-blocking, wakeup notification.
+ *
+ * @details Wraps a Linux eventfd so that a thread blocked in `zmq_poll()` (or `poll()`) can be
+ * woken by another thread without sharing any ZeroMQ sockets.
+ */
+class EventFd
+{
+public:
+    EventFd() : m_fd( eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) {}
+
+    ~EventFd()
+    {
+        if( m_fd >= 0 )
+        {
+            close( m_fd );
+        }
+    }
+
+    EventFd( const EventFd& ) = delete;
+    EventFd& operator=( const EventFd& ) = delete;
+
+    /**
+     * @brief Wake whoever is polling the file descriptor.
+     */
+    void notify() const
+    {
+        const uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = write( m_fd, &one, sizeof( one ) );
+    }
+
+    /**
+     * @brief Reset the notification, so that the descriptor is no longer readable.
+     */
+    void drain() const
+    {
+        uint64_t count = 0;
+        [[maybe_unused]] ssize_t read_ = read( m_fd, &count, sizeof( count ) );
+    }
+
+    [[nodiscard]] int fd() const noexcept
+    {
+        return m_fd;
+    }
+
+private:
+    int m_fd;
+};
+} // namespace Clipd::Utils
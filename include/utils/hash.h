@@ -0,0 +1,65 @@
+#pragma once
+#include "common.h"
+
+#include <cstring>
+#include <string_view>
+
+namespace Clipd::Utils
+{
+/**
+ * @brief A fast, non-cryptographic, 64-bit hash that is stable across hosts and builds.
+ *
+ * @details `std::hash` is fine for in-process tables, but its output is implementation defined, so
+ * it can't be used to compare contents between peers. This is Austin Appleby's MurmurHash64A,
+ * which consumes eight bytes per round.
+ *
+ * @param data The bytes to hash.
+ * @param seed An optional seed.
+ * @return The 64-bit digest of the given bytes.
+ */
+inline uint64_t hash64( std::string_view data, uint64_t seed = 0 )
+{
+    constexpr uint64_t m = 0xc6a4a7935bd1e995ULL;
+    constexpr int r = 47;
+
+    const size_t len = data.size();
+    uint64_t h = seed ^ ( len * m );
+
+    const char* p = data.data();
+    const char* const end = p + ( len / 8 ) * 8;
+    for( ; p != end; p += 8 )
+    {
+        uint64_t k = 0;
+        std::memcpy( &k, p, sizeof( k ) );
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    const auto* tail = reinterpret_cast<const unsigned char*>( p );
+    switch( len & 7 )
+    {
+        case 7: h ^= uint64_t( tail[6] ) << 48; [[fallthrough]];
+        case 6: h ^= uint64_t( tail[5] ) << 40; [[fallthrough]];
+        case 5: h ^= uint64_t( tail[4] ) << 32; [[fallthrough]];
+        case 4: h ^= uint64_t( tail[3] ) << 24; [[fallthrough]];
+        case 3: h ^= uint64_t( tail[2] ) << 16; [[fallthrough]];
+        case 2: h ^= uint64_t( tail[1] ) << 8; [[fallthrough]];
+        case 1:
+            h ^= uint64_t( tail[0] );
+            h *= m;
+            break;
+        default: break;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+} // namespace Clipd::Utils
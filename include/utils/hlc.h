@@ -0,0 +1,129 @@
+#pragma once
+#include "common.h"
+#include "utils/uuid.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+namespace Clipd::Utils
+{
+/**
+ * @brief A Hybrid Logical Clock.
+ *
+ * @details HLC timestamps stay close to wall-clock time, but, like Lamport clocks, every event
+ * that has observed another event is guaranteed a strictly larger timestamp, regardless of clock
+ * skew between hosts.
+ *
+ * A timestamp packs the physical time in milliseconds into the upper 48 bits, and a logical
+ * counter, used to order events within the same millisecond, into the lower 16 bits. So
+ * timestamps compare correctly as plain integers.
+ *
+ * The clock is lock-free, so it is safe to stamp local events on one thread while merging remote
+ * timestamps on another.
+ *
+ * @see https://cse.buffalo.edu/tech-reports/2014-04.pdf
+ */
+class HybridLogicalClock
+{
+public:
+    using Timestamp = uint64_t;
+    //! A source of physical time in milliseconds since the epoch.
+    using PhysicalClock = uint64_t ( * )();
+
+    static constexpr unsigned logical_bits = 16;
+    static constexpr Timestamp logical_mask = ( Timestamp( 1 ) << logical_bits ) - 1;
+
+    explicit HybridLogicalClock( PhysicalClock physical = &wallClockMillis ) :
+        m_physical( physical )
+    {}
+
+    /**
+     * @brief Get a timestamp for a local (or send) event.
+     */
+    Timestamp now()
+    {
+        const Timestamp physical = m_physical() << logical_bits;
+        Timestamp last = m_last.load( std::memory_order_relaxed );
+        Timestamp next = 0;
+        do
+        {
+            next = physical > last ? physical : last + 1;
+        } while( !m_last.compare_exchange_weak( last, next, std::memory_order_acq_rel ) );
+        return next;
+    }
+
+    /**
+     * @brief Merge a timestamp received from a remote peer.
+     *
+     * @return A local timestamp strictly greater than the remote one.
+     */
+    Timestamp update( Timestamp remote )
+    {
+        const Timestamp physical = m_physical() << logical_bits;
+        Timestamp last = m_last.load( std::memory_order_relaxed );
+        Timestamp next = 0;
+        do
+        {
+            const Timestamp latest = std::max( last, remote );
+            next = physical > latest ? physical : latest + 1;
+        } while( !m_last.compare_exchange_weak( last, next, std::memory_order_acq_rel ) );
+        return next;
+    }
+
+    //! @brief Get the physical milliseconds of the given timestamp.
+    static constexpr uint64_t physicalMillis( Timestamp t ) noexcept
+    {
+        return t >> logical_bits;
+    }
+
+    //! @brief The default physical clock.
+    static uint64_t wallClockMillis()
+    {
+        using namespace std::chrono;
+        return static_cast<uint64_t>(
+            duration_cast<milliseconds>( system_clock::now().time_since_epoch() ).count() );
+    }
+
+private:
+    PhysicalClock m_physical;
+    std::atomic<Timestamp> m_last = 0;
+};
+
+/**
+ * @brief The version of a clipboard item.
+ *
+ * @details Versions are totally ordered by their HLC timestamp, with ties broken by the uuid of
+ * the peer that created the item.
+ */
+struct Version
+{
+    HybridLogicalClock::Timestamp timestamp = 0;
+    Uuid origin;
+
+    bool operator==( const Version& rhs ) const noexcept
+    {
+        return timestamp == rhs.timestamp && origin == rhs.origin;
+    }
+    bool operator!=( const Version& rhs ) const noexcept
+    {
+        return !( *this == rhs );
+    }
+    bool operator<( const Version& rhs ) const noexcept
+    {
+        return timestamp < rhs.timestamp || ( timestamp == rhs.timestamp && origin < rhs.origin );
+    }
+    bool operator>( const Version& rhs ) const noexcept
+    {
+        return rhs < *this;
+    }
+};
+
+inline std::ostream& operator<<( std::ostream& o, const Version& version )
+{
+    return o << HybridLogicalClock::physicalMillis( version.timestamp ) << "."
+             << ( version.timestamp & HybridLogicalClock::logical_mask ) << "@"
+             << version.origin.hex();
+}
+} // namespace Clipd::Utils
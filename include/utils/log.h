@@ -0,0 +1,469 @@
+#pragma once
+#include "common.h"
+#include "utils/daemon.h"
+#include "utils/event_fd.h"
+#include "utils/metrics.h"
+#include "utils/payload.h"
+
+#include <poll.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string_view>
+
+/**
+ * @brief The least severe log level compiled in. Lines below it cost nothing at all.
+ *
+ * @details Defaults to Debug, so Trace lines are compiled out unless built with
+ * `-DCLIPD_LOG_MIN_LEVEL=0`.
+ */
+#ifndef CLIPD_LOG_MIN_LEVEL
+#define CLIPD_LOG_MIN_LEVEL 1
+#endif
+
+namespace Clipd::Utils::Log
+{
+enum class Level : uint8_t
+{
+    Trace = 0,
+    Debug = 1,
+    Info = 2,
+    Warn = 3,
+    Error = 4,
+};
+
+constexpr Level compiled_level = static_cast<Level>( CLIPD_LOG_MIN_LEVEL );
+
+inline std::string_view levelName( Level level )
+{
+    switch( level )
+    {
+        case Level::Trace:
+            return "TRACE";
+        case Level::Debug:
+            return "DEBUG";
+        case Level::Info:
+            return "INFO ";
+        case Level::Warn:
+            return "WARN ";
+        case Level::Error:
+            return "ERROR";
+    }
+    return "?????";
+}
+
+/**
+ * @brief A single formatted log line, as stored in the Ring.
+ */
+struct Record
+{
+    static constexpr size_t capacity = 512;
+
+    uint64_t time_us; //!< Wall clock time the line was logged, in microseconds since the epoch.
+    Level level;
+    bool truncated;  //!< Whether the line didn't fit, and was cut short.
+    uint16_t length; //!< The number of bytes of text.
+    std::array<char, capacity> text;
+};
+
+/**
+ * @brief A bounded, lock-free, multi-producer single-consumer ring of log Records.
+ *
+ * @details This is Dmitry Vyukov's bounded queue, with a sequence number per slot. Producers claim
+ * a slot with one CAS, format their line directly into it, and publish it by bumping its
+ * sequence number, so logging never allocates or takes a lock. If the writer has fallen behind
+ * and the ring is full, lines are dropped (and counted) rather than blocking the caller, so the
+ * logging threads never wait on the terminal.
+ *
+ * @see http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+class Ring
+{
+public:
+    /**
+     * @param slots The number of lines the ring holds. Must be a power of two.
+     */
+    explicit Ring( size_t slots = 1024 ) :
+        m_mask( slots - 1 ),
+        m_slots( std::make_unique<Slot[]>( slots ) )
+    {
+        for( size_t i = 0; i < slots; ++i )
+        {
+            m_slots[i].sequence.store( i, std::memory_order_relaxed );
+        }
+    }
+
+    //! @brief A slot claimed by a producer.
+    struct Claim
+    {
+        Record* record = nullptr; //!< Null if the ring was full.
+        size_t position = 0;
+    };
+
+    /**
+     * @brief Claim a slot to format a line into. Safe to call from any thread.
+     *
+     * @return The claimed slot, which must be published, or a null record if the ring is full.
+     */
+    Claim claim()
+    {
+        size_t position = m_enqueue.load( std::memory_order_relaxed );
+        while( true )
+        {
+            Slot& slot = m_slots[position & m_mask];
+            const size_t sequence = slot.sequence.load( std::memory_order_acquire );
+            const auto difference =
+                static_cast<std::ptrdiff_t>( sequence ) - static_cast<std::ptrdiff_t>( position );
+            if( difference == 0 )
+            {
+                if( m_enqueue.compare_exchange_weak( position, position + 1,
+                                                     std::memory_order_relaxed ) )
+                {
+                    return Claim {&slot.record, position};
+                }
+            } else if( difference < 0 )
+            {
+                m_dropped.fetch_add( 1, std::memory_order_relaxed );
+                return Claim {};
+            } else
+            {
+                position = m_enqueue.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    /**
+     * @brief Hand a claimed record to the writer.
+     */
+    void publish( const Claim& claim )
+    {
+        m_slots[claim.position & m_mask].sequence.store( claim.position + 1,
+                                                         std::memory_order_release );
+        // Pairs with the fence in drain(), as in CommandQueue.
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        // Only the first line after a drain needs to pay for the syscall.
+        if( !m_wake_pending.exchange( true, std::memory_order_acq_rel ) )
+        {
+            m_wakeup.notify();
+        }
+    }
+
+    /**
+     * @brief Pop and handle every published record. Must only be called from the writer thread.
+     *
+     * @return The number of records handled.
+     */
+    template <typename Handler>
+    size_t drain( Handler&& handler )
+    {
+        m_wakeup.drain();
+        m_wake_pending.store( false, std::memory_order_release );
+        // Order the store before the loads of the slots below, so that a line published after
+        // them sees the cleared flag, and wakes the writer again.
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        size_t handled = 0;
+        while( true )
+        {
+            Slot& slot = m_slots[m_dequeue & m_mask];
+            if( slot.sequence.load( std::memory_order_acquire ) != m_dequeue + 1 )
+            {
+                return handled;
+            }
+            handler( static_cast<const Record&>( slot.record ) );
+            slot.sequence.store( m_dequeue + m_mask + 1, std::memory_order_release );
+            ++m_dequeue;
+            ++handled;
+        }
+    }
+
+    //! @brief The number of lines dropped because the ring was full.
+    [[nodiscard]] uint64_t dropped() const noexcept
+    {
+        return m_dropped.load( std::memory_order_relaxed );
+    }
+
+    //! @brief The file descriptor that becomes readable when lines have been published.
+    [[nodiscard]] int fd() const noexcept
+    {
+        return m_wakeup.fd();
+    }
+
+private:
+    struct Slot
+    {
+        Record record;
+        std::atomic<size_t> sequence = 0;
+    };
+
+    const size_t m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+    alignas( 64 ) std::atomic<size_t> m_enqueue = 0;
+    alignas( 64 ) size_t m_dequeue = 0;
+    std::atomic<uint64_t> m_dropped = 0;
+    EventFd m_wakeup;
+    std::atomic<bool> m_wake_pending = false;
+};
+
+/**
+ * @brief The process-wide log: a Ring, and the runtime level.
+ */
+class Logger
+{
+public:
+    static Logger& instance()
+    {
+        static Logger logger;
+        return logger;
+    }
+
+    void setLevel( Level level ) noexcept
+    {
+        m_level.store( level, std::memory_order_relaxed );
+    }
+
+    [[nodiscard]] bool enabled( Level level ) const noexcept
+    {
+        return level >= m_level.load( std::memory_order_relaxed );
+    }
+
+    Ring& ring() noexcept
+    {
+        return m_ring;
+    }
+
+private:
+    std::atomic<Level> m_level = Level::Info;
+    Ring m_ring;
+};
+
+/**
+ * @brief A stream buffer over a fixed span of memory, that stops writing when it's full.
+ */
+class SpanBuffer : public std::streambuf
+{
+public:
+    SpanBuffer( char* begin, size_t size )
+    {
+        setp( begin, begin + size );
+    }
+
+    [[nodiscard]] size_t written() const
+    {
+        return static_cast<size_t>( pptr() - pbase() );
+    }
+
+    [[nodiscard]] bool overflowed() const noexcept
+    {
+        return m_overflowed;
+    }
+
+protected:
+    int_type overflow( int_type ) override
+    {
+        m_overflowed = true;
+        return traits_type::eof();
+    }
+
+    std::streamsize xsputn( const char* s, std::streamsize count ) override
+    {
+        const auto space = static_cast<std::streamsize>( epptr() - pptr() );
+        const std::streamsize n = std::min( count, space );
+        std::copy( s, s + n, pptr() );
+        pbump( static_cast<int>( n ) );
+        if( n < count )
+        {
+            m_overflowed = true;
+        }
+        return n;
+    }
+
+private:
+    bool m_overflowed = false;
+};
+
+/**
+ * @brief Formats one log line directly into a claimed Ring slot, and publishes it when destroyed.
+ *
+ * @details Use the CLIPD_LOG_* macros rather than constructing Lines directly.
+ */
+class Line
+{
+public:
+    Line( Ring& ring, Level level ) :
+        m_ring( ring ),
+        m_claim( ring.claim() ),
+        m_buffer( m_claim.record ? m_claim.record->text.data() : nullptr,
+                  m_claim.record ? Record::capacity : 0 ),
+        m_stream( &m_buffer )
+    {
+        if( m_claim.record )
+        {
+            using namespace std::chrono;
+            m_claim.record->time_us = static_cast<uint64_t>(
+                duration_cast<microseconds>( system_clock::now().time_since_epoch() ).count() );
+            m_claim.record->level = level;
+        }
+    }
+
+    ~Line()
+    {
+        if( m_claim.record )
+        {
+            m_claim.record->length = static_cast<uint16_t>( m_buffer.written() );
+            m_claim.record->truncated = m_buffer.overflowed();
+            m_ring.publish( m_claim );
+        }
+    }
+
+    Line( const Line& ) = delete;
+    Line& operator=( const Line& ) = delete;
+
+    std::ostream& stream()
+    {
+        return m_stream;
+    }
+
+private:
+    Ring& m_ring;
+    Ring::Claim m_claim;
+    SpanBuffer m_buffer;
+    std::ostream m_stream;
+};
+
+/**
+ * @brief Log at most the first few bytes of a (potentially multi-megabyte) payload.
+ */
+struct Preview
+{
+    const Payload& payload;
+    size_t limit;
+};
+
+inline Preview preview( const Payload& payload, size_t limit = 64 )
+{
+    return Preview {payload, limit};
+}
+
+inline std::ostream& operator<<( std::ostream& o, const Preview& preview )
+{
+    const std::string_view view = preview.payload.view();
+    if( view.size() <= preview.limit )
+    {
+        return o << '"' << view << '"';
+    }
+    return o << '"' << view.substr( 0, preview.limit ) << "\"... (" << view.size() << " bytes)";
+}
+
+/**
+ * @brief Writes the log lines to a file, on its own thread.
+ *
+ * @details The writer sleeps until lines are published, and then writes everything in the ring
+ * with a single flush, so a burst of lines costs one write. Lines still in the ring when the
+ * writer is stopped are written before its thread exits.
+ */
+class Writer : public Daemon
+{
+public:
+    explicit Writer( std::FILE* file, Ring& ring = Logger::instance().ring() ) :
+        m_file( file ),
+        m_ring( ring )
+    {}
+
+    /**
+     * @brief Write every published line. Must only be called from one thread at a time.
+     */
+    void flush()
+    {
+        m_ring.drain( [this]( const Record& record ) { write( record ); } );
+
+        const uint64_t dropped = m_ring.dropped();
+        if( dropped != m_reported_drops )
+        {
+            m_dropped.add( dropped - m_reported_drops );
+            std::fprintf( m_file, "... %llu log lines dropped\n",
+                          static_cast<unsigned long long>( dropped - m_reported_drops ) );
+            m_reported_drops = dropped;
+        }
+        std::fflush( m_file );
+    }
+
+protected:
+    void loop() override
+    {
+        // Bound the poll so that the loop condition is re-checked once stopped.
+        pollfd wakeup = {m_ring.fd(), POLLIN, 0};
+        ::poll( &wakeup, 1, 100 );
+        flush();
+    }
+
+    void teardown() override
+    {
+        flush();
+    }
+
+private:
+    void write( const Record& record )
+    {
+        const auto seconds = static_cast<std::time_t>( record.time_us / 1000000 );
+        std::tm local {};
+        localtime_r( &seconds, &local );
+        std::array<char, 16> time {};
+        std::strftime( time.data(), time.size(), "%H:%M:%S", &local );
+
+        const std::string_view level = levelName( record.level );
+        std::string_view text( record.text.data(), record.length );
+        if( !text.empty() && text.back() == '\n' )
+        {
+            text.remove_suffix( 1 );
+        }
+        std::fprintf( m_file, "[%s.%06u] %.*s %.*s%s\n", time.data(),
+                      static_cast<unsigned>( record.time_us % 1000000 ),
+                      static_cast<int>( level.size() ), level.data(),
+                      static_cast<int>( text.size() ), text.data(),
+                      record.truncated ? "... (truncated)" : "" );
+    }
+
+    std::FILE* m_file;
+    Ring& m_ring;
+    uint64_t m_reported_drops = 0;
+    Metrics::Counter& m_dropped = Metrics::Registry::global().counter( "log.dropped" );
+};
+} // namespace Clipd::Utils::Log
+
+/**
+ * @brief Log a line at the given level.
+ *
+ * @details The line is formatted with `operator<<`, as in
+ * @code
+ * CLIPD_LOG_INFO( "Peer " << name << " entered" );
+ * @endcode
+ * Nothing is evaluated if the level is disabled, and lines below CLIPD_LOG_MIN_LEVEL are removed
+ * at compile time.
+ */
+#define CLIPD_LOG( level, message )                                                               \
+    do                                                                                            \
+    {                                                                                             \
+        if constexpr( ( level ) >= ::Clipd::Utils::Log::compiled_level )                          \
+        {                                                                                         \
+            auto& clipd_logger_ = ::Clipd::Utils::Log::Logger::instance();                        \
+            if( clipd_logger_.enabled( level ) )                                                  \
+            {                                                                                     \
+                ::Clipd::Utils::Log::Line clipd_line_( clipd_logger_.ring(), level );             \
+                clipd_line_.stream() << message;                                                  \
+            }                                                                                     \
+        }                                                                                         \
+    } while( false )
+
+#define CLIPD_LOG_TRACE( message ) CLIPD_LOG( ::Clipd::Utils::Log::Level::Trace, message )
+#define CLIPD_LOG_DEBUG( message ) CLIPD_LOG( ::Clipd::Utils::Log::Level::Debug, message )
+#define CLIPD_LOG_INFO( message ) CLIPD_LOG( ::Clipd::Utils::Log::Level::Info, message )
+#define CLIPD_LOG_WARN( message ) CLIPD_LOG( ::Clipd::Utils::Log::Level::Warn, message )
+#define CLIPD_LOG_ERROR( message ) CLIPD_LOG( ::Clipd::Utils::Log::Level::Error, message )
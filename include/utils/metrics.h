@@ -0,0 +1,410 @@
+#pragma once
+#include "common.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Clipd::Utils::Metrics
+{
+namespace Detail
+{
+//! The number of independent cells each Counter is split into.
+constexpr size_t shards = 16;
+
+/**
+ * @brief The shard the calling thread updates.
+ *
+ * @details Threads are assigned shards round robin the first time they record a metric, so that
+ * the handful of clipd threads never write to the same cache line.
+ */
+inline size_t threadShard() noexcept
+{
+    static std::atomic<size_t> next_shard = 0;
+    thread_local const size_t shard = next_shard.fetch_add( 1, std::memory_order_relaxed ) % shards;
+    return shard;
+}
+
+//! @brief A value padded out to its own cache line.
+struct alignas( 64 ) Cell
+{
+    std::atomic<uint64_t> value = 0;
+};
+} // namespace Detail
+
+/**
+ * @brief A monotonically increasing count of events.
+ *
+ * @details Each thread increments its own cache line with a relaxed atomic add, so incrementing
+ * never contends with other threads. Reading the counter sums every thread's cell, and is only
+ * meant for the (rare) snapshots.
+ */
+class Counter
+{
+public:
+    void add( uint64_t n = 1 ) noexcept
+    {
+        m_cells[Detail::threadShard()].value.fetch_add( n, std::memory_order_relaxed );
+    }
+
+    [[nodiscard]] uint64_t value() const noexcept
+    {
+        uint64_t total = 0;
+        for( const auto& cell : m_cells )
+        {
+            total += cell.value.load( std::memory_order_relaxed );
+        }
+        return total;
+    }
+
+private:
+    std::array<Detail::Cell, Detail::shards> m_cells;
+};
+
+/**
+ * @brief A value that can go up and down, like the depth of a queue.
+ */
+class Gauge
+{
+public:
+    void set( int64_t value ) noexcept
+    {
+        m_value.store( value, std::memory_order_relaxed );
+    }
+
+    void add( int64_t delta ) noexcept
+    {
+        m_value.fetch_add( delta, std::memory_order_relaxed );
+    }
+
+    [[nodiscard]] int64_t value() const noexcept
+    {
+        return m_value.load( std::memory_order_relaxed );
+    }
+
+private:
+    std::atomic<int64_t> m_value = 0;
+};
+
+/**
+ * @brief A lock-free histogram of unsigned values, like latencies in nanoseconds.
+ *
+ * @details This uses the same log-linear bucketing as HdrHistogram: values below
+ * `2 * sub_buckets` get a bucket each, and every power of two above that is split into
+ * `sub_buckets` linear buckets. So every recorded value is within 1 / sub_buckets (~6%) of its
+ * bucket's bounds, from nanoseconds up to the full 64 bit range, in a fixed 8 KiB of buckets.
+ *
+ * Recording a value is a count-leading-zeros, and two relaxed atomic adds.
+ */
+class Histogram
+{
+public:
+    static constexpr unsigned sub_bucket_bits = 4;
+    static constexpr uint64_t sub_buckets = uint64_t( 1 ) << sub_bucket_bits;
+    static constexpr size_t bucket_count = 2 * sub_buckets + ( 63 - sub_bucket_bits ) * sub_buckets;
+
+    void record( uint64_t value ) noexcept
+    {
+        m_buckets[bucketIndex( value )].fetch_add( 1, std::memory_order_relaxed );
+        m_sum.fetch_add( value, std::memory_order_relaxed );
+
+        uint64_t max = m_max.load( std::memory_order_relaxed );
+        while( value > max &&
+               !m_max.compare_exchange_weak( max, value, std::memory_order_relaxed ) )
+        {
+        }
+    }
+
+    template <typename Rep, typename Period>
+    void record( std::chrono::duration<Rep, Period> duration ) noexcept
+    {
+        const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>( duration );
+        record( static_cast<uint64_t>( std::max<int64_t>( nanoseconds.count(), 0 ) ) );
+    }
+
+    [[nodiscard]] uint64_t count() const noexcept
+    {
+        uint64_t total = 0;
+        for( const auto& bucket : m_buckets )
+        {
+            total += bucket.load( std::memory_order_relaxed );
+        }
+        return total;
+    }
+
+    [[nodiscard]] uint64_t sum() const noexcept
+    {
+        return m_sum.load( std::memory_order_relaxed );
+    }
+
+    [[nodiscard]] uint64_t max() const noexcept
+    {
+        return m_max.load( std::memory_order_relaxed );
+    }
+
+    /**
+     * @brief Get the value below which the given fraction of the recorded values fall.
+     *
+     * @param quantile The fraction, between 0 and 1.
+     * @return The upper bound of the bucket the quantile falls in, or zero if nothing has been
+     * recorded.
+     */
+    [[nodiscard]] uint64_t percentile( double quantile ) const noexcept
+    {
+        const uint64_t total = count();
+        if( total == 0 )
+        {
+            return 0;
+        }
+        const auto rank = static_cast<uint64_t>( quantile * static_cast<double>( total - 1 ) ) + 1;
+
+        uint64_t seen = 0;
+        for( size_t i = 0; i < bucket_count; ++i )
+        {
+            seen += m_buckets[i].load( std::memory_order_relaxed );
+            if( seen >= rank )
+            {
+                return std::min( bucketUpperBound( i ), max() );
+            }
+        }
+        return max();
+    }
+
+    [[nodiscard]] static size_t bucketIndex( uint64_t value ) noexcept
+    {
+        if( value < 2 * sub_buckets )
+        {
+            return static_cast<size_t>( value );
+        }
+        const auto msb = static_cast<unsigned>( 63 - __builtin_clzll( value ) );
+        const unsigned shift = msb - sub_bucket_bits;
+        const uint64_t mantissa = ( value >> shift ) - sub_buckets;
+        return static_cast<size_t>( 2 * sub_buckets + ( shift - 1 ) * sub_buckets + mantissa );
+    }
+
+    [[nodiscard]] static uint64_t bucketUpperBound( size_t index ) noexcept
+    {
+        if( index < 2 * sub_buckets )
+        {
+            return index;
+        }
+        const uint64_t offset = index - 2 * sub_buckets;
+        const uint64_t shift = offset / sub_buckets + 1;
+        const uint64_t lower = ( sub_buckets + offset % sub_buckets ) << shift;
+        return lower + ( ( uint64_t( 1 ) << shift ) - 1 );
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> m_buckets {};
+    std::atomic<uint64_t> m_sum = 0;
+    std::atomic<uint64_t> m_max = 0;
+};
+
+/**
+ * @brief A point in time copy of every metric in a Registry.
+ */
+struct Snapshot
+{
+    struct HistogramSummary
+    {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+        uint64_t p999;
+    };
+
+    std::map<std::string, uint64_t> counters;
+    std::map<std::string, int64_t> gauges;
+    std::map<std::string, HistogramSummary> histograms;
+
+    //! @brief Write the snapshot as a human readable table.
+    void writeText( std::ostream& o ) const
+    {
+        for( const auto& [name, value] : counters )
+        {
+            o << name << " " << value << "\n";
+        }
+        for( const auto& [name, value] : gauges )
+        {
+            o << name << " " << value << "\n";
+        }
+        for( const auto& [name, h] : histograms )
+        {
+            o << name << " count=" << h.count << " p50=" << h.p50 << " p90=" << h.p90
+              << " p99=" << h.p99 << " p999=" << h.p999 << " max=" << h.max << "\n";
+        }
+    }
+
+    //! @brief Write the snapshot as a single JSON object.
+    void writeJson( std::ostream& o ) const
+    {
+        const auto quoted = []( std::ostream& out, std::string_view s ) -> std::ostream& {
+            out << '"';
+            for( const char c : s )
+            {
+                if( c == '"' || c == '\\' )
+                {
+                    out << '\\';
+                }
+                out << c;
+            }
+            return out << '"';
+        };
+
+        o << "{\"counters\":{";
+        const char* separator = "";
+        for( const auto& [name, value] : counters )
+        {
+            quoted( o << separator, name ) << ":" << value;
+            separator = ",";
+        }
+        o << "},\"gauges\":{";
+        separator = "";
+        for( const auto& [name, value] : gauges )
+        {
+            quoted( o << separator, name ) << ":" << value;
+            separator = ",";
+        }
+        o << "},\"histograms\":{";
+        separator = "";
+        for( const auto& [name, h] : histograms )
+        {
+            quoted( o << separator, name )
+                << ":{\"count\":" << h.count << ",\"sum\":" << h.sum << ",\"max\":" << h.max
+                << ",\"p50\":" << h.p50 << ",\"p90\":" << h.p90 << ",\"p99\":" << h.p99
+                << ",\"p999\":" << h.p999 << "}";
+            separator = ",";
+        }
+        o << "}}";
+    }
+};
+
+/**
+ * @brief Owns every named metric.
+ *
+ * @details Looking a metric up by name takes a lock, so callers look their metrics up once, and
+ * keep the returned reference; metrics are never destroyed before the registry, except acquired
+ * counters once they're released. Recording to a metric never locks.
+ */
+class Registry
+{
+public:
+    //! @brief The registry the clipd daemons record to.
+    static Registry& global()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    Counter& counter( const std::string& name )
+    {
+        return lookup( m_counters, name );
+    }
+
+    /**
+     * @brief Get the counter of an instance that comes and goes, like a peer.
+     *
+     * @details Unlike counter(), the counter is destroyed once every acquire() of it is released,
+     * so the registry doesn't keep a counter for every peer it has ever seen. Don't also look
+     * such a counter up with counter(), whose reference would dangle.
+     */
+    Counter& acquire( const std::string& name )
+    {
+        const std::lock_guard lock( m_mutex );
+        ++m_references[name];
+        auto& counter = m_counters[name];
+        if( !counter )
+        {
+            counter = std::make_unique<Counter>();
+        }
+        return *counter;
+    }
+
+    //! @brief Release a counter from acquire(), destroying it if nothing else acquired it.
+    void release( const std::string& name )
+    {
+        const std::lock_guard lock( m_mutex );
+        const auto it = m_references.find( name );
+        if( it != m_references.end() && --it->second == 0 )
+        {
+            m_references.erase( it );
+            m_counters.erase( name );
+        }
+    }
+
+    Gauge& gauge( const std::string& name )
+    {
+        return lookup( m_gauges, name );
+    }
+
+    Histogram& histogram( const std::string& name )
+    {
+        return lookup( m_histograms, name );
+    }
+
+    [[nodiscard]] Snapshot snapshot() const
+    {
+        const std::lock_guard lock( m_mutex );
+
+        Snapshot snapshot;
+        for( const auto& [name, counter] : m_counters )
+        {
+            snapshot.counters.emplace( name, counter->value() );
+        }
+        for( const auto& [name, gauge] : m_gauges )
+        {
+            snapshot.gauges.emplace( name, gauge->value() );
+        }
+        for( const auto& [name, h] : m_histograms )
+        {
+            snapshot.histograms.emplace(
+                name, Snapshot::HistogramSummary {h->count(), h->sum(), h->max(),
+                                                  h->percentile( 0.5 ), h->percentile( 0.9 ),
+                                                  h->percentile( 0.99 ), h->percentile( 0.999 )} );
+        }
+        return snapshot;
+    }
+
+private:
+    template <typename Metric>
+    Metric& lookup( std::map<std::string, std::unique_ptr<Metric>>& metrics,
+                    const std::string& name )
+    {
+        const std::lock_guard lock( m_mutex );
+        auto& metric = metrics[name];
+        if( !metric )
+        {
+            metric = std::make_unique<Metric>();
+        }
+        return *metric;
+    }
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<Counter>> m_counters;
+    //! The number of times each acquired counter is held.
+    std::map<std::string, size_t> m_references;
+    std::map<std::string, std::unique_ptr<Gauge>> m_gauges;
+    std::map<std::string, std::unique_ptr<Histogram>> m_histograms;
+};
+
+/**
+ * @brief Name a metric of a particular instance, like `network.bytes_sent{peer=...}`.
+ */
+inline std::string labelled( std::string_view name, std::string_view key, std::string_view value )
+{
+    std::string labelled( name );
+    labelled.append( "{" ).append( key ).append( "=" ).append( value ).append( "}" );
+    return labelled;
+}
+} // namespace Clipd::Utils::Metrics
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace Clipd::Utils
+{
+/**
+ * @brief An unbounded, lock-free, multi-producer single-consumer queue.
+ *
+ * @details This is Dmitry Vyukov's non-intrusive MPSC node-based queue. Pushing is wait-free (one
+ * atomic exchange), and popping is lock-free, but may only be done from a single thread.
+ *
+ * A push that has swapped the head, but has not yet linked the previous node, is briefly invisible
+ * to the consumer. pop() reports the queue as empty in that window, so the consumer must be woken
+ * again by the producer after every push (which CommandQueue does).
+ *
+ * @see http://www.1024cores.net/home/lock-free-algorithms/queues/non-intrusive-mpsc-node-based-queue
+ *
+ * @tparam T The queued value type.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue() : m_head( new Node() ), m_tail( m_head.load( std::memory_order_relaxed ) ) {}
+
+    ~MpscQueue()
+    {
+        while( pop() )
+        {
+        }
+        delete m_tail;
+    }
+
+    MpscQueue( const MpscQueue& ) = delete;
+    MpscQueue& operator=( const MpscQueue& ) = delete;
+
+    /**
+     * @brief Push a value onto the queue. Safe to call from any number of threads.
+     */
+    void push( T value )
+    {
+        auto* node = new Node( std::move( value ) );
+        Node* prev = m_head.exchange( node, std::memory_order_acq_rel );
+        prev->next.store( node, std::memory_order_release );
+    }
+
+    /**
+     * @brief Pop the oldest value from the queue. Must only be called from the consumer thread.
+     *
+     * @return The popped value, or nothing if the queue is empty.
+     */
+    std::optional<T> pop()
+    {
+        Node* tail = m_tail;
+        Node* next = tail->next.load( std::memory_order_acquire );
+        if( !next )
+        {
+            return std::nullopt;
+        }
+
+        std::optional<T> value( std::move( *next->value ) );
+        next->value.reset();
+        m_tail = next;
+        delete tail;
+        return value;
+    }
+
+private:
+    struct Node
+    {
+        Node() = default;
+        explicit Node( T&& v ) : value( std::move( v ) ) {}
+
+        std::atomic<Node*> next = nullptr;
+        std::optional<T> value;
+    };
+
+    std::atomic<Node*> m_head;
+    Node* m_tail;
+};
+} // namespace Clipd::Utils
@@ -0,0 +1,144 @@
+#pragma once
+#include "common.h"
+#include "utils/metrics.h"
+
+#include <algorithm>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace Clipd::Utils
+{
+/**
+ * @brief Count bytes of clipboard contents copied into another buffer.
+ *
+ * @details The copies are reported as the "payload.bytes_copied" counter, so that the bytes copied
+ * per update can be measured. Encoding the contents, like compressing or sealing them, isn't a
+ * copy.
+ */
+inline void countCopied( size_t bytes ) noexcept
+{
+    static Metrics::Counter& copied = Metrics::Registry::global().counter( "payload.bytes_copied" );
+    copied.add( bytes );
+}
+
+/**
+ * @brief An immutable, reference counted, byte buffer.
+ *
+ * @details A Payload is the unit of clipboard contents that flows from the clipboard listener,
+ * through the delegates, to the network (and back again). Copying a Payload copies a pointer and
+ * bumps an atomic reference count; the bytes themselves are never copied. The storage is released
+ * when the last Payload referencing it is destroyed, regardless of which thread that happens on.
+ *
+ * The storage is type erased, so a Payload can own a `std::string` captured from the clipboard,
+ * or a `zframe_t` received from the network, without the utilities depending on CZMQ.
+ */
+class Payload
+{
+public:
+    Payload() = default;
+
+    /**
+     * @brief Take ownership of the given string without copying its contents.
+     */
+    explicit Payload( std::string&& contents )
+    {
+        auto owner = std::make_shared<const std::string>( std::move( contents ) );
+        m_data = owner->data();
+        m_size = owner->size();
+        m_owner = std::move( owner );
+    }
+
+    /**
+     * @brief Wrap a region of memory kept alive by the given owner.
+     *
+     * @param data The start of the (immutable) buffer.
+     * @param size The size of the buffer in bytes.
+     * @param owner The object keeping the buffer alive. Its deleter is called exactly once, when
+     * the last Payload referencing the buffer is destroyed.
+     */
+    Payload( const char* data, size_t size, std::shared_ptr<const void> owner ) :
+        m_owner( std::move( owner ) ),
+        m_data( data ),
+        m_size( size )
+    {}
+
+    [[nodiscard]] const char* data() const noexcept
+    {
+        return m_data;
+    }
+
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return m_size == 0;
+    }
+
+    /**
+     * @brief Get a non-owning view of the buffer.
+     *
+     * @note The view is only valid for as long as a Payload referencing the buffer is alive.
+     */
+    [[nodiscard]] std::string_view view() const noexcept
+    {
+        return std::string_view( m_data, m_size );
+    }
+
+    /**
+     * @brief Copy the buffer into a new string.
+     *
+     * @note This is the only method that copies the contents. Only use it at API boundaries that
+     * require an owned string, like `clip::set_text()`. The copy is counted by countCopied().
+     */
+    [[nodiscard]] std::string str() const
+    {
+        countCopied( m_size );
+        return std::string( m_data, m_size );
+    }
+
+    /**
+     * @brief A part of the buffer, sharing it without copying.
+     *
+     * @details The part is clamped to the end of the buffer.
+     */
+    [[nodiscard]] Payload slice( size_t offset, size_t size ) const
+    {
+        offset = std::min( offset, m_size );
+        return Payload( m_data + offset, std::min( size, m_size - offset ), m_owner );
+    }
+
+    /**
+     * @brief Get the number of Payloads sharing this buffer.
+     */
+    [[nodiscard]] long use_count() const noexcept
+    {
+        return m_owner.use_count();
+    }
+
+private:
+    std::shared_ptr<const void> m_owner;
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+inline bool operator==( const Payload& lhs, std::string_view rhs )
+{
+    return lhs.view() == rhs;
+}
+
+inline bool operator!=( const Payload& lhs, std::string_view rhs )
+{
+    return !( lhs == rhs );
+}
+
+inline std::ostream& operator<<( std::ostream& o, const Payload& payload )
+{
+    return o << payload.view();
+}
+} // namespace Clipd::Utils
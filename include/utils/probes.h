@@ -0,0 +1,39 @@
+#pragma once
+
+/**
+ * @file probes.h
+ * @brief USDT (SystemTap SDT) static tracepoints.
+ *
+ * @details Each probe compiles to a single `nop` instruction, plus a note in the ELF binary that
+ * tells `perf`, `bpftrace`, and SystemTap where the probe is, and where to find its arguments.
+ * Until a tracer attaches, nothing is recorded, so the probes stay in release builds. The
+ * arguments are still evaluated, so they should be cheap: integers and pointers to existing
+ * strings.
+ *
+ * The probes are all in the `clipd` provider. List them with
+ * @code
+ * bpftrace -l 'usdt:build/main:clipd:*'
+ * @endcode
+ * and see `tools/bpftrace/` for example scripts.
+ *
+ * The probes are no-ops if `<sys/sdt.h>` (from systemtap-sdt-dev) isn't installed, or if
+ * `CLIPD_DISABLE_PROBES` is defined.
+ */
+
+#if !defined( CLIPD_DISABLE_PROBES ) && __has_include( <sys/sdt.h>)
+#include <sys/sdt.h>
+
+#define CLIPD_PROBES_ENABLED 1
+#define CLIPD_PROBE0( name ) DTRACE_PROBE( clipd, name )
+#define CLIPD_PROBE1( name, a ) DTRACE_PROBE1( clipd, name, a )
+#define CLIPD_PROBE2( name, a, b ) DTRACE_PROBE2( clipd, name, a, b )
+#define CLIPD_PROBE3( name, a, b, c ) DTRACE_PROBE3( clipd, name, a, b, c )
+#define CLIPD_PROBE4( name, a, b, c, d ) DTRACE_PROBE4( clipd, name, a, b, c, d )
+#else
+#define CLIPD_PROBES_ENABLED 0
+#define CLIPD_PROBE0( name ) static_cast<void>( 0 )
+#define CLIPD_PROBE1( name, a ) static_cast<void>( 0 )
+#define CLIPD_PROBE2( name, a, b ) static_cast<void>( 0 )
+#define CLIPD_PROBE3( name, a, b, c ) static_cast<void>( 0 )
+#define CLIPD_PROBE4( name, a, b, c, d ) static_cast<void>( 0 )
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+#include "common.h"
+
+#include <limits>
+#include <random>
+
+namespace Clipd::Utils
+{
+/**
+ * @brief A fast, non-cryptographic, 64-bit pseudorandom number generator.
+ *
+ * @details This is Blackman and Vigna's xoshiro256**, which has a 256-bit state, passes BigCrush,
+ * and costs a handful of shifts and multiplies per number. That's much cheaper than
+ * `std::mt19937`, with its 2.5 KiB of state, and unlike a shared static generator, each thread
+ * gets its own through threadRandom(), so no locking is needed.
+ *
+ * It satisfies UniformRandomBitGenerator, so it works with the standard distributions.
+ */
+class FastRandom
+{
+public:
+    using result_type = uint64_t;
+
+    //! @brief Seed the state from the given seed, spread out by SplitMix64.
+    explicit FastRandom( uint64_t seed )
+    {
+        for( auto& word : m_state )
+        {
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+            z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+            word = z ^ ( z >> 31 );
+        }
+    }
+
+    static constexpr result_type min() noexcept
+    {
+        return std::numeric_limits<result_type>::min();
+    }
+    static constexpr result_type max() noexcept
+    {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    result_type operator()() noexcept
+    {
+        const uint64_t result = rotl( m_state[1] * 5, 7 ) * 9;
+        const uint64_t t = m_state[1] << 17;
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl( m_state[3], 45 );
+        return result;
+    }
+
+private:
+    static constexpr uint64_t rotl( uint64_t x, int k ) noexcept
+    {
+        return ( x << k ) | ( x >> ( 64 - k ) );
+    }
+
+    uint64_t m_state[4] = {};
+};
+
+/**
+ * @brief This thread's FastRandom generator, seeded from `std::random_device` on first use.
+ */
+inline FastRandom& threadRandom()
+{
+    thread_local FastRandom random( [] {
+        std::random_device device;
+        return ( uint64_t( device() ) << 32 ) ^ device();
+    }() );
+    return random;
+}
+} // namespace Clipd::Utils
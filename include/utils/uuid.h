@@ -1,50 +1,170 @@
 #pragma once
 
 #include "common.h"
+#include "utils/random.h"
 
-#include <iomanip>
+#include <functional>
 #include <limits>
+#include <optional>
 #include <random>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace Clipd::Utils
 {
 /**
- * @brief Generate random integers.
+ * @brief Generate random integers, from this thread's generator.
  *
  * @tparam Integral An integer type.
  */
 template <typename Integral>
 inline Integral randint()
 {
-    static std::random_device rd;
-    static std::mt19937 gen( rd() );
-    static std::uniform_int_distribution<Integral> dist( std::numeric_limits<Integral>::min(),
-                                                         std::numeric_limits<Integral>::max() );
-
-    return dist( gen );
+    // The standard distributions don't take character types, so draw bytes as wider integers.
+    using Drawn = std::conditional_t<
+        ( sizeof( Integral ) < sizeof( int16_t ) ),
+        std::conditional_t<std::is_signed_v<Integral>, int16_t, uint16_t>, Integral>;
+    std::uniform_int_distribution<Drawn> dist( std::numeric_limits<Integral>::min(),
+                                               std::numeric_limits<Integral>::max() );
+    return static_cast<Integral>( dist( threadRandom() ) );
 }
 
 /**
  * @brief Generate a random hex string of the specified number of bytes.
  *
+ * @details May be called from any thread. Each 64-bit draw from the thread's generator makes eight
+ * bytes, formatted without a stream.
+ *
  * @param bytes The number of two-character byte groups to generate.
- * @return A string of random hex characters.
+ * @return A string of random lowercase hex characters.
  */
-std::string random_hex( size_t bytes )
+inline std::string random_hex( size_t bytes )
 {
-    std::stringstream ss;
-
+    static const char digits[] = "0123456789abcdef";
+    std::string hex( 2 * bytes, '0' );
+    uint64_t bits = 0;
     for( size_t i = 0; i < bytes; ++i )
     {
-        // While the generated bytes will be in the range `[0, 255]`, cast to
-        // `unit16_t` because `std::hex` treats `uint8_t` values differently.
-        ss << std::setfill( '0' ) << std::setw( 2 ) << std::hex
-           << static_cast<uint16_t>( randint<uint8_t>() );
+        if( i % 8 == 0 )
+        {
+            bits = threadRandom()();
+        }
+        hex[2 * i] = digits[( bits >> 4 ) & 0xF];
+        hex[2 * i + 1] = digits[bits & 0xF];
+        bits >>= 8;
     }
-
-    return ss.str();
+    return hex;
 }
 
+/**
+ * @brief A compact 128-bit identifier.
+ *
+ * @details Zyre identifies peers with 16 byte UUIDs, formatted as 32 hex characters. Storing them
+ * as two integers makes them cheap to compare, hash, and copy, without allocating.
+ */
+struct Uuid
+{
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    /**
+     * @brief Generate a random identifier, like a message ID, from this thread's generator.
+     */
+    static Uuid random()
+    {
+        FastRandom& random = threadRandom();
+        const uint64_t hi = random();
+        return Uuid {hi, random()};
+    }
+
+    /**
+     * @brief Parse an identifier from 32 hex characters, in either case.
+     *
+     * @return The parsed identifier, or nothing if the string isn't 32 hex characters.
+     */
+    static std::optional<Uuid> fromHex( std::string_view hex )
+    {
+        constexpr size_t num_chars = 32;
+        if( hex.size() != num_chars )
+        {
+            return std::nullopt;
+        }
+
+        Uuid uuid;
+        for( size_t i = 0; i < num_chars; ++i )
+        {
+            const char c = hex[i];
+            uint64_t nibble = 0;
+            if( c >= '0' && c <= '9' )
+            {
+                nibble = static_cast<uint64_t>( c - '0' );
+            }
+            else if( c >= 'a' && c <= 'f' )
+            {
+                nibble = static_cast<uint64_t>( c - 'a' + 10 );
+            }
+            else if( c >= 'A' && c <= 'F' )
+            {
+                nibble = static_cast<uint64_t>( c - 'A' + 10 );
+            }
+            else
+            {
+                return std::nullopt;
+            }
+
+            uint64_t& half = i < num_chars / 2 ? uuid.hi : uuid.lo;
+            half = ( half << 4 ) | nibble;
+        }
+        return uuid;
+    }
+
+    /**
+     * @brief Format the identifier as 32 uppercase hex characters, like Zyre does.
+     */
+    [[nodiscard]] std::string hex() const
+    {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string hex( 32, '0' );
+        for( size_t i = 0; i < 16; ++i )
+        {
+            const uint64_t half = i < 8 ? hi : lo;
+            const auto shift = static_cast<unsigned>( 60 - 8 * ( i % 8 ) );
+            hex[2 * i] = digits[( half >> shift ) & 0xF];
+            hex[2 * i + 1] = digits[( half >> ( shift - 4 ) ) & 0xF];
+        }
+        return hex;
+    }
+
+    [[nodiscard]] bool isNil() const noexcept
+    {
+        return hi == 0 && lo == 0;
+    }
+
+    bool operator==( const Uuid& rhs ) const noexcept
+    {
+        return hi == rhs.hi && lo == rhs.lo;
+    }
+    bool operator!=( const Uuid& rhs ) const noexcept
+    {
+        return !( *this == rhs );
+    }
+    bool operator<( const Uuid& rhs ) const noexcept
+    {
+        return hi < rhs.hi || ( hi == rhs.hi && lo < rhs.lo );
+    }
+};
 } // namespace Clipd::Utils
+
+namespace std
+{
+template <>
+struct hash<Clipd::Utils::Uuid>
+{
+    size_t operator()( const Clipd::Utils::Uuid& uuid ) const noexcept
+    {
+        // The identifiers are random, so mixing the halves is enough.
+        return static_cast<size_t>( uuid.hi ^ ( uuid.lo * 0x9e3779b97f4a7c15ULL ) );
+    }
+};
+} // namespace std
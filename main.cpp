@@ -1,17 +1,27 @@
 #include "app/args.h"
 #include "app/certs.h"
+#include "app/metrics_reporter.h"
+#include "clipboard/backend.h"
 #include "clipboard/clipboard_daemon.h"
+#include "clipboard/load_generator.h"
 #include "common.h"
 #include "network/peer_discovery.h"
+#include "network/recording.h"
+#include "network/relay.h"
+#include "network/zyre_transport.h"
 #include "utils/daemon.h"
+#include "utils/log.h"
 #include "utils/uuid.h"
 
 #include <unistd.h>
 
+#include <chrono>
 #include <csignal>
 #include <cstdlib>
-#include <iostream>
+#include <fstream>
 #include <list>
+#include <string>
+#include <vector>
 
 std::list<std::unique_ptr<Clipd::Utils::Daemon>> g_daemons;
 
@@ -26,6 +36,14 @@ void handle_SIGINT( int ) // NOLINT
     }
 }
 
+/**
+ * @brief Handle SIGUSR1 by dumping the metrics.
+ */
+void handle_SIGUSR1( int ) // NOLINT
+{
+    Clipd::App::MetricsReporter::requestDump();
+}
+
 void setSignalHandler()
 {
     struct sigaction sigint_handler;           // NOLINT
@@ -33,6 +51,12 @@ void setSignalHandler()
     sigemptyset( &sigint_handler.sa_mask );
     sigint_handler.sa_flags = 0;
     sigaction( SIGINT, &sigint_handler, nullptr );
+
+    struct sigaction sigusr1_handler;            // NOLINT
+    sigusr1_handler.sa_handler = handle_SIGUSR1; // NOLINT
+    sigemptyset( &sigusr1_handler.sa_mask );
+    sigusr1_handler.sa_flags = SA_RESTART;
+    sigaction( SIGUSR1, &sigusr1_handler, nullptr );
 }
 
 /**
@@ -43,6 +67,8 @@ void setSignalHandler()
 int main( int argc, const char** argv )
 {
     Clipd::App::CommandlineArgs_t args = Clipd::App::ParseArgs( argc, argv );
+    Clipd::Utils::Log::Logger::instance().setLevel( args.verbose ? Clipd::Utils::Log::Level::Debug
+                                                                 : Clipd::Utils::Log::Level::Info );
 
     if( args.generate_certificate )
     {
@@ -55,29 +81,156 @@ int main( int argc, const char** argv )
     {
         zcert = Clipd::App::LoadCertificate( args.certificate );
     }
+    // Sealed sessions also seal their items with keys derived from the certificate, which still
+    // encrypts every link with CURVE.
+    std::vector<uint8_t> session_secret;
+    if( zcert && args.encrypt_once )
+    {
+        const auto* secret = zcert_secret_key( zcert );
+        session_secret.assign( secret, secret + Clipd::Network::SessionKey::secret_size );
+    }
 
     //! @todo Create an "Application" object (main() should be as simple and small as possible.)
     //! @note Creating an "Application" object is substantially complicated by the posix signal
     //! handling.
-    auto clipd = std::make_unique<Clipd::Clipboard::ClipboardDaemon>();
+    Clipd::Network::Coalescer::Config coalescing;
+    coalescing.debounce = std::chrono::milliseconds( args.debounce_ms );
+    coalescing.max_delay = std::chrono::milliseconds( args.max_delay_ms );
+    Clipd::Network::FanoutTree::Config fanout;
+    fanout.degree = args.fanout;
+    Clipd::Network::LaneScheduler::Config lanes;
+    lanes.rate = args.uplink_mbps * 1e6;
+    Clipd::Network::Throttle::Config throttle;
+    throttle.peer_rate = args.peer_rate;
+    throttle.session_rate = args.session_rate;
+
+    Clipd::Network::ZyreTransport::Discovery discovery;
+    discovery.port = args.discovery_port;
+    discovery.interface = args.interface;
+    discovery.multicast_port = args.multicast_port;
+    discovery.endpoint = args.endpoint;
+    discovery.gossip_bind = args.gossip_bind;
+    discovery.gossip_connect = args.gossip_connect;
+    discovery.scope = args.lan_scale ? args.session : std::string();
+    discovery.beacon_interval = std::chrono::milliseconds( args.beacon_interval_ms );
+    discovery.evasive_timeout = std::chrono::milliseconds( args.evasive_ms );
+    discovery.expired_timeout = std::chrono::milliseconds( args.expired_ms );
+
+    std::unique_ptr<Clipd::Network::Transport> transport =
+        std::make_unique<Clipd::Network::ZyreTransport>( discovery, zcert, args.verbose );
+    // The recorder outlives the daemons' threads, which are joined before main() returns.
+    std::ofstream recording;
+    std::unique_ptr<Clipd::Network::Recorder> recorder;
+    if( !args.record.empty() )
+    {
+        recording.open( args.record, std::ios::binary | std::ios::trunc );
+        recorder = std::make_unique<Clipd::Network::Recorder>(
+            recording, transport->uuid(), args.session,
+            *Clipd::Network::parseRecordedContents( args.record_contents ) );
+        transport = std::make_unique<Clipd::Network::RecordingTransport>( std::move( transport ),
+                                                                           *recorder );
+    }
+
     auto discoveryd = std::make_unique<Clipd::Network::PeerDiscoveryDaemon>(
-        args.discovery_port, zcert, args.session, args.verbose );
-    clipd->registerOnTextUpdate(
-        Clipd::Utils::Functor<void( const std::string& )>( [&args]( const std::string& update ) {
-            if( args.verbose )
-            {
-                std::cout << "clipd: clipboard update:" << std::endl;
-                std::cout << update << std::endl;
-            }
+        std::move( transport ), args.session, coalescing, fanout, lanes, !args.lan_scale );
+    discoveryd->setThrottle( throttle );
+    discoveryd->setMaxPayload( args.max_payload );
+    if( !session_secret.empty() && !discoveryd->setSessionSecret( session_secret ) )
+    {
+        return 1;
+    }
+    auto backend = Clipd::Clipboard::createBackend( args.backend );
+    auto clipd = std::make_unique<Clipd::Clipboard::ClipboardDaemon>( discoveryd->uuid(), backend );
+    clipd->registerOnTextUpdate( Clipd::Utils::Functor<void( const Clipd::Clipboard::Item& )>(
+        []( const Clipd::Clipboard::Item& update ) {
+            CLIPD_LOG_DEBUG( "Clipboard update " << update.version << ": "
+                                                 << Clipd::Utils::Log::preview( update.contents ) );
         } ) );
-    clipd->registerOnTextUpdate( Clipd::Utils::Functor<void( const std::string& )>(
+    clipd->registerOnTextUpdate( Clipd::Utils::Functor<void( const Clipd::Clipboard::Item& )>(
         discoveryd.get(), &Clipd::Network::PeerDiscoveryDaemon::receiveLocalClipboardUpdate ) );
+    if( recorder )
+    {
+        clipd->registerOnTextUpdate( Clipd::Utils::Functor<void( const Clipd::Clipboard::Item& )>(
+            recorder.get(), &Clipd::Network::Recorder::recordLocal ) );
+    }
+
+    discoveryd->registerOnRemoteClipboardUpdate(
+        Clipd::Utils::Functor<void( const Clipd::Clipboard::Item& )>(
+            clipd.get(), &Clipd::Clipboard::ClipboardDaemon::receiveRemoteClipboardUpdate ) );
 
-    discoveryd->registerOnRemoteClipboardUpdate( Clipd::Utils::Functor<void( const std::string& )>(
-        clipd.get(), &Clipd::Clipboard::ClipboardDaemon::receiveRemoteClipboardUpdate ) );
+    // A gateway relays its sessions to the gateways of other subnets, through a second node that
+    // only gossips with them. Its own clipboards are synchronized with both nodes.
+    std::unique_ptr<Clipd::Network::PeerDiscoveryDaemon> relayd;
+    std::vector<std::string> sessions = {args.session};
+    if( !args.relay_endpoint.empty() )
+    {
+        Clipd::Network::ZyreTransport::Discovery gossip;
+        gossip.endpoint = args.relay_endpoint;
+        gossip.gossip_bind = args.relay_gossip_bind;
+        gossip.gossip_connect = args.relay_gossip_connect;
+        relayd = std::make_unique<Clipd::Network::PeerDiscoveryDaemon>(
+            std::make_unique<Clipd::Network::ZyreTransport>(
+                gossip, zcert ? zcert_dup( zcert ) : nullptr, args.verbose ),
+            args.session, coalescing, fanout, lanes );
+        relayd->setThrottle( throttle );
+        relayd->setMaxPayload( args.max_payload );
+        if( !session_secret.empty() && !relayd->setSessionSecret( session_secret ) )
+        {
+            return 1;
+        }
+        clipd->registerOnTextUpdate( Clipd::Utils::Functor<void( const Clipd::Clipboard::Item& )>(
+            relayd.get(), &Clipd::Network::PeerDiscoveryDaemon::receiveLocalClipboardUpdate ) );
+        relayd->registerOnRemoteClipboardUpdate(
+            Clipd::Utils::Functor<void( const Clipd::Clipboard::Item& )>(
+                clipd.get(), &Clipd::Clipboard::ClipboardDaemon::receiveRemoteClipboardUpdate ) );
+    }
+
+    // Each gateway session is synchronized with its own clipboard, through the same Zyre node.
+    for( const auto& [session, name] : args.gateway )
+    {
+        auto gateway = std::make_unique<Clipd::Clipboard::ClipboardDaemon>(
+            discoveryd->uuid(), Clipd::Clipboard::createBackend( name ) );
+        for( auto* network : {discoveryd.get(), relayd.get()} )
+        {
+            if( !network )
+            {
+                continue;
+            }
+            network->addSession( session );
+            gateway->registerOnTextUpdate(
+                Clipd::Utils::Functor<void( const Clipd::Clipboard::Item& )>(
+                    [network, hosted = session]( const Clipd::Clipboard::Item& update ) {
+                        network->receiveLocalClipboardUpdate( hosted, update );
+                    } ) );
+            network->registerOnRemoteClipboardUpdate(
+                session, Clipd::Utils::Functor<void( const Clipd::Clipboard::Item& )>(
+                             gateway.get(),
+                             &Clipd::Clipboard::ClipboardDaemon::receiveRemoteClipboardUpdate ) );
+        }
+        sessions.push_back( session );
+        g_daemons.push_back( std::move( gateway ) );
+    }
+
+    // The relay outlives the daemons' threads, which are joined before main() returns.
+    std::unique_ptr<Clipd::Network::Relay> relay;
+    if( relayd )
+    {
+        relay = std::make_unique<Clipd::Network::Relay>( *discoveryd, *relayd, sessions );
+        g_daemons.push_back( std::move( relayd ) );
+    }
 
     g_daemons.push_back( std::move( clipd ) );
     g_daemons.push_back( std::move( discoveryd ) );
+    if( !args.loadgen.empty() )
+    {
+        g_daemons.push_back( std::make_unique<Clipd::Clipboard::LoadGenerator>(
+            *Clipd::Clipboard::LoadGenerator::Config::parse( args.loadgen ), backend ) );
+    }
+    g_daemons.push_back(
+        std::make_unique<Clipd::App::MetricsReporter>( args.metrics, args.trace ) );
+    auto log_writer = std::make_unique<Clipd::Utils::Log::Writer>( stdout );
+    auto& log = *log_writer;
+    g_daemons.push_back( std::move( log_writer ) );
 
     setSignalHandler();
 
@@ -89,6 +242,12 @@ int main( int argc, const char** argv )
     {
         daemon->join();
     }
+    // Write anything logged by the other daemons while they stopped.
+    log.flush();
+    if( recorder )
+    {
+        recorder->flush();
+    }
 
     return 0;
 }
@@ -1,17 +1,55 @@
 #include "app/args.h"
 
+#include "clipboard/backend.h"
+#include "clipboard/load_generator.h"
+#include "network/recording.h"
+
 #include <clipp.h>
 
 #include <cstdlib>
 #include <iostream>
+#include <optional>
+#include <set>
+#include <sstream>
 #include <string>
 
 namespace Clipd::App
 {
+namespace
+{
+/**
+ * @brief Parse a comma separated list of `session=backend` routes. The backend defaults to memory.
+ *
+ * @return The routes, or nothing if a route has no session.
+ */
+std::optional<std::vector<std::pair<std::string, std::string>>>
+parseGateway( const std::string& spec )
+{
+    std::vector<std::pair<std::string, std::string>> routes;
+    std::stringstream ss( spec );
+    for( std::string route; std::getline( ss, route, ',' ); )
+    {
+        const size_t equals = route.find( '=' );
+        std::string session = route.substr( 0, equals );
+        std::string backend = equals == std::string::npos ? "memory" : route.substr( equals + 1 );
+        if( session.empty() )
+        {
+            return std::nullopt;
+        }
+        routes.emplace_back( std::move( session ), std::move( backend ) );
+    }
+    return routes;
+}
+} // namespace
+
 CommandlineArgs_t ParseArgs( int argc, const char** argv )
 {
     static const std::string description = "\tPeer-to-peer X11 clipboard synchronization.";
     std::string cert_path = "";
+    std::string metrics_path = "";
+    std::string trace_path = "";
+    std::string record_path = "";
+    std::string gateway = "";
     CommandlineArgs_t args;
 
     //! @see https://github.com/muellan/clipp for details.
@@ -22,14 +60,102 @@ CommandlineArgs_t ParseArgs( int argc, const char** argv )
                  clipp::option( "-p", "--port" )
                      .set( args.discovery_port )
                      .doc( "The port to use for peer discovery." ),
+                 ( clipp::option( "-i", "--interface" ) & clipp::value( "name", args.interface ) ) %
+                     "The network interface to use for peer discovery.",
+                 ( clipp::option( "--endpoint" ) & clipp::value( "endpoint", args.endpoint ) ) %
+                     "Listen for peers on the given endpoint, like tcp://10.0.0.2:5671, and "
+                     "discover them by gossip instead of UDP broadcasts.",
+                 ( clipp::option( "--gossip-bind" ) &
+                   clipp::value( "endpoint", args.gossip_bind ) ) %
+                     "Act as a gossip hub for other peers on the given endpoint.",
+                 ( clipp::option( "--gossip-connect" ) &
+                   clipp::value( "endpoint", args.gossip_connect ) ) %
+                     "Discover peers through the gossip hub at the given endpoint.",
+                 clipp::option( "--lan-scale" )
+                     .set( args.lan_scale )
+                     .doc( "Only discover, and connect to, peers in the same session, and beacon "
+                           "every 5 s rather than every second, for LANs with hundreds of hosts." ),
+                 ( clipp::option( "--beacon-interval" ) &
+                   clipp::value( "ms", args.beacon_interval_ms ) ) %
+                     "How often to broadcast a discovery beacon.",
+                 ( clipp::option( "--evasive" ) & clipp::value( "ms", args.evasive_ms ) ) %
+                     "How long a silent peer takes to be pinged, which must be longer than the "
+                     "beacon interval.",
+                 ( clipp::option( "--expired" ) & clipp::value( "ms", args.expired_ms ) ) %
+                     "How long a silent peer takes to be dropped.",
+                 ( clipp::option( "--relay-endpoint" ) &
+                   clipp::value( "endpoint", args.relay_endpoint ) ) %
+                     "Act as a gateway, relaying this peer's sessions to the gateways of other "
+                     "subnets, through a second node listening on the given endpoint.",
+                 ( clipp::option( "--relay-gossip-bind" ) &
+                   clipp::value( "endpoint", args.relay_gossip_bind ) ) %
+                     "Act as the gossip hub for the other gateways on the given endpoint.",
+                 ( clipp::option( "--relay-gossip-connect" ) &
+                   clipp::value( "endpoint", args.relay_gossip_connect ) ) %
+                     "Discover the other gateways through the gossip hub at the given endpoint.",
                  ( clipp::option( "-e", "--encrypt" ).set( args.encrypt_traffic ) &
                    clipp::value( "certificate", cert_path ) ) %
                      "Encrypt traffic using the given certificate.",
+                 clipp::option( "--encrypt-once" ).set( args.encrypt_once ) %
+                     "With --encrypt, also seal each clipboard update once, at its origin, with a "
+                     "key for the whole session derived from the certificate, so it stays sealed "
+                     "as it's forwarded. Every peer in the session must use the same certificate, "
+                     "and this option.",
                  ( clipp::option( "-g", "--generate" ).set( args.generate_certificate ) &
                    clipp::value( "certificate", cert_path ) ) %
                      "Generate a certificate.",
                  ( clipp::option( "-s", "--session" ) & clipp::value( "ID", args.session ) ) %
-                     "The session ID to join for this peer." );
+                     "The session ID to join for this peer.",
+                 ( clipp::option( "--gateway" ) & clipp::value( "routes", gateway ) ) %
+                     "Also host the sessions in a list like alice=file:/home/alice/.clipboard on "
+                     "this node, each synchronized with its own clipboard backend.",
+                 ( clipp::option( "--debounce" ) & clipp::value( "ms", args.debounce_ms ) ) %
+                     "Coalesce clipboard updates closer together than this. Zero disables.",
+                 ( clipp::option( "--max-delay" ) & clipp::value( "ms", args.max_delay_ms ) ) %
+                     "The longest a coalesced clipboard update may be held back.",
+                 ( clipp::option( "--fanout" ) & clipp::value( "degree", args.fanout ) ) %
+                     "Send large clipboard updates to this many peers, which forward them to "
+                     "the rest of the session, rather than to every peer. Zero disables.",
+                 ( clipp::option( "--uplink" ) & clipp::value( "MB/s", args.uplink_mbps ) ) %
+                     "Pace clipboard updates to this uplink bandwidth, so that small updates "
+                     "overtake large ones rather than queueing behind them. Off by default: "
+                     "without it, small updates wait behind large ones in the transport.",
+                 ( clipp::option( "--multicast" ) & clipp::value( "port", args.multicast_port ) ) %
+                     "Multicast clipboard updates small enough to fit in a datagram on this port, "
+                     "to every peer on the local network at once. With --encrypt, requires "
+                     "--encrypt-once. Zero disables.",
+                 ( clipp::option( "--peer-rate" ) & clipp::value( "updates/s", args.peer_rate ) ) %
+                     "Only apply this many clipboard updates per second from each peer, and only "
+                     "send this many, applying and sending the latest of the rest once allowed. "
+                     "Zero disables.",
+                 ( clipp::option( "--session-rate" ) &
+                   clipp::value( "updates/s", args.session_rate ) ) %
+                     "Only apply, or send, this many clipboard updates per second in each "
+                     "session, from every peer together. Zero disables.",
+                 ( clipp::option( "--max-payload" ) &
+                   clipp::value( "bytes", args.max_payload ) ) %
+                     "Drop clipboard updates larger than this, and tell peers not to send them. "
+                     "Zero, the default, accepts any size.",
+                 ( clipp::option( "--backend" ) & clipp::value( "name", args.backend ) ) %
+                     "The clipboard to synchronize: x11 (the default), memory, for machines "
+                     "without an X server, or file:<path>, a file to copy to by writing it, and "
+                     "to paste from by reading it.",
+                 ( clipp::option( "--loadgen" ) & clipp::value( "spec", args.loadgen ) ) %
+                     "Write synthetic contents to the clipboard, as described by a list like "
+                     "rate=20,burst=5,sizes=64:4096,duplicates=0.1,count=1000,seed=1. Uses the "
+                     "memory backend unless another is given.",
+                 ( clipp::option( "--metrics" ) & clipp::value( "path", metrics_path ) ) %
+                     "Write a JSON metrics snapshot to the given file on SIGUSR1, and on exit.",
+                 ( clipp::option( "--trace" ) & clipp::value( "path", trace_path ) ) %
+                     "Write sampled copy to paste traces to the given file in the Chrome trace "
+                     "format on SIGUSR1, and on exit.",
+                 ( clipp::option( "--record" ) & clipp::value( "path", record_path ) ) %
+                     "Record local copies and received messages to the given file, to be "
+                     "replayed by build/replay.",
+                 ( clipp::option( "--record-contents" ) &
+                   clipp::value( "mode", args.record_contents ) ) %
+                     "How much of the clipboard contents to record: full, hash (the default), "
+                     "or redact, which only records their sizes." );
 
     auto display_help = [&]() {
         std::cout
@@ -45,6 +171,9 @@ CommandlineArgs_t ParseArgs( int argc, const char** argv )
     }
     // Clipp doesn't seem to play nicely with std::filesystem::path.
     args.certificate = cert_path;
+    args.metrics = metrics_path;
+    args.trace = trace_path;
+    args.record = record_path;
 
     if( args.help )
     {
@@ -52,6 +181,119 @@ CommandlineArgs_t ParseArgs( int argc, const char** argv )
         std::exit( 0 );
     }
 
+    if( args.backend.empty() )
+    {
+        args.backend = args.loadgen.empty() ? "x11" : "memory";
+    }
+    if( !Clipboard::isBackend( args.backend ) )
+    {
+        std::cout << "Unknown clipboard backend '" << args.backend << "'." << std::endl;
+        std::exit( 1 );
+    }
+
+    const auto routes = parseGateway( gateway );
+    if( !routes )
+    {
+        std::cout << "Invalid gateway routes '" << gateway << "'." << std::endl;
+        std::exit( 1 );
+    }
+    args.gateway = *routes;
+    // The X11 backend always uses $DISPLAY, so only one session can synchronize it.
+    size_t x11 = args.backend == "x11" ? 1 : 0;
+    std::set<std::string> hosted = {args.session};
+    for( const auto& [session, backend] : args.gateway )
+    {
+        if( !Clipboard::isBackend( backend ) )
+        {
+            std::cout << "Unknown clipboard backend '" << backend << "' for session '" << session
+                      << "'." << std::endl;
+            std::exit( 1 );
+        }
+        x11 += backend == "x11" ? 1 : 0;
+        if( !hosted.insert( session ).second )
+        {
+            std::cout << "The session '" << session << "' is hosted more than once." << std::endl;
+            std::exit( 1 );
+        }
+    }
+    if( x11 > 1 )
+    {
+        std::cout << "Only one session can use the x11 backend." << std::endl;
+        std::exit( 1 );
+    }
+    if( !args.loadgen.empty() && !Clipboard::LoadGenerator::Config::parse( args.loadgen ) )
+    {
+        std::cout << "Invalid load generator specification '" << args.loadgen << "'."
+                  << std::endl;
+        std::exit( 1 );
+    }
+
+    if( !Network::parseRecordedContents( args.record_contents ) )
+    {
+        std::cout << "Unknown recorded contents '" << args.record_contents << "'." << std::endl;
+        std::exit( 1 );
+    }
+
+    if( ( !args.gossip_bind.empty() || !args.gossip_connect.empty() ) && args.endpoint.empty() )
+    {
+        std::cout << "Gossip discovery requires an --endpoint for peers to connect to."
+                  << std::endl;
+        std::exit( 1 );
+    }
+
+    if( args.lan_scale )
+    {
+        // Beacons refresh a peer, so a peer is only pinged if it's silent for several of them.
+        args.beacon_interval_ms = args.beacon_interval_ms != 0 ? args.beacon_interval_ms : 5000;
+        args.evasive_ms = args.evasive_ms != 0 ? args.evasive_ms : 3 * args.beacon_interval_ms;
+        args.expired_ms = args.expired_ms != 0 ? args.expired_ms : 12 * args.beacon_interval_ms;
+        // Peers of the other hosted sessions beacon on their own session's port.
+        if( !args.gateway.empty() )
+        {
+            std::cout << "--lan-scale only discovers the peers of one session, so it can't host "
+                         "--gateway sessions."
+                      << std::endl;
+            std::exit( 1 );
+        }
+    }
+    const uint32_t interval = args.beacon_interval_ms != 0 ? args.beacon_interval_ms : 1000;
+    const uint32_t evasive = args.evasive_ms != 0 ? args.evasive_ms : 5000;
+    const uint32_t expired = args.expired_ms != 0 ? args.expired_ms : 30000;
+    if( evasive <= interval || expired <= evasive )
+    {
+        std::cout << "The evasive timeout must be longer than the beacon interval, and the expired "
+                     "timeout longer than the evasive timeout."
+                  << std::endl;
+        std::exit( 1 );
+    }
+
+    if( !args.relay_endpoint.empty() && args.relay_gossip_bind.empty() &&
+        args.relay_gossip_connect.empty() )
+    {
+        std::cout << "A gateway requires a --relay-gossip-bind or --relay-gossip-connect endpoint."
+                  << std::endl;
+        std::exit( 1 );
+    }
+    if( ( !args.relay_gossip_bind.empty() || !args.relay_gossip_connect.empty() ) &&
+        args.relay_endpoint.empty() )
+    {
+        std::cout << "Relay gossip requires a --relay-endpoint for gateways to connect to."
+                  << std::endl;
+        std::exit( 1 );
+    }
+
+    if( args.encrypt_once && !args.encrypt_traffic )
+    {
+        std::cout << "Encrypting once requires a certificate to --encrypt with." << std::endl;
+        std::exit( 1 );
+    }
+    if( args.encrypt_traffic && !args.encrypt_once && args.multicast_port != 0 )
+    {
+        std::cout << "Datagrams bypass the encrypted links, so multicasting with --encrypt requires "
+                     "--encrypt-once to seal them."
+                  << std::endl;
+        std::exit( 1 );
+    }
     if( args.encrypt_traffic )
     {
         if( !fs::exists( args.certificate ) )
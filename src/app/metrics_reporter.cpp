@@ -0,0 +1,72 @@
+#include "app/metrics_reporter.h"
+
+#include "clipboard/trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace Clipd::App
+{
+namespace
+{
+/**
+ * @brief Replace the given file, via a temporary file, so that readers never see a partial write.
+ */
+template <typename Writer>
+void replaceFile( const fs::path& path, Writer&& write )
+{
+    if( path.empty() )
+    {
+        return;
+    }
+
+    fs::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file( temporary );
+        write( file );
+        file << "\n";
+        if( !file )
+        {
+            std::cerr << "Failed to write " << temporary << std::endl;
+            return;
+        }
+    }
+    std::error_code error;
+    fs::rename( temporary, path, error );
+    if( error )
+    {
+        std::cerr << "Failed to write " << path << ": " << error.message() << std::endl;
+    }
+}
+} // namespace
+
+void MetricsReporter::loop()
+{
+    using namespace std::chrono_literals;
+
+    if( s_dump_requested.exchange( false, std::memory_order_relaxed ) )
+    {
+        const auto snapshot = Utils::Metrics::Registry::global().snapshot();
+        snapshot.writeText( std::cerr );
+        std::cerr.flush();
+        writeFiles( snapshot );
+    }
+
+    std::this_thread::sleep_for( 100ms );
+}
+
+void MetricsReporter::teardown()
+{
+    writeFiles( Utils::Metrics::Registry::global().snapshot() );
+}
+
+void MetricsReporter::writeFiles( const Utils::Metrics::Snapshot& snapshot ) const
+{
+    replaceFile( m_snapshot_path, [&snapshot]( std::ostream& o ) { snapshot.writeJson( o ); } );
+    replaceFile( m_trace_path,
+                 []( std::ostream& o ) { Clipboard::Tracer::global().writeChromeTrace( o ); } );
+}
+} // namespace Clipd::App
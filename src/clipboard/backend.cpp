@@ -0,0 +1,53 @@
+#include "clipboard/backend.h"
+
+#include "clipboard/file_backend.h"
+#include "clipboard/memory_backend.h"
+
+#include <clip.h>
+
+namespace Clipd::Clipboard
+{
+namespace
+{
+//! @brief The path of the file named by a `file:<path>` backend name, or empty if it isn't one.
+std::string_view filePath( std::string_view name )
+{
+    return name.substr( 0, file_prefix.size() ) == file_prefix ? name.substr( file_prefix.size() )
+                                                               : std::string_view {};
+}
+} // namespace
+
+std::string X11Backend::getText()
+{
+    std::string contents;
+    clip::get_text( contents );
+    return contents;
+}
+
+void X11Backend::setText( const Utils::Payload& contents )
+{
+    clip::set_text( contents.str() );
+}
+
+std::shared_ptr<Backend> createBackend( std::string_view name )
+{
+    if( name == "x11" )
+    {
+        return std::make_shared<X11Backend>();
+    }
+    if( name == "memory" )
+    {
+        return std::make_shared<MemoryBackend>();
+    }
+    if( const auto path = filePath( name ); !path.empty() )
+    {
+        return std::make_shared<FileBackend>( std::string( path ) );
+    }
+    return nullptr;
+}
+
+bool isBackend( std::string_view name )
+{
+    return name == "x11" || name == "memory" || !filePath( name ).empty();
+}
+} // namespace Clipd::Clipboard
@@ -1,49 +1,113 @@
 #include "clipboard/clipboard_daemon.h"
 
-#include <clip.h>
+#include "utils/probes.h"
 
 #include <chrono>
-#include <thread>
 
 namespace Clipd::Clipboard
 {
-void ClipboardDaemon::registerOnTextUpdate( Utils::Functor<void( const std::string& )> callback )
+namespace
+{
+uint32_t microseconds( std::chrono::steady_clock::duration duration )
+{
+    return static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>( duration ).count() );
+}
+} // namespace
+
+ClipboardDaemon::ClipboardDaemon( Utils::Uuid origin, std::shared_ptr<Backend> backend ) :
+    m_backend( std::move( backend ) ),
+    m_sync( origin )
+{}
+
+void ClipboardDaemon::registerOnTextUpdate( Utils::Functor<void( const Item& )> callback )
 {
     m_text_delegate.subscribe( std::move( callback ) );
 }
 
-void ClipboardDaemon::receiveRemoteClipboardUpdate( const std::string& update )
+void ClipboardDaemon::receiveRemoteClipboardUpdate( const Item& update )
 {
-    std::hash<std::string> hasher;
-    size_t hash = hasher( update );
-    m_curr_text_hash = hash;
-    clip::set_text( update );
+    CLIPD_PROBE4( clipboard_remote_update, update.version.timestamp, update.contents.size(),
+                  update.version.origin.hi, update.version.origin.lo );
+    {
+        const std::lock_guard lock( m_mailbox_mutex );
+        if( m_mailbox )
+        {
+            // An item older than the waiting one would be ignored once that one is applied.
+            m_mailbox_coalesced.add();
+            if( !( update.version > m_mailbox->version ) )
+            {
+                return;
+            }
+        }
+        m_mailbox = update;
+    }
+    m_backend->wake();
+}
+
+void ClipboardDaemon::apply( const Item& update )
+{
+    if( !m_sync.receiveRemote( update ) )
+    {
+        CLIPD_PROBE1( clipboard_remote_ignored, update.version.timestamp );
+        m_dedupe_hits.add();
+        return;
+    }
+
+    const auto set_start = std::chrono::steady_clock::now();
+    m_backend->setText( update.contents );
+    const auto set_end = std::chrono::steady_clock::now();
+    CLIPD_PROBE2( clipboard_remote_applied, update.version.timestamp, update.contents.size() );
+    m_updates_applied.add();
+    Tracer::global().complete( update, microseconds( set_end - set_start ),
+                               Trace::wallClockMicros() );
+    if( update.observed != std::chrono::steady_clock::time_point {} )
+    {
+        m_receive_to_set.record( std::chrono::steady_clock::now() - update.observed );
+    }
 }
 
 std::string ClipboardDaemon::getClipboardTextContents() const
 {
-    std::string contents;
-    clip::get_text( contents );
-    return contents;
+    return m_backend->getText();
 }
 
 void ClipboardDaemon::loop()
 {
-    using namespace std::chrono_literals;
-    std::string clipboard_contents = this->getClipboardTextContents();
+    CLIPD_PROBE0( clipboard_loop_start );
+
+    // Remote items are applied first, so that the clipboard read below recognizes them.
+    std::optional<Item> remote;
+    {
+        const std::lock_guard lock( m_mailbox_mutex );
+        remote.swap( m_mailbox );
+    }
+    if( remote )
+    {
+        apply( *remote );
+    }
 
-    // This isn't a cryptographically secure hash (it's even worse than MD5), but I believe that it
-    // will suffice for now.
-    std::hash<std::string> hasher;
-    size_t hash = hasher( clipboard_contents );
+    const uint64_t captured_us = Trace::wallClockMicros();
+    const auto read_start = std::chrono::steady_clock::now();
+    std::string contents = this->getClipboardTextContents();
+    const auto read_end = std::chrono::steady_clock::now();
 
-    if( hash != m_curr_text_hash )
+    // The contents are only moved into a shared Payload if they are a new local copy, so none of
+    // the subscribers copy them.
+    if( auto item = m_sync.observeLocal( std::move( contents ) ) )
     {
-        m_curr_text_hash = hash;
-        m_text_delegate( clipboard_contents );
+        item->observed = std::chrono::steady_clock::now();
+        CLIPD_PROBE2( clipboard_change, item->version.timestamp, item->contents.size() );
+        item->trace.captured_us = captured_us;
+        item->trace.read_us = microseconds( read_end - read_start );
+        item->trace.hash_us = microseconds( item->observed - read_end );
+        m_updates_captured.add();
+        m_text_delegate( *item );
     }
 
-    // Limit how quickly we query the X11 clipboard.
-    std::this_thread::sleep_for( 50ms );
+    CLIPD_PROBE0( clipboard_loop_end );
+
+    // Limit how quickly we poll clipboards that can't tell us when they change.
+    m_backend->waitForChange( poll_interval );
 }
 } // namespace Clipd::Clipboard
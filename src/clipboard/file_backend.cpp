@@ -0,0 +1,90 @@
+#include "clipboard/file_backend.h"
+
+#include "utils/log.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace Clipd::Clipboard
+{
+FileBackend::FileBackend( std::string path ) : m_path( std::move( path ) ) {}
+
+std::string FileBackend::getText()
+{
+    const std::lock_guard lock( m_mutex );
+    const auto current = stamp();
+    if( !current )
+    {
+        return {};
+    }
+    if( same( *current, m_stamp ) )
+    {
+        return m_contents;
+    }
+
+    std::ifstream file( m_path, std::ios::binary );
+    m_contents.assign( std::istreambuf_iterator<char>( file ), std::istreambuf_iterator<char>() );
+    // Stamped before reading, so a write while reading is read again next time.
+    m_stamp = *current;
+    return m_contents;
+}
+
+void FileBackend::setText( const Utils::Payload& contents )
+{
+    const std::lock_guard lock( m_mutex );
+    const int fd = ::open( m_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600 );
+    if( fd < 0 )
+    {
+        CLIPD_LOG_WARN( "Failed to open the clipboard file '" << m_path
+                                                              << "': " << std::strerror( errno ) );
+        return;
+    }
+    size_t written = 0;
+    while( written < contents.size() )
+    {
+        const ssize_t n = ::write( fd, contents.data() + written, contents.size() - written );
+        if( n < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if( n < 0 )
+        {
+            CLIPD_LOG_WARN( "Failed to write the clipboard file '"
+                            << m_path << "': " << std::strerror( errno ) );
+            break;
+        }
+        written += static_cast<size_t>( n );
+    }
+    ::close( fd );
+
+    // Remember what we wrote, so the file isn't read again until someone else writes it.
+    if( const auto current = stamp(); current && written == contents.size() )
+    {
+        m_contents = contents.str();
+        m_stamp = *current;
+    }
+}
+
+std::optional<FileBackend::Stamp> FileBackend::stamp() const
+{
+    struct stat status = {};
+    if( ::stat( m_path.c_str(), &status ) != 0 )
+    {
+        return std::nullopt;
+    }
+    return Stamp {status.st_ino, status.st_size, status.st_mtim};
+}
+
+bool FileBackend::same( const Stamp& lhs, const Stamp& rhs )
+{
+    return lhs.inode == rhs.inode && lhs.size == rhs.size &&
+           lhs.modified.tv_sec == rhs.modified.tv_sec &&
+           lhs.modified.tv_nsec == rhs.modified.tv_nsec;
+}
+} // namespace Clipd::Clipboard
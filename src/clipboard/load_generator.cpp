@@ -0,0 +1,191 @@
+#include "clipboard/load_generator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <type_traits>
+
+namespace Clipd::Clipboard
+{
+namespace
+{
+template <typename Number>
+std::optional<Number> parseNumber( const std::string& value )
+{
+    if( value.empty() )
+    {
+        return std::nullopt;
+    }
+    char* end = nullptr;
+    if constexpr( std::is_floating_point_v<Number> )
+    {
+        const Number number = std::strtod( value.c_str(), &end );
+        return *end == '\0' ? std::optional<Number>( number ) : std::nullopt;
+    }
+    else
+    {
+        const auto number = static_cast<Number>( std::strtoull( value.c_str(), &end, 10 ) );
+        return *end == '\0' && value.front() != '-' ? std::optional<Number>( number )
+                                                    : std::nullopt;
+    }
+}
+
+std::vector<std::string> split( std::string_view s, char separator )
+{
+    std::vector<std::string> parts;
+    while( !s.empty() )
+    {
+        const size_t end = std::min( s.find( separator ), s.size() );
+        parts.emplace_back( s.substr( 0, end ) );
+        s.remove_prefix( std::min( end + 1, s.size() ) );
+    }
+    return parts;
+}
+} // namespace
+
+std::optional<LoadGenerator::Config> LoadGenerator::Config::parse( std::string_view spec )
+{
+    Config config;
+    for( const auto& pair : split( spec, ',' ) )
+    {
+        const size_t equals = pair.find( '=' );
+        if( equals == std::string::npos )
+        {
+            return std::nullopt;
+        }
+        const std::string key = pair.substr( 0, equals );
+        const std::string value = pair.substr( equals + 1 );
+
+        bool valid = false;
+        if( key == "rate" )
+        {
+            const auto rate = parseNumber<double>( value );
+            valid = rate && *rate > 0;
+            config.rate = rate.value_or( 0 );
+        }
+        else if( key == "burst" )
+        {
+            const auto burst = parseNumber<size_t>( value );
+            valid = burst && *burst > 0;
+            config.burst = burst.value_or( 0 );
+        }
+        else if( key == "sizes" )
+        {
+            config.sizes.clear();
+            for( const auto& size : split( value, ':' ) )
+            {
+                if( const auto parsed = parseNumber<size_t>( size ) )
+                {
+                    config.sizes.push_back( *parsed );
+                }
+            }
+            valid = !config.sizes.empty() && config.sizes.size() == split( value, ':' ).size();
+        }
+        else if( key == "duplicates" )
+        {
+            const auto duplicates = parseNumber<double>( value );
+            valid = duplicates && *duplicates >= 0 && *duplicates <= 1;
+            config.duplicates = duplicates.value_or( 0 );
+        }
+        else if( key == "count" )
+        {
+            const auto count = parseNumber<uint64_t>( value );
+            valid = count.has_value();
+            config.count = count.value_or( 0 );
+        }
+        else if( key == "seed" )
+        {
+            config.seed = parseNumber<uint64_t>( value );
+            valid = config.seed.has_value();
+        }
+
+        if( !valid )
+        {
+            return std::nullopt;
+        }
+    }
+    return config;
+}
+
+LoadGenerator::LoadGenerator( const Config& config, std::shared_ptr<Backend> backend ) :
+    m_config( config ),
+    m_backend( std::move( backend ) ),
+    m_random( config.seed.value_or( std::random_device {}() ) )
+{
+    // Lower case words, so that the contents compress about as well as text.
+    const auto& sizes = m_config.sizes;
+    const size_t largest = sizes.empty() ? 0 : *std::max_element( sizes.begin(), sizes.end() );
+    m_text.reserve( largest );
+    while( m_text.size() < largest )
+    {
+        const size_t length = 1 + m_random() % 10;
+        for( size_t i = 0; i < length; ++i )
+        {
+            m_text.push_back( static_cast<char>( 'a' + m_random() % 26 ) );
+        }
+        m_text.push_back( ' ' );
+    }
+}
+
+std::string LoadGenerator::next()
+{
+    std::uniform_real_distribution<double> uniform( 0.0, 1.0 );
+    if( !m_history.empty() && uniform( m_random ) < m_config.duplicates )
+    {
+        m_duplicates.add();
+        return m_history[m_random() % m_history.size()];
+    }
+
+    const size_t size =
+        m_config.sizes.empty() ? 0 : m_config.sizes[m_random() % m_config.sizes.size()];
+    // Number every write, so that the new contents differ from all the previous ones.
+    std::string contents = "loadgen " + std::to_string( m_generated++ ) + " ";
+    contents.resize( std::min( contents.size(), size ) );
+    const size_t length = size - contents.size();
+    contents.append( m_text, m_random() % ( m_text.size() - length + 1 ), length );
+
+    m_history.push_back( contents );
+    if( m_history.size() > history_size )
+    {
+        m_history.pop_front();
+    }
+    return contents;
+}
+
+void LoadGenerator::setup()
+{
+    m_next_burst = std::chrono::steady_clock::now();
+}
+
+void LoadGenerator::loop()
+{
+    using namespace std::chrono;
+
+    const auto now = steady_clock::now();
+    if( now < m_next_burst )
+    {
+        // Bound the sleep so that the loop condition is re-checked promptly.
+        std::this_thread::sleep_for( std::min<steady_clock::duration>( m_next_burst - now,
+                                                                       milliseconds( 100 ) ) );
+        return;
+    }
+    // Don't try to catch up on bursts missed while the process was stalled.
+    m_next_burst = std::max( m_next_burst + duration_cast<steady_clock::duration>(
+                                                duration<double>( 1.0 / m_config.rate ) ),
+                             now );
+
+    for( size_t i = 0; i < m_config.burst; ++i )
+    {
+        if( m_config.count != 0 && m_written >= m_config.count )
+        {
+            stop();
+            return;
+        }
+        std::string contents = next();
+        m_bytes.add( contents.size() );
+        m_backend->setText( Utils::Payload( std::move( contents ) ) );
+        m_writes.add();
+        ++m_written;
+    }
+}
+} // namespace Clipd::Clipboard
@@ -0,0 +1,43 @@
+#include "clipboard/memory_backend.h"
+
+namespace Clipd::Clipboard
+{
+std::string MemoryBackend::getText()
+{
+    const std::lock_guard lock( m_mutex );
+    m_read_generation = m_generation;
+    return m_contents;
+}
+
+void MemoryBackend::setText( const Utils::Payload& contents )
+{
+    setText( contents.str() );
+}
+
+void MemoryBackend::setText( std::string contents )
+{
+    {
+        const std::lock_guard lock( m_mutex );
+        m_contents = std::move( contents );
+        ++m_generation;
+    }
+    m_changed.notify_all();
+}
+
+void MemoryBackend::waitForChange( std::chrono::milliseconds timeout )
+{
+    std::unique_lock lock( m_mutex );
+    m_changed.wait_for( lock, timeout,
+                        [this] { return m_woken || m_generation != m_read_generation; } );
+    m_woken = false;
+}
+
+void MemoryBackend::wake()
+{
+    {
+        const std::lock_guard lock( m_mutex );
+        m_woken = true;
+    }
+    m_changed.notify_all();
+}
+} // namespace Clipd::Clipboard
@@ -0,0 +1,79 @@
+#include "clipboard/sync_state.h"
+
+#include "utils/hash.h"
+
+#include <algorithm>
+
+namespace Clipd::Clipboard
+{
+SyncState::SyncState( Utils::Uuid origin, Utils::HybridLogicalClock::PhysicalClock physical ) :
+    m_origin( origin ),
+    m_physical( physical ),
+    m_clock( physical )
+{}
+
+std::optional<Item> SyncState::observeLocal( std::string&& contents )
+{
+    const uint64_t digest = Utils::hash64( contents );
+
+    std::unique_lock<std::mutex> lock( m_mutex );
+    if( m_has_current && digest == m_current_digest )
+    {
+        return std::nullopt;
+    }
+
+    const bool startup = !m_has_current;
+    m_current_digest = digest;
+    m_has_current = true;
+
+    // Contents that arrived over the network are never re-broadcast, even if the clipboard
+    // changed to them before receiveRemote() was called (e.g. when another clipd on this host set
+    // the shared clipboard first). An empty clipboard is never worth broadcasting.
+    if( contents.empty() || receivedFromNetwork( digest ) )
+    {
+        return std::nullopt;
+    }
+
+    // Whatever was on the clipboard at startup is shared with peers that have nothing better, but
+    // it has the oldest possible timestamp, so the session's current item always supersedes it.
+    m_current = Utils::Version {startup ? 0 : m_clock.now(), m_origin};
+    return Item {m_current, Utils::Payload( std::move( contents ) )};
+}
+
+bool SyncState::receiveRemote( const Item& item )
+{
+    m_clock.update( item.version.timestamp );
+    const uint64_t digest = Utils::hash64( item.contents.view() );
+
+    std::unique_lock<std::mutex> lock( m_mutex );
+    m_remote_digests[m_next_remote_digest] = RemoteDigest {digest, m_physical()};
+    m_next_remote_digest = ( m_next_remote_digest + 1 ) % num_remote_digests;
+
+    if( !( item.version > m_current ) )
+    {
+        return false;
+    }
+
+    m_current = item.version;
+    const bool changed = !m_has_current || digest != m_current_digest;
+    m_current_digest = digest;
+    m_has_current = true;
+    return changed;
+}
+
+Utils::Version SyncState::current() const
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+    return m_current;
+}
+
+bool SyncState::receivedFromNetwork( uint64_t digest ) const
+{
+    const uint64_t now = m_physical();
+    return std::any_of( m_remote_digests.begin(), m_remote_digests.end(),
+                        [digest, now]( const RemoteDigest& remote ) {
+                            return remote.received_ms != 0 && remote.digest == digest &&
+                                   now - remote.received_ms < echo_window_ms;
+                        } );
+}
+} // namespace Clipd::Clipboard
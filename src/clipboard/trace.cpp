@@ -0,0 +1,136 @@
+#include "clipboard/trace.h"
+
+#include "clipboard/item.h"
+
+#include <algorithm>
+
+namespace Clipd::Clipboard
+{
+namespace
+{
+//! The difference between two timestamps, clamped to zero if clock error made it negative.
+uint64_t elapsed( int64_t from, int64_t to )
+{
+    return to > from ? static_cast<uint64_t>( to - from ) : 0;
+}
+
+void writeEvent( std::ostream& o, const char* name, int pid, uint64_t start_us,
+                 uint64_t duration_us )
+{
+    o << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":1,\"ts\":"
+      << start_us << ",\"dur\":" << duration_us << "}";
+}
+} // namespace
+
+Tracer::Tracer( size_t capacity, size_t sample_every, Utils::Metrics::Registry& registry ) :
+    m_capacity( capacity ),
+    m_sample_every( std::max<size_t>( sample_every, 1 ) ),
+    m_read( registry.histogram( "trace.read_ns" ) ),
+    m_hash( registry.histogram( "trace.hash_ns" ) ),
+    m_queue( registry.histogram( "trace.queue_ns" ) ),
+    m_transit( registry.histogram( "trace.transit_ns" ) ),
+    m_decode( registry.histogram( "trace.decode_ns" ) ),
+    m_set_text( registry.histogram( "trace.set_text_ns" ) ),
+    m_end_to_end( registry.histogram( "trace.end_to_end_ns" ) )
+{}
+
+Tracer& Tracer::global()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::complete( const Item& item, uint32_t set_text_us, uint64_t applied_us )
+{
+    const Trace& trace = item.trace;
+    if( trace.captured_us == 0 )
+    {
+        return;
+    }
+
+    // Lay the origin's timestamps out on our clock. Without an offset estimate yet, assume the
+    // clocks are synchronized (by NTP, say).
+    const int64_t offset = trace.offset_us.value_or( 0 );
+    const auto captured = static_cast<int64_t>( trace.captured_us ) + offset;
+    const auto sent = static_cast<int64_t>( trace.sent_us ) + offset;
+
+    Sample sample {};
+    sample.origin = item.version.origin;
+    sample.version = item.version.timestamp;
+    sample.size = item.contents.size();
+    sample.offset_known = trace.offset_us.has_value();
+    sample.captured_us = static_cast<uint64_t>( std::max<int64_t>( captured, 0 ) );
+    sample.read_us = trace.read_us;
+    sample.hash_us = trace.hash_us;
+    sample.queue_us = elapsed( captured + trace.read_us + trace.hash_us, sent );
+    sample.transit_us = elapsed( sent, static_cast<int64_t>( trace.received_us ) );
+    sample.decode_us = trace.decode_us;
+    sample.set_text_us = set_text_us;
+
+    constexpr uint64_t ns_per_us = 1000;
+    m_read.record( sample.read_us * ns_per_us );
+    m_hash.record( sample.hash_us * ns_per_us );
+    m_queue.record( sample.queue_us * ns_per_us );
+    m_transit.record( sample.transit_us * ns_per_us );
+    m_decode.record( sample.decode_us * ns_per_us );
+    m_set_text.record( sample.set_text_us * ns_per_us );
+    m_end_to_end.record( elapsed( captured, static_cast<int64_t>( applied_us ) ) * ns_per_us );
+
+    const std::lock_guard lock( m_mutex );
+    if( m_completed++ % m_sample_every != 0 || m_capacity == 0 )
+    {
+        return;
+    }
+    if( m_samples.size() == m_capacity )
+    {
+        m_samples.pop_front();
+    }
+    m_samples.push_back( sample );
+}
+
+void Tracer::writeChromeTrace( std::ostream& o ) const
+{
+    // The origin's stages go in one process, and ours in another, so that the viewer shows the
+    // handoff between the two peers.
+    constexpr int origin_pid = 1;
+    constexpr int local_pid = 2;
+
+    o << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    o << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << origin_pid
+      << ",\"args\":{\"name\":\"origin\"}},";
+    o << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << local_pid
+      << ",\"args\":{\"name\":\"local\"}}";
+
+    const std::lock_guard lock( m_mutex );
+    for( const auto& s : m_samples )
+    {
+        uint64_t t = s.captured_us;
+        o << ",";
+        writeEvent( o, "read", origin_pid, t, s.read_us );
+        t += s.read_us;
+        o << ",";
+        writeEvent( o, "hash", origin_pid, t, s.hash_us );
+        t += s.hash_us;
+        o << ",";
+        writeEvent( o, "queue", origin_pid, t, s.queue_us );
+        t += s.queue_us;
+        o << ",";
+        writeEvent( o, "transit", local_pid, t, s.transit_us );
+        t += s.transit_us;
+        o << ",";
+        writeEvent( o, "decode", local_pid, t, s.decode_us );
+        t += s.decode_us;
+        o << ",";
+        writeEvent( o, "set_text", local_pid, t, s.set_text_us );
+        t += s.set_text_us;
+
+        // A single event spanning the whole copy, that carries the item's details.
+        o << ",{\"name\":\"copy\",\"ph\":\"X\",\"pid\":" << local_pid
+          << ",\"tid\":2,\"ts\":" << s.captured_us << ",\"dur\":" << t - s.captured_us
+          << ",\"args\":{\"origin\":\"" << s.origin.hex() << "\",\"version\":" << s.version
+          << ",\"size\":" << s.size << ",\"offset_known\":" << ( s.offset_known ? "true" : "false" )
+          << "}}";
+    }
+    o << "]}";
+}
+} // namespace Clipd::Clipboard
@@ -0,0 +1,149 @@
+#include "network/capabilities.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+namespace Clipd::Network
+{
+namespace
+{
+const std::string protocol_header = "X-CLIPD-PROTOCOL";
+const std::string codecs_header = "X-CLIPD-CODECS";
+const std::string max_payload_header = "X-CLIPD-MAX-PAYLOAD";
+const std::string chunking_header = "X-CLIPD-CHUNKING";
+const std::string lazy_pull_header = "X-CLIPD-LAZY-PULL";
+const std::string fanout_header = "X-CLIPD-FANOUT";
+const std::string multicast_header = "X-CLIPD-MULTICAST";
+const std::string timing_header = "X-CLIPD-TIMING";
+const std::string formats_header = "X-CLIPD-FORMATS";
+
+std::vector<std::string> split( const std::string& list )
+{
+    std::vector<std::string> items;
+    std::stringstream ss( list );
+    std::string item;
+    while( std::getline( ss, item, ',' ) )
+    {
+        if( !item.empty() )
+        {
+            items.push_back( item );
+        }
+    }
+    return items;
+}
+
+uint64_t parseUnsigned( const std::string& value )
+{
+    try
+    {
+        return std::stoull( value );
+    } catch( const std::exception& )
+    {
+        return 0;
+    }
+}
+} // namespace
+
+Capabilities Capabilities::local()
+{
+    Capabilities local;
+    local.protocol = 1;
+    local.codecs = ( 1U << static_cast<unsigned>( Codec::Raw ) ) |
+                   ( 1U << static_cast<unsigned>( Codec::Deflate ) );
+    local.chunking = true;
+    local.lazy_pull = true;
+    local.fanout = true;
+    local.timing = true;
+    local.formats = {"text/plain;charset=utf-8"};
+    return local;
+}
+
+Capabilities Capabilities::fromHeaders( const std::map<std::string, std::string>& headers )
+{
+    Capabilities capabilities;
+    const auto header = [&headers]( const std::string& name ) -> const std::string* {
+        const auto it = headers.find( name );
+        return it == headers.end() ? nullptr : &it->second;
+    };
+
+    const std::string* protocol = header( protocol_header );
+    if( !protocol )
+    {
+        // A legacy peer, which has the defaults.
+        return capabilities;
+    }
+    constexpr uint64_t max_protocol = 255;
+    capabilities.protocol =
+        static_cast<uint8_t>( std::min( parseUnsigned( *protocol ), max_protocol ) );
+
+    if( const std::string* codecs = header( codecs_header ) )
+    {
+        for( const auto& name : split( *codecs ) )
+        {
+            if( const auto codec = parseCodec( name ) )
+            {
+                capabilities.codecs |= 1U << static_cast<unsigned>( *codec );
+            }
+        }
+    }
+    if( const std::string* max_payload = header( max_payload_header ) )
+    {
+        capabilities.max_payload = parseUnsigned( *max_payload );
+    }
+    if( const std::string* chunking = header( chunking_header ) )
+    {
+        capabilities.chunking = *chunking == "1";
+    }
+    if( const std::string* lazy_pull = header( lazy_pull_header ) )
+    {
+        capabilities.lazy_pull = *lazy_pull == "1";
+    }
+    if( const std::string* fanout = header( fanout_header ) )
+    {
+        capabilities.fanout = *fanout == "1";
+    }
+    if( const std::string* multicast = header( multicast_header ) )
+    {
+        capabilities.multicast = *multicast == "1";
+    }
+    if( const std::string* timing = header( timing_header ) )
+    {
+        capabilities.timing = *timing == "1";
+    }
+    if( const std::string* formats = header( formats_header ) )
+    {
+        capabilities.formats = split( *formats );
+    }
+    return capabilities;
+}
+
+std::map<std::string, std::string> Capabilities::toHeaders() const
+{
+    std::string codec_list;
+    for( Codec codec : {Codec::Raw, Codec::Deflate} )
+    {
+        if( supports( codec ) )
+        {
+            codec_list += ( codec_list.empty() ? "" : "," ) + std::string( codecName( codec ) );
+        }
+    }
+    std::string format_list;
+    for( const auto& format : formats )
+    {
+        format_list += ( format_list.empty() ? "" : "," ) + format;
+    }
+
+    return {
+        {protocol_header, std::to_string( static_cast<unsigned>( protocol ) )},
+        {codecs_header, codec_list},
+        {max_payload_header, std::to_string( max_payload )},
+        {chunking_header, chunking ? "1" : "0"},
+        {lazy_pull_header, lazy_pull ? "1" : "0"},
+        {fanout_header, fanout ? "1" : "0"},
+        {multicast_header, multicast ? "1" : "0"},
+        {timing_header, timing ? "1" : "0"},
+        {formats_header, format_list},
+    };
+}
+} // namespace Clipd::Network
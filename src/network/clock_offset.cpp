@@ -0,0 +1,36 @@
+#include "network/clock_offset.h"
+
+#include <algorithm>
+
+namespace Clipd::Network
+{
+void ClockOffset::sample( int64_t delay_us, Clock::time_point now )
+{
+    if( now - m_window_start >= window )
+    {
+        m_previous = m_current;
+        m_current.reset();
+        m_window_start = now;
+    }
+    m_current = m_current ? std::min( *m_current, delay_us ) : delay_us;
+}
+
+std::optional<int64_t> ClockOffset::delay() const
+{
+    if( m_current && m_previous )
+    {
+        return std::min( *m_current, *m_previous );
+    }
+    return m_current ? m_current : m_previous;
+}
+
+std::optional<int64_t> ClockOffset::offset() const
+{
+    const auto measured = delay();
+    if( !measured || !m_reported )
+    {
+        return std::nullopt;
+    }
+    return ( *measured - *m_reported ) / 2;
+}
+} // namespace Clipd::Network
@@ -0,0 +1,59 @@
+#include "network/coalescer.h"
+
+#include <algorithm>
+
+namespace Clipd::Network
+{
+std::optional<Clipboard::Item> Coalescer::offer( Clipboard::Item update, Clock::time_point now )
+{
+    m_stats.offered.fetch_add( 1, std::memory_order_relaxed );
+    m_last_offer = now;
+
+    const bool quiet = !m_last_release || now - *m_last_release >= m_config.debounce;
+    if( !m_pending && quiet )
+    {
+        return release( std::move( update ), now );
+    }
+
+    if( m_pending )
+    {
+        m_stats.dropped.fetch_add( 1, std::memory_order_relaxed );
+    }
+    else
+    {
+        m_first_pending = now;
+    }
+    m_pending = std::move( update );
+    return std::nullopt;
+}
+
+std::optional<Clipboard::Item> Coalescer::poll( Clock::time_point now )
+{
+    const auto due = deadline();
+    if( !due || now < *due )
+    {
+        return std::nullopt;
+    }
+
+    Clipboard::Item update = std::move( *m_pending );
+    m_pending.reset();
+    return release( std::move( update ), now );
+}
+
+std::optional<Coalescer::Clock::time_point> Coalescer::deadline() const
+{
+    if( !m_pending )
+    {
+        return std::nullopt;
+    }
+
+    return std::min( m_last_offer + m_config.debounce, m_first_pending + m_config.max_delay );
+}
+
+Clipboard::Item Coalescer::release( Clipboard::Item update, Clock::time_point now )
+{
+    m_stats.released.fetch_add( 1, std::memory_order_relaxed );
+    m_last_release = now;
+    return update;
+}
+} // namespace Clipd::Network
@@ -0,0 +1,88 @@
+#include "network/codec.h"
+
+#include <zlib.h>
+
+#include <string>
+
+namespace Clipd::Network
+{
+namespace
+{
+//! The most zlib's deflate can shrink its input by.
+constexpr uint64_t max_deflate_ratio = 1032;
+} // namespace
+
+std::string_view codecName( Codec codec )
+{
+    switch( codec )
+    {
+        case Codec::Raw: return "raw";
+        case Codec::Deflate: return "deflate";
+    }
+    return "unknown";
+}
+
+std::optional<Codec> parseCodec( std::string_view name )
+{
+    for( Codec codec : {Codec::Raw, Codec::Deflate} )
+    {
+        if( codecName( codec ) == name )
+        {
+            return codec;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<Utils::Payload> encode( Codec codec, const Utils::Payload& contents )
+{
+    switch( codec )
+    {
+        case Codec::Raw: return contents;
+        case Codec::Deflate:
+        {
+            uLongf size = compressBound( contents.size() );
+            std::string compressed( size, '\0' );
+            // Favor speed: clipboard contents are usually text, which compresses well regardless.
+            const int status = compress2( reinterpret_cast<Bytef*>( compressed.data() ), &size,
+                                          reinterpret_cast<const Bytef*>( contents.data() ),
+                                          contents.size(), Z_BEST_SPEED );
+            if( status != Z_OK || size >= contents.size() )
+            {
+                return std::nullopt;
+            }
+            compressed.resize( size );
+            return Utils::Payload( std::move( compressed ) );
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<Utils::Payload> decode( Codec codec, const Utils::Payload& encoded, uint64_t size )
+{
+    switch( codec )
+    {
+        case Codec::Raw: return encoded;
+        case Codec::Deflate:
+        {
+            // The size comes off the wire, so it's checked before the buffer is allocated.
+            if( size > max_deflate_ratio * ( uint64_t( encoded.size() ) + 1 ) )
+            {
+                return std::nullopt;
+            }
+            std::string decompressed( size, '\0' );
+            uLongf decompressed_size = size;
+            const int status = uncompress( reinterpret_cast<Bytef*>( decompressed.data() ),
+                                           &decompressed_size,
+                                           reinterpret_cast<const Bytef*>( encoded.data() ),
+                                           encoded.size() );
+            if( status != Z_OK || decompressed_size != size )
+            {
+                return std::nullopt;
+            }
+            return Utils::Payload( std::move( decompressed ) );
+        }
+    }
+    return std::nullopt;
+}
+} // namespace Clipd::Network
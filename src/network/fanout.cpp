@@ -0,0 +1,60 @@
+#include "network/fanout.h"
+
+#include <algorithm>
+
+namespace Clipd::Network
+{
+FanoutTree::FanoutTree( std::vector<Utils::Uuid> members, const Utils::Uuid& root,
+                        size_t degree ) :
+    m_members( std::move( members ) ),
+    m_degree( std::max<size_t>( degree, 1 ) )
+{
+    m_members.push_back( root );
+    std::sort( m_members.begin(), m_members.end() );
+    m_members.erase( std::unique( m_members.begin(), m_members.end() ), m_members.end() );
+    m_root = static_cast<size_t>(
+        std::lower_bound( m_members.begin(), m_members.end(), root ) - m_members.begin() );
+}
+
+std::optional<size_t> FanoutTree::position( const Utils::Uuid& node ) const
+{
+    const auto found = std::lower_bound( m_members.begin(), m_members.end(), node );
+    if( found == m_members.end() || !( *found == node ) )
+    {
+        return std::nullopt;
+    }
+    const auto index = static_cast<size_t>( found - m_members.begin() );
+    return ( index + m_members.size() - m_root ) % m_members.size();
+}
+
+std::vector<Utils::Uuid> FanoutTree::children( const Utils::Uuid& node ) const
+{
+    std::vector<Utils::Uuid> children;
+    const auto parent = position( node );
+    if( !parent )
+    {
+        return children;
+    }
+    for( size_t child = *parent * m_degree + 1;
+         child <= *parent * m_degree + m_degree && child < m_members.size(); ++child )
+    {
+        children.push_back( m_members[( m_root + child ) % m_members.size()] );
+    }
+    return children;
+}
+
+std::optional<size_t> FanoutTree::depth( const Utils::Uuid& node ) const
+{
+    auto at = position( node );
+    if( !at )
+    {
+        return std::nullopt;
+    }
+    size_t hops = 0;
+    for( ; *at != 0; at = ( *at - 1 ) / m_degree )
+    {
+        ++hops;
+    }
+    return hops;
+}
+} // namespace Clipd::Network
@@ -0,0 +1,127 @@
+#include "network/lanes.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace Clipd::Network
+{
+namespace
+{
+//! How far ahead of the wire paced lanes may run, so a burst of small messages isn't held back.
+constexpr double burst_s = 0.005;
+
+Lane other( Lane lane )
+{
+    return lane == Lane::Interactive ? Lane::Bulk : Lane::Interactive;
+}
+} // namespace
+
+std::string_view laneName( Lane lane )
+{
+    switch( lane )
+    {
+        case Lane::Control: return "control";
+        case Lane::Interactive: return "interactive";
+        case Lane::Bulk: return "bulk";
+    }
+    return "unknown";
+}
+
+void LaneScheduler::push( Lane lane, Outgoing message )
+{
+    message.lane = lane;
+    m_lanes[static_cast<size_t>( lane )].messages.push_back( std::move( message ) );
+}
+
+std::optional<Outgoing> LaneScheduler::pop( Clock::time_point now )
+{
+    const bool paced = m_config.rate > 0;
+    if( paced )
+    {
+        m_tokens = tokens( now );
+        m_refilled = now;
+    }
+
+    Queue& control = m_lanes[static_cast<size_t>( Lane::Control )];
+    if( !control.messages.empty() )
+    {
+        return take( control, now );
+    }
+    if( queued( Lane::Interactive ) == 0 && queued( Lane::Bulk ) == 0 )
+    {
+        return std::nullopt;
+    }
+    // A message may overdraw the bucket, but nothing more is sent until it's paid back.
+    if( paced && m_tokens < 0 )
+    {
+        return std::nullopt;
+    }
+
+    // Each turn, a lane earns a quantum in proportion to its weight, and sends messages until
+    // their cost exceeds what it has earned.
+    while( true )
+    {
+        Queue& queue = m_lanes[static_cast<size_t>( m_turn )];
+        if( queue.messages.empty() )
+        {
+            queue.deficit = 0;
+            m_turn = other( m_turn );
+            continue;
+        }
+        const uint64_t cost = std::max<uint64_t>( queue.messages.front().cost, 1 );
+        if( queue.deficit >= cost )
+        {
+            queue.deficit -= cost;
+            return take( queue, now );
+        }
+        const size_t weight = m_turn == Lane::Interactive ? m_config.interactive_weight
+                                                          : m_config.bulk_weight;
+        queue.deficit += std::max<uint64_t>( uint64_t( weight ) * m_config.chunk, 1 );
+        m_turn = other( m_turn );
+    }
+}
+
+std::optional<LaneScheduler::Clock::duration> LaneScheduler::wait( Clock::time_point now ) const
+{
+    if( queued( Lane::Control ) != 0 )
+    {
+        return Clock::duration::zero();
+    }
+    if( queued( Lane::Interactive ) == 0 && queued( Lane::Bulk ) == 0 )
+    {
+        return std::nullopt;
+    }
+    const double available = m_config.rate > 0 ? tokens( now ) : 0;
+    if( available >= 0 )
+    {
+        return Clock::duration::zero();
+    }
+    const std::chrono::duration<double> refill( -available / m_config.rate );
+    return std::chrono::ceil<Clock::duration>( refill );
+}
+
+double LaneScheduler::tokens( Clock::time_point now ) const
+{
+    const double burst =
+        std::max( m_config.rate * burst_s, static_cast<double>( m_config.chunk ) );
+    // The bucket starts full.
+    if( m_refilled == Clock::time_point {} )
+    {
+        return burst;
+    }
+    const double elapsed = std::chrono::duration<double>( now - m_refilled ).count();
+    return std::min( burst, m_tokens + m_config.rate * std::max( elapsed, 0.0 ) );
+}
+
+Outgoing LaneScheduler::take( Queue& queue, Clock::time_point now )
+{
+    Outgoing message = std::move( queue.messages.front() );
+    queue.messages.pop_front();
+    if( m_config.rate > 0 )
+    {
+        m_tokens = tokens( now ) - static_cast<double>( message.cost );
+        m_refilled = now;
+    }
+    return message;
+}
+} // namespace Clipd::Network
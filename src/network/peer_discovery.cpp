@@ -1,145 +1,1608 @@
 #include "network/peer_discovery.h"
 
-#include "network/message.h"
+#include "network/protocol.h"
+#include "utils/hash.h"
+#include "utils/log.h"
+#include "utils/probes.h"
 
-#include <iostream>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <map>
 
 namespace Clipd::Network
 {
-PeerDiscoveryDaemon::PeerDiscoveryDaemon( uint16_t discovery_port, zcert_t* certificate,
-                                          const std::string& session, bool verbose ) :
-    m_discovery_port( discovery_port ),
-    m_verbose( verbose ),
-    m_session( session ),
-    m_zcert( certificate ),
-    m_znode( zyre_new( nullptr ) )
+namespace
 {
-    if( m_verbose )
+using namespace std::chrono_literals;
+
+//! The most recent datagrams each session keeps, to whisper to peers that lost them.
+constexpr size_t multicast_history = 64;
+//! How long after its last datagram a sender multicasts each heartbeat, so that peers notice if
+//! they lost it.
+constexpr std::array<Transport::Clock::duration, 2> heartbeat_delays = {20ms, 200ms};
+//! The most reserved for an item before its chunks arrive, since its size comes off the wire.
+constexpr uint64_t max_assembly_reserve = 16 * 1024 * 1024;
+
+uint64_t frameBytes( const std::vector<Utils::Payload>& frames )
+{
+    uint64_t bytes = 0;
+    for( const auto& frame : frames )
+    {
+        bytes += frame.size();
+    }
+    return bytes;
+}
+
+//! @brief The header of the given datagram, which a sealed session authenticates with its frames.
+std::string datagramHeader( const Protocol::Datagram& datagram )
+{
+    const Protocol::Datagram header {datagram.sender, datagram.group, datagram.sequence, {}};
+    return Protocol::encodeDatagram( header ).str();
+}
+} // namespace
+
+PeerDiscoveryDaemon::PeerDiscoveryDaemon( std::unique_ptr<Transport> transport,
+                                          const std::string& session,
+                                          const Coalescer::Config& coalescing,
+                                          const FanoutTree::Config& fanout,
+                                          const LaneScheduler::Config& lanes, bool join_global ) :
+    m_transport( std::move( transport ) ),
+    m_on_event( this, &PeerDiscoveryDaemon::handleEvent ),
+    m_uuid( m_transport->uuid() ),
+    m_capabilities( Capabilities::local() ),
+    m_coalescing( coalescing ),
+    m_fanout( fanout ),
+    m_lanes( lanes )
+{
+    for( Lane lane : {Lane::Control, Lane::Interactive, Lane::Bulk} )
+    {
+        m_lane_waits[static_cast<size_t>( lane )] =
+            &Utils::Metrics::Registry::global().histogram( Utils::Metrics::labelled(
+                "network.lanes.wait_ns", "lane", std::string( laneName( lane ) ) ) );
+    }
+
+    if( join_global )
+    {
+        m_transport->join( "GLOBAL" );
+    }
+    addSession( session );
+
+    // Advertise what this node supports, so that peers can pick the best encoding for it.
+    m_capabilities.multicast = m_sessions.front().multicast;
+    advertise();
+}
+
+PeerDiscoveryDaemon::~PeerDiscoveryDaemon()
+{
+    for( const auto& [uuid, peer] : m_peers )
+    {
+        releaseCounters( peer );
+    }
+}
+
+void PeerDiscoveryDaemon::addSession( const std::string& session )
+{
+    if( m_routes.count( session ) != 0 )
+    {
+        return;
+    }
+
+    Session& hosted = m_sessions.emplace_back();
+    hosted.name = session;
+    hosted.protocol_group = Protocol::sessionGroup( session );
+    if( !m_session_secret.empty() )
+    {
+        hosted.key = SessionKey::derive( m_session_secret, hosted.name );
+    }
+    m_routes.emplace( hosted.name, &hosted );
+    m_routes.emplace( hosted.protocol_group, &hosted );
+    m_hosted_sessions.add( 1 );
+
+    m_transport->join( hosted.name );
+    m_transport->join( hosted.protocol_group );
+    joinMulticast( hosted );
+}
+
+void PeerDiscoveryDaemon::joinMulticast( Session& session )
+{
+    // Datagrams bypass the transport's encrypted links, so they'd carry an unsealed session's
+    // items in the clear, and let anyone on the LAN inject them.
+    if( !session.multicast && ( session.key || !m_transport->encrypted() ) )
+    {
+        session.multicast = m_transport->joinMulticast( session.protocol_group );
+    }
+}
+
+bool PeerDiscoveryDaemon::setSessionSecret( const std::vector<uint8_t>& secret )
+{
+    for( auto& session : m_sessions )
+    {
+        session.key = SessionKey::derive( secret, session.name );
+        if( !session.key )
+        {
+            CLIPD_LOG_ERROR( "Failed to derive a key for session '" << session.name << "'" );
+            return false;
+        }
+    }
+    m_session_secret = secret;
+    for( auto& session : m_sessions )
+    {
+        joinMulticast( session );
+    }
+    m_capabilities.multicast = m_sessions.front().multicast;
+    advertise();
+    return true;
+}
+
+void PeerDiscoveryDaemon::setThrottle( const Throttle::Config& config )
+{
+    m_send_throttle = Throttle( config );
+    m_receive_throttle = Throttle( config );
+}
+
+void PeerDiscoveryDaemon::setMaxPayload( uint64_t bytes )
+{
+    m_capabilities.max_payload = bytes;
+    advertise();
+}
+
+void PeerDiscoveryDaemon::advertise()
+{
+    for( const auto& [name, value] : m_capabilities.toHeaders() )
+    {
+        m_transport->setHeader( name, value );
+    }
+}
+
+void PeerDiscoveryDaemon::receiveLocalClipboardUpdate( const Clipboard::Item& item )
+{
+    receiveLocalClipboardUpdate( m_sessions.front().name, item );
+}
+
+void PeerDiscoveryDaemon::receiveLocalClipboardUpdate( const std::string& session,
+                                                       const Clipboard::Item& item )
+{
+    m_queue_depth.add( 1 );
+    m_commands.post( Command {Command::Type::Shout, session, item} );
+}
+
+void PeerDiscoveryDaemon::registerOnRemoteClipboardUpdate(
+    Utils::Functor<void( const Clipboard::Item& )> callback )
+{
+    m_sessions.front().remote_update_delegate.subscribe( callback );
+}
+
+void PeerDiscoveryDaemon::registerOnRemoteClipboardUpdate(
+    const std::string& session, Utils::Functor<void( const Clipboard::Item& )> callback )
+{
+    if( Session* hosted = findSession( session ) )
+    {
+        hosted->remote_update_delegate.subscribe( callback );
+    }
+}
+
+size_t PeerDiscoveryDaemon::sessionPeers( const std::string& session ) const
+{
+    const auto route = m_routes.find( session );
+    return route == m_routes.end() ? 0 : route->second->peers.load( std::memory_order_relaxed );
+}
+
+PeerDiscoveryDaemon::Session* PeerDiscoveryDaemon::findSession( const std::string& group )
+{
+    const auto route = m_routes.find( group );
+    return route == m_routes.end() ? nullptr : route->second;
+}
+
+PeerDiscoveryDaemon::Session* PeerDiscoveryDaemon::whisperedSession( const Protocol::Header& header,
+                                                                     const Peer* sender )
+{
+    if( !header.session.empty() )
+    {
+        return findSession( header.session );
+    }
+    if( sender )
+    {
+        for( auto& session : m_sessions )
+        {
+            if( sender->inGroup( session.protocol_group ) )
+            {
+                return &session;
+            }
+        }
+    }
+    return &m_sessions.front();
+}
+
+void PeerDiscoveryDaemon::stop()
+{
+    Utils::Daemon::stop();
+    // Interrupt the poll in loop() so that teardown() runs promptly.
+    m_commands.wake();
+}
+
+void PeerDiscoveryDaemon::setup()
+{
+    if( m_transport->start() )
+    {
+        CLIPD_LOG_INFO( "Started peer discovery as " << m_uuid.hex() );
+    } else
+    {
+        CLIPD_LOG_ERROR( "Failed to start peer discovery" );
+    }
+}
+
+void PeerDiscoveryDaemon::teardown()
+{
+    for( const auto& [group, coalescer] : m_coalescers )
+    {
+        const auto& stats = coalescer.stats();
+        CLIPD_LOG_DEBUG( "Coalesced " << stats.offered << " updates to '" << group << "' into "
+                                      << stats.released << " broadcasts (" << stats.dropped
+                                      << " dropped)" );
+    }
+
+    m_transport->stop();
+}
+
+void PeerDiscoveryDaemon::loop()
+{
+    using namespace std::chrono;
+    // Bound the wait so that the loop condition is re-checked even if a wakeup is missed.
+    milliseconds timeout( 100 );
+    if( const auto next_flush = step() )
+    {
+        timeout = std::min( timeout, ceil<milliseconds>( *next_flush ) );
+    }
+    if( m_transport->wait( timeout, m_commands.fd() ) )
+    {
+        m_poll_wakeups.add();
+    }
+}
+
+std::optional<Transport::Clock::duration> PeerDiscoveryDaemon::step()
+{
+    m_transport->receive( m_on_event );
+
+    const size_t drained =
+        m_commands.drain( [this]( const Command& command ) { handleCommand( command ); } );
+    if( drained != 0 )
+    {
+        m_queue_depth.add( -static_cast<int64_t>( drained ) );
+        m_commands_drained.record( drained );
+    }
+    std::optional<Transport::Clock::duration> next;
+    for( const auto due : {flushCoalesced(), flushThrottled(), flushRepairs(), flushPulls(),
+                           flushLanes(), flushHeartbeats()} )
+    {
+        if( due )
+        {
+            next = next ? std::min( *next, *due ) : *due;
+        }
+    }
+    return next;
+}
+
+void PeerDiscoveryDaemon::handleCommand( const Command& command )
+{
+    if( command.type != Command::Type::Shout )
+    {
+        const auto uuid = Utils::Uuid::fromHex( command.target );
+        const Peer* peer = uuid ? m_peers.find( *uuid ) : nullptr;
+        sendTimed( command.type, command.target, m_sessions.front(),
+                   Protocol::encodeItem( command.item, peer ? codecFor( *peer, command.item )
+                                                            : Codec::Raw ),
+                   &command.item );
+        return;
+    }
+
+    // Commands are drained in batches, so an update that was queued, but not yet sent, is simply
+    // replaced by the next update in the same batch.
+    auto& coalescer = m_coalescers.try_emplace( command.target, m_coalescing ).first->second;
+    if( auto update = coalescer.offer( command.item, m_transport->now() ) )
+    {
+        release( command.target, *update );
+    }
+}
+
+std::optional<Coalescer::Clock::duration> PeerDiscoveryDaemon::flushCoalesced()
+{
+    const auto now = m_transport->now();
+    std::optional<Coalescer::Clock::duration> next_flush;
+    for( auto& [group, coalescer] : m_coalescers )
+    {
+        if( auto update = coalescer.poll( now ) )
+        {
+            release( group, *update );
+        }
+        if( const auto deadline = coalescer.deadline() )
+        {
+            const auto remaining = *deadline - now;
+            next_flush = next_flush ? std::min( *next_flush, remaining ) : remaining;
+        }
+    }
+    return next_flush;
+}
+
+std::optional<Transport::Clock::duration> PeerDiscoveryDaemon::flushRepairs()
+{
+    const auto now = m_transport->now();
+    std::optional<Transport::Clock::duration> next_repair;
+    for( auto& session : m_sessions )
+    {
+        if( !session.repair || session.repair->pulled )
+        {
+            continue;
+        }
+        const auto& repair = *session.repair;
+        if( repair.deadline > now )
+        {
+            const auto remaining = repair.deadline - now;
+            next_repair = next_repair ? std::min( *next_repair, remaining ) : remaining;
+            continue;
+        }
+
+        const bool arrived = session.current && !( session.current->version < repair.version );
+        const bool pulling =
+            session.pending_pull && !( repair.version > session.pending_pull->version );
+        if( arrived || pulling )
+        {
+            session.repair.reset();
+            continue;
+        }
+        CLIPD_LOG_DEBUG( "Pulling " << repair.version << ", which didn't arrive in time" );
+        m_fanout_repairs.add();
+        session.repair->pulled = true;
+        pull( session, repair.version, repair.from );
+    }
+    return next_repair;
+}
+
+std::optional<Transport::Clock::duration> PeerDiscoveryDaemon::flushPulls()
+{
+    const auto now = m_transport->now();
+    std::optional<Transport::Clock::duration> next;
+    for( auto& session : m_sessions )
+    {
+        if( session.pending_pull && session.pending_pull->deadline <= now )
+        {
+            CLIPD_LOG_DEBUG( "Pulling " << session.pending_pull->version
+                                        << " again, which didn't arrive in time" );
+            repull( session, false );
+        }
+        if( session.pending_pull )
+        {
+            const auto remaining = session.pending_pull->deadline - now;
+            next = next ? std::min( *next, remaining ) : remaining;
+        }
+    }
+    return next;
+}
+
+void PeerDiscoveryDaemon::pull( Session& session, const Utils::Version& version,
+                                const std::string& from )
+{
+    auto& pending = session.pending_pull;
+    if( !pending || pending->version != version )
+    {
+        pending = Session::Pull {version, from, {}, {}, 0};
+    }
+    pending->from = from;
+    pending->deadline = m_transport->now() + pull_timeout;
+    ++pending->attempts;
+    sendTimed( Command::Type::Whisper, from, session, Protocol::encodePull( version ) );
+}
+
+void PeerDiscoveryDaemon::repull( Session& session, bool exited )
+{
+    auto& pending = *session.pending_pull;
+    // A peer that's still here may just have been slow, so it's asked again after the others.
+    if( !exited )
+    {
+        pending.others.push_back( pending.from );
+    }
+    if( pending.others.empty() || pending.attempts >= max_pull_attempts )
+    {
+        CLIPD_LOG_DEBUG( "Gave up pulling " << pending.version );
+        session.pending_pull.reset();
+        return;
+    }
+    const std::string next = std::move( pending.others.front() );
+    pending.others.erase( pending.others.begin() );
+    m_pull_retries.add();
+    pull( session, pending.version, next );
+}
+
+std::optional<Transport::Clock::duration> PeerDiscoveryDaemon::flushHeartbeats()
+{
+    const auto now = m_transport->now();
+    std::optional<Transport::Clock::duration> next;
+    for( auto& session : m_sessions )
+    {
+        if( session.sequence == 0 || session.heartbeats == heartbeat_delays.size() )
+        {
+            continue;
+        }
+        const auto due = session.multicast_at + heartbeat_delays[session.heartbeats];
+        if( due > now )
+        {
+            next = next ? std::min( *next, due - now ) : due - now;
+            continue;
+        }
+        Protocol::Datagram heartbeat {m_uuid, Utils::hash64( session.protocol_group ),
+                                      session.sequence, {}};
+        if( session.key )
+        {
+            heartbeat.frames = {session.key->seal( {}, datagramHeader( heartbeat ) )};
+        }
+        m_transport->multicast( session.protocol_group, Protocol::encodeDatagram( heartbeat ) );
+        if( ++session.heartbeats < heartbeat_delays.size() )
+        {
+            const auto wait = session.multicast_at + heartbeat_delays[session.heartbeats] - now;
+            next = next ? std::min( *next, wait ) : wait;
+        }
+    }
+    return next;
+}
+
+std::optional<Transport::Clock::duration> PeerDiscoveryDaemon::flushLanes()
+{
+    const auto now = m_transport->now();
+    while( auto message = m_lanes.pop( now ) )
+    {
+        m_lane_waits[static_cast<size_t>( message->lane )]->record( now - message->queued );
+        transmit( *message );
+    }
+    return m_lanes.wait( now );
+}
+
+std::optional<Transport::Clock::duration> PeerDiscoveryDaemon::flushThrottled()
+{
+    const auto now = m_transport->now();
+    const std::string self = m_uuid.hex();
+    std::optional<Transport::Clock::duration> next;
+    const auto due = [&next]( Transport::Clock::duration wait ) {
+        next = next ? std::min( *next, wait ) : wait;
+    };
+    for( auto& session : m_sessions )
+    {
+        if( session.throttled_out )
+        {
+            if( m_send_throttle.admit( session.name, self, now ) )
+            {
+                const Clipboard::Item item = std::move( *session.throttled_out );
+                session.throttled_out.reset();
+                publish( session.name, item );
+            } else
+            {
+                due( m_send_throttle.wait( session.name, self, now ) );
+            }
+        }
+        // Each peer's held item only waits for that peer's bucket. The newest the throttle lets
+        // through is delivered, and the older ones it supersedes are dropped.
+        std::vector<decltype( session.throttled_in )::iterator> held;
+        for( auto it = session.throttled_in.begin(); it != session.throttled_in.end(); ++it )
+        {
+            held.push_back( it );
+        }
+        std::sort( held.begin(), held.end(), []( const auto& lhs, const auto& rhs ) {
+            return lhs->second.version > rhs->second.version;
+        } );
+        for( const auto& it : held )
+        {
+            if( m_receive_throttle.admit( session.name, it->first, now ) )
+            {
+                const Clipboard::Item item = std::move( it->second );
+                session.throttled_in.erase( it );
+                deliverThrottled( session, item );
+                break;
+            }
+            due( m_receive_throttle.wait( session.name, it->first, now ) );
+        }
+    }
+    return next;
+}
+
+void PeerDiscoveryDaemon::release( const std::string& session, const Clipboard::Item& item )
+{
+    Session* hosted = findSession( session );
+    if( !hosted || !m_send_throttle.enabled() )
+    {
+        publish( session, item );
+        return;
+    }
+    // Once an item is held back, newer ones wait behind it, so they can't overtake it.
+    if( hosted->throttled_out )
+    {
+        m_throttle_coalesced_out.add();
+        if( item.version > hosted->throttled_out->version )
+        {
+            hosted->throttled_out = item;
+        }
+        return;
+    }
+    if( m_send_throttle.admit( hosted->name, m_uuid.hex(), m_transport->now() ) )
+    {
+        publish( session, item );
+        return;
+    }
+    m_throttle_held_out.add();
+    hosted->throttled_out = item;
+}
+
+void PeerDiscoveryDaemon::publish( const std::string& session, const Clipboard::Item& item )
+{
+    CLIPD_PROBE2( network_publish, item.version.timestamp, item.contents.size() );
+    Session* hosted = findSession( session );
+    if( !hosted )
+    {
+        CLIPD_LOG_WARN( "Dropped an update to '" << session << "', which isn't hosted here" );
+        return;
+    }
+    if( !hosted->current || item.version > hosted->current->version )
+    {
+        hosted->current = item;
+    }
+    if( item.observed != std::chrono::steady_clock::time_point {} )
+    {
+        m_capture_to_send.record( m_transport->now() - item.observed );
+    }
+
+    const std::string& group = hosted->protocol_group;
+    bool has_legacy = false;
+    bool all_lazy = true;
+    size_t members = 0;
+    size_t refusing = 0;
+    size_t deflate = 0;
+    for( const auto& [uuid, peer] : m_peers )
+    {
+        if( peer.inGroup( group ) && !peer.capabilities.accepts( item.contents.size() ) )
+        {
+            ++refusing;
+        }
+        else if( peer.inGroup( group ) )
+        {
+            ++members;
+            all_lazy = all_lazy && peer.capabilities.lazy_pull;
+            deflate += codecFor( peer, item ) == Codec::Deflate ? 1U : 0U;
+        }
+        else if( peer.inGroup( session ) )
+        {
+            has_legacy = true;
+        }
+    }
+
+    // Legacy peers only understand the plain text contents, shouted to the session itself, which
+    // a sealed session never sends, since its items are only ever sent sealed.
+    if( has_legacy && !hosted->key )
+    {
+        send( Command::Type::Shout, session, {item.contents} );
+    }
+    if( members == 0 )
+    {
+        return;
+    }
+
+    // Large items are sent down a tree, so that no node sends more than a few copies.
+    if( disseminate( *hosted, item ) )
+    {
+        return;
+    }
+
+    // Large items are announced by digest, and only pulled by the peers that want them.
+    if( item.contents.size() >= lazy_pull_threshold && all_lazy )
+    {
+        sendTimed( Command::Type::Shout, group, *hosted, Protocol::encodeDigest( item ) );
+        return;
+    }
+
+    // Peers that don't accept items this large would only drop a shout, so the rest of the session
+    // is whispered the item instead, which costs the uplink the same.
+    if( refusing != 0 )
+    {
+        std::map<Codec, std::vector<Utils::Payload>> encodings;
+        for( const auto& [uuid, peer] : m_peers )
+        {
+            if( peer.inGroup( group ) && peer.capabilities.accepts( item.contents.size() ) )
+            {
+                const Codec codec = codecFor( peer, item );
+                auto [encoding, inserted] = encodings.try_emplace( codec );
+                if( inserted )
+                {
+                    encoding->second = Protocol::encodeItem( item, codec );
+                    sealItem( *hosted, encoding->second );
+                }
+                sendTimed( Command::Type::Whisper, uuid.hex(), *hosted, encoding->second, &item );
+            }
+        }
+        return;
+    }
+
+    // Shout with the codec most of the session prefers. Peers that can't decode it drop the shout,
+    // and are whispered an encoding they do support instead, rather than everyone falling back to
+    // the lowest common denominator.
+    const Codec shouted = deflate * 2 >= members ? Codec::Deflate : Codec::Raw;
+    auto frames = Protocol::encodeItem( item, shouted );
+    const auto sent = Protocol::decodeHeader( frames.front() );
+    sendTimed( Command::Type::Shout, group, *hosted, std::move( frames ), &item );
+
+    if( !sent || sent->codec == Codec::Raw )
+    {
+        return;
+    }
+    for( const auto& [uuid, peer] : m_peers )
+    {
+        if( peer.inGroup( group ) && !peer.capabilities.supports( sent->codec ) )
+        {
+            sendTimed( Command::Type::Whisper, uuid.hex(), *hosted,
+                       Protocol::encodeItem( item, codecFor( peer, item ) ), &item );
+        }
+    }
+}
+
+bool PeerDiscoveryDaemon::disseminate( Session& session, const Clipboard::Item& item )
+{
+    // Relayed items are shouted, since every node roots the tree at the item's origin.
+    if( m_fanout.degree == 0 || item.contents.size() < m_fanout.threshold ||
+        !( item.version.origin == m_uuid ) )
+    {
+        return false;
+    }
+    constexpr size_t max_degree = 255;
+    const auto degree = static_cast<uint8_t>( std::min( m_fanout.degree, max_degree ) );
+    const FanoutTree tree = fanoutTree( session, m_uuid, degree );
+    // Shouting to no more peers than we have children costs no more than the tree.
+    if( tree.size() <= size_t( degree ) + 1 )
+    {
+        return false;
+    }
+
+    // Peers that don't forward items aren't in the tree, and pull the item when it's announced.
+    auto announcement = Protocol::encodeDigest( item );
+    if( auto header = Protocol::decodeHeader( announcement.front() ) )
+    {
+        header->fanout = degree;
+        announcement.front() = Protocol::encodeHeader( *header );
+    }
+    sendTimed( Command::Type::Shout, session.protocol_group, session, std::move( announcement ) );
+    forward( session, item, tree, degree );
+    return true;
+}
+
+FanoutTree PeerDiscoveryDaemon::fanoutTree( const Session& session, const Utils::Uuid& root,
+                                            size_t degree ) const
+{
+    std::vector<Utils::Uuid> members = {m_uuid};
+    for( const auto& [uuid, peer] : m_peers )
+    {
+        if( peer.capabilities.fanout && peer.inGroup( session.protocol_group ) )
+        {
+            members.push_back( uuid );
+        }
+    }
+    return FanoutTree( std::move( members ), root, degree );
+}
+
+void PeerDiscoveryDaemon::forward( Session& session, const Clipboard::Item& item,
+                                   const FanoutTree& tree, uint8_t degree,
+                                   const std::vector<Utils::Payload>* received )
+{
+    session.forwarded = item.version;
+    const auto received_header =
+        received && received->size() > 1 ? Protocol::decodeHeader( received->front() )
+                                         : std::nullopt;
+
+    // Each encoding is made once, however many children it's sent to.
+    std::map<Codec, std::vector<Utils::Payload>> encodings;
+    for( const auto& child : tree.children( m_uuid ) )
+    {
+        // Children that don't accept the item would drop it, and their children pull it instead.
+        const Peer* peer = m_peers.find( child );
+        if( !peer || !peer->capabilities.accepts( item.contents.size() ) )
+        {
+            continue;
+        }
+        const Codec codec = codecFor( *peer, item );
+        auto [encoding, inserted] = encodings.try_emplace( codec );
+        auto& frames = encoding->second;
+        if( inserted )
+        {
+            // Forward the body as it was received, rather than compressing it again at each hop.
+            if( received_header && received_header->codec == codec )
+            {
+                frames = {received->at( 0 ), received->at( 1 )};
+            } else
+            {
+                frames = Protocol::encodeItem( item, codec );
+            }
+            if( auto header = Protocol::decodeHeader( frames.front() ) )
+            {
+                header->fanout = degree;
+                header->session.clear();
+                frames.front() = Protocol::encodeHeader( *header );
+            }
+            sealItem( session, frames );
+        }
+        m_fanout_forwarded.add();
+        sendTimed( Command::Type::Whisper, child.hex(), session, frames, &item );
+    }
+}
+
+Codec PeerDiscoveryDaemon::codecFor( const Peer& peer, const Clipboard::Item& item ) const
+{
+    // Small items aren't worth the CPU time to compress.
+    if( item.contents.size() >= compression_threshold &&
+        peer.capabilities.supports( Codec::Deflate ) && m_capabilities.supports( Codec::Deflate ) )
+    {
+        return Codec::Deflate;
+    }
+    return Codec::Raw;
+}
+
+template <typename Function>
+void PeerDiscoveryDaemon::forEachRecipient( Command::Type type, const std::string& target,
+                                            Function&& function ) const
+{
+    switch( type )
     {
-        zyre_set_verbose( m_znode );
-        zyre_print( m_znode );
+        case Command::Type::Shout:
+            for( const auto& [uuid, peer] : m_peers )
+            {
+                if( peer.inGroup( target ) )
+                {
+                    function( peer );
+                }
+            }
+            break;
+        case Command::Type::Whisper:
+            if( const auto uuid = Utils::Uuid::fromHex( target ) )
+            {
+                if( const Peer* peer = m_peers.find( *uuid ) )
+                {
+                    function( *peer );
+                }
+            }
+            break;
     }
-    if( m_discovery_port != 0 )
+}
+
+void PeerDiscoveryDaemon::sendTimed( Command::Type type, const std::string& target,
+                                     const Session& session, std::vector<Utils::Payload> frames,
+                                     const Clipboard::Item* item )
+{
+    // Items are sealed before they're split into chunks, so each is only sealed once.
+    sealItem( session, frames );
+    // Whispers aren't sent to a group, so tell a peer hosting several sessions which one it's for.
+    if( type == Command::Type::Whisper )
     {
-        zyre_set_port( m_znode, m_discovery_port );
+        if( auto header = Protocol::decodeHeader( frames.front() ) )
+        {
+            header->session = session.name;
+            frames.front() = Protocol::encodeHeader( *header );
+        }
     }
-    if( m_zcert )
+
+    Outgoing message;
+    message.type = type;
+    message.target = target;
+    message.session = session.name;
+    message.frames = std::move( frames );
+    message.queued = m_transport->now();
+    // Relayed items would be traced from the relay's send, so only their origin traces them.
+    if( item && item->version.origin == m_uuid )
     {
-        zyre_set_zcert( m_znode, m_zcert );
+        message.timing.captured_us = item->trace.captured_us;
+        message.timing.read_us = item->trace.read_us;
+        message.timing.hash_us = item->trace.hash_us;
     }
 
-    zyre_join( m_znode, "GLOBAL" );
-    zyre_join( m_znode, m_session.c_str() );
+    // Chunks are only sent if every recipient can reassemble them.
+    uint64_t recipients = 0;
+    bool chunking = true;
+    forEachRecipient( type, target, [&recipients, &chunking]( const Peer& peer ) {
+        ++recipients;
+        chunking = chunking && peer.capabilities.chunking;
+    } );
+    recipients = std::max<uint64_t>( recipients, 1 );
+
+    const auto header = Protocol::decodeHeader( message.frames.front() );
+    Lane lane = Lane::Control;
+    if( header && header->kind == Protocol::Kind::Item && message.frames.size() > 1 )
+    {
+        lane = message.frames[1].size() >= m_lanes.config().chunk ? Lane::Bulk
+                                                                  : Lane::Interactive;
+    }
+    if( lane == Lane::Bulk && chunking )
+    {
+        for( auto& chunk : Protocol::encodeChunks( message.frames, m_lanes.config().chunk ) )
+        {
+            Outgoing piece = message;
+            piece.frames = std::move( chunk );
+            piece.cost = frameBytes( piece.frames ) * recipients;
+            m_lanes.push( lane, std::move( piece ) );
+        }
+        return;
+    }
+    message.cost = frameBytes( message.frames ) * recipients;
+    m_lanes.push( lane, std::move( message ) );
 }
 
-void PeerDiscoveryDaemon::receiveLocalClipboardUpdate( const std::string& contents )
+void PeerDiscoveryDaemon::sealItem( const Session& session, std::vector<Utils::Payload>& frames )
 {
-    zyre_shouts( m_znode, m_session.c_str(), "%s", contents.data() );
+    if( !session.key || frames.size() < 2 )
+    {
+        return;
+    }
+    auto header = Protocol::decodeHeader( frames.front() );
+    if( !header || header->kind != Protocol::Kind::Item || header->sealed )
+    {
+        return;
+    }
+    header->sealed = true;
+    frames.front() = Protocol::encodeHeader( *header );
+    frames[1] = session.key->seal( {frames[1]} );
 }
 
-void PeerDiscoveryDaemon::registerOnRemoteClipboardUpdate(
-    Utils::Functor<void( const std::string& )> callback )
+std::optional<std::vector<Utils::Payload>>
+PeerDiscoveryDaemon::openItem( const Session& session, const std::vector<Utils::Payload>& frames )
 {
-    m_remote_update_delegate.subscribe( callback );
+    auto header = frames.size() > 1 ? Protocol::decodeHeader( frames.front() ) : std::nullopt;
+    auto body = header && session.key ? session.key->open( frames[1] ) : std::nullopt;
+    if( !body || body->size() != 1 )
+    {
+        return std::nullopt;
+    }
+    header->sealed = false;
+    return std::vector<Utils::Payload> {Protocol::encodeHeader( *header ),
+                                        std::move( body->front() )};
 }
 
-void PeerDiscoveryDaemon::start()
+void PeerDiscoveryDaemon::transmit( Outgoing& message )
 {
-    Utils::Daemon::start();
+    // Small items shouted to a session that receives datagrams are multicast instead. Only the
+    // message is kept to repair the datagram with, since it's whispered with a new Timing frame.
+    Session* session = findSession( message.session );
+    const bool datagram = session && message.type == Command::Type::Shout &&
+                          message.lane == Lane::Interactive && multicasts( *session );
+    std::vector<Utils::Payload> repair = datagram ? message.frames : std::vector<Utils::Payload> {};
+
+    // Each recipient only uses the delay measured from it, which changes slowly, so a shout only
+    // carries every member's delay now and then.
+    const auto now = m_transport->now();
+    const bool delays = message.type == Command::Type::Whisper ||
+                        ( session && now >= session->delays_at );
+    if( delays && session && message.type == Command::Type::Shout )
+    {
+        session->delays_at = now + delays_interval;
+    }
 
-    int status = zyre_start( m_znode );
-    if( m_verbose )
+    Protocol::Timing& timing = message.timing;
+    timing.sent_us = m_transport->wallClockMicros();
+    bool timed = true;
+    forEachRecipient( message.type, message.target, [&timing, &timed, delays]( const Peer& peer ) {
+        timed = timed && peer.capabilities.timing;
+        if( delays && timing.delays.size() < Protocol::max_timing_delays )
+        {
+            if( const auto delay = peer.clock.delay() )
+            {
+                timing.delays.emplace_back( peer.uuid, *delay );
+            }
+        }
+    } );
+    // Peers without the Timing capability drop messages with more frames than they expect.
+    if( timed )
+    {
+        message.frames.push_back( Protocol::encodeTiming( timing ) );
+    }
+    if( datagram && multicast( *session, message.frames, std::move( repair ) ) )
     {
-        std::cout << "Starting zyre peer discovery... " << ( status == 0 ? "Success!" : "Failed." )
-                  << std::endl;
+        return;
     }
+    send( message.type, message.target, message.frames );
 }
 
-void PeerDiscoveryDaemon::stop()
+bool PeerDiscoveryDaemon::multicasts( const Session& session ) const
 {
-    Utils::Daemon::stop();
-
-    zcert_destroy( &m_zcert );
-    zyre_stop( m_znode );
-    zyre_destroy( &m_znode );
-    m_znode = nullptr;
+    if( !session.multicast )
+    {
+        return false;
+    }
+    bool any = false;
+    for( const auto& [uuid, peer] : m_peers )
+    {
+        if( peer.inGroup( session.protocol_group ) )
+        {
+            if( !peer.capabilities.multicast )
+            {
+                return false;
+            }
+            any = true;
+        }
+    }
+    return any;
 }
 
-void PeerDiscoveryDaemon::loop()
+bool PeerDiscoveryDaemon::multicast( Session& session, const std::vector<Utils::Payload>& frames,
+                                     std::vector<Utils::Payload> repair )
 {
-    //! @todo zmsg_recv_nowait is deprecated in favor of zloop or zpoller. Think about using
-    //! a better design.
-    zmsg_t* msg = zmsg_recv_nowait( zyre_socket( m_znode ) );
-    if( msg )
+    Protocol::Datagram datagram {m_uuid, Utils::hash64( session.protocol_group ),
+                                 session.sequence + 1, frames};
+    // Datagrams don't travel over the session's encrypted links, so they're sealed whole, along
+    // with the sender and sequence number in their header.
+    if( session.key )
+    {
+        datagram.frames = {session.key->seal( frames, datagramHeader( datagram ) )};
+    }
+    if( Protocol::datagramSize( datagram.frames ) > Protocol::max_datagram_size )
+    {
+        return false;
+    }
+    ++session.sequence;
+    const Utils::Payload encoded = Protocol::encodeDatagram( datagram );
+    m_bytes_sent.add( encoded.size() );
+    m_datagrams_sent.add();
+    CLIPD_PROBE3( network_send, "MULTICAST", session.protocol_group.c_str(), encoded.size() );
+    m_transport->multicast( session.protocol_group, encoded );
+
+    session.multicast_history.emplace_back( datagram.sequence, std::move( repair ) );
+    if( session.multicast_history.size() > multicast_history )
     {
-        parseMessage( msg );
-        zmsg_destroy( &msg );
+        session.multicast_history.pop_front();
     }
+    session.multicast_at = m_transport->now();
+    session.heartbeats = 0;
+    return true;
 }
 
-void PeerDiscoveryDaemon::parseMessage( zmsg_t* msg )
+void PeerDiscoveryDaemon::send( Command::Type type, const std::string& target,
+                                const std::vector<Utils::Payload>& frames )
 {
-    const std::string header = "==============================================================";
+    const uint64_t bytes = frameBytes( frames );
+    m_bytes_sent.add( bytes );
+    CLIPD_PROBE3( network_send, type == Command::Type::Shout ? "SHOUT" : "WHISPER", target.c_str(),
+                  bytes );
+    // A shout is sent to each member of the group separately.
+    forEachRecipient( type, target, [bytes]( const Peer& peer ) {
+        if( peer.bytes_sent )
+        {
+            peer.bytes_sent->add( bytes );
+        }
+    } );
 
-    const Messages::MessageType type = Messages::parseMessageType( msg );
     switch( type )
     {
-        case Messages::MessageType::Enter:
+        case Command::Type::Shout:
+            m_transport->shout( target, frames );
+            break;
+        case Command::Type::Whisper:
+            m_transport->whisper( target, frames );
+            break;
+    }
+}
+
+void PeerDiscoveryDaemon::releaseCounters( const Peer& peer )
+{
+    if( !peer.bytes_sent )
+    {
+        return;
+    }
+    auto& metrics = Utils::Metrics::Registry::global();
+    const std::string hex = peer.uuid.hex();
+    metrics.release( Utils::Metrics::labelled( "network.bytes_sent", "peer", hex ) );
+    metrics.release( Utils::Metrics::labelled( "network.bytes_received", "peer", hex ) );
+}
+
+bool PeerDiscoveryDaemon::acceptsSize( const std::string& sender, uint64_t size )
+{
+    if( m_capabilities.accepts( size ) )
+    {
+        return true;
+    }
+    m_oversized.add();
+    CLIPD_LOG_WARN( "Dropped a " << size << " byte item from " << sender
+                                 << ", larger than the " << m_capabilities.max_payload
+                                 << " bytes we accept" );
+    return false;
+}
+
+void PeerDiscoveryDaemon::countSessionPeers()
+{
+    for( auto& session : m_sessions )
+    {
+        session.peers.store( m_peers.members( session.protocol_group ),
+                             std::memory_order_relaxed );
+    }
+}
+
+void PeerDiscoveryDaemon::handleEvent( const Event& event )
+{
+    const auto now = m_transport->now();
+    const auto uuid = Utils::Uuid::fromHex( event.peer );
+
+    switch( event.type )
+    {
+        case Event::Type::Enter:
+        {
+            CLIPD_PROBE3( network_message, "ENTER", event.peer.c_str(), 0 );
+            CLIPD_LOG_INFO( "Peer " << event.name << " (" << event.peer << ") entered from "
+                                    << event.address );
+            if( uuid )
+            {
+                Peer& peer = m_peers.enter( *uuid, event.name, event.address, now );
+                peer.capabilities = Capabilities::fromHeaders( event.headers );
+
+                if( !peer.bytes_sent )
+                {
+                    auto& metrics = Utils::Metrics::Registry::global();
+                    const std::string hex = uuid->hex();
+                    peer.bytes_sent = &metrics.acquire(
+                        Utils::Metrics::labelled( "network.bytes_sent", "peer", hex ) );
+                    peer.bytes_received = &metrics.acquire(
+                        Utils::Metrics::labelled( "network.bytes_received", "peer", hex ) );
+                }
+            }
+            break;
+        }
+        case Event::Type::Exit:
+        {
+            CLIPD_PROBE3( network_message, "EXIT", event.peer.c_str(), 0 );
+            CLIPD_LOG_INFO( "Peer " << event.name << " (" << event.peer << ") exited" );
+            if( uuid )
+            {
+                if( const Peer* peer = m_peers.find( *uuid ) )
+                {
+                    releaseCounters( *peer );
+                }
+                m_peers.exit( *uuid );
+                countSessionPeers();
+            }
+            for( auto& session : m_sessions )
+            {
+                session.assemblies.erase( event.peer );
+                session.expected.erase( event.peer );
+                // An item held back from the peer is stale by the time the throttle, which forgets
+                // the peer below, would let it through.
+                session.throttled_in.erase( event.peer );
+                // Whatever was pulled from the peer won't arrive, so pull it from another.
+                if( auto& pending = session.pending_pull )
+                {
+                    auto& others = pending->others;
+                    others.erase( std::remove( others.begin(), others.end(), event.peer ),
+                                  others.end() );
+                    if( pending->from == event.peer )
+                    {
+                        repull( session, true );
+                    }
+                }
+            }
+            m_receive_throttle.forget( event.peer );
+            break;
+        }
+        case Event::Type::Evasive:
+        {
+            CLIPD_PROBE3( network_message, "EVASIVE", event.peer.c_str(), 0 );
+            if( uuid )
+            {
+                m_peers.evasive( *uuid );
+            }
+            break;
+        }
+        case Event::Type::Join:
+        {
+            CLIPD_PROBE3( network_message, "JOIN", event.peer.c_str(), 0 );
+            if( uuid )
+            {
+                m_peers.join( *uuid, event.group, now );
+                countSessionPeers();
+            }
+            // Let peers joining one of our sessions catch up, without waiting for the next copy.
+            const Session* session = findSession( event.group );
+            if( session && event.group == session->protocol_group && session->current )
+            {
+                sendTimed( Command::Type::Whisper, event.peer, *session,
+                           Protocol::encodeDigest( *session->current ) );
+            }
+            break;
+        }
+        case Event::Type::Leave:
         {
-            //! @todo Associate a peer's UUID with a host IP.
-            //! That way, when multiple nodes are running on the same host, less bad things
-            //! happen.
-            const Messages::Enter payload( msg );
-            std::cout << header << std::endl;
-            std::cout << payload << std::endl;
-            std::cout << header << std::endl;
+            CLIPD_PROBE3( network_message, "LEAVE", event.peer.c_str(), 0 );
+            if( uuid )
+            {
+                m_peers.leave( *uuid, event.group, now );
+                countSessionPeers();
+            }
             break;
         }
-        case Messages::MessageType::Exit:
+        case Event::Type::Whisper:
         {
-            const Messages::Exit payload( msg );
-            std::cout << header << std::endl;
-            std::cout << payload << std::endl;
-            std::cout << header << std::endl;
+            [[maybe_unused]] const uint64_t bytes = countReceived( event.peer, event.frames );
+            CLIPD_PROBE3( network_message, "WHISPER", event.peer.c_str(), bytes );
+            if( uuid )
+            {
+                m_peers.touch( *uuid, now );
+            }
+            receiveMessage( event.peer, {}, event.frames );
             break;
         }
-        case Messages::MessageType::Evasive:
+        case Event::Type::Shout:
         {
-            const Messages::Evasive payload( msg );
+            [[maybe_unused]] const uint64_t bytes = countReceived( event.peer, event.frames );
+            CLIPD_PROBE3( network_message, "SHOUT", event.peer.c_str(), bytes );
+            if( uuid )
+            {
+                m_peers.touch( *uuid, now );
+            }
+            // Only listen for remote clipboard changes in our sessions.
+            Session* session = findSession( event.group );
+            if( !session )
+            {
+                break;
+            }
+            if( event.group == session->protocol_group )
+            {
+                receiveMessage( event.peer, event.group, event.frames );
+            }
+            else if( event.frames.size() == 1 && !session->key )
+            {
+                // Protocol peers also shout plain text to the session when it has legacy peers,
+                // but we'll receive the same item in the protocol group.
+                const Peer* peer = uuid ? m_peers.find( *uuid ) : nullptr;
+                if( peer && peer->capabilities.protocol == 0 )
+                {
+                    // Legacy items aren't versioned, so treat them as a copy made on receipt.
+                    const Clipboard::Item item {{m_clock.now(), *uuid}, event.frames.front(), now};
+                    receiveItem( *session, item, event.peer );
+                }
+            }
             break;
         }
-        case Messages::MessageType::Join:
+        case Event::Type::Datagram:
         {
-            const Messages::Join payload( msg );
+            receiveDatagram( event.group, event.frames );
             break;
         }
-        case Messages::MessageType::Leave:
+    }
+}
+
+void PeerDiscoveryDaemon::receiveDatagram( const std::string& group,
+                                           const std::vector<Utils::Payload>& frames )
+{
+    Session* session = findSession( group );
+    auto datagram = session && session->multicast && frames.size() == 1
+                        ? Protocol::decodeDatagram( frames.front() )
+                        : std::nullopt;
+    if( !datagram || datagram->group != Utils::hash64( session->protocol_group ) ||
+        datagram->sender == m_uuid )
+    {
+        return;
+    }
+    // Only peers Zyre has discovered in the session can be asked to repair what we missed.
+    const Peer* peer = m_peers.find( datagram->sender );
+    if( !peer || !peer->inGroup( session->protocol_group ) )
+    {
+        return;
+    }
+    const std::string sender = datagram->sender.hex();
+    [[maybe_unused]] const uint64_t bytes = countReceived( sender, frames );
+    CLIPD_PROBE3( network_message, "MULTICAST", sender.c_str(), bytes );
+
+    // A sealed session's datagrams are opened before anything in them is believed, since their
+    // sender and sequence number are sealed with them.
+    std::vector<Utils::Payload> message = datagram->frames;
+    if( session->key )
+    {
+        auto opened =
+            datagram->frames.size() == 1
+                ? session->key->open( datagram->frames.front(), datagramHeader( *datagram ) )
+                : std::nullopt;
+        if( !opened )
+        {
+            m_unsealed.add();
+            return;
+        }
+        message = std::move( *opened );
+    }
+    m_datagrams_received.add();
+    m_peers.touch( datagram->sender, m_transport->now() );
+
+    // Every datagram before this one, or up to and including a heartbeat's, should have arrived.
+    // The first datagram heard from a peer starts its sequence, since anything older was offered
+    // when we joined.
+    const uint64_t through = message.empty() ? datagram->sequence : datagram->sequence - 1;
+    const auto [expected, first] = session->expected.try_emplace( sender, through + 1 );
+    if( first || through < expected->second )
+    {
+        // A sequence further behind than the sender's history means it started again, or we
+        // believed a forged one, so it's started again here too.
+        const bool behind = expected->second - through > multicast_history;
+        expected->second = behind ? datagram->sequence + 1
+                                  : std::max( expected->second, datagram->sequence + 1 );
+    } else
+    {
+        // Only the sender's history can be whispered back, so a longer loss, like a dropped Wi-Fi
+        // link, only asks for the end of it. The items before that have been superseded.
+        const uint64_t missed = through - expected->second + 1;
+        m_datagrams_missed.add( missed );
+        const uint64_t from =
+            missed > multicast_history ? through - multicast_history + 1 : expected->second;
+        sendTimed( Command::Type::Whisper, sender, *session,
+                   Protocol::encodeNack( Protocol::Nack {from, through} ) );
+        expected->second = datagram->sequence + 1;
+    }
+
+    if( !message.empty() )
+    {
+        receiveMessage( sender, session->protocol_group, message );
+    }
+}
+
+void PeerDiscoveryDaemon::repairDatagrams( Session& session, const std::string& peer,
+                                           const Protocol::Nack& nack )
+{
+    for( const auto& [sequence, message] : session.multicast_history )
+    {
+        if( sequence >= nack.first && sequence <= nack.last )
+        {
+            m_datagrams_repaired.add();
+            sendTimed( Command::Type::Whisper, peer, session, message );
+        }
+    }
+}
+
+uint64_t PeerDiscoveryDaemon::countReceived( const std::string& sender,
+                                             const std::vector<Utils::Payload>& frames )
+{
+    const uint64_t bytes = frameBytes( frames );
+    m_bytes_received.add( bytes );
+
+    const auto uuid = Utils::Uuid::fromHex( sender );
+    const Peer* peer = uuid ? m_peers.find( *uuid ) : nullptr;
+    if( peer && peer->bytes_received )
+    {
+        peer->bytes_received->add( bytes );
+    }
+    return bytes;
+}
+
+void PeerDiscoveryDaemon::receiveMessage( const std::string& sender, const std::string& group,
+                                          const std::vector<Utils::Payload>& received )
+{
+    if( received.empty() )
+    {
+        return;
+    }
+    auto header = Protocol::decodeHeader( received.front() );
+    if( !header )
+    {
+        return;
+    }
+
+    const uint64_t received_us = m_transport->wallClockMicros();
+    const auto uuid = Utils::Uuid::fromHex( sender );
+    Peer* peer = uuid ? m_peers.find( *uuid ) : nullptr;
+    Session* session = group.empty() ? whisperedSession( *header, peer ) : findSession( group );
+    if( !session )
+    {
+        return;
+    }
+    // Large items arrive in chunks, and are handled like any other item once they're complete.
+    std::vector<Utils::Payload> assembled;
+    if( header->kind == Protocol::Kind::Chunk )
+    {
+        assembled = assemble( *session, sender, *header, received );
+        header = assembled.empty() ? std::nullopt : Protocol::decodeHeader( assembled.front() );
+        if( !header )
+        {
+            return;
+        }
+    }
+    const auto& frames = assembled.empty() ? received : assembled;
+    const auto timing =
+        frames.size() > 1 ? Protocol::decodeTiming( frames.back() ) : std::nullopt;
+    if( peer && timing )
+    {
+        peer->clock.sample( static_cast<int64_t>( received_us ) -
+                                static_cast<int64_t>( timing->sent_us ),
+                            m_transport->now() );
+        for( const auto& [id, delay] : timing->delays )
+        {
+            if( id == m_uuid )
+            {
+                peer->clock.report( delay );
+            }
+        }
+    }
+
+    switch( header->kind )
+    {
+        case Protocol::Kind::Item:
         {
-            const Messages::Leave payload( msg );
+            // Copies of an item that arrived by another path are dropped without decoding them.
+            // The window may report an item it hasn't seen, so newer items are never dropped.
+            // Items sent down a tree may still need forwarding, which receiveForwarded() checks.
+            const auto decode_start = m_transport->now();
+            const auto id = Protocol::messageId( header->version );
+            const bool newer = !session->current || header->version > session->current->version;
+            if( !newer && header->fanout == 0 && m_seen.contains( id, decode_start ) )
+            {
+                m_duplicates.add();
+                break;
+            }
+            // A sealed session only accepts items sealed with its key, and other sessions can't
+            // open them.
+            if( header->sealed != session->key.has_value() )
+            {
+                m_unsealed.add();
+                break;
+            }
+            if( !acceptsSize( sender, header->size ) )
+            {
+                break;
+            }
+            const auto opened = session->key ? openItem( *session, frames ) : std::nullopt;
+            if( session->key && !opened )
+            {
+                m_unsealed.add();
+                break;
+            }
+            // Items encoded with a codec we don't support are dropped; the sender whispers us an
+            // encoding we do support. Corrupted items are dropped too.
+            if( auto item = Protocol::decodeItem( opened ? *opened : frames ) )
+            {
+                m_seen.insert( id, decode_start );
+                item->observed = m_transport->now();
+                if( peer && timing && timing->captured_us != 0 && item->version.origin == *uuid )
+                {
+                    Clipboard::Trace& trace = item->trace;
+                    trace.captured_us = timing->captured_us;
+                    trace.read_us = timing->read_us;
+                    trace.hash_us = timing->hash_us;
+                    trace.sent_us = timing->sent_us;
+                    trace.offset_us = peer->clock.offset();
+                    trace.received_us = received_us;
+                    trace.decode_us = static_cast<uint32_t>(
+                        std::chrono::duration_cast<std::chrono::microseconds>( item->observed -
+                                                                               decode_start )
+                            .count() );
+                }
+                // A repaired item is forwarded down the rest of the tree, as if it had arrived.
+                uint8_t degree = header->fanout;
+                const auto& repair = session->repair;
+                if( degree == 0 && repair && repair->pulled && repair->version == item->version )
+                {
+                    degree = repair->degree;
+                }
+                if( degree != 0 )
+                {
+                    receiveForwarded( *session, *item, degree, frames, sender );
+                } else
+                {
+                    receiveItem( *session, *item, sender );
+                }
+            }
             break;
         }
-        case Messages::MessageType::Whisper:
+        case Protocol::Kind::Digest:
         {
-            const Messages::Whisper payload( msg );
+            // Every session member sends a digest to a joining peer, and large items are shouted
+            // as digests. Only pull the contents once, only if they're newer than what we already
+            // have, and only if we'd accept them.
+            const bool newer = !session->current || header->version > session->current->version;
+            auto& pending = session->pending_pull;
+            const bool pulling = pending && !( header->version > pending->version );
+            const bool wanted = newer && !pulling && acceptsSize( sender, header->size );
+            if( wanted && header->fanout != 0 )
+            {
+                // The item is on its way down a tree, so only pull it if it doesn't arrive.
+                if( !session->repair || header->version > session->repair->version )
+                {
+                    const auto hops = fanoutTree( *session, header->version.origin, header->fanout )
+                                          .depth( m_uuid )
+                                          .value_or( 1 );
+                    session->repair = Session::Repair {
+                        header->version, sender, header->fanout,
+                        m_transport->now() + m_fanout.repair * std::max<size_t>( hops, 1 )};
+                }
+            } else if( wanted )
+            {
+                pull( *session, header->version, sender );
+            } else if( pulling && pending->version == header->version && pending->from != sender &&
+                       std::find( pending->others.begin(), pending->others.end(), sender ) ==
+                           pending->others.end() )
+            {
+                // Another peer with the item, to pull it from if the first doesn't answer.
+                pending->others.push_back( sender );
+            }
             break;
         }
-        case Messages::MessageType::Shout:
+        case Protocol::Kind::Pull:
         {
-            const Messages::Shout payload( msg );
-            std::cout << header << std::endl;
-            std::cout << payload << std::endl;
-            std::cout << header << std::endl;
-            // Only listen for remote clipboard changes in our session.
-            if( payload.groupname == m_session )
+            // If our item has changed since the digest was sent, the newer item is still wanted.
+            const auto& current = session->current;
+            if( current && !( current->version < header->version ) )
             {
-                m_remote_update_delegate( payload.message );
+                sendTimed( Command::Type::Whisper, sender, *session,
+                           Protocol::encodeItem( *current,
+                                                 peer ? codecFor( *peer, *current ) : Codec::Raw ),
+                           &*current );
             }
             break;
         }
-        case Messages::MessageType::Unknown:
+        case Protocol::Kind::Chunk:
+            // Reassembled into an Item above.
+            break;
+        case Protocol::Kind::Nack:
         {
+            if( const auto nack = frames.size() > 1 ? Protocol::decodeNack( frames[1] )
+                                                    : std::nullopt )
+            {
+                repairDatagrams( *session, sender, *nack );
+            }
             break;
         }
     }
 }
+
+std::vector<Utils::Payload>
+PeerDiscoveryDaemon::assemble( Session& session, const std::string& sender,
+                               const Protocol::Header& header,
+                               const std::vector<Utils::Payload>& frames )
+{
+    const auto chunk = frames.size() > 2 ? Protocol::decodeChunk( frames[1] ) : std::nullopt;
+    if( !chunk )
+    {
+        return {};
+    }
+    const Utils::Payload& piece = frames[2];
+
+    // The first chunk of an item replaces any item the peer hadn't finished sending. Copies of
+    // items that arrived by another path are dropped before they're reassembled.
+    if( chunk->offset == 0 )
+    {
+        const auto now = m_transport->now();
+        const bool newer = !session.current || header.version > session.current->version;
+        const bool duplicate = !newer && header.fanout == 0 &&
+                               m_seen.contains( Protocol::messageId( header.version ), now );
+        const bool acceptable = !duplicate && acceptsSize( sender, header.size ) &&
+                                chunk->total != 0 && chunk->total <= header.size;
+        if( duplicate || !acceptable )
+        {
+            if( duplicate )
+            {
+                m_duplicates.add();
+            }
+            session.assemblies.erase( sender );
+            return {};
+        }
+        auto& assembly = session.assemblies[sender];
+        assembly = {header.version, chunk->total, {}};
+        assembly.body.reserve( std::min( chunk->total, max_assembly_reserve ) );
+    }
+
+    // Chunks arrive in order, so one that doesn't follow the last means the start was missed.
+    const auto found = session.assemblies.find( sender );
+    if( found == session.assemblies.end() )
+    {
+        return {};
+    }
+    auto& assembly = found->second;
+    if( assembly.version != header.version || assembly.total != chunk->total ||
+        assembly.body.size() != chunk->offset ||
+        assembly.body.size() + piece.size() > assembly.total )
+    {
+        session.assemblies.erase( found );
+        return {};
+    }
+    assembly.body.append( piece.data(), piece.size() );
+    Utils::countCopied( piece.size() );
+    // A large pulled item is still arriving, so it isn't pulled again.
+    if( session.pending_pull && session.pending_pull->from == sender )
+    {
+        session.pending_pull->deadline = m_transport->now() + pull_timeout;
+    }
+    if( assembly.body.size() < assembly.total )
+    {
+        return {};
+    }
+
+    Protocol::Header item_header = header;
+    item_header.kind = Protocol::Kind::Item;
+    std::vector<Utils::Payload> assembled = {Protocol::encodeHeader( item_header ),
+                                             Utils::Payload( std::move( assembly.body ) )};
+    // Keep the last chunk's Timing frame, which traces the whole item.
+    if( frames.size() > 3 )
+    {
+        assembled.push_back( frames.back() );
+    }
+    session.assemblies.erase( found );
+    return assembled;
+}
+
+void PeerDiscoveryDaemon::receiveForwarded( Session& session, const Clipboard::Item& item,
+                                            uint8_t degree,
+                                            const std::vector<Utils::Payload>& frames,
+                                            const std::string& sender )
+{
+    // Items arrive down the tree once, unless the tree changed under them, so only the first
+    // copy is forwarded, and items older than the one we have aren't forwarded at all.
+    const bool forwarded = session.forwarded && !( item.version > *session.forwarded );
+    if( forwarded || ( session.current && item.version < session.current->version ) )
+    {
+        m_fanout_duplicates.add();
+        return;
+    }
+    forward( session, item, fanoutTree( session, item.version.origin, degree ), degree, &frames );
+
+    // The item may have been pulled already, if it took too long to arrive.
+    if( session.current && session.current->version == item.version )
+    {
+        m_fanout_duplicates.add();
+        return;
+    }
+    receiveItem( session, item, sender );
+}
+
+void PeerDiscoveryDaemon::receiveItem( Session& session, const Clipboard::Item& item,
+                                       const std::string& sender )
+{
+    if( session.pending_pull && !( item.version < session.pending_pull->version ) )
+    {
+        session.pending_pull.reset();
+    }
+    if( session.repair && !( item.version < session.repair->version ) )
+    {
+        session.repair.reset();
+    }
+    if( !session.current || item.version > session.current->version )
+    {
+        session.current = item;
+    }
+    if( !m_receive_throttle.enabled() )
+    {
+        session.remote_update_delegate( item );
+        return;
+    }
+
+    // A flooding peer shouldn't make the clipboard apply every one of its items, only the latest
+    // one, as often as the throttle allows. Items are held for each peer, so a peer under its
+    // limit isn't held back by another's backlog, as long as its item is newer than every held
+    // one, which it supersedes.
+    const bool newest = std::all_of(
+        session.throttled_in.begin(), session.throttled_in.end(),
+        [&item]( const auto& held ) { return item.version > held.second.version; } );
+    if( newest && m_receive_throttle.admit( session.name, sender, m_transport->now() ) )
+    {
+        deliverThrottled( session, item );
+        return;
+    }
+    const auto [held, first] = session.throttled_in.try_emplace( sender, item );
+    if( first )
+    {
+        m_throttle_held_in.add();
+        return;
+    }
+    m_throttle_coalesced_in.add();
+    if( item.version > held->second.version )
+    {
+        held->second = item;
+    }
+}
+
+void PeerDiscoveryDaemon::deliverThrottled( Session& session, const Clipboard::Item& item )
+{
+    // Delivering a held item older than this one would take the clipboard back.
+    for( auto held = session.throttled_in.begin(); held != session.throttled_in.end(); )
+    {
+        if( held->second.version < item.version )
+        {
+            m_throttle_coalesced_in.add();
+            held = session.throttled_in.erase( held );
+        } else
+        {
+            ++held;
+        }
+    }
+    session.remote_update_delegate( item );
+}
 } // namespace Clipd::Network
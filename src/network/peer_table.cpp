@@ -0,0 +1,102 @@
+#include "network/peer_table.h"
+
+#include <algorithm>
+
+namespace Clipd::Network
+{
+bool Peer::inGroup( std::string_view group ) const
+{
+    return std::find( groups.begin(), groups.end(), group ) != groups.end();
+}
+
+Peer& PeerTable::enter( const Utils::Uuid& uuid, std::string_view name, std::string_view address,
+                        Clock::time_point now )
+{
+    Peer& peer = m_peers[uuid];
+    peer.uuid = uuid;
+    peer.name = name;
+    peer.address = address;
+    peer.last_seen = now;
+    peer.evasive = false;
+    return peer;
+}
+
+void PeerTable::exit( const Utils::Uuid& uuid )
+{
+    const auto it = m_peers.find( uuid );
+    if( it == m_peers.end() )
+    {
+        return;
+    }
+    for( const auto& group : it->second.groups )
+    {
+        --m_members[group];
+    }
+    m_peers.erase( it );
+}
+
+void PeerTable::evasive( const Utils::Uuid& uuid )
+{
+    if( Peer* peer = find( uuid ) )
+    {
+        peer->evasive = true;
+    }
+}
+
+void PeerTable::join( const Utils::Uuid& uuid, std::string_view group, Clock::time_point now )
+{
+    // Zyre only reports JOINs from peers that have entered, but be robust to reordering.
+    Peer& peer = m_peers[uuid];
+    peer.uuid = uuid;
+    peer.last_seen = now;
+    peer.evasive = false;
+    if( !peer.inGroup( group ) )
+    {
+        peer.groups.emplace_back( group );
+        ++m_members[peer.groups.back()];
+    }
+}
+
+void PeerTable::leave( const Utils::Uuid& uuid, std::string_view group, Clock::time_point now )
+{
+    Peer* peer = find( uuid );
+    if( !peer )
+    {
+        return;
+    }
+    peer->last_seen = now;
+    const auto member = std::find( peer->groups.begin(), peer->groups.end(), group );
+    if( member != peer->groups.end() )
+    {
+        --m_members[*member];
+        peer->groups.erase( member );
+    }
+}
+
+void PeerTable::touch( const Utils::Uuid& uuid, Clock::time_point now )
+{
+    if( Peer* peer = find( uuid ) )
+    {
+        peer->last_seen = now;
+        peer->evasive = false;
+    }
+}
+
+size_t PeerTable::members( const std::string& group ) const
+{
+    const auto it = m_members.find( group );
+    return it == m_members.end() ? 0 : it->second;
+}
+
+const Peer* PeerTable::find( const Utils::Uuid& uuid ) const
+{
+    const auto it = m_peers.find( uuid );
+    return it == m_peers.end() ? nullptr : &it->second;
+}
+
+Peer* PeerTable::find( const Utils::Uuid& uuid )
+{
+    const auto it = m_peers.find( uuid );
+    return it == m_peers.end() ? nullptr : &it->second;
+}
+} // namespace Clipd::Network
@@ -0,0 +1,343 @@
+#include "network/protocol.h"
+
+#include "utils/hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace Clipd::Network::Protocol
+{
+namespace
+{
+constexpr char magic[] = {'C', 'L', 'P', 'D'};
+constexpr char timing_magic[] = {'C', 'L', 'P', 'T'};
+constexpr char datagram_magic[] = {'C', 'L', 'P', 'M'};
+constexpr size_t datagram_header_size = 36;
+constexpr size_t timing_size = 32;
+constexpr size_t timing_delay_size = 24;
+//! Set in a header's codec byte if the body is sealed.
+constexpr uint8_t sealed_codec = 0x80;
+
+void putU32( std::string& buffer, size_t offset, uint32_t value )
+{
+    for( size_t i = 0; i < sizeof( value ); ++i )
+    {
+        buffer[offset + i] = static_cast<char>( ( value >> ( 8 * i ) ) & 0xFF );
+    }
+}
+
+uint32_t getU32( const char* data, size_t offset )
+{
+    uint32_t value = 0;
+    for( size_t i = 0; i < sizeof( value ); ++i )
+    {
+        value |= uint32_t( static_cast<unsigned char>( data[offset + i] ) ) << ( 8 * i );
+    }
+    return value;
+}
+
+void putU64( std::string& buffer, size_t offset, uint64_t value )
+{
+    for( size_t i = 0; i < sizeof( value ); ++i )
+    {
+        buffer[offset + i] = static_cast<char>( ( value >> ( 8 * i ) ) & 0xFF );
+    }
+}
+
+uint64_t getU64( const char* data, size_t offset )
+{
+    uint64_t value = 0;
+    for( size_t i = 0; i < sizeof( value ); ++i )
+    {
+        value |= uint64_t( static_cast<unsigned char>( data[offset + i] ) ) << ( 8 * i );
+    }
+    return value;
+}
+
+Header itemHeader( Kind kind, const Clipboard::Item& item )
+{
+    Header header;
+    header.kind = kind;
+    header.version = item.version;
+    header.digest = Utils::hash64( item.contents.view() );
+    header.size = item.contents.size();
+    return header;
+}
+} // namespace
+
+std::string sessionGroup( std::string_view session )
+{
+    return std::string( session ) + "/clipd" +
+           std::to_string( static_cast<unsigned>( protocol_version ) );
+}
+
+Utils::Payload encodeHeader( const Header& header )
+{
+    std::string buffer( header_size, '\0' );
+    std::memcpy( buffer.data(), magic, sizeof( magic ) );
+    buffer[4] = static_cast<char>( protocol_version );
+    buffer[5] = static_cast<char>( header.kind );
+    buffer[6] = static_cast<char>( static_cast<uint8_t>( header.codec ) |
+                                   ( header.sealed ? sealed_codec : 0 ) );
+    buffer[7] = static_cast<char>( header.fanout );
+    putU64( buffer, 8, header.version.timestamp );
+    putU64( buffer, 16, header.version.origin.hi );
+    putU64( buffer, 24, header.version.origin.lo );
+    putU64( buffer, 32, header.digest );
+    putU64( buffer, 40, header.size );
+    buffer += header.session;
+    return Utils::Payload( std::move( buffer ) );
+}
+
+std::vector<Utils::Payload> encodeItem( const Clipboard::Item& item, Codec codec )
+{
+    Header header = itemHeader( Kind::Item, item );
+    if( codec != Codec::Raw )
+    {
+        if( auto encoded = encode( codec, item.contents ) )
+        {
+            header.codec = codec;
+            return {encodeHeader( header ), std::move( *encoded )};
+        }
+    }
+    return {encodeHeader( header ), item.contents};
+}
+
+std::vector<Utils::Payload> encodeDigest( const Clipboard::Item& item )
+{
+    return {encodeHeader( itemHeader( Kind::Digest, item ) )};
+}
+
+std::vector<Utils::Payload> encodePull( const Utils::Version& version )
+{
+    Header header;
+    header.kind = Kind::Pull;
+    header.version = version;
+    return {encodeHeader( header )};
+}
+
+std::vector<std::vector<Utils::Payload>> encodeChunks( const std::vector<Utils::Payload>& item,
+                                                       size_t size )
+{
+    std::vector<std::vector<Utils::Payload>> chunks;
+    auto header = item.size() > 1 ? decodeHeader( item[0] ) : std::nullopt;
+    if( !header || header->kind != Kind::Item )
+    {
+        return chunks;
+    }
+    header->kind = Kind::Chunk;
+    const Utils::Payload chunk_header = encodeHeader( *header );
+    const Utils::Payload& body = item[1];
+    size = std::max<size_t>( size, 1 );
+    for( size_t offset = 0; offset < body.size(); offset += size )
+    {
+        chunks.push_back( {chunk_header, encodeChunk( Chunk {offset, body.size()} ),
+                           body.slice( offset, size )} );
+    }
+    return chunks;
+}
+
+Utils::Payload encodeChunk( const Chunk& chunk )
+{
+    std::string buffer( chunk_frame_size, '\0' );
+    putU64( buffer, 0, chunk.offset );
+    putU64( buffer, 8, chunk.total );
+    return Utils::Payload( std::move( buffer ) );
+}
+
+std::optional<Chunk> decodeChunk( const Utils::Payload& frame )
+{
+    if( frame.size() != chunk_frame_size )
+    {
+        return std::nullopt;
+    }
+    return Chunk {getU64( frame.data(), 0 ), getU64( frame.data(), 8 )};
+}
+
+size_t datagramSize( const std::vector<Utils::Payload>& frames )
+{
+    size_t size = datagram_header_size;
+    for( const auto& frame : frames )
+    {
+        size += sizeof( uint32_t ) + frame.size();
+    }
+    return size;
+}
+
+Utils::Payload encodeDatagram( const Datagram& datagram )
+{
+    std::string buffer( datagramSize( datagram.frames ), '\0' );
+    std::memcpy( buffer.data(), datagram_magic, sizeof( datagram_magic ) );
+    putU64( buffer, 4, datagram.sender.hi );
+    putU64( buffer, 12, datagram.sender.lo );
+    putU64( buffer, 20, datagram.group );
+    putU64( buffer, 28, datagram.sequence );
+    size_t offset = datagram_header_size;
+    for( const auto& frame : datagram.frames )
+    {
+        putU32( buffer, offset, static_cast<uint32_t>( frame.size() ) );
+        std::memcpy( buffer.data() + offset + sizeof( uint32_t ), frame.data(), frame.size() );
+        Utils::countCopied( frame.size() );
+        offset += sizeof( uint32_t ) + frame.size();
+    }
+    return Utils::Payload( std::move( buffer ) );
+}
+
+std::optional<Datagram> decodeDatagram( const Utils::Payload& datagram )
+{
+    const char* data = datagram.data();
+    if( datagram.size() < datagram_header_size ||
+        std::memcmp( data, datagram_magic, sizeof( datagram_magic ) ) != 0 )
+    {
+        return std::nullopt;
+    }
+    Datagram decoded;
+    decoded.sender.hi = getU64( data, 4 );
+    decoded.sender.lo = getU64( data, 12 );
+    decoded.group = getU64( data, 20 );
+    decoded.sequence = getU64( data, 28 );
+    size_t offset = datagram_header_size;
+    while( offset < datagram.size() )
+    {
+        if( datagram.size() - offset < sizeof( uint32_t ) )
+        {
+            return std::nullopt;
+        }
+        const size_t size = getU32( data, offset );
+        offset += sizeof( uint32_t );
+        if( datagram.size() - offset < size )
+        {
+            return std::nullopt;
+        }
+        decoded.frames.push_back( datagram.slice( offset, size ) );
+        offset += size;
+    }
+    return decoded;
+}
+
+std::vector<Utils::Payload> encodeNack( const Nack& nack )
+{
+    Header header;
+    header.kind = Kind::Nack;
+    std::string buffer( nack_frame_size, '\0' );
+    putU64( buffer, 0, nack.first );
+    putU64( buffer, 8, nack.last );
+    return {encodeHeader( header ), Utils::Payload( std::move( buffer ) )};
+}
+
+std::optional<Nack> decodeNack( const Utils::Payload& frame )
+{
+    if( frame.size() != nack_frame_size )
+    {
+        return std::nullopt;
+    }
+    const Nack nack {getU64( frame.data(), 0 ), getU64( frame.data(), 8 )};
+    if( nack.last < nack.first )
+    {
+        return std::nullopt;
+    }
+    return nack;
+}
+
+Utils::Payload encodeTiming( const Timing& timing )
+{
+    const size_t count = std::min( timing.delays.size(), max_timing_delays );
+    std::string buffer( timing_size + count * timing_delay_size, '\0' );
+    std::memcpy( buffer.data(), timing_magic, sizeof( timing_magic ) );
+    buffer[4] = static_cast<char>( count & 0xFF );
+    buffer[5] = static_cast<char>( ( count >> 8 ) & 0xFF );
+    putU64( buffer, 8, timing.sent_us );
+    putU64( buffer, 16, timing.captured_us );
+    putU32( buffer, 24, timing.read_us );
+    putU32( buffer, 28, timing.hash_us );
+    for( size_t i = 0; i < count; ++i )
+    {
+        const size_t offset = timing_size + i * timing_delay_size;
+        const auto& [uuid, delay] = timing.delays[i];
+        putU64( buffer, offset, uuid.hi );
+        putU64( buffer, offset + 8, uuid.lo );
+        putU64( buffer, offset + 16, static_cast<uint64_t>( delay ) );
+    }
+    return Utils::Payload( std::move( buffer ) );
+}
+
+std::optional<Timing> decodeTiming( const Utils::Payload& frame )
+{
+    const char* data = frame.data();
+    if( frame.size() < timing_size ||
+        std::memcmp( data, timing_magic, sizeof( timing_magic ) ) != 0 )
+    {
+        return std::nullopt;
+    }
+    const size_t count = static_cast<unsigned char>( data[4] ) |
+                         size_t( static_cast<unsigned char>( data[5] ) ) << 8;
+    if( frame.size() != timing_size + count * timing_delay_size )
+    {
+        return std::nullopt;
+    }
+
+    Timing timing;
+    timing.sent_us = getU64( data, 8 );
+    timing.captured_us = getU64( data, 16 );
+    timing.read_us = getU32( data, 24 );
+    timing.hash_us = getU32( data, 28 );
+    timing.delays.reserve( count );
+    for( size_t i = 0; i < count; ++i )
+    {
+        const size_t offset = timing_size + i * timing_delay_size;
+        const Utils::Uuid uuid {getU64( data, offset ), getU64( data, offset + 8 )};
+        timing.delays.emplace_back( uuid, static_cast<int64_t>( getU64( data, offset + 16 ) ) );
+    }
+    return timing;
+}
+
+std::optional<Header> decodeHeader( const Utils::Payload& frame )
+{
+    const char* data = frame.data();
+    if( frame.size() < header_size || std::memcmp( data, magic, sizeof( magic ) ) != 0 ||
+        static_cast<uint8_t>( data[4] ) != protocol_version )
+    {
+        return std::nullopt;
+    }
+
+    Header header;
+    header.kind = static_cast<Kind>( data[5] );
+    const auto codec = static_cast<uint8_t>( data[6] );
+    header.codec = static_cast<Codec>( codec & ~sealed_codec );
+    header.sealed = ( codec & sealed_codec ) != 0;
+    header.fanout = static_cast<uint8_t>( data[7] );
+    header.version.timestamp = getU64( data, 8 );
+    header.version.origin.hi = getU64( data, 16 );
+    header.version.origin.lo = getU64( data, 24 );
+    header.digest = getU64( data, 32 );
+    header.size = getU64( data, 40 );
+    header.session.assign( data + header_size, frame.size() - header_size );
+    return header;
+}
+
+std::optional<Clipboard::Item> decodeItem( const std::vector<Utils::Payload>& frames,
+                                           uint64_t max_size )
+{
+    // Any frames after the body, like the Timing frame, aren't part of the item.
+    if( frames.size() < 2 )
+    {
+        return std::nullopt;
+    }
+
+    const auto header = decodeHeader( frames[0] );
+    if( !header || header->kind != Kind::Item || header->sealed || header->size > max_size )
+    {
+        return std::nullopt;
+    }
+
+    // A body corrupted, or cut short, on the way doesn't match the digest its sender hashed.
+    auto contents = decode( header->codec, frames[1], header->size );
+    if( !contents || contents->size() != header->size ||
+        Utils::hash64( contents->view() ) != header->digest )
+    {
+        return std::nullopt;
+    }
+    return Clipboard::Item {header->version, std::move( *contents )};
+}
+} // namespace Clipd::Network::Protocol
@@ -0,0 +1,708 @@
+#include "network/recording.h"
+
+#include "network/protocol.h"
+#include "utils/hash.h"
+
+#include <poll.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <random>
+
+namespace Clipd::Network
+{
+namespace
+{
+constexpr char magic[] = {'C', 'L', 'P', 'R'};
+constexpr uint8_t format_version = 1;
+constexpr size_t header_size = 32;
+
+void putVarint( std::string& buffer, uint64_t value )
+{
+    while( value >= 0x80 )
+    {
+        buffer.push_back( static_cast<char>( ( value & 0x7F ) | 0x80 ) );
+        value >>= 7;
+    }
+    buffer.push_back( static_cast<char>( value ) );
+}
+
+void putU64( std::string& buffer, uint64_t value )
+{
+    for( size_t i = 0; i < sizeof( value ); ++i )
+    {
+        buffer.push_back( static_cast<char>( ( value >> ( 8 * i ) ) & 0xFF ) );
+    }
+}
+
+void putString( std::string& buffer, std::string_view s )
+{
+    putVarint( buffer, s.size() );
+    buffer.append( s );
+}
+
+/**
+ * @brief Reads the fields of a recording, and remembers whether it ever read past the end.
+ */
+class Cursor
+{
+public:
+    explicit Cursor( std::string_view data ) : m_data( data ) {}
+
+    explicit operator bool() const noexcept
+    {
+        return m_ok;
+    }
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return m_data.empty();
+    }
+
+    std::string_view bytes( uint64_t size )
+    {
+        if( size > m_data.size() )
+        {
+            fail();
+            return {};
+        }
+        const std::string_view bytes = m_data.substr( 0, size );
+        m_data.remove_prefix( size );
+        return bytes;
+    }
+
+    uint8_t byte()
+    {
+        const auto b = bytes( 1 );
+        return b.empty() ? 0 : static_cast<uint8_t>( b.front() );
+    }
+
+    uint64_t u64()
+    {
+        const auto b = bytes( sizeof( uint64_t ) );
+        uint64_t value = 0;
+        for( size_t i = 0; i < b.size(); ++i )
+        {
+            value |= uint64_t( static_cast<unsigned char>( b[i] ) ) << ( 8 * i );
+        }
+        return value;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for( unsigned shift = 0; shift < 64; shift += 7 )
+        {
+            const uint8_t b = byte();
+            value |= uint64_t( b & 0x7FU ) << shift;
+            if( ( b & 0x80U ) == 0 )
+            {
+                return value;
+            }
+        }
+        fail();
+        return 0;
+    }
+
+    std::string string()
+    {
+        return std::string( bytes( varint() ) );
+    }
+
+    //! @brief Mark the rest of the data as unreadable.
+    void fail()
+    {
+        m_ok = false;
+        m_data = {};
+    }
+
+private:
+    std::string_view m_data;
+    bool m_ok = true;
+};
+
+//! @brief A recorded frame, before its contents are restored.
+struct Frame
+{
+    RecordedContents form = RecordedContents::Full;
+    uint64_t size = 0;
+    uint64_t hash = 0;
+    Utils::Payload bytes; //!< Full frames only.
+};
+
+std::vector<Frame> readFrames( Cursor& cursor )
+{
+    std::vector<Frame> frames( std::min<uint64_t>( cursor.varint(), 1024 ) );
+    for( auto& frame : frames )
+    {
+        const uint8_t form = cursor.byte();
+        if( form > static_cast<uint8_t>( RecordedContents::Redacted ) )
+        {
+            cursor.fail();
+            break;
+        }
+        frame.form = static_cast<RecordedContents>( form );
+        frame.size = cursor.varint();
+        switch( frame.form )
+        {
+            case RecordedContents::Full:
+                frame.bytes = Utils::Payload( std::string( cursor.bytes( frame.size ) ) );
+                break;
+            case RecordedContents::Hashed:
+                frame.hash = cursor.u64();
+                break;
+            case RecordedContents::Redacted:
+                break;
+        }
+    }
+    return frames;
+}
+
+/**
+ * @brief Replace the redacted contents of the given frames with synthetic contents.
+ *
+ * @param seed Seeds the synthetic contents of frames that weren't hashed.
+ */
+std::vector<Utils::Payload> restoreFrames( std::vector<Frame> frames, uint64_t seed )
+{
+    const auto redacted = std::find_if( frames.begin(), frames.end(), []( const Frame& frame ) {
+        return frame.form != RecordedContents::Full;
+    } );
+    const auto header = !frames.empty() && frames.front().form == RecordedContents::Full
+                            ? Protocol::decodeHeader( frames.front().bytes )
+                            : std::nullopt;
+
+    // Items are encoded around their contents, so re-encode them around the synthetic contents.
+    if( redacted != frames.end() && header && header->kind == Protocol::Kind::Item )
+    {
+        const uint64_t contents_seed =
+            redacted->form == RecordedContents::Hashed ? redacted->hash : seed;
+        const Clipboard::Item item {
+            header->version,
+            Utils::Payload( Recording::synthesize( header->size, contents_seed ) )};
+        auto restored = Protocol::encodeItem( item, header->codec );
+        if( !header->session.empty() )
+        {
+            Protocol::Header whispered = *Protocol::decodeHeader( restored.front() );
+            whispered.session = header->session;
+            restored.front() = Protocol::encodeHeader( whispered );
+        }
+        if( frames.size() > 2 && frames.back().form == RecordedContents::Full &&
+            Protocol::decodeTiming( frames.back().bytes ) )
+        {
+            restored.push_back( frames.back().bytes );
+        }
+        return restored;
+    }
+
+    std::vector<Utils::Payload> restored;
+    restored.reserve( frames.size() );
+    for( auto& frame : frames )
+    {
+        switch( frame.form )
+        {
+            case RecordedContents::Full:
+                restored.push_back( std::move( frame.bytes ) );
+                break;
+            case RecordedContents::Hashed:
+                restored.emplace_back( Recording::synthesize( frame.size, frame.hash ) );
+                break;
+            case RecordedContents::Redacted:
+                restored.emplace_back( Recording::synthesize( frame.size, seed++ ) );
+                break;
+        }
+    }
+    return restored;
+}
+
+bool hasName( Event::Type type )
+{
+    return type == Event::Type::Enter || type == Event::Type::Exit;
+}
+
+bool hasGroup( Event::Type type )
+{
+    return type == Event::Type::Join || type == Event::Type::Leave || type == Event::Type::Shout;
+}
+
+bool hasFrames( Event::Type type )
+{
+    return type == Event::Type::Whisper || type == Event::Type::Shout;
+}
+} // namespace
+
+std::optional<RecordedContents> parseRecordedContents( std::string_view name )
+{
+    if( name == "full" )
+    {
+        return RecordedContents::Full;
+    }
+    if( name == "hash" )
+    {
+        return RecordedContents::Hashed;
+    }
+    if( name == "redact" )
+    {
+        return RecordedContents::Redacted;
+    }
+    return std::nullopt;
+}
+
+std::optional<Recording> Recording::read( std::istream& in )
+{
+    const std::string data( ( std::istreambuf_iterator<char>( in ) ),
+                            std::istreambuf_iterator<char>() );
+    if( data.size() < header_size || std::memcmp( data.data(), magic, sizeof( magic ) ) != 0 ||
+        static_cast<uint8_t>( data[4] ) != format_version ||
+        static_cast<uint8_t>( data[5] ) > static_cast<uint8_t>( RecordedContents::Redacted ) )
+    {
+        return std::nullopt;
+    }
+
+    Recording recording;
+    recording.contents = static_cast<RecordedContents>( data[5] );
+    Cursor cursor( data );
+    cursor.bytes( 8 );
+    recording.started_us = cursor.u64();
+    recording.node.hi = cursor.u64();
+    recording.node.lo = cursor.u64();
+    recording.session = cursor.string();
+    if( !cursor )
+    {
+        return std::nullopt;
+    }
+
+    std::chrono::microseconds time( 0 );
+    while( !cursor.empty() )
+    {
+        Record record;
+        time += std::chrono::microseconds( cursor.varint() );
+        record.time = time;
+        // Synthetic contents that weren't hashed are seeded by their record, so they're distinct.
+        const uint64_t seed = recording.records.size() << 16U;
+
+        const uint8_t type = cursor.byte();
+        if( type == 0 )
+        {
+            record.kind = Record::Kind::Local;
+            auto frames = restoreFrames( readFrames( cursor ), seed );
+            record.contents = frames.empty() ? Utils::Payload() : std::move( frames.front() );
+        }
+        else if( type <= static_cast<uint8_t>( Event::Type::Shout ) + 1 )
+        {
+            Event& event = record.event;
+            event.type = static_cast<Event::Type>( type - 1 );
+            Utils::Uuid peer;
+            peer.hi = cursor.u64();
+            peer.lo = cursor.u64();
+            event.peer = peer.hex();
+            if( hasName( event.type ) )
+            {
+                event.name = cursor.string();
+            }
+            if( event.type == Event::Type::Enter )
+            {
+                event.address = cursor.string();
+                for( uint64_t count = cursor.varint(); count > 0 && cursor; --count )
+                {
+                    std::string name = cursor.string();
+                    event.headers[std::move( name )] = cursor.string();
+                }
+            }
+            if( hasGroup( event.type ) )
+            {
+                event.group = cursor.string();
+            }
+            if( hasFrames( event.type ) )
+            {
+                event.frames = restoreFrames( readFrames( cursor ), seed );
+            }
+        }
+        else
+        {
+            break;
+        }
+
+        // A truncated record was being written when the recording was cut short.
+        if( !cursor )
+        {
+            break;
+        }
+        recording.records.push_back( std::move( record ) );
+    }
+    return recording;
+}
+
+void Recording::retime( uint64_t start_us, double speed )
+{
+    const double scale = speed > 0 ? 1 / speed : 1;
+    const auto shift = [&]( uint64_t us ) -> uint64_t {
+        // Zero is an unset time, like the capture time of a relayed item.
+        if( us == 0 )
+        {
+            return 0;
+        }
+        const double elapsed = static_cast<double>( us ) - static_cast<double>( started_us );
+        return static_cast<uint64_t>(
+            std::max( 0.0, static_cast<double>( start_us ) + elapsed * scale ) );
+    };
+
+    using Clock = Utils::HybridLogicalClock;
+    for( auto& record : records )
+    {
+        auto& frames = record.event.frames;
+        if( frames.empty() )
+        {
+            continue;
+        }
+        if( auto header = Protocol::decodeHeader( frames.front() ) )
+        {
+            const uint64_t ms = Clock::physicalMillis( header->version.timestamp );
+            header->version.timestamp = ( shift( ms * 1000 ) / 1000 ) << Clock::logical_bits |
+                                        ( header->version.timestamp & Clock::logical_mask );
+            frames.front() = Protocol::encodeHeader( *header );
+        }
+        if( frames.size() > 1 )
+        {
+            if( auto timing = Protocol::decodeTiming( frames.back() ) )
+            {
+                timing->sent_us = shift( timing->sent_us );
+                timing->captured_us = shift( timing->captured_us );
+                frames.back() = Protocol::encodeTiming( *timing );
+            }
+        }
+    }
+    started_us = start_us;
+}
+
+std::string Recording::synthesize( size_t size, uint64_t seed )
+{
+    // Random lowercase words, so that the contents deflate about as well as text.
+    std::mt19937_64 random( seed );
+    std::string contents( size, ' ' );
+    for( size_t i = 0; i < size; )
+    {
+        uint64_t bits = random();
+        for( size_t j = 0; j < sizeof( bits ) && i < size; ++j, ++i, bits >>= 8U )
+        {
+            const auto b = static_cast<uint8_t>( bits & 0xFFU );
+            contents[i] = b < 40 ? ' ' : static_cast<char>( 'a' + b % 26 );
+        }
+    }
+    return contents;
+}
+
+Recorder::Recorder( std::ostream& out, const Utils::Uuid& node, const std::string& session,
+                    RecordedContents contents ) :
+    m_out( out ),
+    m_contents( contents ),
+    m_start( Clock::now() )
+{
+    m_buffer.append( magic, sizeof( magic ) );
+    m_buffer.push_back( static_cast<char>( format_version ) );
+    m_buffer.push_back( static_cast<char>( contents ) );
+    m_buffer.append( 2, '\0' );
+    putU64( m_buffer, Clipboard::Trace::wallClockMicros() );
+    putU64( m_buffer, node.hi );
+    putU64( m_buffer, node.lo );
+    putString( m_buffer, session );
+}
+
+Recorder::~Recorder()
+{
+    flush();
+}
+
+void Recorder::recordLocal( const Clipboard::Item& item )
+{
+    std::string fields;
+    putVarint( fields, 1 );
+    encodeFrame( fields, item.contents,
+                 m_contents == RecordedContents::Hashed ? Utils::hash64( item.contents.view() ) : 0,
+                 true );
+    append( 0, fields );
+}
+
+void Recorder::recordEvent( const Event& event )
+{
+    // A datagram is recorded as the shout it stands in for, so replays don't need multicast.
+    if( event.type == Event::Type::Datagram )
+    {
+        auto datagram = event.frames.empty() ? std::nullopt
+                                             : Protocol::decodeDatagram( event.frames.front() );
+        if( datagram && !datagram->frames.empty() )
+        {
+            Event shout;
+            shout.type = Event::Type::Shout;
+            shout.peer = datagram->sender.hex();
+            shout.group = event.group;
+            shout.frames = std::move( datagram->frames );
+            recordEvent( shout );
+        }
+        return;
+    }
+
+    std::string fields;
+    const auto peer = Utils::Uuid::fromHex( event.peer ).value_or( Utils::Uuid {} );
+    putU64( fields, peer.hi );
+    putU64( fields, peer.lo );
+    if( hasName( event.type ) )
+    {
+        putString( fields, event.name );
+    }
+    if( event.type == Event::Type::Enter )
+    {
+        putString( fields, event.address );
+        putVarint( fields, event.headers.size() );
+        for( const auto& [name, value] : event.headers )
+        {
+            putString( fields, name );
+            putString( fields, value );
+        }
+    }
+    if( hasGroup( event.type ) )
+    {
+        putString( fields, event.group );
+    }
+    if( hasFrames( event.type ) )
+    {
+        encodeFrames( fields, event.frames );
+    }
+    append( static_cast<uint8_t>( static_cast<uint8_t>( event.type ) + 1 ), fields );
+}
+
+void Recorder::flush()
+{
+    const std::lock_guard lock( m_mutex );
+    m_out.write( m_buffer.data(), static_cast<std::streamsize>( m_buffer.size() ) );
+    m_out.flush();
+    m_buffer.clear();
+}
+
+void Recorder::append( uint8_t type, const std::string& fields )
+{
+    const std::lock_guard lock( m_mutex );
+    // Timed under the lock, so that records are in order, and their deltas never negative.
+    const auto time =
+        std::chrono::duration_cast<std::chrono::microseconds>( Clock::now() - m_start );
+    const auto delta = std::max( time - m_previous, std::chrono::microseconds::zero() );
+    putVarint( m_buffer, static_cast<uint64_t>( delta.count() ) );
+    m_previous += delta;
+    m_buffer.push_back( static_cast<char>( type ) );
+    m_buffer.append( fields );
+    m_records.add();
+    m_bytes.add( fields.size() + 2 );
+
+    if( m_buffer.size() >= flush_threshold )
+    {
+        m_out.write( m_buffer.data(), static_cast<std::streamsize>( m_buffer.size() ) );
+        m_buffer.clear();
+    }
+}
+
+void Recorder::encodeFrames( std::string& fields, const std::vector<Utils::Payload>& frames ) const
+{
+    putVarint( fields, frames.size() );
+    const auto header =
+        frames.empty() ? std::nullopt : Protocol::decodeHeader( frames.front() );
+    if( !header )
+    {
+        // Legacy peers shout the plain contents.
+        for( const auto& frame : frames )
+        {
+            encodeFrame( fields, frame,
+                         m_contents == RecordedContents::Hashed ? Utils::hash64( frame.view() ) : 0,
+                         true );
+        }
+        return;
+    }
+
+    // The digest in the header is a hash of the contents, which a redacted recording can't keep.
+    if( m_contents == RecordedContents::Redacted )
+    {
+        Protocol::Header scrubbed = *header;
+        scrubbed.digest = 0;
+        encodeFrame( fields, Protocol::encodeHeader( scrubbed ), 0, false );
+    }
+    else
+    {
+        encodeFrame( fields, frames.front(), 0, false );
+    }
+
+    const bool timed = frames.size() > 1 && Protocol::decodeTiming( frames.back() );
+    for( size_t i = 1; i < frames.size(); ++i )
+    {
+        const bool contents = !timed || i + 1 < frames.size();
+        encodeFrame( fields, frames[i], header->digest, contents );
+    }
+}
+
+void Recorder::encodeFrame( std::string& fields, const Utils::Payload& frame, uint64_t hash,
+                            bool contents ) const
+{
+    const RecordedContents form = contents ? m_contents : RecordedContents::Full;
+    fields.push_back( static_cast<char>( form ) );
+    putVarint( fields, frame.size() );
+    switch( form )
+    {
+        case RecordedContents::Full:
+            fields.append( frame.view() );
+            break;
+        case RecordedContents::Hashed:
+            putU64( fields, hash );
+            break;
+        case RecordedContents::Redacted:
+            break;
+    }
+}
+
+RecordingTransport::RecordingTransport( std::unique_ptr<Transport> transport,
+                                        Recorder& recorder ) :
+    m_transport( std::move( transport ) ),
+    m_recorder( recorder ),
+    m_on_event( this, &RecordingTransport::forward )
+{}
+
+Utils::Uuid RecordingTransport::uuid() const
+{
+    return m_transport->uuid();
+}
+
+void RecordingTransport::setHeader( const std::string& name, const std::string& value )
+{
+    m_transport->setHeader( name, value );
+}
+
+void RecordingTransport::join( const std::string& group )
+{
+    m_transport->join( group );
+}
+
+bool RecordingTransport::start()
+{
+    return m_transport->start();
+}
+
+void RecordingTransport::stop()
+{
+    m_transport->stop();
+}
+
+void RecordingTransport::shout( const std::string& group,
+                                const std::vector<Utils::Payload>& frames )
+{
+    m_transport->shout( group, frames );
+}
+
+void RecordingTransport::whisper( const std::string& peer,
+                                  const std::vector<Utils::Payload>& frames )
+{
+    m_transport->whisper( peer, frames );
+}
+
+bool RecordingTransport::joinMulticast( const std::string& group )
+{
+    return m_transport->joinMulticast( group );
+}
+
+void RecordingTransport::multicast( const std::string& group, const Utils::Payload& datagram )
+{
+    m_transport->multicast( group, datagram );
+}
+
+bool RecordingTransport::encrypted() const
+{
+    return m_transport->encrypted();
+}
+
+bool RecordingTransport::wait( std::chrono::milliseconds timeout, int wake_fd )
+{
+    return m_transport->wait( timeout, wake_fd );
+}
+
+size_t RecordingTransport::receive( const Handler& handler )
+{
+    m_handler = &handler;
+    const size_t handled = m_transport->receive( m_on_event );
+    m_handler = nullptr;
+    return handled;
+}
+
+Transport::Clock::time_point RecordingTransport::now() const
+{
+    return m_transport->now();
+}
+
+uint64_t RecordingTransport::wallClockMicros() const
+{
+    return m_transport->wallClockMicros();
+}
+
+void RecordingTransport::forward( const Event& event )
+{
+    m_recorder.recordEvent( event );
+    ( *m_handler )( event );
+}
+
+void ReplayTransport::inject( Event event )
+{
+    {
+        const std::lock_guard lock( m_mutex );
+        m_inbox.push_back( std::move( event ) );
+    }
+    m_ready.notify();
+}
+
+ReplayTransport::Stats ReplayTransport::stats() const
+{
+    Stats stats;
+    stats.shouts = m_shouts.load( std::memory_order_relaxed );
+    stats.whispers = m_whispers.load( std::memory_order_relaxed );
+    stats.bytes = m_bytes.load( std::memory_order_relaxed );
+    return stats;
+}
+
+void ReplayTransport::shout( const std::string& /*group*/,
+                             const std::vector<Utils::Payload>& frames )
+{
+    m_shouts.fetch_add( 1, std::memory_order_relaxed );
+    for( const auto& frame : frames )
+    {
+        m_bytes.fetch_add( frame.size(), std::memory_order_relaxed );
+    }
+}
+
+void ReplayTransport::whisper( const std::string& /*peer*/,
+                               const std::vector<Utils::Payload>& frames )
+{
+    m_whispers.fetch_add( 1, std::memory_order_relaxed );
+    for( const auto& frame : frames )
+    {
+        m_bytes.fetch_add( frame.size(), std::memory_order_relaxed );
+    }
+}
+
+bool ReplayTransport::wait( std::chrono::milliseconds timeout, int wake_fd )
+{
+    pollfd fds[] = {
+        {m_ready.fd(), POLLIN, 0},
+        {wake_fd, POLLIN, 0},
+    };
+    return poll( fds, 2, static_cast<int>( timeout.count() ) ) > 0;
+}
+
+size_t ReplayTransport::receive( const Handler& handler )
+{
+    std::deque<Event> events;
+    {
+        const std::lock_guard lock( m_mutex );
+        m_ready.drain();
+        events.swap( m_inbox );
+    }
+    for( const auto& event : events )
+    {
+        handler( event );
+    }
+    return events.size();
+}
+} // namespace Clipd::Network
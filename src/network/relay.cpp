@@ -0,0 +1,51 @@
+#include "network/relay.h"
+
+#include "utils/log.h"
+
+namespace Clipd::Network
+{
+Relay::Relay( PeerDiscoveryDaemon& local, PeerDiscoveryDaemon& remote,
+              const std::vector<std::string>& sessions ) :
+    m_local( local ),
+    m_remote( remote )
+{
+    for( const auto& session : sessions )
+    {
+        m_local.addSession( session );
+        m_remote.addSession( session );
+        m_local.registerOnRemoteClipboardUpdate(
+            session, Utils::Functor<void( const Clipboard::Item& )>(
+                         [this, session]( const Clipboard::Item& item ) {
+                             forward( m_remote, session, item );
+                         } ) );
+        m_remote.registerOnRemoteClipboardUpdate(
+            session, Utils::Functor<void( const Clipboard::Item& )>(
+                         [this, session]( const Clipboard::Item& item ) {
+                             forward( m_local, session, item );
+                         } ) );
+    }
+}
+
+void Relay::forward( PeerDiscoveryDaemon& to, const std::string& session,
+                     const Clipboard::Item& item )
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        auto [latest, inserted] = m_latest.try_emplace( session, item.version );
+        if( !inserted )
+        {
+            if( !( item.version > latest->second ) )
+            {
+                m_duplicates.add();
+                return;
+            }
+            latest->second = item.version;
+        }
+    }
+
+    ( &to == &m_local ? m_to_local : m_to_remote ).add();
+    CLIPD_LOG_DEBUG( "Relaying " << item.version << " in '" << session << "' to the "
+                                 << ( &to == &m_local ? "local" : "remote" ) << " side" );
+    to.receiveLocalClipboardUpdate( session, item );
+}
+} // namespace Clipd::Network
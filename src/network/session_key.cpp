@@ -0,0 +1,165 @@
+#include "network/session_key.h"
+
+#include <sodium.h>
+
+#include <cstring>
+#include <memory>
+
+namespace Clipd::Network
+{
+namespace
+{
+constexpr char magic[] = {'C', 'L', 'P', 'S'};
+constexpr size_t id_offset = 4;
+constexpr size_t nonce_offset = 12;
+constexpr size_t sealed_header_size = nonce_offset + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+constexpr size_t mac_size = crypto_aead_xchacha20poly1305_ietf_ABYTES;
+constexpr char context[] = "clipd-session:";
+
+uint64_t getU64( const unsigned char* data )
+{
+    uint64_t value = 0;
+    for( size_t i = 0; i < sizeof( value ); ++i )
+    {
+        value |= uint64_t( data[i] ) << ( 8 * i );
+    }
+    return value;
+}
+
+void putU64( unsigned char* data, uint64_t value )
+{
+    for( size_t i = 0; i < sizeof( value ); ++i )
+    {
+        data[i] = static_cast<unsigned char>( ( value >> ( 8 * i ) ) & 0xFF );
+    }
+}
+
+unsigned char* bytes( std::string& buffer, size_t offset = 0 )
+{
+    return reinterpret_cast<unsigned char*>( buffer.data() + offset );
+}
+
+//! @brief The data authenticated with a sealed frame: its header, then any the caller gave.
+std::string authenticated( const char* header, std::string_view associated )
+{
+    std::string data( header, nonce_offset );
+    data.append( associated );
+    return data;
+}
+} // namespace
+
+std::optional<SessionKey> SessionKey::derive( const std::vector<uint8_t>& secret,
+                                              const std::string& session )
+{
+    // Safe to call more than once, and from several threads.
+    if( secret.size() != secret_size || sodium_init() < 0 )
+    {
+        return std::nullopt;
+    }
+
+    SessionKey key;
+    const std::string input = context + session;
+    crypto_generichash( key.m_key.data(), key.m_key.size(),
+                        reinterpret_cast<const unsigned char*>( input.data() ), input.size(),
+                        secret.data(), secret.size() );
+    // The ID is a digest of the key, so it reveals nothing about it.
+    std::array<unsigned char, sizeof( key.m_id )> id = {};
+    crypto_generichash( id.data(), id.size(), key.m_key.data(), key.m_key.size(), nullptr, 0 );
+    key.m_id = getU64( id.data() );
+    return key;
+}
+
+Utils::Payload SessionKey::seal( const std::vector<Utils::Payload>& frames,
+                                 std::string_view associated ) const
+{
+    size_t size = sealed_header_size + mac_size;
+    for( const auto& frame : frames )
+    {
+        size += sizeof( uint32_t ) + frame.size();
+    }
+
+    // The frames are laid out after the header, and encrypted in place.
+    std::string buffer( size, '\0' );
+    std::memcpy( buffer.data(), magic, sizeof( magic ) );
+    putU64( bytes( buffer, id_offset ), m_id );
+    randombytes_buf( bytes( buffer, nonce_offset ), crypto_aead_xchacha20poly1305_ietf_NPUBBYTES );
+    size_t offset = sealed_header_size;
+    for( const auto& frame : frames )
+    {
+        const auto frame_size = static_cast<uint32_t>( frame.size() );
+        for( size_t i = 0; i < sizeof( frame_size ); ++i )
+        {
+            buffer[offset + i] = static_cast<char>( ( frame_size >> ( 8 * i ) ) & 0xFF );
+        }
+        offset += sizeof( frame_size );
+        std::memcpy( buffer.data() + offset, frame.data(), frame.size() );
+        offset += frame.size();
+    }
+
+    const std::string ad = authenticated( buffer.data(), associated );
+    unsigned long long sealed_size = 0;
+    crypto_aead_xchacha20poly1305_ietf_encrypt(
+        bytes( buffer, sealed_header_size ), &sealed_size, bytes( buffer, sealed_header_size ),
+        offset - sealed_header_size, reinterpret_cast<const unsigned char*>( ad.data() ),
+        ad.size(), nullptr, bytes( buffer, nonce_offset ), m_key.data() );
+    return Utils::Payload( std::move( buffer ) );
+}
+
+std::optional<std::vector<Utils::Payload>> SessionKey::open( const Utils::Payload& sealed,
+                                                             std::string_view associated ) const
+{
+    if( sealedWith( sealed ) != m_id || sealed.size() < sealed_header_size + mac_size )
+    {
+        return std::nullopt;
+    }
+
+    // The frames are decrypted into one buffer, which they all share.
+    auto buffer = std::make_shared<std::string>( sealed.size() - sealed_header_size - mac_size,
+                                                 '\0' );
+    const auto* data = reinterpret_cast<const unsigned char*>( sealed.data() );
+    const std::string ad = authenticated( sealed.data(), associated );
+    unsigned long long opened_size = 0;
+    if( crypto_aead_xchacha20poly1305_ietf_decrypt(
+            bytes( *buffer ), &opened_size, nullptr, data + sealed_header_size,
+            sealed.size() - sealed_header_size,
+            reinterpret_cast<const unsigned char*>( ad.data() ), ad.size(), data + nonce_offset,
+            m_key.data() ) != 0 )
+    {
+        return std::nullopt;
+    }
+
+    std::vector<Utils::Payload> frames;
+    size_t offset = 0;
+    while( offset < buffer->size() )
+    {
+        if( buffer->size() - offset < sizeof( uint32_t ) )
+        {
+            return std::nullopt;
+        }
+        uint32_t frame_size = 0;
+        for( size_t i = 0; i < sizeof( frame_size ); ++i )
+        {
+            frame_size |= uint32_t( static_cast<unsigned char>( ( *buffer )[offset + i] ) )
+                          << ( 8 * i );
+        }
+        offset += sizeof( frame_size );
+        if( buffer->size() - offset < frame_size )
+        {
+            return std::nullopt;
+        }
+        frames.emplace_back( buffer->data() + offset, frame_size, buffer );
+        offset += frame_size;
+    }
+    return frames;
+}
+
+std::optional<uint64_t> SessionKey::sealedWith( const Utils::Payload& frame )
+{
+    if( frame.size() < sealed_header_size ||
+        std::memcmp( frame.data(), magic, sizeof( magic ) ) != 0 )
+    {
+        return std::nullopt;
+    }
+    return getU64( reinterpret_cast<const unsigned char*>( frame.data() ) + id_offset );
+}
+} // namespace Clipd::Network
@@ -0,0 +1,701 @@
+#include "network/sim_network.h"
+
+#include <algorithm>
+
+namespace Clipd::Network
+{
+namespace
+{
+//! An arbitrary wall clock time that the virtual time starts at, so that runs are reproducible.
+constexpr uint64_t epoch_wall_us = 1'700'000'000'000'000;
+
+uint64_t countBytes( const std::vector<Utils::Payload>& frames )
+{
+    uint64_t bytes = 0;
+    for( const auto& frame : frames )
+    {
+        bytes += frame.size();
+    }
+    return bytes;
+}
+
+/**
+ * @brief Roughly how many bytes the ZRE message behind a membership event takes.
+ *
+ * @details Each message has a 6 byte header. A HELLO carries the sender's endpoint, groups, name,
+ * and headers, each string prefixed by its length, and a JOIN or LEAVE carries the group. EVASIVE
+ * and EXIT are observed, rather than sent.
+ */
+uint64_t controlBytes( const Event& event, const std::set<std::string>& groups )
+{
+    switch( event.type )
+    {
+        case Event::Type::Enter:
+        {
+            // The endpoint is a tcp:// address, like tcp://10.0.0.2:49152.
+            uint64_t bytes = 6 + 1 + 24 + 4 + 1 + 1 + event.name.size() + 4;
+            for( const auto& group : groups )
+            {
+                bytes += 4 + group.size();
+            }
+            for( const auto& [name, value] : event.headers )
+            {
+                bytes += 1 + name.size() + 4 + value.size();
+            }
+            return bytes;
+        }
+        case Event::Type::Join:
+        case Event::Type::Leave: return 6 + 1 + event.group.size() + 1;
+        case Event::Type::Exit:
+        case Event::Type::Evasive:
+        case Event::Type::Whisper:
+        case Event::Type::Shout:
+        case Event::Type::Datagram: return 0;
+    }
+    return 0;
+}
+} // namespace
+
+SimNetwork::SimNetwork() : SimNetwork( Config {} ) {}
+
+SimNetwork::SimNetwork( const Config& config ) :
+    m_config( config ),
+    m_random( config.seed ),
+    m_now( std::chrono::hours( 1 ) ),
+    m_epoch( m_now )
+{
+}
+
+std::unique_ptr<Transport> SimNetwork::createTransport( const std::string& name,
+                                                        const std::string& scope )
+{
+    const size_t index = m_nodes.size();
+    Node node;
+    node.uuid = Utils::Uuid {m_random(), m_random()};
+    node.name = name;
+    node.scope = scope;
+    m_indices.emplace( node.uuid, index );
+    m_nodes.push_back( std::move( node ) );
+    return std::make_unique<SimTransport>( *this, index );
+}
+
+void SimNetwork::attach( const Utils::Uuid& node, Step step )
+{
+    const size_t index = indexOf( node );
+    if( index == m_nodes.size() )
+    {
+        return;
+    }
+    m_nodes[index].step = std::move( step );
+    start( index );
+}
+
+void SimNetwork::stop( const Utils::Uuid& node )
+{
+    const size_t index = indexOf( node );
+    if( index != m_nodes.size() )
+    {
+        stop( index );
+    }
+}
+
+void SimNetwork::partition( const std::vector<Utils::Uuid>& side )
+{
+    const auto before = reachability();
+    for( const auto& uuid : side )
+    {
+        const size_t index = indexOf( uuid );
+        if( index != m_nodes.size() )
+        {
+            m_nodes[index].side = 1;
+        }
+    }
+    topologyChanged( before );
+}
+
+void SimNetwork::heal()
+{
+    const auto before = reachability();
+    for( auto& node : m_nodes )
+    {
+        node.side = 0;
+    }
+    topologyChanged( before );
+}
+
+void SimNetwork::silence( const Utils::Uuid& node )
+{
+    const size_t index = indexOf( node );
+    if( index == m_nodes.size() )
+    {
+        return;
+    }
+    const auto before = reachability();
+    m_nodes[index].silent = true;
+    topologyChanged( before );
+}
+
+void SimNetwork::resume( const Utils::Uuid& node )
+{
+    const size_t index = indexOf( node );
+    if( index == m_nodes.size() )
+    {
+        return;
+    }
+    const auto before = reachability();
+    m_nodes[index].silent = false;
+    topologyChanged( before );
+}
+
+void SimNetwork::runUntil( Clock::time_point deadline )
+{
+    for( size_t i = 0; i < m_nodes.size(); ++i )
+    {
+        wake( i );
+    }
+    process( deadline );
+    m_now = std::max( m_now, deadline );
+}
+
+bool SimNetwork::runUntilIdle( Clock::duration limit )
+{
+    for( size_t i = 0; i < m_nodes.size(); ++i )
+    {
+        wake( i );
+    }
+    process( m_now + limit );
+    return m_schedule.empty();
+}
+
+uint64_t SimNetwork::wallClockMicros() const
+{
+    using namespace std::chrono;
+    return epoch_wall_us +
+           static_cast<uint64_t>( duration_cast<microseconds>( m_now - m_epoch ).count() );
+}
+
+uint64_t SimNetwork::bytesSent( const Utils::Uuid& node ) const
+{
+    const size_t index = indexOf( node );
+    return index == m_nodes.size() ? 0 : m_nodes[index].bytes_sent;
+}
+
+size_t SimNetwork::connections( const Utils::Uuid& node ) const
+{
+    const size_t index = indexOf( node );
+    if( index == m_nodes.size() )
+    {
+        return 0;
+    }
+    const auto& known = m_nodes[index].known;
+    return static_cast<size_t>( std::count( known.begin(), known.end(), true ) );
+}
+
+void SimNetwork::process( Clock::time_point deadline )
+{
+    while( !m_schedule.empty() && m_schedule.top().time <= deadline )
+    {
+        const size_t slot = m_schedule.top().slot;
+        m_schedule.pop();
+        Scheduled next = std::move( m_slots[slot] );
+        m_free_slots.push_back( slot );
+        m_now = std::max( m_now, next.time );
+        Node& node = m_nodes[next.to];
+
+        switch( next.kind )
+        {
+            case Scheduled::Kind::Deliver:
+            {
+                if( !node.started || !reachable( next.from, next.to ) )
+                {
+                    ++m_stats.dropped;
+                    continue;
+                }
+                if( next.event.type == Event::Type::Enter )
+                {
+                    setKnown( next.to, next.from, true );
+                }
+                else if( next.event.type != Event::Type::Datagram && !knows( next.to, next.from ) )
+                {
+                    // Like Zyre, ignore anything from a peer that hasn't said hello.
+                    ++m_stats.dropped;
+                    continue;
+                }
+                else if( next.event.type == Event::Type::Exit )
+                {
+                    setKnown( next.to, next.from, false );
+                }
+                break;
+            }
+            case Scheduled::Kind::Wake:
+            {
+                if( node.wake == next.time )
+                {
+                    node.wake.reset();
+                }
+                wake( next.to );
+                continue;
+            }
+            case Scheduled::Kind::Liveness:
+            {
+                // The check is stale if the link was restored, even if it has been cut again.
+                const bool cut = m_cuts[link( next.to, next.from )] == next.cut &&
+                                 !reachable( next.from, next.to );
+                if( !node.started || !cut || !knows( next.to, next.from ) )
+                {
+                    continue;
+                }
+                if( next.event.type == Event::Type::Exit )
+                {
+                    setKnown( next.to, next.from, false );
+                }
+                break;
+            }
+        }
+
+        ++m_stats.delivered;
+        node.inbox.push_back( std::move( next.event ) );
+        wake( next.to );
+    }
+}
+
+size_t SimNetwork::indexOf( const Utils::Uuid& uuid ) const
+{
+    const auto found = m_indices.find( uuid );
+    return found == m_indices.end() ? m_nodes.size() : found->second;
+}
+
+bool SimNetwork::reachable( size_t a, size_t b ) const
+{
+    const Node& x = m_nodes[a];
+    const Node& y = m_nodes[b];
+    return !x.silent && !y.silent && x.side == y.side;
+}
+
+bool SimNetwork::knows( size_t observer, size_t peer ) const
+{
+    const auto& known = m_nodes[observer].known;
+    return peer < known.size() && known[peer];
+}
+
+void SimNetwork::setKnown( size_t observer, size_t peer, bool known )
+{
+    auto& nodes = m_nodes[observer].known;
+    if( nodes.size() <= peer )
+    {
+        nodes.resize( m_nodes.size(), false );
+    }
+    nodes[peer] = known;
+}
+
+void SimNetwork::start( size_t node )
+{
+    if( m_nodes[node].started )
+    {
+        return;
+    }
+    m_nodes[node].started = true;
+
+    // Each pair discovers each other when one of them hears the other's beacon.
+    std::uniform_int_distribution<Clock::rep> beacon( 0, m_config.beacon.count() );
+    for( size_t peer = 0; peer < m_nodes.size(); ++peer )
+    {
+        if( peer != node && m_nodes[peer].started && reachable( node, peer ) &&
+            m_nodes[peer].scope == m_nodes[node].scope )
+        {
+            const Clock::duration delay( beacon( m_random ) );
+            introduce( node, peer, delay );
+            introduce( peer, node, delay );
+        }
+    }
+}
+
+void SimNetwork::stop( size_t node )
+{
+    if( !m_nodes[node].started )
+    {
+        return;
+    }
+    for( size_t peer = 0; peer < m_nodes.size(); ++peer )
+    {
+        if( knows( peer, node ) )
+        {
+            send( node, peer, describe( node, Event::Type::Exit ) );
+        }
+    }
+    Node& stopped = m_nodes[node];
+    stopped.started = false;
+    stopped.known.clear();
+    stopped.inbox.clear();
+    stopped.wake.reset();
+}
+
+void SimNetwork::release( size_t node )
+{
+    stop( node );
+    m_nodes[node].step = Step();
+}
+
+void SimNetwork::join( size_t node, const std::string& group )
+{
+    if( !m_nodes[node].groups.insert( group ).second || !m_nodes[node].started )
+    {
+        return;
+    }
+    Event event = describe( node, Event::Type::Join );
+    event.group = group;
+    for( size_t peer = 0; peer < m_nodes.size(); ++peer )
+    {
+        if( knows( peer, node ) )
+        {
+            send( node, peer, event );
+        }
+    }
+}
+
+void SimNetwork::shout( size_t from, const std::string& group,
+                        const std::vector<Utils::Payload>& frames )
+{
+    if( !m_nodes[from].started )
+    {
+        return;
+    }
+    Event event = describe( from, Event::Type::Shout );
+    event.group = group;
+    event.frames = frames;
+    // Like Zyre, send a copy to every peer in the group.
+    for( size_t peer = 0; peer < m_nodes.size(); ++peer )
+    {
+        if( peer != from && knows( from, peer ) && m_nodes[peer].groups.count( group ) != 0 )
+        {
+            send( from, peer, event );
+        }
+    }
+}
+
+void SimNetwork::whisper( size_t from, const std::string& peer,
+                          const std::vector<Utils::Payload>& frames )
+{
+    const auto uuid = Utils::Uuid::fromHex( peer );
+    const size_t to = uuid ? indexOf( *uuid ) : m_nodes.size();
+    if( !m_nodes[from].started || to == m_nodes.size() || !knows( from, to ) )
+    {
+        return;
+    }
+    Event event = describe( from, Event::Type::Whisper );
+    event.frames = frames;
+    send( from, to, std::move( event ) );
+}
+
+bool SimNetwork::joinMulticast( size_t node, const std::string& group )
+{
+    if( !m_config.multicast )
+    {
+        return false;
+    }
+    m_nodes[node].multicast_groups.insert( group );
+    return true;
+}
+
+void SimNetwork::multicast( size_t from, const std::string& group,
+                            const Utils::Payload& datagram )
+{
+    if( !m_nodes[from].started || m_nodes[from].multicast_groups.count( group ) == 0 )
+    {
+        return;
+    }
+    ++m_stats.datagrams;
+    const auto departure = transmit( from, datagram.size(), m_now );
+
+    // Datagrams don't come from a discovered peer, and aren't kept in order, or retransmitted.
+    Event event;
+    event.type = Event::Type::Datagram;
+    event.group = group;
+    event.frames = {datagram};
+    std::uniform_real_distribution<double> loss( 0, 1 );
+    for( size_t to = 0; to < m_nodes.size(); ++to )
+    {
+        const Node& receiver = m_nodes[to];
+        if( to == from || !receiver.started || receiver.multicast_groups.count( group ) == 0 ||
+            !reachable( from, to ) )
+        {
+            continue;
+        }
+        if( m_config.datagram_loss > 0 && loss( m_random ) < m_config.datagram_loss )
+        {
+            ++m_stats.lost;
+            continue;
+        }
+        auto arrival = departure + m_config.latency;
+        if( m_config.jitter > Clock::duration::zero() )
+        {
+            std::uniform_int_distribution<Clock::rep> jitter( 0, m_config.jitter.count() );
+            arrival += Clock::duration( jitter( m_random ) );
+        }
+        schedule( Scheduled {arrival, Scheduled::Kind::Deliver, to, from, 0, event} );
+    }
+}
+
+size_t SimNetwork::receive( size_t node, const Transport::Handler& handler )
+{
+    auto& inbox = m_nodes[node].inbox;
+    size_t handled = 0;
+    while( !inbox.empty() )
+    {
+        const Event event = std::move( inbox.front() );
+        inbox.pop_front();
+        handler( event );
+        ++handled;
+    }
+    return handled;
+}
+
+Event SimNetwork::describe( size_t node, Event::Type type ) const
+{
+    Event event;
+    event.type = type;
+    event.peer = m_nodes[node].uuid.hex();
+    event.name = m_nodes[node].name;
+    if( type == Event::Type::Enter )
+    {
+        event.address = "sim://" + std::to_string( node );
+        event.headers = m_nodes[node].headers;
+    }
+    return event;
+}
+
+void SimNetwork::introduce( size_t from, size_t to, Clock::duration delay )
+{
+    send( from, to, describe( from, Event::Type::Enter ), delay );
+    for( const auto& group : m_nodes[from].groups )
+    {
+        Event event = describe( from, Event::Type::Join );
+        event.group = group;
+        send( from, to, std::move( event ), delay );
+    }
+}
+
+void SimNetwork::send( size_t from, size_t to, Event event, Clock::duration delay )
+{
+    if( !reachable( from, to ) )
+    {
+        ++m_stats.dropped;
+        return;
+    }
+
+    auto departure = m_now + delay;
+    const bool message = event.type == Event::Type::Shout || event.type == Event::Type::Whisper;
+    if( message )
+    {
+        // The copies of a shout queue up behind each other on the sender's uplink.
+        ++m_stats.messages;
+        departure = transmit( from, countBytes( event.frames ), departure );
+    }
+    else
+    {
+        ++m_stats.membership;
+        m_stats.control += controlBytes( event, m_nodes[from].groups );
+    }
+
+    auto arrival = departure + m_config.latency;
+    if( m_config.jitter > Clock::duration::zero() )
+    {
+        std::uniform_int_distribution<Clock::rep> jitter( 0, m_config.jitter.count() );
+        arrival += Clock::duration( jitter( m_random ) );
+    }
+    if( m_config.loss > 0 && std::uniform_real_distribution<double>( 0, 1 )( m_random ) <
+                                 m_config.loss )
+    {
+        ++m_stats.retransmits;
+        arrival += m_config.retransmit;
+    }
+    if( m_config.jitter > Clock::duration::zero() || m_config.loss > 0 )
+    {
+        auto& last = m_last_arrival[link( from, to )];
+        arrival = std::max( arrival, last );
+        last = arrival;
+    }
+
+    schedule( Scheduled {arrival, Scheduled::Kind::Deliver, to, from, 0, std::move( event )} );
+}
+
+SimNetwork::Clock::time_point SimNetwork::transmit( size_t from, uint64_t bytes,
+                                                   Clock::time_point departure )
+{
+    Node& sender = m_nodes[from];
+    m_stats.bytes += bytes;
+    sender.bytes_sent += bytes;
+    if( m_config.bandwidth <= 0 )
+    {
+        return departure;
+    }
+    const std::chrono::duration<double> duration( static_cast<double>( bytes ) /
+                                                  m_config.bandwidth );
+    sender.uplink_free = std::max( sender.uplink_free, departure ) +
+                         std::chrono::duration_cast<Clock::duration>( duration );
+    return sender.uplink_free;
+}
+
+void SimNetwork::schedule( Scheduled scheduled )
+{
+    size_t slot = m_slots.size();
+    if( m_free_slots.empty() )
+    {
+        m_slots.push_back( std::move( scheduled ) );
+    }
+    else
+    {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+        m_slots[slot] = std::move( scheduled );
+    }
+    m_schedule.push( Pending {m_slots[slot].time, m_sequence++, slot} );
+}
+
+void SimNetwork::wake( size_t node )
+{
+    Node& woken = m_nodes[node];
+    if( !woken.started || !woken.step )
+    {
+        return;
+    }
+    const auto next = woken.step();
+    if( !next )
+    {
+        return;
+    }
+    // Always make progress, even if the node asked to be stepped again right away.
+    const auto at = m_now + std::max( *next, Clock::duration( 1 ) );
+    if( !woken.wake || at < *woken.wake )
+    {
+        woken.wake = at;
+        schedule( Scheduled {at, Scheduled::Kind::Wake, node, node, 0, {}} );
+    }
+}
+
+std::vector<bool> SimNetwork::reachability() const
+{
+    const size_t n = m_nodes.size();
+    std::vector<bool> reachable_( n * n );
+    for( size_t a = 0; a < n; ++a )
+    {
+        for( size_t b = 0; b < n; ++b )
+        {
+            reachable_[a * n + b] = reachable( a, b );
+        }
+    }
+    return reachable_;
+}
+
+void SimNetwork::topologyChanged( const std::vector<bool>& before )
+{
+    const size_t n = m_nodes.size();
+    std::uniform_int_distribution<Clock::rep> beacon( 0, m_config.beacon.count() );
+    for( size_t observer = 0; observer < n; ++observer )
+    {
+        if( !m_nodes[observer].started )
+        {
+            continue;
+        }
+        for( size_t peer = 0; peer < n; ++peer )
+        {
+            const bool was = before[observer * n + peer];
+            const bool is = reachable( observer, peer );
+            if( peer == observer || was == is )
+            {
+                continue;
+            }
+            if( !is && knows( observer, peer ) )
+            {
+                const uint64_t cut = ++m_cuts[link( observer, peer )];
+                schedule( Scheduled {m_now + m_config.evasive, Scheduled::Kind::Liveness, observer,
+                                     peer, cut, describe( peer, Event::Type::Evasive )} );
+                schedule( Scheduled {m_now + m_config.expired, Scheduled::Kind::Liveness, observer,
+                                     peer, cut, describe( peer, Event::Type::Exit )} );
+            }
+            else if( is && m_nodes[peer].started && !knows( observer, peer ) &&
+                     m_nodes[peer].scope == m_nodes[observer].scope )
+            {
+                // Peers that expired each other hear each other's beacons again.
+                introduce( peer, observer, Clock::duration( beacon( m_random ) ) );
+            }
+        }
+    }
+}
+
+SimTransport::~SimTransport()
+{
+    m_network.release( m_index );
+}
+
+Utils::Uuid SimTransport::uuid() const
+{
+    return m_network.m_nodes[m_index].uuid;
+}
+
+void SimTransport::setHeader( const std::string& name, const std::string& value )
+{
+    m_network.m_nodes[m_index].headers[name] = value;
+}
+
+void SimTransport::join( const std::string& group )
+{
+    m_network.join( m_index, group );
+}
+
+bool SimTransport::start()
+{
+    m_network.start( m_index );
+    return true;
+}
+
+void SimTransport::stop()
+{
+    m_network.stop( m_index );
+}
+
+void SimTransport::shout( const std::string& group, const std::vector<Utils::Payload>& frames )
+{
+    m_network.shout( m_index, group, frames );
+}
+
+void SimTransport::whisper( const std::string& peer, const std::vector<Utils::Payload>& frames )
+{
+    m_network.whisper( m_index, peer, frames );
+}
+
+bool SimTransport::joinMulticast( const std::string& group )
+{
+    return m_network.joinMulticast( m_index, group );
+}
+
+void SimTransport::multicast( const std::string& group, const Utils::Payload& datagram )
+{
+    m_network.multicast( m_index, group, datagram );
+}
+
+bool SimTransport::encrypted() const
+{
+    return m_network.m_config.encrypted;
+}
+
+bool SimTransport::wait( std::chrono::milliseconds /*timeout*/, int /*wake_fd*/ )
+{
+    return false;
+}
+
+size_t SimTransport::receive( const Handler& handler )
+{
+    return m_network.receive( m_index, handler );
+}
+
+Transport::Clock::time_point SimTransport::now() const
+{
+    return m_network.now();
+}
+
+uint64_t SimTransport::wallClockMicros() const
+{
+    return m_network.wallClockMicros();
+}
+} // namespace Clipd::Network
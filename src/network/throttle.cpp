@@ -0,0 +1,82 @@
+#include "network/throttle.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace Clipd::Network
+{
+bool TokenBucket::take( Clock::time_point now )
+{
+    if( m_rate <= 0 )
+    {
+        return true;
+    }
+    const double available = tokens( now );
+    if( available < 1 )
+    {
+        return false;
+    }
+    m_tokens = available - 1;
+    m_refilled = now;
+    return true;
+}
+
+TokenBucket::Clock::duration TokenBucket::wait( Clock::time_point now ) const
+{
+    const double available = m_rate > 0 ? tokens( now ) : 1;
+    if( available >= 1 )
+    {
+        return Clock::duration::zero();
+    }
+    const std::chrono::duration<double> refill( ( 1 - available ) / m_rate );
+    return std::chrono::ceil<Clock::duration>( refill );
+}
+
+double TokenBucket::tokens( Clock::time_point now ) const
+{
+    // The bucket starts full.
+    if( m_refilled == Clock::time_point {} )
+    {
+        return m_burst;
+    }
+    const double elapsed = std::chrono::duration<double>( now - m_refilled ).count();
+    return std::min( m_burst, m_tokens + m_rate * std::max( elapsed, 0.0 ) );
+}
+
+bool Throttle::admit( const std::string& session, const std::string& peer,
+                      Clock::time_point now )
+{
+    if( !enabled() )
+    {
+        return true;
+    }
+    // Both buckets must have a token before either is taken, so a refused item costs nothing.
+    if( wait( session, peer, now ) != Clock::duration::zero() )
+    {
+        return false;
+    }
+    const double burst = std::max( m_config.burst, 1.0 );
+    m_peers.try_emplace( peer, m_config.peer_rate, burst ).first->second.take( now );
+    m_sessions.try_emplace( session, m_config.session_rate, burst ).first->second.take( now );
+    return true;
+}
+
+Throttle::Clock::duration Throttle::wait( const std::string& session, const std::string& peer,
+                                          Clock::time_point now ) const
+{
+    return std::max( wait( m_peers, peer, now ), wait( m_sessions, session, now ) );
+}
+
+void Throttle::forget( const std::string& peer )
+{
+    m_peers.erase( peer );
+}
+
+Throttle::Clock::duration
+Throttle::wait( const std::unordered_map<std::string, TokenBucket>& buckets,
+                const std::string& key, Clock::time_point now )
+{
+    const auto found = buckets.find( key );
+    return found == buckets.end() ? Clock::duration::zero() : found->second.wait( now );
+}
+} // namespace Clipd::Network
@@ -0,0 +1,345 @@
+#include "network/zyre_transport.h"
+
+#include "network/message.h"
+#include "utils/hash.h"
+#include "utils/log.h"
+
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace Clipd::Network
+{
+namespace
+{
+//! Zyre's default discovery port.
+constexpr uint16_t default_port = 5670;
+//! The ports above the discovery port that scoped beacons are spread over.
+constexpr uint64_t scoped_ports = 4096;
+} // namespace
+
+uint16_t ZyreTransport::beaconPort( uint16_t port, const std::string& scope )
+{
+    const uint16_t base = port != 0 ? port : default_port;
+    if( scope.empty() )
+    {
+        return base;
+    }
+    const uint64_t offset = 1 + Utils::hash64( scope ) % scoped_ports;
+    return static_cast<uint16_t>( std::min<uint64_t>( base + offset, UINT16_MAX ) );
+}
+
+ZyreTransport::ZyreTransport( const Discovery& discovery, zcert_t* certificate, bool verbose ) :
+    m_zcert( certificate ),
+    m_encrypted( certificate != nullptr ),
+    m_znode( zyre_new( nullptr ) ),
+    m_uuid( Utils::Uuid::fromHex( zyre_uuid( m_znode ) ).value_or( Utils::Uuid {} ) ),
+    m_interface( discovery.interface ),
+    m_multicast_port( discovery.multicast_port )
+{
+    if( verbose )
+    {
+        zyre_set_verbose( m_znode );
+        zyre_print( m_znode );
+    }
+    if( discovery.port != 0 || !discovery.scope.empty() )
+    {
+        const uint16_t port = beaconPort( discovery.port, discovery.scope );
+        CLIPD_LOG_DEBUG( "Beaconing for scope '" << discovery.scope << "' on port " << port );
+        zyre_set_port( m_znode, port );
+    }
+    if( discovery.beacon_interval.count() > 0 )
+    {
+        zyre_set_interval( m_znode, static_cast<size_t>( discovery.beacon_interval.count() ) );
+    }
+    if( discovery.evasive_timeout.count() > 0 )
+    {
+        zyre_set_evasive_timeout( m_znode, static_cast<int>( discovery.evasive_timeout.count() ) );
+    }
+    if( discovery.expired_timeout.count() > 0 )
+    {
+        zyre_set_expired_timeout( m_znode, static_cast<int>( discovery.expired_timeout.count() ) );
+    }
+    if( !discovery.interface.empty() )
+    {
+        zyre_set_interface( m_znode, discovery.interface.c_str() );
+    }
+    if( !discovery.endpoint.empty() &&
+        zyre_set_endpoint( m_znode, "%s", discovery.endpoint.c_str() ) != 0 )
+    {
+        CLIPD_LOG_ERROR( "Failed to listen for peers on " << discovery.endpoint );
+    }
+    if( !discovery.gossip_bind.empty() )
+    {
+        zyre_gossip_bind( m_znode, "%s", discovery.gossip_bind.c_str() );
+    }
+    if( !discovery.gossip_connect.empty() )
+    {
+        zyre_gossip_connect( m_znode, "%s", discovery.gossip_connect.c_str() );
+    }
+    if( m_zcert )
+    {
+        zyre_set_zcert( m_znode, m_zcert );
+    }
+}
+
+ZyreTransport::~ZyreTransport()
+{
+    stop();
+}
+
+void ZyreTransport::setHeader( const std::string& name, const std::string& value )
+{
+    zyre_set_header( m_znode, name.c_str(), "%s", value.c_str() );
+}
+
+void ZyreTransport::join( const std::string& group )
+{
+    zyre_join( m_znode, group.c_str() );
+}
+
+bool ZyreTransport::start()
+{
+    return zyre_start( m_znode ) == 0;
+}
+
+void ZyreTransport::stop()
+{
+    if( m_znode )
+    {
+        zyre_stop( m_znode );
+        zyre_destroy( &m_znode );
+        m_znode = nullptr;
+    }
+    zcert_destroy( &m_zcert );
+    for( const auto& multicast : m_multicast )
+    {
+        close( multicast.fd );
+    }
+    m_multicast.clear();
+}
+
+void ZyreTransport::shout( const std::string& group, const std::vector<Utils::Payload>& frames )
+{
+    zmsg_t* msg = Messages::toMessage( frames );
+    zyre_shout( m_znode, group.c_str(), &msg );
+}
+
+void ZyreTransport::whisper( const std::string& peer, const std::vector<Utils::Payload>& frames )
+{
+    zmsg_t* msg = Messages::toMessage( frames );
+    zyre_whisper( m_znode, peer.c_str(), &msg );
+}
+
+bool ZyreTransport::joinMulticast( const std::string& group )
+{
+    if( m_multicast_port == 0 )
+    {
+        return false;
+    }
+    constexpr uint32_t scope = ( 239U << 24U ) | ( 255U << 16U );
+    in_addr address = {};
+    address.s_addr = htonl( scope | static_cast<uint32_t>( Utils::hash64( group ) & 0xFFFFU ) );
+
+    const int fd = socket( AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if( fd < 0 )
+    {
+        CLIPD_LOG_ERROR( "Failed to create a multicast socket: " << std::strerror( errno ) );
+        return false;
+    }
+    // Every node on the host binds the same group and port.
+    const int reuse = 1;
+    sockaddr_in bound = {};
+    bound.sin_family = AF_INET;
+    bound.sin_port = htons( m_multicast_port );
+    bound.sin_addr = address;
+    ip_mreqn membership = {};
+    membership.imr_multiaddr = address;
+    membership.imr_ifindex =
+        m_interface.empty() ? 0 : static_cast<int>( if_nametoindex( m_interface.c_str() ) );
+    const unsigned char ttl = 1;
+    const unsigned char loop = 1;
+    if( setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) ) != 0 ||
+        setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof( reuse ) ) != 0 ||
+        bind( fd, reinterpret_cast<const sockaddr*>( &bound ), sizeof( bound ) ) != 0 ||
+        setsockopt( fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof( membership ) ) != 0 ||
+        setsockopt( fd, IPPROTO_IP, IP_MULTICAST_IF, &membership, sizeof( membership ) ) != 0 ||
+        setsockopt( fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof( ttl ) ) != 0 ||
+        setsockopt( fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof( loop ) ) != 0 )
+    {
+        CLIPD_LOG_ERROR( "Failed to join the multicast group for '"
+                         << group << "': " << std::strerror( errno ) );
+        close( fd );
+        return false;
+    }
+    m_multicast.push_back( MulticastGroup {group, fd, address.s_addr} );
+    return true;
+}
+
+void ZyreTransport::multicast( const std::string& group, const Utils::Payload& datagram )
+{
+    for( const auto& multicast : m_multicast )
+    {
+        if( multicast.group != group )
+        {
+            continue;
+        }
+        sockaddr_in to = {};
+        to.sin_family = AF_INET;
+        to.sin_port = htons( m_multicast_port );
+        to.sin_addr.s_addr = multicast.address;
+        // Datagrams may be lost anyway, so one the socket can't send right now is dropped.
+        if( sendto( multicast.fd, datagram.data(), datagram.size(), 0,
+                    reinterpret_cast<const sockaddr*>( &to ), sizeof( to ) ) < 0 )
+        {
+            CLIPD_LOG_DEBUG( "Failed to multicast to '" << group
+                                                        << "': " << std::strerror( errno ) );
+        }
+        return;
+    }
+}
+
+bool ZyreTransport::wait( std::chrono::milliseconds timeout, int wake_fd )
+{
+    m_poll_items.clear();
+    m_poll_items.push_back( {zsock_resolve( zyre_socket( m_znode ) ), 0, ZMQ_POLLIN, 0} );
+    m_poll_items.push_back( {nullptr, wake_fd, ZMQ_POLLIN, 0} );
+    for( const auto& multicast : m_multicast )
+    {
+        m_poll_items.push_back( {nullptr, multicast.fd, ZMQ_POLLIN, 0} );
+    }
+    return zmq_poll( m_poll_items.data(), static_cast<int>( m_poll_items.size() ),
+                     static_cast<long>( timeout.count() ) ) > 0;
+}
+
+size_t ZyreTransport::receive( const Handler& handler )
+{
+    size_t handled = 0;
+    while( zmsg_t* msg = zmsg_recv_nowait( zyre_socket( m_znode ) ) )
+    {
+        Event event;
+        if( parseMessage( msg, event ) )
+        {
+            handler( event );
+            ++handled;
+        }
+        zmsg_destroy( &msg );
+    }
+    for( const auto& multicast : m_multicast )
+    {
+        handled += receiveDatagrams( multicast.group, multicast.fd, handler );
+    }
+    return handled;
+}
+
+size_t ZyreTransport::receiveDatagrams( const std::string& group, int fd,
+                                        const Handler& handler )
+{
+    size_t handled = 0;
+    while( true )
+    {
+        // Peek at the datagram's size first, so that its buffer is exactly as large.
+        const ssize_t size = recv( fd, nullptr, 0, MSG_PEEK | MSG_TRUNC );
+        if( size < 0 )
+        {
+            break;
+        }
+        std::string buffer( static_cast<size_t>( size ), '\0' );
+        if( recv( fd, buffer.data(), buffer.size(), 0 ) != size )
+        {
+            break;
+        }
+        Event event;
+        event.type = Event::Type::Datagram;
+        event.group = group;
+        event.frames.emplace_back( std::move( buffer ) );
+        handler( event );
+        ++handled;
+    }
+    return handled;
+}
+
+bool ZyreTransport::parseMessage( zmsg_t* msg, Event& event )
+{
+    switch( Messages::parseMessageType( msg ) )
+    {
+        case Messages::MessageType::Enter:
+        {
+            Messages::Enter payload( msg );
+            CLIPD_LOG_DEBUG( payload );
+            event.type = Event::Type::Enter;
+            event.peer = std::move( payload.uuid );
+            event.name = std::move( payload.name );
+            event.address = std::move( payload.address );
+            event.headers = std::move( payload.headers );
+            return true;
+        }
+        case Messages::MessageType::Exit:
+        {
+            Messages::Exit payload( msg );
+            event.type = Event::Type::Exit;
+            event.peer = std::move( payload.uuid );
+            event.name = std::move( payload.name );
+            return true;
+        }
+        case Messages::MessageType::Evasive:
+        {
+            Messages::Evasive payload( msg );
+            event.type = Event::Type::Evasive;
+            event.peer = std::move( payload.uuid );
+            event.name = std::move( payload.name );
+            return true;
+        }
+        case Messages::MessageType::Join:
+        {
+            Messages::Join payload( msg );
+            event.type = Event::Type::Join;
+            event.peer = std::move( payload.uuid );
+            event.name = std::move( payload.name );
+            event.group = std::move( payload.groupname );
+            return true;
+        }
+        case Messages::MessageType::Leave:
+        {
+            Messages::Leave payload( msg );
+            event.type = Event::Type::Leave;
+            event.peer = std::move( payload.uuid );
+            event.name = std::move( payload.name );
+            event.group = std::move( payload.groupname );
+            return true;
+        }
+        case Messages::MessageType::Whisper:
+        {
+            Messages::Whisper payload( msg );
+            event.type = Event::Type::Whisper;
+            event.peer = std::move( payload.uuid );
+            event.name = std::move( payload.name );
+            event.frames = std::move( payload.frames );
+            return true;
+        }
+        case Messages::MessageType::Shout:
+        {
+            Messages::Shout payload( msg );
+            CLIPD_LOG_DEBUG( payload );
+            event.type = Event::Type::Shout;
+            event.peer = std::move( payload.uuid );
+            event.name = std::move( payload.name );
+            event.group = std::move( payload.groupname );
+            event.frames = std::move( payload.frames );
+            return true;
+        }
+        case Messages::MessageType::Unknown:
+        {
+            break;
+        }
+    }
+    return false;
+}
+} // namespace Clipd::Network
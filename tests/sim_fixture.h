@@ -0,0 +1,145 @@
+#pragma once
+#include "network/peer_discovery.h"
+#include "network/sim_network.h"
+#include "utils/hlc.h"
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace Clipd::Tests
+{
+//! @brief Contents that don't compress, so that every copy sent costs its full size.
+inline std::string incompressible( size_t size, uint64_t seed )
+{
+    std::mt19937_64 random( seed );
+    std::string contents( size, '\0' );
+    for( auto& c : contents )
+    {
+        c = static_cast<char>( random() );
+    }
+    return contents;
+}
+
+inline std::string incompressible( size_t size )
+{
+    return incompressible( size, size );
+}
+
+/**
+ * @brief Simulated clipd nodes, all in one session, recording the items each of them receives, and
+ * when.
+ *
+ * @details The nodes are named "node0", "node1", and so on, and are stepped by the SimNetwork. They
+ * haven't discovered each other until the network has run for a while, so most tests start with
+ * `m_network.runFor( 2s )`.
+ */
+class SimSession
+{
+public:
+    using Clock = Network::SimNetwork::Clock;
+
+    //! @brief How every node's daemon is configured.
+    struct Options
+    {
+        Network::Coalescer::Config coalescing;
+        Network::FanoutTree::Config fanout;
+        Network::LaneScheduler::Config lanes;
+        //! The secret to seal the session with, if any. @see PeerDiscoveryDaemon::setSessionSecret
+        std::vector<uint8_t> secret;
+    };
+
+    explicit SimSession( size_t count, const Network::SimNetwork::Config& network = {},
+                         const Options& options = {} ) :
+        m_network( network )
+    {
+        for( size_t i = 0; i < count; ++i )
+        {
+            add( options );
+        }
+    }
+
+    /**
+     * @brief Create a node in the given network's session, and let the network start, and step,
+     * it.
+     */
+    static std::unique_ptr<Network::PeerDiscoveryDaemon>
+    attach( Network::SimNetwork& network, const std::string& name, const Options& options = {} )
+    {
+        auto node = std::make_unique<Network::PeerDiscoveryDaemon>(
+            network.createTransport( name ), "session", options.coalescing, options.fanout,
+            options.lanes );
+        if( !options.secret.empty() )
+        {
+            node->setSessionSecret( options.secret );
+        }
+        network.attach( node->uuid(), Network::SimNetwork::Step(
+                                          node.get(), &Network::PeerDiscoveryDaemon::step ) );
+        return node;
+    }
+
+    //! @brief Add another node to the session, which records the items it receives.
+    Network::PeerDiscoveryDaemon& add( const Options& options = {} )
+    {
+        const size_t i = m_nodes.size();
+        m_nodes.push_back( attach( m_network, "node" + std::to_string( i ), options ) );
+        m_received.emplace_back();
+        m_received_at.emplace_back();
+        m_nodes.back()->registerOnRemoteClipboardUpdate(
+            Utils::Functor<void( const Clipboard::Item& )>( [this, i]( const Clipboard::Item& item ) {
+                m_received[i].push_back( item.contents.str() );
+                m_received_at[i][m_received[i].back()] = m_network.now();
+            } ) );
+        return *m_nodes.back();
+    }
+
+    //! @brief Copy the given contents on the given node, stamped now, or at the given time.
+    void copy( size_t node, const std::string& contents,
+               std::optional<Utils::HybridLogicalClock::Timestamp> stamped = std::nullopt )
+    {
+        m_copied[contents] = m_network.now();
+        m_nodes[node]->receiveLocalClipboardUpdate(
+            Clipboard::Item {{stamped.value_or( m_clock.now() ), m_nodes[node]->uuid()},
+                             Utils::Payload( std::string( contents ) )} );
+    }
+
+    //! @brief The number of nodes whose latest received item is the given contents.
+    [[nodiscard]] size_t converged( const std::string& contents ) const
+    {
+        size_t count = 0;
+        for( const auto& received : m_received )
+        {
+            count += !received.empty() && received.back() == contents ? 1U : 0U;
+        }
+        return count;
+    }
+
+    //! @brief How long the given contents took to reach the given node, since they were copied.
+    [[nodiscard]] std::optional<Clock::duration> delay( size_t node,
+                                                        const std::string& contents ) const
+    {
+        const auto received = m_received_at[node].find( contents );
+        const auto copied = m_copied.find( contents );
+        if( received == m_received_at[node].end() || copied == m_copied.end() )
+        {
+            return std::nullopt;
+        }
+        return received->second - copied->second;
+    }
+
+    Network::SimNetwork m_network;
+    std::vector<std::unique_ptr<Network::PeerDiscoveryDaemon>> m_nodes;
+    //! The items each node received, in the order it received them.
+    std::vector<std::vector<std::string>> m_received;
+    Utils::HybridLogicalClock m_clock;
+
+private:
+    //! When each node last received each item.
+    std::vector<std::map<std::string, Clock::time_point>> m_received_at;
+    //! When each item was last copied.
+    std::map<std::string, Clock::time_point> m_copied;
+};
+} // namespace Clipd::Tests
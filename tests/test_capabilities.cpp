@@ -0,0 +1,48 @@
+#include "network/capabilities.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd::Network;
+
+TEST( CapabilitiesTests, TestHeaderRoundTrip )
+{
+    Capabilities local = Capabilities::local();
+    local.multicast = true;
+    local.max_payload = 1000;
+    const Capabilities remote = Capabilities::fromHeaders( local.toHeaders() );
+
+    EXPECT_EQ( remote.protocol, local.protocol );
+    EXPECT_EQ( remote.codecs, local.codecs );
+    EXPECT_EQ( remote.max_payload, local.max_payload );
+    EXPECT_EQ( remote.chunking, local.chunking );
+    EXPECT_EQ( remote.lazy_pull, local.lazy_pull );
+    EXPECT_EQ( remote.fanout, local.fanout );
+    EXPECT_TRUE( remote.multicast );
+    EXPECT_TRUE( remote.timing );
+    EXPECT_EQ( remote.formats, local.formats );
+    EXPECT_TRUE( remote.supports( Codec::Deflate ) );
+}
+
+TEST( CapabilitiesTests, TestLegacyPeerDefaults )
+{
+    // Legacy peers don't advertise anything.
+    const Capabilities legacy = Capabilities::fromHeaders( {} );
+
+    EXPECT_EQ( legacy.protocol, 0 );
+    EXPECT_TRUE( legacy.supports( Codec::Raw ) );
+    EXPECT_FALSE( legacy.supports( Codec::Deflate ) );
+    EXPECT_FALSE( legacy.lazy_pull );
+    EXPECT_FALSE( legacy.fanout );
+    EXPECT_FALSE( legacy.timing );
+}
+
+TEST( CapabilitiesTests, TestIgnoresUnknownCodecs )
+{
+    const Capabilities remote = Capabilities::fromHeaders(
+        {{"X-CLIPD-PROTOCOL", "2"}, {"X-CLIPD-CODECS", "raw,zstd"}, {"X-CLIPD-LAZY-PULL", "yes"}} );
+
+    EXPECT_EQ( remote.protocol, 2 );
+    EXPECT_TRUE( remote.supports( Codec::Raw ) );
+    EXPECT_FALSE( remote.supports( Codec::Deflate ) );
+}
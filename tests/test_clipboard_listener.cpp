@@ -6,10 +6,13 @@
 #include <gtest/gtest.h>
 
 using namespace Clipd::Utils;
+using Clipd::Clipboard::Item;
 using namespace std::chrono_literals;
 
 using ::testing::AtLeast;
+using ::testing::Field;
 using ::testing::InSequence;
+using ::testing::Property;
 using ::testing::Return;
 using ::testing::StrictMock;
 
@@ -17,20 +20,22 @@ class MockClipboardDaemon : public Clipd::Clipboard::ClipboardDaemon
 {
 public:
     MOCK_METHOD( std::string, getClipboardTextContents, (), ( const, override ) );
-    MOCK_METHOD( void, TextUpdateCallback, (const std::string&));
+    MOCK_METHOD( void, TextUpdateCallback, (const Item&));
 };
 
 TEST( ClipboardListenerTests, TestUniqueCallbackCalls )
 {
     MockClipboardDaemon listener;
     listener.registerOnTextUpdate(
-        Functor<void( const std::string& )>( listener, &MockClipboardDaemon::TextUpdateCallback ) );
+        Functor<void( const Item& )>( listener, &MockClipboardDaemon::TextUpdateCallback ) );
 
     // Ensure that the clipboard listener will always return the constant value "v".
     ON_CALL( listener, getClipboardTextContents() ).WillByDefault( Return( "v" ) );
 
     EXPECT_CALL( listener, getClipboardTextContents() ).Times( AtLeast( 2 ) );
-    EXPECT_CALL( listener, TextUpdateCallback( "v" ) ).Times( 1 );
+    EXPECT_CALL( listener,
+                 TextUpdateCallback( Field( &Item::contents, Property( &Payload::view, "v" ) ) ) )
+        .Times( 1 );
 
     listener.start();
 
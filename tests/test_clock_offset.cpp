@@ -0,0 +1,40 @@
+#include "network/clock_offset.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd::Network;
+
+TEST( ClockOffsetTests, TestEstimatesOffsetFromFastestMessages )
+{
+    // Our clock is 5 ms ahead of the peer's, and the network takes at least 200 us each way.
+    constexpr int64_t offset = 5000;
+    const auto now = ClockOffset::Clock::now();
+
+    ClockOffset clock;
+    EXPECT_FALSE( clock.offset() );
+    for( const int64_t delay : {900, 200, 450} )
+    {
+        clock.sample( delay + offset, now );
+    }
+    EXPECT_EQ( clock.delay(), 200 + offset );
+    // We can't tell the offset from the delay until the peer reports its side.
+    EXPECT_FALSE( clock.offset() );
+
+    clock.report( 200 - offset );
+    EXPECT_EQ( clock.offset(), offset );
+}
+
+TEST( ClockOffsetTests, TestForgetsOldSamples )
+{
+    const auto now = ClockOffset::Clock::now();
+
+    ClockOffset clock;
+    clock.sample( 100, now );
+    clock.sample( 500, now + ClockOffset::window );
+    // The previous window is still remembered.
+    EXPECT_EQ( clock.delay(), 100 );
+
+    clock.sample( 700, now + 2 * ClockOffset::window );
+    EXPECT_EQ( clock.delay(), 500 );
+}
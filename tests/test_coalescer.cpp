@@ -0,0 +1,97 @@
+#include "network/coalescer.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd::Network;
+using namespace Clipd::Utils;
+using namespace std::chrono_literals;
+
+namespace
+{
+Clipd::Clipboard::Item item( std::string contents )
+{
+    return Clipd::Clipboard::Item {{}, Payload( std::move( contents ) )};
+}
+
+Coalescer::Config testConfig()
+{
+    Coalescer::Config config;
+    config.debounce = 100ms;
+    config.max_delay = 500ms;
+    return config;
+}
+} // namespace
+
+TEST( CoalescerTests, TestSingleUpdateIsNotDelayed )
+{
+    Coalescer coalescer( testConfig() );
+    const auto t0 = Coalescer::Clock::now();
+
+    auto released = coalescer.offer( item( "a" ), t0 );
+    ASSERT_TRUE( released );
+    EXPECT_EQ( released->contents, "a" );
+    EXPECT_FALSE( coalescer.deadline() );
+
+    // A second copy after a quiet period is also released immediately.
+    released = coalescer.offer( item( "b" ), t0 + 200ms );
+    ASSERT_TRUE( released );
+    EXPECT_EQ( released->contents, "b" );
+}
+
+TEST( CoalescerTests, TestBurstIsCoalescedLatestWins )
+{
+    Coalescer coalescer( testConfig() );
+    const auto t0 = Coalescer::Clock::now();
+
+    EXPECT_TRUE( coalescer.offer( item( "0" ), t0 ) );
+    for( int i = 1; i <= 5; ++i )
+    {
+        EXPECT_FALSE( coalescer.offer( item( std::to_string( i ) ), t0 + i * 10ms ) );
+    }
+
+    // Not due until the burst has been quiet for the debounce window.
+    EXPECT_FALSE( coalescer.poll( t0 + 100ms ) );
+    const auto released = coalescer.poll( t0 + 150ms );
+    ASSERT_TRUE( released );
+    EXPECT_EQ( released->contents, "5" );
+
+    EXPECT_EQ( coalescer.stats().offered, 6 );
+    EXPECT_EQ( coalescer.stats().released, 2 );
+    EXPECT_EQ( coalescer.stats().dropped, 4 );
+}
+
+TEST( CoalescerTests, TestMaxDelayBoundsContinuousBurst )
+{
+    Coalescer coalescer( testConfig() );
+    const auto t0 = Coalescer::Clock::now();
+
+    EXPECT_TRUE( coalescer.offer( item( "first" ), t0 ) );
+
+    // Updates every 50ms never leave a quiet debounce window, so only the max delay releases them.
+    std::optional<Clipd::Clipboard::Item> released;
+    auto t = t0;
+    for( int i = 1; !released; ++i )
+    {
+        t = t0 + i * 50ms;
+        coalescer.offer( item( std::to_string( i ) ), t );
+        released = coalescer.poll( t );
+    }
+
+    EXPECT_EQ( t - t0, 550ms );
+    EXPECT_EQ( released->contents, "11" );
+}
+
+TEST( CoalescerTests, TestZeroDebounceDisablesCoalescing )
+{
+    Coalescer::Config config;
+    config.debounce = 0ms;
+    Coalescer coalescer( config );
+    const auto t0 = Coalescer::Clock::now();
+
+    for( int i = 0; i < 10; ++i )
+    {
+        EXPECT_TRUE( coalescer.offer( item( std::to_string( i ) ), t0 ) );
+    }
+    EXPECT_EQ( coalescer.stats().dropped, 0 );
+}
@@ -0,0 +1,114 @@
+#include "network/command_queue.h"
+
+#include <poll.h>
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd::Network;
+using namespace Clipd::Utils;
+
+namespace
+{
+bool isReadable( int fd )
+{
+    pollfd item {fd, POLLIN, 0};
+    return poll( &item, 1, 0 ) == 1;
+}
+} // namespace
+
+TEST( CommandQueueTests, TestPostWakesConsumer )
+{
+    CommandQueue queue;
+    EXPECT_FALSE( isReadable( queue.fd() ) );
+
+    queue.post( Command {Command::Type::Shout, "session", {{}, Payload( std::string( "a" ) )}} );
+    queue.post( Command {Command::Type::Shout, "session", {{}, Payload( std::string( "b" ) )}} );
+    EXPECT_TRUE( isReadable( queue.fd() ) );
+
+    std::vector<std::string> drained;
+    queue.drain( [&drained]( const Command& c ) { drained.push_back( c.item.contents.str() ); } );
+
+    EXPECT_THAT( drained, ::testing::ElementsAre( "a", "b" ) );
+    EXPECT_FALSE( isReadable( queue.fd() ) );
+}
+
+TEST( CommandQueueTests, TestMultipleProducers )
+{
+    constexpr size_t num_producers = 4;
+    constexpr size_t num_commands = 10000;
+
+    CommandQueue queue;
+    std::vector<std::thread> producers;
+    for( size_t p = 0; p < num_producers; ++p )
+    {
+        producers.emplace_back( [&queue, p]() {
+            for( size_t i = 0; i < num_commands; ++i )
+            {
+                queue.post( Command {Command::Type::Whisper, std::to_string( p ),
+                                     {{}, Payload( std::to_string( i ) )}} );
+            }
+        } );
+    }
+
+    std::set<std::string> received;
+    std::vector<size_t> last( num_producers, 0 );
+    bool in_order = true;
+    while( received.size() < num_producers * num_commands )
+    {
+        pollfd item {queue.fd(), POLLIN, 0};
+        poll( &item, 1, 100 );
+        queue.drain( [&]( const Command& c ) {
+            const size_t p = std::stoul( c.target );
+            const size_t i = std::stoul( c.item.contents.str() );
+            // Commands from a single producer must be drained in the order they were posted.
+            in_order = in_order && ( i == 0 || i == last[p] + 1 );
+            last[p] = i;
+            received.insert( c.target + ":" + c.item.contents.str() );
+        } );
+    }
+
+    for( auto& producer : producers )
+    {
+        producer.join();
+    }
+    EXPECT_TRUE( in_order );
+    EXPECT_EQ( received.size(), num_producers * num_commands );
+}
+
+TEST( CommandQueueTests, TestNoCommandIsStranded )
+{
+    // The producer waits for each command to be handled before posting the next, so a command left
+    // in the queue without a wakeup stalls the consumer until its poll times out.
+    constexpr size_t num_commands = 20000;
+
+    CommandQueue queue;
+    std::atomic<size_t> handled = 0;
+    std::atomic<bool> stalled = false;
+    std::thread producer( [&]() {
+        for( size_t i = 0; i < num_commands && !stalled.load(); ++i )
+        {
+            queue.post( Command {Command::Type::Shout, "session", {}} );
+            while( handled.load() <= i && !stalled.load() )
+            {
+            }
+        }
+    } );
+
+    size_t stalls = 0;
+    while( handled.load() < num_commands && stalls < 10 )
+    {
+        pollfd item {queue.fd(), POLLIN, 0};
+        stalls += poll( &item, 1, 100 ) == 0 ? 1U : 0U;
+        handled += queue.drain( []( const Command& ) {} );
+    }
+    stalled = true;
+
+    producer.join();
+    EXPECT_EQ( stalls, 0 );
+}
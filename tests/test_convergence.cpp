@@ -0,0 +1,221 @@
+#include "clipboard/sync_state.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd::Clipboard;
+using namespace Clipd::Utils;
+
+namespace
+{
+/**
+ * @brief An in-memory session of peers, connected by a broadcast bus.
+ *
+ * @details Each node polls its clipboard and broadcasts whatever its SyncState reports as a new
+ * local copy, exactly like the ClipboardDaemon and PeerDiscoveryDaemon do. Several nodes may share
+ * one clipboard to model multiple clipd instances on a single host.
+ */
+class Session
+{
+public:
+    Session( size_t num_nodes, size_t num_clipboards ) : m_clipboards( num_clipboards )
+    {
+        for( size_t i = 0; i < num_nodes; ++i )
+        {
+            m_nodes.push_back(
+                Node {std::make_unique<SyncState>( Uuid::random() ), i % num_clipboards} );
+        }
+    }
+
+    //! @brief The user copies the given contents on the given node's host.
+    void copy( size_t node, const std::string& contents )
+    {
+        m_clipboards[m_nodes[node].clipboard] = contents;
+    }
+
+    //! @brief Poll one node's clipboard, like one iteration of ClipboardDaemon::loop().
+    void poll( size_t node )
+    {
+        if( auto item = m_nodes[node].sync->observeLocal(
+                std::string( m_clipboards[m_nodes[node].clipboard] ) ) )
+        {
+            ++m_broadcasts;
+            for( size_t other = 0; other < m_nodes.size(); ++other )
+            {
+                if( other != node )
+                {
+                    m_in_flight.push_back( Delivery {other, *item} );
+                }
+            }
+        }
+    }
+
+    //! @brief Deliver the oldest in-flight item, like PeerDiscoveryDaemon receiving a SHOUT.
+    void deliverOne()
+    {
+        const Delivery delivery = m_in_flight.front();
+        m_in_flight.pop_front();
+
+        const Node& node = m_nodes[delivery.node];
+        if( node.sync->receiveRemote( delivery.item ) )
+        {
+            m_clipboards[node.clipboard] = delivery.item.contents.str();
+        }
+    }
+
+    //! @brief Alternate polling every node and delivering everything until nothing changes.
+    void settle()
+    {
+        for( size_t round = 0; round < 100; ++round )
+        {
+            for( size_t node = 0; node < m_nodes.size(); ++node )
+            {
+                poll( node );
+            }
+            if( m_in_flight.empty() )
+            {
+                return;
+            }
+            while( !m_in_flight.empty() )
+            {
+                deliverOne();
+            }
+        }
+        FAIL() << "The session never settled";
+    }
+
+    [[nodiscard]] bool converged() const
+    {
+        return converged( m_clipboards.front() );
+    }
+
+    [[nodiscard]] bool converged( const std::string& expected ) const
+    {
+        const Version version = m_nodes.front().sync->current();
+        for( const auto& node : m_nodes )
+        {
+            if( node.sync->current() != version || m_clipboards[node.clipboard] != expected )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] const std::string& clipboard( size_t node ) const
+    {
+        return m_clipboards[m_nodes[node].clipboard];
+    }
+
+    [[nodiscard]] size_t broadcasts() const
+    {
+        return m_broadcasts;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return m_nodes.size();
+    }
+
+private:
+    struct Node
+    {
+        std::unique_ptr<SyncState> sync;
+        size_t clipboard;
+    };
+    struct Delivery
+    {
+        size_t node;
+        Item item;
+    };
+
+    std::vector<std::string> m_clipboards;
+    std::vector<Node> m_nodes;
+    std::deque<Delivery> m_in_flight;
+    size_t m_broadcasts = 0;
+};
+} // namespace
+
+TEST( ConvergenceTests, TestOneBroadcastPerCopy )
+{
+    for( size_t num_nodes : {2, 3, 5, 16} )
+    {
+        SCOPED_TRACE( "nodes: " + std::to_string( num_nodes ) );
+        Session session( num_nodes, num_nodes );
+        session.settle();
+        const size_t initial_broadcasts = session.broadcasts();
+
+        for( size_t copy = 0; copy < 20; ++copy )
+        {
+            const std::string contents = "copy " + std::to_string( copy );
+            session.copy( copy % num_nodes, contents );
+            session.settle();
+
+            EXPECT_TRUE( session.converged( contents ) );
+            EXPECT_EQ( session.broadcasts() - initial_broadcasts, copy + 1 );
+        }
+    }
+}
+
+TEST( ConvergenceTests, TestConcurrentCopiesConverge )
+{
+    Session session( 5, 5 );
+    session.settle();
+    const size_t initial_broadcasts = session.broadcasts();
+
+    // Every node copies something different before any of them hear about the others.
+    for( size_t node = 0; node < session.size(); ++node )
+    {
+        session.copy( node, "concurrent " + std::to_string( node ) );
+        session.poll( node );
+    }
+    session.settle();
+
+    // Whichever copy has the largest version wins everywhere, and nothing is re-broadcast.
+    EXPECT_TRUE( session.converged() );
+    EXPECT_THAT( session.clipboard( 0 ), ::testing::StartsWith( "concurrent" ) );
+    EXPECT_EQ( session.broadcasts() - initial_broadcasts, session.size() );
+}
+
+TEST( ConvergenceTests, TestSharedClipboardDoesNotPingPong )
+{
+    // Six nodes on three hosts, two clipd instances per host.
+    Session session( 6, 3 );
+    session.settle();
+    const size_t initial_broadcasts = session.broadcasts();
+
+    for( size_t copy = 0; copy < 10; ++copy )
+    {
+        const std::string contents = "shared " + std::to_string( copy );
+        session.copy( copy % session.size(), contents );
+        session.settle();
+
+        EXPECT_TRUE( session.converged( contents ) );
+    }
+    // Both instances on the copying host see the copy, but nothing is ever echoed back.
+    EXPECT_EQ( session.broadcasts() - initial_broadcasts, 2 * 10 );
+}
+
+TEST( ConvergenceTests, TestJoiningPeerAdoptsSessionItem )
+{
+    SyncState session_peer( Uuid::random() );
+    session_peer.observeLocal( "" );
+    const auto copied = session_peer.observeLocal( "session contents" );
+    ASSERT_TRUE( copied );
+
+    // A peer starting up later, with something else already on its clipboard.
+    SyncState joining_peer( Uuid::random() );
+    const auto startup = joining_peer.observeLocal( "stale contents" );
+    ASSERT_TRUE( startup );
+    EXPECT_LT( startup->version, copied->version );
+
+    // The session's item, caught up by digest and pull, replaces the startup contents...
+    EXPECT_TRUE( joining_peer.receiveRemote( *copied ) );
+    // ...but the startup contents never replace the session's item.
+    EXPECT_FALSE( session_peer.receiveRemote( *startup ) );
+}
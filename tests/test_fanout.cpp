@@ -0,0 +1,143 @@
+#include "sim_fixture.h"
+
+#include "network/fanout.h"
+#include "network/peer_discovery.h"
+#include "network/sim_network.h"
+#include "utils/metrics.h"
+
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd;
+using namespace Clipd::Network;
+using namespace std::chrono_literals;
+using Clipd::Tests::incompressible;
+
+namespace
+{
+std::vector<Utils::Uuid> randomUuids( size_t count )
+{
+    std::mt19937_64 random( 42 );
+    std::vector<Utils::Uuid> uuids;
+    for( size_t i = 0; i < count; ++i )
+    {
+        uuids.push_back( Utils::Uuid {random(), random()} );
+    }
+    return uuids;
+}
+
+/**
+ * @brief Simulated clipd nodes in one session, sending large items down a FanoutTree.
+ */
+class Session : public Tests::SimSession
+{
+public:
+    Session( size_t count, size_t degree ) : SimSession( count, {}, options( degree ) )
+    {
+        m_network.runFor( 2s );
+    }
+
+    [[nodiscard]] FanoutTree tree( size_t root, size_t degree ) const
+    {
+        std::vector<Utils::Uuid> members;
+        for( const auto& node : m_nodes )
+        {
+            members.push_back( node->uuid() );
+        }
+        return FanoutTree( members, m_nodes[root]->uuid(), degree );
+    }
+
+private:
+    static Options options( size_t degree )
+    {
+        Options options;
+        options.fanout.degree = degree;
+        return options;
+    }
+};
+} // namespace
+
+TEST( FanoutTests, TestTreeSpansEveryMemberOnce )
+{
+    const auto members = randomUuids( 40 );
+    const Utils::Uuid& root = members[17];
+    const FanoutTree tree( members, root, 3 );
+    ASSERT_EQ( tree.size(), 40 );
+    EXPECT_EQ( tree.depth( root ), 0 );
+
+    std::deque<Utils::Uuid> frontier = {root};
+    std::vector<Utils::Uuid> reached;
+    while( !frontier.empty() )
+    {
+        const Utils::Uuid parent = frontier.front();
+        frontier.pop_front();
+        reached.push_back( parent );
+        const auto children = tree.children( parent );
+        EXPECT_LE( children.size(), 3 );
+        for( const auto& child : children )
+        {
+            EXPECT_EQ( *tree.depth( child ), *tree.depth( parent ) + 1 );
+            frontier.push_back( child );
+        }
+    }
+    EXPECT_THAT( reached, testing::UnorderedElementsAreArray( members ) );
+    // A full 3-ary tree of 40 nodes has 1 + 3 + 9 + 27 of them.
+    EXPECT_EQ( *tree.depth( reached.back() ), 3 );
+}
+
+TEST( FanoutTests, TestNodesOutsideTheTreeHaveNoChildren )
+{
+    const auto members = randomUuids( 5 );
+    const FanoutTree tree( {members.begin(), members.begin() + 4}, members[0], 2 );
+    EXPECT_TRUE( tree.children( members[4] ).empty() );
+    EXPECT_FALSE( tree.depth( members[4] ) );
+}
+
+TEST( FanoutTests, TestOriginSendsOnlyToItsChildren )
+{
+    Session session( 30, 3 );
+    const std::string contents = incompressible( 256 * 1024 );
+    const uint64_t sent = session.m_network.bytesSent( session.m_nodes[0]->uuid() );
+    session.copy( 0, contents );
+    EXPECT_TRUE( session.m_network.runUntilIdle( 5s ) );
+
+    for( size_t i = 1; i < session.m_received.size(); ++i )
+    {
+        EXPECT_EQ( session.m_received[i].size(), 1 ) << i;
+        EXPECT_TRUE( !session.m_received[i].empty() && session.m_received[i].back() == contents )
+            << i;
+    }
+    // Three copies, and a small announcement to each peer, rather than 29 copies.
+    const uint64_t egress = session.m_network.bytesSent( session.m_nodes[0]->uuid() ) - sent;
+    EXPECT_GE( egress, 3 * contents.size() );
+    EXPECT_LT( egress, 4 * contents.size() );
+}
+
+TEST( FanoutTests, TestSubtreeOfSilencedParentIsRepaired )
+{
+    auto& repairs = Utils::Metrics::Registry::global().counter( "network.fanout.repairs" );
+    Session session( 20, 2 );
+    const auto tree = session.tree( 0, 2 );
+    const Utils::Uuid silenced = tree.children( session.m_nodes[0]->uuid() ).front();
+    session.m_network.silence( silenced );
+
+    const uint64_t repaired = repairs.value();
+    const std::string contents = incompressible( 128 * 1024 );
+    session.copy( 0, contents );
+    session.m_network.runFor( 3s );
+
+    size_t converged = 0;
+    for( size_t i = 1; i < session.m_nodes.size(); ++i )
+    {
+        const auto& received = session.m_received[i];
+        converged += received.size() == 1 && received.back() == contents ? 1U : 0U;
+    }
+    EXPECT_EQ( converged, session.m_nodes.size() - 2 );
+    // The silenced node's children pulled the item, and then forwarded it to their own.
+    EXPECT_EQ( repairs.value() - repaired, tree.children( silenced ).size() );
+}
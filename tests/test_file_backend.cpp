@@ -0,0 +1,69 @@
+#include "clipboard/file_backend.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd;
+using namespace Clipd::Clipboard;
+
+namespace
+{
+//! @brief A file path that's removed when the test ends.
+struct TempPath
+{
+    std::string path = "/tmp/clipd-test-" + std::to_string( getpid() ) + ".clipboard";
+
+    ~TempPath()
+    {
+        std::remove( path.c_str() );
+    }
+};
+} // namespace
+
+TEST( FileBackendTests, TestMissingFileIsEmpty )
+{
+    const TempPath file;
+    FileBackend backend( file.path );
+
+    EXPECT_EQ( backend.getText(), "" );
+}
+
+TEST( FileBackendTests, TestReadsWritesByOthers )
+{
+    const TempPath file;
+    FileBackend backend( file.path );
+
+    std::ofstream( file.path ) << "copied";
+    EXPECT_EQ( backend.getText(), "copied" );
+
+    std::ofstream( file.path ) << "copied again";
+    EXPECT_EQ( backend.getText(), "copied again" );
+}
+
+TEST( FileBackendTests, TestSetTextKeepsTheFilesMode )
+{
+    const TempPath file;
+    FileBackend backend( file.path );
+
+    backend.setText( Utils::Payload( std::string( "pasted" ) ) );
+    struct stat status = {};
+    ASSERT_EQ( ::stat( file.path.c_str(), &status ), 0 );
+    // A file the gateway creates is private to the gateway's user.
+    EXPECT_EQ( status.st_mode & 0777, 0600 );
+
+    ASSERT_EQ( ::chmod( file.path.c_str(), 0640 ), 0 );
+    backend.setText( Utils::Payload( std::string( "pasted again" ) ) );
+    ASSERT_EQ( ::stat( file.path.c_str(), &status ), 0 );
+    EXPECT_EQ( status.st_mode & 0777, 0640 );
+
+    std::ifstream in( file.path );
+    EXPECT_EQ( std::string( std::istreambuf_iterator<char>( in ), {} ), "pasted again" );
+    EXPECT_EQ( backend.getText(), "pasted again" );
+}
@@ -0,0 +1,169 @@
+#include "sim_fixture.h"
+
+#include "network/lanes.h"
+#include "network/peer_discovery.h"
+#include "network/sim_network.h"
+
+#include <optional>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace Clipd;
+using namespace Clipd::Network;
+using namespace std::chrono_literals;
+using Clipd::Tests::incompressible;
+
+namespace
+{
+Outgoing message( size_t cost )
+{
+    Outgoing outgoing;
+    outgoing.target = "group";
+    outgoing.cost = cost;
+    return outgoing;
+}
+
+/**
+ * @brief Two simulated nodes behind a 10 MB/s uplink, which record when they received each item.
+ */
+class Link : public Tests::SimSession
+{
+public:
+    explicit Link( const LaneScheduler::Config& lanes ) : SimSession( 2, config(), options( lanes ) )
+    {
+        m_network.runFor( 2s );
+    }
+
+    static SimNetwork::Config config()
+    {
+        SimNetwork::Config config;
+        config.bandwidth = 10e6;
+        return config;
+    }
+
+    static Options options( const LaneScheduler::Config& lanes )
+    {
+        Options options;
+        options.coalescing.debounce = 0ms;
+        options.lanes = lanes;
+        return options;
+    }
+
+    void copy( const std::string& contents )
+    {
+        SimSession::copy( 0, contents );
+    }
+
+    void wait( SimNetwork::Clock::duration duration )
+    {
+        m_network.runFor( duration );
+    }
+
+    //! @brief How long after they were copied the given contents are received.
+    std::optional<SimNetwork::Clock::duration> latency( const std::string& contents )
+    {
+        m_network.runFor( 2s );
+        return delay( 1, contents );
+    }
+};
+} // namespace
+
+TEST( LaneTests, TestControlHasStrictPriority )
+{
+    LaneScheduler lanes;
+    const auto now = LaneScheduler::Clock::now();
+    lanes.push( Lane::Bulk, message( 100 ) );
+    lanes.push( Lane::Interactive, message( 100 ) );
+    lanes.push( Lane::Control, message( 100 ) );
+    lanes.push( Lane::Control, message( 100 ) );
+
+    EXPECT_EQ( lanes.pop( now )->lane, Lane::Control );
+    EXPECT_EQ( lanes.pop( now )->lane, Lane::Control );
+    EXPECT_TRUE( lanes.pop( now ) );
+    EXPECT_TRUE( lanes.pop( now ) );
+    EXPECT_FALSE( lanes.pop( now ) );
+    EXPECT_FALSE( lanes.wait( now ) );
+}
+
+TEST( LaneTests, TestWeightedLanesShareByWeight )
+{
+    LaneScheduler::Config config;
+    config.chunk = 1000;
+    LaneScheduler lanes( config );
+    for( size_t i = 0; i < 100; ++i )
+    {
+        lanes.push( Lane::Interactive, message( 1000 ) );
+        lanes.push( Lane::Bulk, message( 1000 ) );
+    }
+
+    size_t interactive = 0;
+    const auto now = LaneScheduler::Clock::now();
+    for( size_t i = 0; i < 50; ++i )
+    {
+        interactive += lanes.pop( now )->lane == Lane::Interactive ? 1 : 0;
+    }
+    EXPECT_EQ( interactive, 40 );
+}
+
+TEST( LaneTests, TestPacedLanesWaitForTheUplink )
+{
+    LaneScheduler::Config config;
+    config.chunk = 1000;
+    config.rate = 1e6;
+    LaneScheduler lanes( config );
+    const auto now = LaneScheduler::Clock::now();
+    for( size_t i = 0; i < 20; ++i )
+    {
+        lanes.push( Lane::Bulk, message( 1000 ) );
+    }
+
+    // The bucket holds 5 ms of the uplink, and may be overdrawn by one message.
+    size_t sent = 0;
+    while( lanes.pop( now ) )
+    {
+        ++sent;
+    }
+    EXPECT_EQ( sent, 6 );
+    const auto wait = lanes.wait( now );
+    ASSERT_TRUE( wait );
+    EXPECT_EQ( *wait, std::chrono::milliseconds( 1 ) );
+    EXPECT_TRUE( lanes.pop( now + *wait ) );
+
+    // Control messages are never held back.
+    lanes.push( Lane::Control, message( 1000 ) );
+    EXPECT_EQ( lanes.pop( now + *wait )->lane, Lane::Control );
+}
+
+TEST( LaneTests, TestChunkedItemsReassemble )
+{
+    Link link( {} );
+    const std::string contents = incompressible( 300 * 1024 + 7 );
+    link.copy( contents );
+    EXPECT_TRUE( link.latency( contents ) );
+}
+
+TEST( LaneTests, TestSmallItemsOvertakePacedLargeOnes )
+{
+    LaneScheduler::Config paced;
+    paced.rate = Link::config().bandwidth;
+    const std::string large = incompressible( 2 * 1024 * 1024 );
+
+    // Without pacing, the large item fills the uplink, and the small one waits behind it. The
+    // large item is pulled after its digest, so the small one is copied once it's being sent.
+    Link unpaced_link( {} );
+    unpaced_link.copy( large );
+    unpaced_link.wait( 5ms );
+    unpaced_link.copy( "small" );
+    const auto unpaced = unpaced_link.latency( "small" );
+    ASSERT_TRUE( unpaced );
+    EXPECT_GT( *unpaced, 150ms );
+
+    Link paced_link( paced );
+    paced_link.copy( large );
+    paced_link.wait( 5ms );
+    paced_link.copy( "small" );
+    const auto overtaking = paced_link.latency( "small" );
+    ASSERT_TRUE( overtaking );
+    EXPECT_LT( *overtaking, 30ms );
+}
@@ -0,0 +1,100 @@
+#include "clipboard/clipboard_daemon.h"
+#include "clipboard/load_generator.h"
+#include "clipboard/memory_backend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd;
+using namespace Clipd::Clipboard;
+using namespace std::chrono_literals;
+
+TEST( LoadGeneratorTests, TestParseSpecification )
+{
+    const auto config = LoadGenerator::Config::parse(
+        "rate=20,burst=5,sizes=64:4096,duplicates=0.25,count=7,seed=3" );
+    ASSERT_TRUE( config );
+    EXPECT_DOUBLE_EQ( config->rate, 20.0 );
+    EXPECT_EQ( config->burst, 5 );
+    EXPECT_THAT( config->sizes, testing::ElementsAre( 64, 4096 ) );
+    EXPECT_DOUBLE_EQ( config->duplicates, 0.25 );
+    EXPECT_EQ( config->count, 7 );
+    EXPECT_EQ( config->seed, 3 );
+
+    EXPECT_TRUE( LoadGenerator::Config::parse( "" ) );
+    EXPECT_FALSE( LoadGenerator::Config::parse( "rate=0" ) );
+    EXPECT_FALSE( LoadGenerator::Config::parse( "burst=-1" ) );
+    EXPECT_FALSE( LoadGenerator::Config::parse( "sizes=64:big" ) );
+    EXPECT_FALSE( LoadGenerator::Config::parse( "duplicates=2" ) );
+    EXPECT_FALSE( LoadGenerator::Config::parse( "colour=blue" ) );
+    EXPECT_FALSE( LoadGenerator::Config::parse( "rate" ) );
+}
+
+TEST( LoadGeneratorTests, TestGeneratedContents )
+{
+    LoadGenerator::Config config;
+    config.sizes = {16, 1000};
+    config.seed = 1;
+    LoadGenerator unique( config, std::make_shared<MemoryBackend>() );
+
+    std::set<std::string> seen;
+    for( int i = 0; i < 100; ++i )
+    {
+        const std::string contents = unique.next();
+        EXPECT_THAT( contents.size(), testing::AnyOf( 16, 1000 ) );
+        EXPECT_TRUE( seen.insert( contents ).second );
+    }
+
+    config.duplicates = 1.0;
+    LoadGenerator duplicates( config, std::make_shared<MemoryBackend>() );
+    const std::string first = duplicates.next();
+    EXPECT_EQ( duplicates.next(), first );
+}
+
+TEST( LoadGeneratorTests, TestMemoryBackendDrivesClipboardDaemon )
+{
+    auto backend = std::make_shared<MemoryBackend>();
+    ClipboardDaemon daemon( Utils::Uuid::random(), backend );
+
+    std::mutex mutex;
+    std::condition_variable copied;
+    std::vector<std::string> captured;
+    daemon.registerOnTextUpdate( Utils::Functor<void( const Item& )>( [&]( const Item& item ) {
+        const std::lock_guard lock( mutex );
+        captured.push_back( item.contents.str() );
+        copied.notify_all();
+    } ) );
+    daemon.start();
+
+    // The memory backend wakes the clipboard thread as soon as it is written.
+    backend->setText( std::string( "copied" ) );
+    {
+        std::unique_lock lock( mutex );
+        EXPECT_TRUE( copied.wait_for( lock, 1s, [&] {
+            return std::find( captured.begin(), captured.end(), "copied" ) != captured.end();
+        } ) );
+    }
+
+    // A later physical time is newer than the copy, regardless of the logical counters.
+    std::this_thread::sleep_for( 5ms );
+    Utils::HybridLogicalClock clock;
+    daemon.receiveRemoteClipboardUpdate( Item {{clock.now(), Utils::Uuid::random()},
+                                               Utils::Payload( std::string( "pasted" ) )} );
+    // Remote items are applied by the clipboard thread, which they wake.
+    const auto deadline = std::chrono::steady_clock::now() + 1s;
+    while( backend->getText() != "pasted" && std::chrono::steady_clock::now() < deadline )
+    {
+        std::this_thread::sleep_for( 1ms );
+    }
+    EXPECT_EQ( backend->getText(), "pasted" );
+
+    daemon.stop();
+    daemon.join();
+}
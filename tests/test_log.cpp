@@ -0,0 +1,61 @@
+#include "utils/log.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Clipd::Utils;
+
+namespace
+{
+std::vector<std::string> drainLines( Log::Ring& ring )
+{
+    std::vector<std::string> lines;
+    ring.drain( [&lines]( const Log::Record& record ) {
+        lines.emplace_back( record.text.data(), record.length );
+    } );
+    return lines;
+}
+} // namespace
+
+TEST( LogTests, TestRingDropsWhenFull )
+{
+    Log::Ring ring( 4 );
+    for( int i = 0; i < 6; ++i )
+    {
+        Log::Line( ring, Log::Level::Info ).stream() << "line " << i;
+    }
+    EXPECT_EQ( ring.dropped(), 2 );
+    EXPECT_THAT( drainLines( ring ),
+                 testing::ElementsAre( "line 0", "line 1", "line 2", "line 3" ) );
+
+    // Draining frees the slots for reuse.
+    Log::Line( ring, Log::Level::Info ).stream() << "line 6";
+    EXPECT_THAT( drainLines( ring ), testing::ElementsAre( "line 6" ) );
+}
+
+TEST( LogTests, TestLongLinesAreTruncated )
+{
+    Log::Ring ring( 2 );
+    Log::Line( ring, Log::Level::Info ).stream() << std::string( 2 * Log::Record::capacity, 'x' );
+
+    bool truncated = false;
+    size_t length = 0;
+    ring.drain( [&]( const Log::Record& record ) {
+        truncated = record.truncated;
+        length = record.length;
+    } );
+    EXPECT_TRUE( truncated );
+    EXPECT_EQ( length, Log::Record::capacity );
+}
+
+TEST( LogTests, TestPayloadPreview )
+{
+    std::stringstream ss;
+    ss << Log::preview( Payload( std::string( "short" ) ) ) << " "
+       << Log::preview( Payload( std::string( 100, 'a' ) ), 4 );
+    EXPECT_EQ( ss.str(), "\"short\" \"aaaa\"... (100 bytes)" );
+}
@@ -0,0 +1,149 @@
+#include "network/message.h"
+
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd::Network::Messages;
+using namespace Clipd::Utils;
+
+namespace
+{
+/**
+ * @brief Frames for a synthetic Zyre message.
+ *
+ * @details Each frame references its Payload, so a frame the parsers leak keeps its Payload's use
+ * count up after the message is destroyed.
+ */
+std::vector<Payload> frames( const std::vector<std::string>& contents )
+{
+    std::vector<Payload> payloads;
+    for( const auto& frame : contents )
+    {
+        payloads.emplace_back( std::string( frame ) );
+    }
+    return payloads;
+}
+
+//! @brief The ENTER headers frame, packed as zyre_set_header() headers are.
+Payload packedHeaders()
+{
+    zhash_t* hash = zhash_new();
+    zhash_autofree( hash );
+    zhash_insert( hash, "X-CLIPD-CAPS", const_cast<char*>( "v1" ) ); // NOLINT
+    zframe_t* packed = zhash_pack( hash );
+    zhash_destroy( &hash );
+    Payload headers( std::string( reinterpret_cast<char*>( zframe_data( packed ) ),
+                                  zframe_size( packed ) ) );
+    zframe_destroy( &packed );
+    return headers;
+}
+
+//! @brief Whether no frame references the payloads any more.
+bool released( const std::vector<Payload>& payloads )
+{
+    for( const auto& payload : payloads )
+    {
+        if( payload.use_count() != 1 )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+TEST( MessagesTests, TestEnterDestroysEveryFrame )
+{
+    auto payloads = frames( {"ENTER", "uuid", "name"} );
+    payloads.push_back( packedHeaders() );
+    payloads.emplace_back( std::string( "tcp://127.0.0.1:47001" ) );
+    zmsg_t* msg = toMessage( payloads );
+
+    EXPECT_EQ( parseMessageType( msg ), MessageType::Enter );
+    const Enter enter( msg );
+    zmsg_destroy( &msg );
+
+    EXPECT_EQ( enter.uuid, "uuid" );
+    EXPECT_EQ( enter.name, "name" );
+    EXPECT_THAT( enter.headers, ::testing::ElementsAre( ::testing::Pair( "X-CLIPD-CAPS", "v1" ) ) );
+    EXPECT_EQ( enter.address, "tcp://127.0.0.1:47001" );
+    EXPECT_TRUE( released( payloads ) );
+}
+
+TEST( MessagesTests, TestPeerEventsDestroyEveryFrame )
+{
+    const auto exit = frames( {"EXIT", "uuid", "name"} );
+    const auto evasive = frames( {"EVASIVE", "uuid", "name"} );
+    const auto join = frames( {"JOIN", "uuid", "name", "session"} );
+    const auto leave = frames( {"LEAVE", "uuid", "name", "session"} );
+
+    zmsg_t* msg = toMessage( exit );
+    EXPECT_EQ( parseMessageType( msg ), MessageType::Exit );
+    EXPECT_EQ( Exit( msg ).uuid, "uuid" );
+    zmsg_destroy( &msg );
+
+    msg = toMessage( evasive );
+    EXPECT_EQ( parseMessageType( msg ), MessageType::Evasive );
+    EXPECT_EQ( Evasive( msg ).name, "name" );
+    zmsg_destroy( &msg );
+
+    msg = toMessage( join );
+    EXPECT_EQ( parseMessageType( msg ), MessageType::Join );
+    EXPECT_EQ( Join( msg ).groupname, "session" );
+    zmsg_destroy( &msg );
+
+    msg = toMessage( leave );
+    EXPECT_EQ( parseMessageType( msg ), MessageType::Leave );
+    EXPECT_EQ( Leave( msg ).groupname, "session" );
+    zmsg_destroy( &msg );
+
+    EXPECT_TRUE( released( exit ) );
+    EXPECT_TRUE( released( evasive ) );
+    EXPECT_TRUE( released( join ) );
+    EXPECT_TRUE( released( leave ) );
+}
+
+TEST( MessagesTests, TestContentFramesLiveAsLongAsTheMessage )
+{
+    const auto whisper = frames( {"WHISPER", "uuid", "name", "header", "body"} );
+    const auto shout = frames( {"SHOUT", "uuid", "name", "session", "header", "body"} );
+
+    {
+        zmsg_t* msg = toMessage( whisper );
+        EXPECT_EQ( parseMessageType( msg ), MessageType::Whisper );
+        const Whisper parsed( msg );
+        zmsg_destroy( &msg );
+        EXPECT_THAT( parsed.frames, ::testing::ElementsAre( "header", "body" ) );
+        // The content frames are shared with the parsed message, not copied.
+        EXPECT_EQ( whisper[4].use_count(), 2 );
+        EXPECT_EQ( parsed.frames[1].data(), whisper[4].data() );
+    }
+    {
+        zmsg_t* msg = toMessage( shout );
+        EXPECT_EQ( parseMessageType( msg ), MessageType::Shout );
+        const Shout parsed( msg );
+        zmsg_destroy( &msg );
+        EXPECT_EQ( parsed.groupname, "session" );
+        EXPECT_THAT( parsed.frames, ::testing::ElementsAre( "header", "body" ) );
+    }
+
+    EXPECT_TRUE( released( whisper ) );
+    EXPECT_TRUE( released( shout ) );
+}
+
+TEST( MessagesTests, TestTruncatedMessagesDontLeak )
+{
+    // A message cut short leaves the rest of the fields empty.
+    const auto truncated = frames( {"JOIN", "uuid"} );
+    zmsg_t* msg = toMessage( truncated );
+    EXPECT_EQ( parseMessageType( msg ), MessageType::Join );
+    const Join join( msg );
+    zmsg_destroy( &msg );
+
+    EXPECT_EQ( join.uuid, "uuid" );
+    EXPECT_TRUE( join.groupname.empty() );
+    EXPECT_TRUE( released( truncated ) );
+}
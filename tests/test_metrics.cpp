@@ -0,0 +1,90 @@
+#include "utils/metrics.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace Clipd::Utils::Metrics;
+
+TEST( MetricsTests, TestCounterSumsAcrossThreads )
+{
+    Counter counter;
+    std::vector<std::thread> threads;
+    for( int t = 0; t < 4; ++t )
+    {
+        threads.emplace_back( [&counter]() {
+            for( int i = 0; i < 10000; ++i )
+            {
+                counter.add();
+            }
+        } );
+    }
+    for( auto& thread : threads )
+    {
+        thread.join();
+    }
+    EXPECT_EQ( counter.value(), 40000 );
+}
+
+TEST( MetricsTests, TestHistogramPercentiles )
+{
+    Histogram histogram;
+    for( uint64_t i = 1; i <= 1000; ++i )
+    {
+        histogram.record( i * 1000 );
+    }
+
+    EXPECT_EQ( histogram.count(), 1000 );
+    EXPECT_EQ( histogram.max(), 1000000 );
+    // Every bucket is within 1/16th of the values it holds.
+    EXPECT_NEAR( histogram.percentile( 0.5 ), 500000, 500000 / 16 );
+    EXPECT_NEAR( histogram.percentile( 0.99 ), 990000, 990000 / 16 );
+    EXPECT_EQ( histogram.percentile( 1.0 ), 1000000 );
+}
+
+TEST( MetricsTests, TestHistogramBucketsCoverEveryValue )
+{
+    for( const uint64_t value : {uint64_t( 0 ), uint64_t( 31 ), uint64_t( 32 ), uint64_t( 12345 ),
+                                 ~uint64_t( 0 )} )
+    {
+        const size_t index = Histogram::bucketIndex( value );
+        ASSERT_LT( index, Histogram::bucket_count );
+        EXPECT_GE( Histogram::bucketUpperBound( index ), value );
+        if( index > 0 )
+        {
+            EXPECT_LT( Histogram::bucketUpperBound( index - 1 ), value );
+        }
+    }
+}
+
+TEST( MetricsTests, TestSnapshot )
+{
+    Registry registry;
+    registry.counter( labelled( "bytes", "peer", "A" ) ).add( 3 );
+    EXPECT_EQ( &registry.counter( "bytes{peer=A}" ), &registry.counter( "bytes{peer=A}" ) );
+    registry.gauge( "depth" ).add( -2 );
+    registry.histogram( "latency_ns" ).record( 7 );
+
+    std::stringstream json;
+    registry.snapshot().writeJson( json );
+    EXPECT_EQ( json.str(), "{\"counters\":{\"bytes{peer=A}\":3},\"gauges\":{\"depth\":-2},"
+                           "\"histograms\":{\"latency_ns\":{\"count\":1,\"sum\":7,\"max\":7,"
+                           "\"p50\":7,\"p90\":7,\"p99\":7,\"p999\":7}}}" );
+}
+
+TEST( MetricsTests, TestAcquiredCountersAreDestroyedOnceReleased )
+{
+    Registry registry;
+    auto& counter = registry.acquire( "bytes{peer=A}" );
+    EXPECT_EQ( &registry.acquire( "bytes{peer=A}" ), &counter );
+    counter.add( 3 );
+
+    registry.release( "bytes{peer=A}" );
+    EXPECT_EQ( registry.snapshot().counters.at( "bytes{peer=A}" ), 3 );
+    registry.release( "bytes{peer=A}" );
+    EXPECT_EQ( registry.snapshot().counters.count( "bytes{peer=A}" ), 0 );
+    registry.release( "bytes{peer=A}" );
+}
@@ -0,0 +1,84 @@
+#include "utils/payload.h"
+
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd::Utils;
+using Clipd::Utils::Metrics::Registry;
+
+TEST( PayloadTests, TestMoveFromStringDoesNotCopy )
+{
+    std::string contents( 4096, 'x' );
+    const char* original = contents.data();
+
+    const Payload payload( std::move( contents ) );
+
+    EXPECT_EQ( payload.data(), original );
+    EXPECT_EQ( payload.size(), 4096 );
+}
+
+TEST( PayloadTests, TestCopiesShareStorage )
+{
+    const Payload payload( std::string( "clipboard" ) );
+    const Payload copy = payload; // NOLINT
+
+    EXPECT_EQ( copy.data(), payload.data() );
+    EXPECT_EQ( payload.use_count(), 2 );
+    EXPECT_EQ( copy, "clipboard" );
+}
+
+TEST( PayloadTests, TestOwnerReleasedWithLastReference )
+{
+    static const char buffer[] = "frame";
+    bool released = false;
+
+    {
+        Payload outer;
+        {
+            const Payload inner( buffer, sizeof( buffer ) - 1,
+                                 std::shared_ptr<const void>(
+                                     buffer, [&released]( const void* ) { released = true; } ) );
+            outer = inner;
+        }
+        EXPECT_FALSE( released );
+        EXPECT_EQ( outer, "frame" );
+    }
+    EXPECT_TRUE( released );
+}
+
+TEST( PayloadTests, TestEmptyPayload )
+{
+    const Payload payload;
+
+    EXPECT_TRUE( payload.empty() );
+    EXPECT_EQ( payload.view(), "" );
+    EXPECT_EQ( payload.use_count(), 0 );
+}
+
+TEST( PayloadTests, TestSliceSharesStorage )
+{
+    const Payload payload( std::string( "clipboard" ) );
+    const Payload slice = payload.slice( 4, 3 );
+
+    EXPECT_EQ( slice, "boa" );
+    EXPECT_EQ( slice.data(), payload.data() + 4 );
+    EXPECT_EQ( payload.use_count(), 2 );
+    EXPECT_EQ( payload.slice( 6, 100 ), "ard" );
+    EXPECT_TRUE( payload.slice( 100, 1 ).empty() );
+}
+
+TEST( PayloadTests, TestOnlyStrCountsCopies )
+{
+    const auto& copied = Registry::global().counter( "payload.bytes_copied" );
+    const Payload payload( std::string( "clipboard" ) );
+    const uint64_t before = copied.value();
+
+    const Payload copy = payload; // NOLINT
+    EXPECT_EQ( copy.slice( 4, 3 ), "boa" );
+    EXPECT_EQ( copied.value(), before );
+
+    EXPECT_EQ( payload.str(), "clipboard" );
+    EXPECT_EQ( copied.value(), before + 9 );
+}
@@ -0,0 +1,61 @@
+#include "network/peer_table.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd::Network;
+using namespace Clipd::Utils;
+
+TEST( PeerTableTests, TestMembershipEvents )
+{
+    PeerTable table;
+    const auto now = PeerTable::Clock::now();
+    const Uuid alice = Uuid::random();
+    const Uuid bob = Uuid::random();
+
+    table.enter( alice, "alice", "tcp://10.0.0.1:49152", now );
+    table.enter( bob, "bob", "tcp://10.0.0.2:49152", now );
+    table.join( alice, "GLOBAL", now );
+    table.join( alice, "session", now );
+    table.join( bob, "GLOBAL", now );
+    ASSERT_EQ( table.size(), 2 );
+
+    const Peer* peer = table.find( alice );
+    ASSERT_NE( peer, nullptr );
+    EXPECT_EQ( peer->name, "alice" );
+    EXPECT_EQ( peer->address, "tcp://10.0.0.1:49152" );
+    EXPECT_TRUE( peer->inGroup( "session" ) );
+    EXPECT_FALSE( table.find( bob )->inGroup( "session" ) );
+    EXPECT_EQ( table.members( "GLOBAL" ), 2 );
+    EXPECT_EQ( table.members( "session" ), 1 );
+
+    table.leave( alice, "session", now );
+    EXPECT_FALSE( table.find( alice )->inGroup( "session" ) );
+    EXPECT_TRUE( table.find( alice )->inGroup( "GLOBAL" ) );
+    EXPECT_EQ( table.members( "session" ), 0 );
+
+    table.evasive( bob );
+    EXPECT_TRUE( table.find( bob )->evasive );
+    table.touch( bob, now + std::chrono::seconds( 1 ) );
+    EXPECT_FALSE( table.find( bob )->evasive );
+    EXPECT_EQ( table.find( bob )->last_seen, now + std::chrono::seconds( 1 ) );
+
+    table.exit( bob );
+    EXPECT_EQ( table.find( bob ), nullptr );
+    EXPECT_EQ( table.size(), 1 );
+    EXPECT_EQ( table.members( "GLOBAL" ), 1 );
+}
+
+TEST( PeerTableTests, TestPointersSurviveInsertion )
+{
+    PeerTable table;
+    const auto now = PeerTable::Clock::now();
+    const Uuid first = Uuid::random();
+    const Peer* peer = &table.enter( first, "first", "", now );
+
+    for( int i = 0; i < 1000; ++i )
+    {
+        table.enter( Uuid::random(), "other", "", now );
+    }
+    EXPECT_EQ( table.find( first ), peer );
+}
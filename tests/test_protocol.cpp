@@ -0,0 +1,235 @@
+#include "network/protocol.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd;
+using namespace Clipd::Network;
+
+TEST( ProtocolTests, TestItemRoundTrip )
+{
+    Utils::HybridLogicalClock clock;
+    const Clipboard::Item item {{clock.now(), Utils::Uuid::random()},
+                                Utils::Payload( std::string( "contents" ) )};
+
+    const auto frames = Protocol::encodeItem( item );
+    ASSERT_EQ( frames.size(), 2 );
+    EXPECT_EQ( frames[0].size(), Protocol::header_size );
+    // The body shares the item's contents rather than copying them.
+    EXPECT_EQ( frames[1].data(), item.contents.data() );
+
+    const auto decoded = Protocol::decodeItem( frames );
+    ASSERT_TRUE( decoded );
+    EXPECT_EQ( decoded->version, item.version );
+    EXPECT_EQ( decoded->contents, "contents" );
+}
+
+TEST( ProtocolTests, TestDeflateRoundTrip )
+{
+    Utils::HybridLogicalClock clock;
+    const std::string contents( 4096, 'a' );
+    const Clipboard::Item item {{clock.now(), Utils::Uuid::random()},
+                                Utils::Payload( std::string( contents ) )};
+
+    const auto frames = Protocol::encodeItem( item, Codec::Deflate );
+    ASSERT_EQ( frames.size(), 2 );
+    EXPECT_LT( frames[1].size(), contents.size() );
+
+    const auto header = Protocol::decodeHeader( frames[0] );
+    ASSERT_TRUE( header );
+    EXPECT_EQ( header->codec, Codec::Deflate );
+    EXPECT_EQ( header->size, contents.size() );
+
+    const auto decoded = Protocol::decodeItem( frames );
+    ASSERT_TRUE( decoded );
+    EXPECT_EQ( decoded->contents, contents );
+}
+
+TEST( ProtocolTests, TestOversizedDeflatedItemsAreRejected )
+{
+    const Clipboard::Item item {{}, Utils::Payload( std::string( 4096, 'a' ) )};
+    auto frames = Protocol::encodeItem( item, Codec::Deflate );
+    EXPECT_FALSE( Protocol::decodeItem( frames, 4095 ) );
+    EXPECT_TRUE( Protocol::decodeItem( frames, 4096 ) );
+
+    // A forged size is rejected before a buffer that large is allocated.
+    auto header = Protocol::decodeHeader( frames[0] );
+    ASSERT_TRUE( header );
+    header->size = uint64_t( 1 ) << 62;
+    frames[0] = Protocol::encodeHeader( *header );
+    EXPECT_FALSE( Protocol::decodeItem( frames ) );
+    EXPECT_FALSE( decode( Codec::Deflate, frames[1], header->size ) );
+}
+
+TEST( ProtocolTests, TestIncompressibleItemsAreSentRaw )
+{
+    const Clipboard::Item item {{}, Utils::Payload( std::string( "short" ) )};
+
+    const auto frames = Protocol::encodeItem( item, Codec::Deflate );
+    const auto header = Protocol::decodeHeader( frames.front() );
+    ASSERT_TRUE( header );
+    EXPECT_EQ( header->codec, Codec::Raw );
+    EXPECT_EQ( frames[1].data(), item.contents.data() );
+}
+
+TEST( ProtocolTests, TestTimingRoundTrip )
+{
+    Protocol::Timing timing;
+    timing.sent_us = 1000;
+    timing.captured_us = 900;
+    timing.read_us = 40;
+    timing.hash_us = 2;
+    timing.delays = {{Utils::Uuid::random(), -250}, {Utils::Uuid::random(), 80}};
+
+    const auto decoded = Protocol::decodeTiming( Protocol::encodeTiming( timing ) );
+    ASSERT_TRUE( decoded );
+    EXPECT_EQ( decoded->sent_us, timing.sent_us );
+    EXPECT_EQ( decoded->captured_us, timing.captured_us );
+    EXPECT_EQ( decoded->read_us, timing.read_us );
+    EXPECT_EQ( decoded->hash_us, timing.hash_us );
+    EXPECT_EQ( decoded->delays, timing.delays );
+
+    // The timing frame follows the body, and isn't part of the item.
+    const Clipboard::Item item {{}, Utils::Payload( std::string( "contents" ) )};
+    auto frames = Protocol::encodeItem( item );
+    frames.push_back( Protocol::encodeTiming( timing ) );
+    const auto decoded_item = Protocol::decodeItem( frames );
+    ASSERT_TRUE( decoded_item );
+    EXPECT_EQ( decoded_item->contents, "contents" );
+    EXPECT_FALSE( Protocol::decodeTiming( frames[1] ) );
+}
+
+TEST( ProtocolTests, TestRejectsForeignFrames )
+{
+    // A message from a peer that doesn't speak the clipd protocol.
+    const std::vector<Utils::Payload> legacy = {Utils::Payload( std::string( "plain text" ) )};
+    EXPECT_FALSE( Protocol::decodeItem( legacy ) );
+
+    const std::vector<Utils::Payload> garbage = {Utils::Payload( std::string( 64, 'x' ) ),
+                                                 Utils::Payload( std::string( "body" ) )};
+    EXPECT_FALSE( Protocol::decodeItem( garbage ) );
+}
+
+TEST( ProtocolTests, TestCorruptedItemsAreRejected )
+{
+    const Clipboard::Item item {{}, Utils::Payload( std::string( "contents" ) )};
+    auto frames = Protocol::encodeItem( item, Codec::Raw );
+    ASSERT_TRUE( Protocol::decodeItem( frames ) );
+
+    frames[1] = Utils::Payload( std::string( "Contents" ) );
+    EXPECT_FALSE( Protocol::decodeItem( frames ) );
+}
+
+TEST( HybridLogicalClockTests, TestMonotonicAcrossSkew )
+{
+    Utils::HybridLogicalClock clock;
+    auto last = clock.now();
+    for( int i = 0; i < 1000; ++i )
+    {
+        const auto next = clock.now();
+        EXPECT_GT( next, last );
+        last = next;
+    }
+
+    // A remote peer whose clock is an hour ahead.
+    const auto remote =
+        last + ( uint64_t( 3600 * 1000 ) << Utils::HybridLogicalClock::logical_bits );
+    EXPECT_GT( clock.update( remote ), remote );
+    EXPECT_GT( clock.now(), remote );
+}
+
+TEST( ProtocolTests, TestWhisperedSessionRoundTrip )
+{
+    const Clipboard::Item item {{}, Utils::Payload( std::string( "contents" ) )};
+    auto frames = Protocol::encodeDigest( item );
+    auto header = Protocol::decodeHeader( frames.front() );
+    ASSERT_TRUE( header );
+    EXPECT_TRUE( header->session.empty() );
+    EXPECT_EQ( header->fanout, 0 );
+
+    header->session = "alice";
+    header->fanout = 3;
+    const auto tagged = Protocol::decodeHeader( Protocol::encodeHeader( *header ) );
+    ASSERT_TRUE( tagged );
+    EXPECT_EQ( tagged->session, "alice" );
+    EXPECT_EQ( tagged->fanout, 3 );
+    EXPECT_EQ( tagged->kind, Protocol::Kind::Digest );
+    EXPECT_EQ( tagged->digest, header->digest );
+}
+
+TEST( ProtocolTests, TestSealedItemsArentDecoded )
+{
+    const Clipboard::Item item {{}, Utils::Payload( std::string( 4096, 'a' ) )};
+    auto frames = Protocol::encodeItem( item, Codec::Deflate );
+    auto header = Protocol::decodeHeader( frames.front() );
+    ASSERT_TRUE( header );
+    EXPECT_FALSE( header->sealed );
+
+    header->sealed = true;
+    frames.front() = Protocol::encodeHeader( *header );
+    const auto sealed = Protocol::decodeHeader( frames.front() );
+    ASSERT_TRUE( sealed );
+    EXPECT_TRUE( sealed->sealed );
+    EXPECT_EQ( sealed->codec, Codec::Deflate );
+    // The body has to be opened first, and peers that can't open it drop it.
+    EXPECT_FALSE( Protocol::decodeItem( frames ) );
+}
+
+TEST( ProtocolTests, TestChunksCoverTheBodyInOrder )
+{
+    Utils::HybridLogicalClock clock;
+    const Clipboard::Item item {{clock.now(), Utils::Uuid::random()},
+                                Utils::Payload( std::string( 2500, 'c' ) )};
+    const auto frames = Protocol::encodeItem( item );
+    const auto chunks = Protocol::encodeChunks( frames, 1000 );
+    ASSERT_EQ( chunks.size(), 3 );
+
+    uint64_t offset = 0;
+    for( const auto& chunk : chunks )
+    {
+        ASSERT_EQ( chunk.size(), 3 );
+        const auto header = Protocol::decodeHeader( chunk[0] );
+        ASSERT_TRUE( header );
+        EXPECT_EQ( header->kind, Protocol::Kind::Chunk );
+        EXPECT_EQ( header->version, item.version );
+        const auto position = Protocol::decodeChunk( chunk[1] );
+        ASSERT_TRUE( position );
+        EXPECT_EQ( position->offset, offset );
+        EXPECT_EQ( position->total, 2500 );
+        // The pieces share the body rather than copying it.
+        EXPECT_EQ( chunk[2].data(), frames[1].data() + offset );
+        offset += chunk[2].size();
+    }
+    EXPECT_EQ( offset, 2500 );
+    EXPECT_TRUE( Protocol::encodeChunks( Protocol::encodeDigest( item ), 1000 ).empty() );
+}
+
+TEST( ProtocolTests, TestDatagramRoundTrip )
+{
+    Protocol::Datagram datagram;
+    datagram.sender = Utils::Uuid::random();
+    datagram.group = 42;
+    datagram.sequence = 7;
+    datagram.frames = {Utils::Payload( std::string( "header" ) ),
+                       Utils::Payload( std::string( "contents" ) )};
+    const auto encoded = Protocol::encodeDatagram( datagram );
+    EXPECT_EQ( encoded.size(), Protocol::datagramSize( datagram.frames ) );
+
+    const auto decoded = Protocol::decodeDatagram( encoded );
+    ASSERT_TRUE( decoded );
+    EXPECT_EQ( decoded->sender, datagram.sender );
+    EXPECT_EQ( decoded->group, 42 );
+    EXPECT_EQ( decoded->sequence, 7 );
+    ASSERT_EQ( decoded->frames.size(), 2 );
+    EXPECT_EQ( decoded->frames[1].str(), "contents" );
+    // A truncated datagram, or one that isn't clipd's, is ignored.
+    EXPECT_FALSE( Protocol::decodeDatagram( encoded.slice( 0, encoded.size() - 1 ) ) );
+    EXPECT_FALSE( Protocol::decodeDatagram( Utils::Payload( std::string( 40, 'x' ) ) ) );
+
+    const auto nack = Protocol::encodeNack( Protocol::Nack {3, 5} );
+    ASSERT_EQ( nack.size(), 2 );
+    const auto range = Protocol::decodeNack( nack[1] );
+    ASSERT_TRUE( range );
+    EXPECT_EQ( range->first, 3 );
+    EXPECT_EQ( range->last, 5 );
+}
@@ -0,0 +1,196 @@
+#include "network/capabilities.h"
+#include "network/peer_discovery.h"
+#include "network/protocol.h"
+#include "network/recording.h"
+#include "utils/hlc.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd;
+using namespace Clipd::Network;
+
+namespace
+{
+/**
+ * @brief A peer copying to, and shouting at, a recorded node.
+ */
+struct RecordedPeer
+{
+    Utils::Uuid uuid = Utils::Uuid::random();
+    Utils::HybridLogicalClock clock;
+
+    [[nodiscard]] Event enter() const
+    {
+        Event event;
+        event.type = Event::Type::Enter;
+        event.peer = uuid.hex();
+        event.name = "peer";
+        event.address = "tcp://10.0.0.2:5670";
+        event.headers = Capabilities::local().toHeaders();
+        return event;
+    }
+
+    [[nodiscard]] Event join( const std::string& group ) const
+    {
+        Event event;
+        event.type = Event::Type::Join;
+        event.peer = uuid.hex();
+        event.group = group;
+        return event;
+    }
+
+    //! @brief Shout the given contents, deflated, to the given session's protocol group.
+    Event shout( const std::string& session, const std::string& contents )
+    {
+        Event event;
+        event.type = Event::Type::Shout;
+        event.peer = uuid.hex();
+        event.group = Protocol::sessionGroup( session );
+        event.frames = Protocol::encodeItem(
+            Clipboard::Item {{clock.now(), uuid}, Utils::Payload( std::string( contents ) )},
+            Codec::Deflate );
+        Protocol::Timing timing;
+        timing.sent_us = 1234;
+        event.frames.push_back( Protocol::encodeTiming( timing ) );
+        return event;
+    }
+};
+
+std::string record( RecordedContents contents, RecordedPeer& peer,
+                    const std::vector<std::string>& copies )
+{
+    std::ostringstream out;
+    Recorder recorder( out, Utils::Uuid {1, 2}, "session", contents );
+    recorder.recordEvent( peer.enter() );
+    recorder.recordEvent( peer.join( Protocol::sessionGroup( "session" ) ) );
+    for( const auto& copy : copies )
+    {
+        recorder.recordLocal( Clipboard::Item {{}, Utils::Payload( std::string( copy ) )} );
+        recorder.recordEvent( peer.shout( "session", copy ) );
+    }
+    recorder.flush();
+    return out.str();
+}
+} // namespace
+
+TEST( RecordingTests, TestFullRecordingRoundTrip )
+{
+    RecordedPeer peer;
+    const std::string secret( 4096, 's' );
+    const std::string data = record( RecordedContents::Full, peer, {secret} );
+    EXPECT_NE( data.find( "session" ), std::string::npos );
+
+    std::istringstream in( data );
+    const auto recording = Recording::read( in );
+    ASSERT_TRUE( recording );
+    EXPECT_EQ( recording->node, ( Utils::Uuid {1, 2} ) );
+    EXPECT_EQ( recording->session, "session" );
+    ASSERT_EQ( recording->records.size(), 4 );
+
+    const Event& enter = recording->records[0].event;
+    EXPECT_EQ( enter.type, Event::Type::Enter );
+    EXPECT_EQ( enter.peer, peer.uuid.hex() );
+    EXPECT_EQ( enter.address, "tcp://10.0.0.2:5670" );
+    EXPECT_EQ( enter.headers, Capabilities::local().toHeaders() );
+    EXPECT_EQ( recording->records[1].event.group, Protocol::sessionGroup( "session" ) );
+
+    EXPECT_EQ( recording->records[2].kind, Record::Kind::Local );
+    EXPECT_EQ( recording->records[2].contents, secret );
+    const auto item = Protocol::decodeItem( recording->records[3].event.frames );
+    ASSERT_TRUE( item );
+    EXPECT_EQ( item->contents, secret );
+    for( size_t i = 1; i < recording->records.size(); ++i )
+    {
+        EXPECT_GE( recording->records[i].time, recording->records[i - 1].time );
+    }
+}
+
+TEST( RecordingTests, TestHashedContentsKeepDuplicates )
+{
+    RecordedPeer peer;
+    const std::string secret( 4096, 's' );
+    const std::string other( 100, 'o' );
+    const std::string data = record( RecordedContents::Hashed, peer, {secret, other, secret} );
+    EXPECT_EQ( data.find( "sssssssssssssssss" ), std::string::npos );
+    // Deflated contents are redacted too, so they're hashed to a handful of bytes.
+    EXPECT_LT( data.size(), 1024 );
+
+    std::istringstream in( data );
+    const auto recording = Recording::read( in );
+    ASSERT_TRUE( recording );
+    ASSERT_EQ( recording->records.size(), 8 );
+    const auto& first = recording->records[2].contents;
+    EXPECT_EQ( first.size(), secret.size() );
+    EXPECT_NE( first, secret );
+    EXPECT_EQ( recording->records[4].contents.size(), other.size() );
+    EXPECT_EQ( recording->records[6].contents, first.view() );
+
+    // Received items are hashed by the digest of their contents, so replay the same contents as
+    // the local copy, with the recorded version, codec, and timing.
+    const auto& frames = recording->records[3].event.frames;
+    ASSERT_EQ( frames.size(), 3 );
+    const auto header = Protocol::decodeHeader( frames.front() );
+    ASSERT_TRUE( header );
+    EXPECT_EQ( header->codec, Codec::Deflate );
+    EXPECT_EQ( header->version.origin, peer.uuid );
+    const auto item = Protocol::decodeItem( frames );
+    ASSERT_TRUE( item );
+    EXPECT_EQ( item->contents, first.view() );
+    EXPECT_EQ( Protocol::decodeTiming( frames.back() )->sent_us, 1234 );
+}
+
+TEST( RecordingTests, TestTruncatedRecordingReadsCompleteRecords )
+{
+    RecordedPeer peer;
+    const std::string data = record( RecordedContents::Redacted, peer, {"one", "two"} );
+
+    std::istringstream in( data.substr( 0, data.size() - 1 ) );
+    const auto recording = Recording::read( in );
+    ASSERT_TRUE( recording );
+    EXPECT_EQ( recording->records.size(), 5 );
+    // Redacted copies are replayed as distinct contents of the same size.
+    EXPECT_EQ( recording->records[2].contents.size(), 3 );
+    EXPECT_NE( recording->records[2].contents, recording->records[4].contents.view() );
+
+    std::istringstream garbage( "not a recording" );
+    EXPECT_FALSE( Recording::read( garbage ) );
+}
+
+TEST( RecordingTests, TestReplayThroughDaemon )
+{
+    RecordedPeer peer;
+    std::istringstream in( record( RecordedContents::Full, peer, {"copied"} ) );
+    auto recording = Recording::read( in );
+    ASSERT_TRUE( recording );
+    // Replay an hour later, so the received item is versioned an hour later too.
+    const auto recorded = Protocol::decodeHeader( recording->records[3].event.frames.front() );
+    ASSERT_TRUE( recorded );
+    recording->retime( recording->started_us + 3600ULL * 1000 * 1000, 1 );
+
+    auto transport = std::make_unique<ReplayTransport>( recording->node );
+    auto& network = *transport;
+    PeerDiscoveryDaemon daemon( std::move( transport ), recording->session );
+    std::vector<Clipboard::Item> received;
+    daemon.registerOnRemoteClipboardUpdate( Utils::Functor<void( const Clipboard::Item& )>(
+        [&received]( const Clipboard::Item& item ) { received.push_back( item ); } ) );
+
+    for( const auto& replayed : recording->records )
+    {
+        if( replayed.kind == Record::Kind::Event )
+        {
+            network.inject( replayed.event );
+        }
+    }
+    daemon.step();
+    EXPECT_EQ( daemon.sessionPeers(), 1 );
+    ASSERT_EQ( received.size(), 1 );
+    EXPECT_EQ( received.front().contents, "copied" );
+    EXPECT_EQ( received.front().version.origin, peer.uuid );
+    EXPECT_EQ( received.front().version.timestamp,
+               recorded->version.timestamp + ( 3600ULL * 1000 << 16U ) );
+}
@@ -0,0 +1,136 @@
+#include "sim_fixture.h"
+
+#include "network/peer_discovery.h"
+#include "network/relay.h"
+#include "network/sim_network.h"
+#include "utils/hlc.h"
+#include "utils/metrics.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd;
+using namespace Clipd::Network;
+using namespace std::chrono_literals;
+
+namespace
+{
+/**
+ * @brief Subnets of simulated peers in one session, each on its own SimNetwork, so that they can
+ * only reach each other through gateways relaying to a shared gossip network.
+ */
+class Subnets
+{
+public:
+    Subnets( size_t subnets, size_t peers ) : m_gossip( seeded( 1000 ) )
+    {
+        for( size_t s = 0; s < subnets; ++s )
+        {
+            m_subnets.emplace_back( peers, seeded( s + 1 ) );
+            addGateway( s );
+        }
+    }
+
+    //! @brief Add another gateway to the given subnet.
+    void addGateway( size_t subnet )
+    {
+        m_gateways.push_back( Tests::SimSession::attach( m_subnets[subnet].m_network, "gateway" ) );
+        auto& local = *m_gateways.back();
+        m_gateways.push_back( Tests::SimSession::attach( m_gossip, "gossip" ) );
+        auto& remote = *m_gateways.back();
+        m_relays.push_back( std::make_unique<Relay>( local, remote,
+                                                     std::vector<std::string> {"session"} ) );
+    }
+
+    //! @brief Run every network for the given duration, in lockstep.
+    void runFor( SimNetwork::Clock::duration duration )
+    {
+        for( SimNetwork::Clock::duration elapsed {}; elapsed < duration; elapsed += 5ms )
+        {
+            m_gossip.runFor( 5ms );
+            for( auto& subnet : m_subnets )
+            {
+                subnet.m_network.runFor( 5ms );
+            }
+        }
+    }
+
+    void copy( size_t subnet, const std::string& contents )
+    {
+        // One clock for every subnet, so that items copied later are always newer.
+        m_subnets[subnet].copy( 0, contents, m_clock.now() );
+    }
+
+    SimNetwork m_gossip;
+    std::deque<Tests::SimSession> m_subnets; //!< A deque, so that the sessions never move.
+
+private:
+    static SimNetwork::Config seeded( uint64_t seed )
+    {
+        SimNetwork::Config config;
+        config.seed = seed;
+        return config;
+    }
+
+    std::vector<std::unique_ptr<PeerDiscoveryDaemon>> m_gateways;
+    std::vector<std::unique_ptr<Relay>> m_relays;
+    Utils::HybridLogicalClock m_clock;
+};
+} // namespace
+
+TEST( RelayTests, TestItemsCrossEachGatewayLinkOnce )
+{
+    Subnets subnets( 3, 4 );
+    subnets.runFor( 2s );
+
+    const uint64_t gossiped = subnets.m_gossip.stats().messages;
+    subnets.copy( 0, "contents" );
+    subnets.runFor( 500ms );
+
+    // The origin's gateway shouts once to each of the other two gateways, which shout to their
+    // own subnets, and nothing comes back.
+    EXPECT_EQ( subnets.m_gossip.stats().messages - gossiped, 2 );
+    for( size_t s = 0; s < subnets.m_subnets.size(); ++s )
+    {
+        const auto& received = subnets.m_subnets[s].m_received;
+        for( size_t i = s == 0 ? 1 : 0; i < received.size(); ++i )
+        {
+            EXPECT_THAT( received[i], testing::ElementsAre( "contents" ) ) << s << "/" << i;
+        }
+    }
+    EXPECT_TRUE( subnets.m_subnets[0].m_received[0].empty() );
+}
+
+TEST( RelayTests, TestSecondGatewayDoesNotLoop )
+{
+    auto& duplicates = Utils::Metrics::Registry::global().counter( "relay.duplicates" );
+    auto& received = Utils::Metrics::Registry::global().counter( "network.duplicates" );
+    Subnets subnets( 2, 2 );
+    subnets.addGateway( 1 );
+    subnets.runFor( 2s );
+
+    const uint64_t gossiped = subnets.m_gossip.stats().messages;
+    const uint64_t duplicated = duplicates.value();
+    const uint64_t received_twice = received.value();
+    subnets.copy( 0, "first" );
+    subnets.runFor( 500ms );
+    subnets.copy( 1, "second" );
+    subnets.runFor( 500ms );
+
+    // Both gateways on the second subnet relay the first item into it, and each stops the other's
+    // copy, rather than sending it back. Both also relay the second item to the gossip network,
+    // where every gateway stops the copy it received second: the first subnet's gateway before
+    // even decoding it, since it had already received the item, and the other two at the relay,
+    // since they had only sent it. The peers on the second subnet receive the first item from
+    // both of its gateways, and drop the second copy before decoding it.
+    EXPECT_EQ( subnets.m_gossip.stats().messages - gossiped, 2 + 4 );
+    EXPECT_EQ( duplicates.value() - duplicated, 2 + 2 );
+    EXPECT_EQ( received.value() - received_twice, 1 + 2 );
+    EXPECT_EQ( subnets.m_subnets[0].m_received[1].back(), "second" );
+    EXPECT_EQ( subnets.m_subnets[1].m_received[1].back(), "second" );
+}
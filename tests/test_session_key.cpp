@@ -0,0 +1,162 @@
+#include "sim_fixture.h"
+
+#include "network/peer_discovery.h"
+#include "network/protocol.h"
+#include "network/session_key.h"
+#include "network/sim_network.h"
+#include "utils/metrics.h"
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace Clipd;
+using namespace Clipd::Network;
+using namespace std::chrono_literals;
+
+namespace
+{
+const std::vector<uint8_t> secret( SessionKey::secret_size, 42 );
+
+std::vector<std::string> strings( const std::vector<Utils::Payload>& frames )
+{
+    std::vector<std::string> result;
+    for( const auto& frame : frames )
+    {
+        result.push_back( frame.str() );
+    }
+    return result;
+}
+} // namespace
+
+TEST( SessionKeyTests, TestSealedMessagesOpen )
+{
+    const auto key = SessionKey::derive( secret, "session" );
+    ASSERT_TRUE( key );
+    const std::vector<Utils::Payload> frames = {Utils::Payload( std::string( "header" ) ),
+                                                Utils::Payload( std::string() ),
+                                                Utils::Payload( std::string( 5000, 'x' ) )};
+    const auto sealed = key->seal( frames );
+    EXPECT_EQ( SessionKey::sealedWith( sealed ), key->id() );
+    EXPECT_EQ( sealed.view().find( "header" ), std::string_view::npos );
+
+    const auto opened = key->open( sealed );
+    ASSERT_TRUE( opened );
+    EXPECT_EQ( strings( *opened ), strings( frames ) );
+}
+
+TEST( SessionKeyTests, TestTamperedMessagesDontOpen )
+{
+    const auto key = SessionKey::derive( secret, "session" );
+    ASSERT_TRUE( key );
+    const std::string sealed = key->seal( {Utils::Payload( std::string( "contents" ) )} ).str();
+    for( size_t i = 12; i < sealed.size(); ++i )
+    {
+        std::string tampered = sealed;
+        tampered[i] = static_cast<char>( tampered[i] ^ 1 );
+        EXPECT_FALSE( key->open( Utils::Payload( std::move( tampered ) ) ) ) << i;
+    }
+    EXPECT_FALSE( key->open( Utils::Payload( sealed.substr( 0, sealed.size() - 1 ) ) ) );
+}
+
+TEST( SessionKeyTests, TestAssociatedDataIsAuthenticated )
+{
+    const auto key = SessionKey::derive( secret, "session" );
+    ASSERT_TRUE( key );
+    const auto sealed = key->seal( {Utils::Payload( std::string( "contents" ) )}, "sequence 1" );
+    EXPECT_TRUE( key->open( sealed, "sequence 1" ) );
+    EXPECT_FALSE( key->open( sealed, "sequence 2" ) );
+    EXPECT_FALSE( key->open( sealed ) );
+}
+
+TEST( SessionKeyTests, TestKeysDifferBySessionAndSecret )
+{
+    const auto key = SessionKey::derive( secret, "session" );
+    const auto other_session = SessionKey::derive( secret, "other" );
+    const auto other_secret =
+        SessionKey::derive( std::vector<uint8_t>( SessionKey::secret_size, 7 ), "session" );
+    ASSERT_TRUE( key && other_session && other_secret );
+    EXPECT_NE( key->id(), other_session->id() );
+    EXPECT_NE( key->id(), other_secret->id() );
+
+    const auto sealed = key->seal( {Utils::Payload( std::string( "contents" ) )} );
+    EXPECT_FALSE( other_session->open( sealed ) );
+    EXPECT_FALSE( other_secret->open( sealed ) );
+    EXPECT_FALSE( SessionKey::derive( {1, 2, 3}, "session" ) );
+}
+
+TEST( SessionKeyTests, TestOnlyPeersWithTheSecretReceiveSealedItems )
+{
+    auto& unsealed = Utils::Metrics::Registry::global().counter( "network.unsealed" );
+    // The last node isn't sealed, so it can neither read the session's items, nor send its own.
+    Tests::SimSession::Options sealed;
+    sealed.secret = secret;
+    Tests::SimSession sim( 0 );
+    sim.add( sealed );
+    sim.add( sealed );
+    sim.add();
+    sim.m_network.runFor( 2s );
+
+    const uint64_t dropped = unsealed.value();
+    sim.copy( 0, "sealed" );
+    sim.m_network.runFor( 1s );
+    sim.copy( 2, "unsealed" );
+    sim.m_network.runFor( 1s );
+
+    EXPECT_EQ( sim.m_received[1], std::vector<std::string> {"sealed"} );
+    EXPECT_TRUE( sim.m_received[2].empty() );
+    EXPECT_TRUE( sim.m_received[0].empty() );
+    EXPECT_GE( unsealed.value() - dropped, 2 );
+}
+
+TEST( SessionKeyTests, TestOnlyItemBodiesAreSealed )
+{
+    Tests::SimSession::Options sealed;
+    sealed.secret = secret;
+    Tests::SimSession sim( 2, {}, sealed );
+    // A peer without the secret, which records the headers of the items it's sent, and whether it
+    // could read their contents.
+    auto observer = sim.m_network.createTransport( "observer" );
+    observer->setHeader( "X-CLIPD-PROTOCOL", "1" );
+    observer->setHeader( "X-CLIPD-CHUNKING", "1" );
+    observer->join( "session" );
+    observer->join( Protocol::sessionGroup( "session" ) );
+    std::vector<Protocol::Header> headers;
+    bool leaked = false;
+    auto observe = [&observer, &headers, &leaked]() -> std::optional<SimNetwork::Clock::duration> {
+        observer->receive( Transport::Handler( [&headers, &leaked]( const Event& event ) {
+            const auto header = event.frames.empty() ? std::nullopt
+                                                     : Protocol::decodeHeader( event.frames[0] );
+            if( header && header->kind != Protocol::Kind::Digest )
+            {
+                headers.push_back( *header );
+            }
+            for( const auto& frame : event.frames )
+            {
+                leaked = leaked || frame.view().find( "secret" ) != std::string_view::npos;
+            }
+        } ) );
+        return std::nullopt;
+    };
+    sim.m_network.attach( observer->uuid(), SimNetwork::Step( std::move( observe ) ) );
+    sim.m_network.runFor( 2s );
+
+    // A small item, and one large enough to be sent in chunks.
+    std::string large( 256 * 1024, 'l' );
+    large.replace( 0, 6, "secret" );
+    for( const auto& contents : {std::string( "secret contents" ), large} )
+    {
+        sim.copy( 0, contents );
+        sim.m_network.runFor( 1s );
+    }
+
+    EXPECT_EQ( sim.m_received[1], std::vector<std::string>( {"secret contents", large} ) );
+    ASSERT_GT( headers.size(), 2 );
+    for( const auto& header : headers )
+    {
+        EXPECT_TRUE( header.sealed );
+    }
+    EXPECT_EQ( headers.back().kind, Protocol::Kind::Chunk );
+    EXPECT_FALSE( leaked );
+}
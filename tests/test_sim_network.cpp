@@ -0,0 +1,404 @@
+#include "sim_fixture.h"
+
+#include "network/peer_discovery.h"
+#include "network/protocol.h"
+#include "network/sim_network.h"
+#include "utils/hlc.h"
+#include "utils/metrics.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace Clipd;
+using namespace Clipd::Network;
+using namespace Clipd::Tests;
+using namespace std::chrono_literals;
+
+
+TEST( SimNetworkTests, TestShoutReachesEveryPeer )
+{
+    SimSession sim( 100 );
+    sim.m_network.runFor( 2s );
+    for( const auto& node : sim.m_nodes )
+    {
+        ASSERT_EQ( node->sessionPeers(), 99 );
+    }
+
+    const uint64_t sent = sim.m_network.stats().messages;
+    sim.copy( 0, "contents" );
+    EXPECT_TRUE( sim.m_network.runUntilIdle( 1s ) );
+    EXPECT_EQ( sim.converged( "contents" ), 99 );
+    EXPECT_TRUE( sim.m_received[0].empty() );
+    // Zyre sends every peer in the group its own copy of a shout.
+    EXPECT_EQ( sim.m_network.stats().messages - sent, 99 );
+}
+
+TEST( SimNetworkTests, TestSameSeedIsDeterministic )
+{
+    SimNetwork::Config config;
+    config.jitter = 5ms;
+    config.loss = 0.1;
+    config.seed = 7;
+
+    const auto run = [&config] {
+        SimSession sim( 20, config );
+        sim.m_network.runFor( 2s );
+        sim.copy( 3, "contents" );
+        sim.m_network.runUntilIdle( 5s );
+        return std::make_pair( sim.m_network.stats().retransmits,
+                               sim.m_network.now().time_since_epoch() );
+    };
+    EXPECT_EQ( run(), run() );
+}
+
+TEST( SimNetworkTests, TestPartitionedPeersExpireAndCatchUp )
+{
+    SimNetwork::Config config;
+    config.evasive = 1s;
+    config.expired = 3s;
+    SimSession sim( 10, config );
+    sim.m_network.runFor( 2s );
+
+    sim.m_network.partition( {sim.m_nodes[8]->uuid(), sim.m_nodes[9]->uuid()} );
+    sim.copy( 0, "while partitioned" );
+    sim.m_network.runFor( 4s );
+    EXPECT_EQ( sim.converged( "while partitioned" ), 7 );
+    EXPECT_EQ( sim.m_nodes[0]->sessionPeers(), 7 );
+    EXPECT_EQ( sim.m_nodes[9]->sessionPeers(), 1 );
+
+    // The partitioned peers rediscover the others, who offer them the item they missed.
+    sim.m_network.heal();
+    sim.m_network.runFor( 2s );
+    EXPECT_EQ( sim.converged( "while partitioned" ), 9 );
+    EXPECT_EQ( sim.m_nodes[9]->sessionPeers(), 9 );
+}
+
+TEST( SimNetworkTests, TestExitedPeersCountersAreReleased )
+{
+    SimNetwork::Config config;
+    config.evasive = 1s;
+    config.expired = 3s;
+    SimSession sim( 2, config );
+    sim.m_network.runFor( 2s );
+    sim.copy( 0, "contents" );
+    sim.m_network.runFor( 1s );
+
+    const std::string name =
+        Utils::Metrics::labelled( "network.bytes_sent", "peer", sim.m_nodes[1]->uuid().hex() );
+    EXPECT_EQ( Utils::Metrics::Registry::global().snapshot().counters.count( name ), 1 );
+
+    sim.m_network.partition( {sim.m_nodes[1]->uuid()} );
+    sim.m_network.runFor( 4s );
+    EXPECT_EQ( Utils::Metrics::Registry::global().snapshot().counters.count( name ), 0 );
+}
+
+TEST( SimNetworkTests, TestUnansweredPullIsRetried )
+{
+    auto& retried = Utils::Metrics::Registry::global().counter( "network.pulls.retried" );
+    const uint64_t retried_before = retried.value();
+
+    SimNetwork::Config config;
+    config.latency = 10ms;
+    config.evasive = 1s;
+    config.expired = 3s;
+    SimSession sim( 4, config );
+    sim.m_network.runFor( 2s );
+    const Utils::Uuid late = sim.m_nodes[3]->uuid();
+    sim.m_network.partition( {late} );
+    sim.copy( 0, "contents" );
+    sim.m_network.runFor( 4s );
+    ASSERT_EQ( sim.converged( "contents" ), 2 );
+
+    // The rediscovered peers each offer the item the late node missed, which it pulls from the
+    // first of them. That pull is lost, and so are any offers that arrive while it's in flight.
+    sim.m_network.heal();
+    const uint64_t sent = sim.m_network.bytesSent( late );
+    while( sim.m_network.bytesSent( late ) == sent )
+    {
+        sim.m_network.runFor( 1ms );
+    }
+    sim.m_network.silence( late );
+    sim.m_network.runFor( 20ms );
+    sim.m_network.resume( late );
+
+    sim.m_network.runFor( 5s );
+    EXPECT_EQ( sim.converged( "contents" ), 3 );
+    EXPECT_GT( retried.value() - retried_before, 0 );
+}
+
+TEST( SimNetworkTests, TestOversizedItemsAreDropped )
+{
+    SimSession sim( 2 );
+    auto attacker = sim.m_network.createTransport( "attacker" );
+    attacker->join( "session" );
+    attacker->join( Protocol::sessionGroup( "session" ) );
+    auto ignore = [&attacker]() -> std::optional<SimNetwork::Clock::duration> {
+        attacker->receive( Transport::Handler( []( const Event& ) {} ) );
+        return std::nullopt;
+    };
+    sim.m_network.attach( attacker->uuid(), SimNetwork::Step( std::move( ignore ) ) );
+    sim.m_network.runFor( 2s );
+
+    // An item claiming to decompress to far more than any peer accepts.
+    const Clipboard::Item item {{sim.m_clock.now(), attacker->uuid()},
+                                Utils::Payload( std::string( 4096, 'a' ) )};
+    auto frames = Protocol::encodeItem( item, Codec::Deflate );
+    auto header = Protocol::decodeHeader( frames[0] );
+    ASSERT_TRUE( header );
+    header->size = uint64_t( 1 ) << 62;
+    frames[0] = Protocol::encodeHeader( *header );
+    attacker->shout( Protocol::sessionGroup( "session" ), frames );
+    sim.m_network.runFor( 1s );
+    EXPECT_TRUE( sim.m_received[0].empty() );
+    EXPECT_TRUE( sim.m_received[1].empty() );
+
+    sim.copy( 0, "contents" );
+    sim.m_network.runFor( 1s );
+    EXPECT_EQ( sim.converged( "contents" ), 1 );
+}
+
+TEST( SimNetworkTests, TestMaxPayloadIsConfigurable )
+{
+    auto& oversized = Utils::Metrics::Registry::global().counter( "network.oversized" );
+
+    // Node 1 only accepts small items, and node 2 accepts any size.
+    SimSession sim( 3 );
+    sim.m_nodes[1]->setMaxPayload( 1000 );
+    auto sender = sim.m_network.createTransport( "sender" );
+    sender->join( "session" );
+    sender->join( Protocol::sessionGroup( "session" ) );
+    auto ignore = [&sender]() -> std::optional<SimNetwork::Clock::duration> {
+        sender->receive( Transport::Handler( []( const Event& ) {} ) );
+        return std::nullopt;
+    };
+    sim.m_network.attach( sender->uuid(), SimNetwork::Step( std::move( ignore ) ) );
+    sim.m_network.runFor( 2s );
+
+    const std::string huge( 20 * 1024 * 1024, 'h' );
+    sim.copy( 0, huge );
+    sim.m_network.runFor( 2s );
+    EXPECT_TRUE( sim.m_received[1].empty() );
+    ASSERT_EQ( sim.m_received[2].size(), 1 );
+    EXPECT_EQ( sim.m_received[2].back().size(), huge.size() );
+
+    // A peer that ignores the advertised limit has its item dropped, and counted.
+    const uint64_t oversized_before = oversized.value();
+    const Clipboard::Item item {{sim.m_clock.now(), sender->uuid()},
+                                Utils::Payload( std::string( 2000, 'a' ) )};
+    sender->shout( Protocol::sessionGroup( "session" ), Protocol::encodeItem( item, Codec::Raw ) );
+    sim.m_network.runFor( 1s );
+    EXPECT_TRUE( sim.m_received[1].empty() );
+    EXPECT_EQ( sim.m_received[2].size(), 2 );
+    EXPECT_EQ( oversized.value() - oversized_before, 1 );
+}
+
+TEST( SimNetworkTests, TestPeersAreOnlySentItemsTheyAccept )
+{
+    SimSession sim( 2 );
+    // A peer that only accepts small items, and counts the items it's sent.
+    auto small = sim.m_network.createTransport( "small" );
+    small->setHeader( "X-CLIPD-PROTOCOL", "1" );
+    small->setHeader( "X-CLIPD-MAX-PAYLOAD", "1000" );
+    small->join( "session" );
+    small->join( Protocol::sessionGroup( "session" ) );
+    std::vector<uint64_t> sizes;
+    auto count = [&small, &sizes]() -> std::optional<SimNetwork::Clock::duration> {
+        small->receive( Transport::Handler( [&sizes]( const Event& event ) {
+            const auto header = event.frames.empty() ? std::nullopt
+                                                     : Protocol::decodeHeader( event.frames[0] );
+            if( header && header->kind == Protocol::Kind::Item )
+            {
+                sizes.push_back( header->size );
+            }
+        } ) );
+        return std::nullopt;
+    };
+    sim.m_network.attach( small->uuid(), SimNetwork::Step( std::move( count ) ) );
+    sim.m_network.runFor( 2s );
+
+    const std::string large( 4000, 'l' );
+    sim.copy( 0, large );
+    sim.m_network.runFor( 1s );
+    sim.copy( 0, "contents" );
+    sim.m_network.runFor( 1s );
+    EXPECT_THAT( sim.m_received[1], testing::ElementsAre( large, "contents" ) );
+    EXPECT_THAT( sizes, testing::ElementsAre( 8 ) );
+}
+
+TEST( SimNetworkTests, TestTimingIsOnlySentToPeersThatReadIt )
+{
+    SimSession sim( 2 );
+    // A peer from before the Timing frame, which counts the frames of the items it's sent.
+    auto old = sim.m_network.createTransport( "old" );
+    old->setHeader( "X-CLIPD-PROTOCOL", "1" );
+    old->join( "session" );
+    old->join( Protocol::sessionGroup( "session" ) );
+    std::vector<size_t> frames;
+    auto count = [&old, &frames]() -> std::optional<SimNetwork::Clock::duration> {
+        old->receive( Transport::Handler( [&frames]( const Event& event ) {
+            const auto header = event.frames.empty() ? std::nullopt
+                                                     : Protocol::decodeHeader( event.frames[0] );
+            if( header && header->kind == Protocol::Kind::Item )
+            {
+                frames.push_back( event.frames.size() );
+            }
+        } ) );
+        return std::nullopt;
+    };
+    sim.m_network.attach( old->uuid(), SimNetwork::Step( std::move( count ) ) );
+    sim.m_network.runFor( 2s );
+
+    sim.copy( 0, "contents" );
+    sim.m_network.runFor( 1s );
+    EXPECT_THAT( sim.m_received[1], testing::ElementsAre( "contents" ) );
+    EXPECT_THAT( frames, testing::ElementsAre( 2 ) );
+}
+
+TEST( SimNetworkTests, TestShoutsOnlyCarryDelaysNowAndThen )
+{
+    SimSession sim( 2 );
+    // A peer that reads Timing frames, and counts the delays in the ones it's sent.
+    auto timed = sim.m_network.createTransport( "timed" );
+    timed->setHeader( "X-CLIPD-PROTOCOL", "1" );
+    timed->setHeader( "X-CLIPD-TIMING", "1" );
+    timed->join( "session" );
+    timed->join( Protocol::sessionGroup( "session" ) );
+    std::vector<size_t> delays;
+    const std::string sender = sim.m_nodes[0]->uuid().hex();
+    auto count = [&timed, &delays, &sender]() -> std::optional<SimNetwork::Clock::duration> {
+        timed->receive( Transport::Handler( [&delays, &sender]( const Event& event ) {
+            const auto timing = event.frames.size() > 2 && event.peer == sender
+                                    ? Protocol::decodeTiming( event.frames.back() )
+                                    : std::nullopt;
+            if( timing )
+            {
+                delays.push_back( timing->delays.size() );
+            }
+        } ) );
+        return std::nullopt;
+    };
+    sim.m_network.attach( timed->uuid(), SimNetwork::Step( std::move( count ) ) );
+    sim.m_network.runFor( 2s );
+
+    // The first node measures its delay from the second, then shouts several items.
+    sim.copy( 1, "from 1" );
+    sim.m_network.runFor( 1s );
+    for( size_t i = 0; i < 4; ++i )
+    {
+        sim.copy( 0, "item" + std::to_string( i ) );
+        sim.m_network.runFor( 100ms );
+    }
+    sim.m_network.runFor( 10s );
+    sim.copy( 0, "later" );
+    sim.m_network.runFor( 1s );
+    EXPECT_THAT( delays, testing::ElementsAre( 1, 0, 0, 0, 1 ) );
+}
+
+TEST( SimNetworkTests, TestGatewayRoutesSessionsThroughOneNode )
+{
+    SimNetwork network;
+    std::map<std::string, std::vector<std::string>> received;
+    const auto subscribe = [&received]( PeerDiscoveryDaemon& node, const std::string& session,
+                                        const std::string& name ) {
+        node.registerOnRemoteClipboardUpdate(
+            session, Utils::Functor<void( const Clipboard::Item& )>(
+                         [&received, name]( const Clipboard::Item& item ) {
+                             received[name].push_back( item.contents.str() );
+                         } ) );
+    };
+    std::vector<std::unique_ptr<PeerDiscoveryDaemon>> nodes;
+    const auto add = [&]( const std::string& session ) -> PeerDiscoveryDaemon& {
+        const std::string name = session + std::to_string( nodes.size() );
+        nodes.push_back(
+            std::make_unique<PeerDiscoveryDaemon>( network.createTransport( name ), session ) );
+        subscribe( *nodes.back(), session, name );
+        network.attach( nodes.back()->uuid(),
+                        SimNetwork::Step( nodes.back().get(), &PeerDiscoveryDaemon::step ) );
+        return *nodes.back();
+    };
+
+    PeerDiscoveryDaemon gateway( network.createTransport( "gateway" ), "alice" );
+    for( const std::string session : {"bob", "carol"} )
+    {
+        gateway.addSession( session );
+    }
+    for( const std::string session : {"alice", "bob", "carol"} )
+    {
+        subscribe( gateway, session, "gateway/" + session );
+    }
+    network.attach( gateway.uuid(), SimNetwork::Step( &gateway, &PeerDiscoveryDaemon::step ) );
+    add( "alice" );
+    add( "bob" );
+    add( "bob" );
+    network.runFor( 2s );
+    EXPECT_EQ( gateway.sessionPeers(), 1 );
+    EXPECT_EQ( gateway.sessionPeers( "bob" ), 2 );
+    EXPECT_EQ( gateway.sessionPeers( "carol" ), 0 );
+    EXPECT_EQ( nodes[1]->sessionPeers(), 2 );
+
+    Utils::HybridLogicalClock clock;
+    const auto copy = [&clock]( const Utils::Uuid& origin, const std::string& contents ) {
+        return Clipboard::Item {{clock.now(), origin}, Utils::Payload( std::string( contents ) )};
+    };
+    gateway.receiveLocalClipboardUpdate( "bob", copy( gateway.uuid(), "for bob" ) );
+    nodes[0]->receiveLocalClipboardUpdate( copy( nodes[0]->uuid(), "from alice" ) );
+    EXPECT_TRUE( network.runUntilIdle( 1s ) );
+    EXPECT_THAT( received["bob1"], testing::ElementsAre( "for bob" ) );
+    EXPECT_THAT( received["bob2"], testing::ElementsAre( "for bob" ) );
+    EXPECT_THAT( received["gateway/alice"], testing::ElementsAre( "from alice" ) );
+    EXPECT_TRUE( received["alice0"].empty() );
+    EXPECT_TRUE( received["gateway/bob"].empty() );
+
+    // A peer joining a hosted session catches up on its item, by whispers tagged with the session.
+    gateway.receiveLocalClipboardUpdate( "carol", copy( gateway.uuid(), "for carol" ) );
+    network.runFor( 1s );
+    add( "carol" );
+    network.runFor( 2s );
+    EXPECT_THAT( received["carol3"], testing::ElementsAre( "for carol" ) );
+    EXPECT_TRUE( received["alice0"].empty() );
+    EXPECT_THAT( received["bob1"], testing::ElementsAre( "for bob" ) );
+}
+
+TEST( SimNetworkTests, TestScopedNodesOnlyDiscoverTheirSession )
+{
+    SimNetwork network;
+    std::vector<std::unique_ptr<PeerDiscoveryDaemon>> nodes;
+    for( size_t i = 0; i < 6; ++i )
+    {
+        // Each session is its own discovery scope, and no node joins GLOBAL.
+        const std::string session = i < 3 ? "alice" : "bob";
+        nodes.push_back( std::make_unique<PeerDiscoveryDaemon>(
+            network.createTransport( "node" + std::to_string( i ), session ), session,
+            Coalescer::Config {}, FanoutTree::Config {}, LaneScheduler::Config {}, false ) );
+        network.attach( nodes.back()->uuid(),
+                        SimNetwork::Step( nodes.back().get(), &PeerDiscoveryDaemon::step ) );
+    }
+    network.runFor( 2s );
+
+    for( const auto& node : nodes )
+    {
+        EXPECT_EQ( node->sessionPeers(), 2 );
+        EXPECT_EQ( network.connections( node->uuid() ), 2 );
+    }
+    // An ENTER, and a JOIN for each of the session's two groups, to each of two peers.
+    EXPECT_EQ( network.stats().membership, 6 * 2 * 3 );
+}
+
+TEST( SimNetworkTests, TestItemsAreNotCopiedOnTheWay )
+{
+    SimSession sim( 2 );
+    sim.m_network.runFor( 2s );
+    const auto& copied = Utils::Metrics::Registry::global().counter( "payload.bytes_copied" );
+    const uint64_t before = copied.value();
+
+    sim.copy( 0, std::string( 4096, 'x' ) );
+    EXPECT_TRUE( sim.m_network.runUntilIdle( 1s ) );
+    EXPECT_EQ( sim.converged( std::string( 4096, 'x' ) ), 1 );
+    // The only copy is the one the test records.
+    EXPECT_EQ( copied.value() - before, 4096 );
+}
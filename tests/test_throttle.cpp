@@ -0,0 +1,228 @@
+#include "sim_fixture.h"
+
+#include "network/peer_discovery.h"
+#include "network/sim_network.h"
+#include "network/throttle.h"
+#include "utils/metrics.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace Clipd;
+using namespace Clipd::Network;
+using namespace std::chrono_literals;
+
+namespace
+{
+Throttle::Config limit( double peer_rate, double session_rate, double burst )
+{
+    Throttle::Config config;
+    config.peer_rate = peer_rate;
+    config.session_rate = session_rate;
+    config.burst = burst;
+    return config;
+}
+
+/**
+ * @brief Simulated nodes with their own throttles, where the first floods the session, the second
+ * receives it, and a third, if there is one, stays under its limit.
+ */
+class Flood : public Tests::SimSession
+{
+public:
+    Flood( const Throttle::Config& sender, const Throttle::Config& receiver, bool polite = false ) :
+        SimSession( polite ? 3 : 2, {}, options() )
+    {
+        m_nodes[0]->setThrottle( sender );
+        m_nodes[1]->setThrottle( receiver );
+        m_network.runFor( 2s );
+    }
+
+    static Options options()
+    {
+        Options options;
+        options.coalescing.debounce = 0ms;
+        return options;
+    }
+
+    //! @brief Copy an item every millisecond for a second, and return the last one.
+    std::string flood()
+    {
+        std::string contents;
+        for( size_t i = 0; i < 1000; ++i )
+        {
+            contents = "item" + std::to_string( i );
+            copy( 0, contents );
+            m_network.runFor( 1ms );
+        }
+        m_network.runFor( 2s );
+        return contents;
+    }
+
+    [[nodiscard]] Utils::HybridLogicalClock::Timestamp stamp()
+    {
+        return m_clock.now();
+    }
+
+    void run( SimNetwork::Clock::duration duration )
+    {
+        m_network.runFor( duration );
+    }
+
+    //! @brief The items the second node received, in the order it received them.
+    [[nodiscard]] const std::vector<std::string>& received() const
+    {
+        return m_received[1];
+    }
+
+    //! @brief How long the given item took to reach the second node, if it did.
+    [[nodiscard]] std::optional<SimNetwork::Clock::duration>
+    delay( const std::string& contents ) const
+    {
+        return SimSession::delay( 1, contents );
+    }
+};
+
+Utils::Metrics::Counter& counter( const std::string& name, const std::string& direction )
+{
+    return Utils::Metrics::Registry::global().counter(
+        Utils::Metrics::labelled( name, "direction", direction ) );
+}
+} // namespace
+
+TEST( ThrottleTests, TestBucketAllowsBurstsThenItsRate )
+{
+    TokenBucket bucket( 10, 4 );
+    const auto now = TokenBucket::Clock::now();
+    for( size_t i = 0; i < 4; ++i )
+    {
+        EXPECT_TRUE( bucket.take( now ) ) << i;
+    }
+    EXPECT_FALSE( bucket.take( now ) );
+
+    const auto wait = bucket.wait( now );
+    EXPECT_GE( wait, 100ms );
+    EXPECT_LE( wait, 101ms );
+    EXPECT_FALSE( bucket.take( now + 50ms ) );
+    EXPECT_TRUE( bucket.take( now + wait ) );
+    EXPECT_FALSE( bucket.take( now + wait ) );
+}
+
+TEST( ThrottleTests, TestPeersAndSessionsHaveTheirOwnBuckets )
+{
+    const auto now = Throttle::Clock::now();
+    Throttle unlimited;
+    EXPECT_FALSE( unlimited.enabled() );
+    EXPECT_TRUE( unlimited.admit( "session", "a", now ) );
+
+    // One peer using up its bucket doesn't hold back another.
+    Throttle peers( limit( 1, 0, 1 ) );
+    EXPECT_TRUE( peers.admit( "session", "a", now ) );
+    EXPECT_FALSE( peers.admit( "session", "a", now ) );
+    EXPECT_TRUE( peers.admit( "session", "b", now ) );
+    EXPECT_EQ( peers.wait( "session", "a", now ), 1s );
+    peers.forget( "a" );
+    EXPECT_TRUE( peers.admit( "session", "a", now ) );
+
+    // But every peer together may only use up their session's bucket.
+    Throttle sessions( limit( 0, 1, 1 ) );
+    EXPECT_TRUE( sessions.admit( "session", "a", now ) );
+    EXPECT_FALSE( sessions.admit( "session", "b", now ) );
+    EXPECT_TRUE( sessions.admit( "other", "b", now ) );
+
+    // A refused item doesn't take a token from the bucket that had one.
+    Throttle both( limit( 1, 2, 1 ) );
+    EXPECT_TRUE( both.admit( "session", "a", now ) );
+    EXPECT_FALSE( both.admit( "session", "a", now ) );
+    EXPECT_TRUE( both.admit( "session", "b", now + 500ms ) );
+}
+
+TEST( ThrottleTests, TestFloodedReceiverOnlyDeliversTheLatestItems )
+{
+    auto& held = counter( "network.throttle.held", "receive" );
+    auto& coalesced = counter( "network.throttle.coalesced", "receive" );
+    const uint64_t held_before = held.value();
+    const uint64_t coalesced_before = coalesced.value();
+
+    Flood flood( {}, limit( 10, 0, 4 ) );
+    const std::string last = flood.flood();
+
+    // A burst, then 10 items a second, and the latest item held back, once the flood stops.
+    ASSERT_FALSE( flood.received().empty() );
+    EXPECT_LE( flood.received().size(), 20 );
+    EXPECT_EQ( flood.received().back(), last );
+    EXPECT_GT( held.value() - held_before, 0 );
+    EXPECT_GT( coalesced.value() - coalesced_before, 900 );
+}
+
+TEST( ThrottleTests, TestFloodDoesntHoldBackOtherPeers )
+{
+    auto& coalesced = counter( "network.throttle.coalesced", "receive" );
+
+    // The first node uses up its burst, and has its next item held back.
+    Flood flood( {}, limit( 10, 0, 4 ), true );
+    for( size_t i = 0; i < 5; ++i )
+    {
+        flood.copy( 0, "item" + std::to_string( i ) );
+        flood.run( 1ms );
+    }
+    const auto before = flood.stamp();
+    flood.copy( 0, "item5" );
+    flood.run( 10ms );
+
+    // The third node is under its limit, so its item is delivered as it arrives, even though it
+    // was copied before the held one, rather than being dropped for it.
+    const uint64_t coalesced_before = coalesced.value();
+    flood.copy( 2, "older", before );
+    flood.run( 10ms );
+    const auto delay = flood.delay( "older" );
+    ASSERT_TRUE( delay );
+    EXPECT_LE( *delay, 5ms );
+    EXPECT_EQ( coalesced.value(), coalesced_before );
+
+    // A newer item from the third node is delivered at once too, and supersedes the held one.
+    flood.copy( 2, "newer" );
+    flood.run( 1s );
+    ASSERT_TRUE( flood.delay( "newer" ) );
+    EXPECT_LE( *flood.delay( "newer" ), 5ms );
+    EXPECT_EQ( flood.received().back(), "newer" );
+    EXPECT_FALSE( flood.delay( "item5" ) );
+}
+
+TEST( ThrottleTests, TestItemsHeldFromExitedPeersAreDropped )
+{
+    // The first node uses up its burst, has its next item held back, and exits.
+    Flood flood( {}, limit( 10, 0, 4 ) );
+    for( size_t i = 0; i < 6; ++i )
+    {
+        flood.copy( 0, "item" + std::to_string( i ) );
+        flood.run( 1ms );
+    }
+    flood.m_network.stop( flood.m_nodes[0]->uuid() );
+    flood.run( 1s );
+
+    // Its held item isn't delivered once the throttle, which forgot the peer, would allow it.
+    ASSERT_FALSE( flood.received().empty() );
+    EXPECT_NE( flood.received().back(), "item5" );
+    EXPECT_FALSE( flood.delay( "item5" ) );
+}
+
+TEST( ThrottleTests, TestFloodingSenderOnlySendsTheLatestItems )
+{
+    auto& held = counter( "network.throttle.held", "send" );
+    auto& coalesced = counter( "network.throttle.coalesced", "send" );
+    const uint64_t held_before = held.value();
+    const uint64_t coalesced_before = coalesced.value();
+
+    Flood flood( limit( 0, 10, 4 ), {} );
+    const std::string last = flood.flood();
+
+    ASSERT_FALSE( flood.received().empty() );
+    EXPECT_LE( flood.received().size(), 20 );
+    EXPECT_EQ( flood.received().back(), last );
+    EXPECT_GT( held.value() - held_before, 0 );
+    EXPECT_GT( coalesced.value() - coalesced_before, 900 );
+}
@@ -0,0 +1,46 @@
+#include "clipboard/item.h"
+#include "clipboard/trace.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace Clipd;
+using namespace Clipd::Clipboard;
+
+TEST( TracerTests, TestRecordsStagesOnLocalClock )
+{
+    Utils::Metrics::Registry registry;
+    Tracer tracer( 4, 1, registry );
+
+    // The origin's clock is 1 s behind ours.
+    Item item {{}, Utils::Payload( std::string( "contents" ) )};
+    item.trace.captured_us = 10'000;
+    item.trace.read_us = 100;
+    item.trace.hash_us = 10;
+    item.trace.sent_us = 10'500;
+    item.trace.offset_us = 1'000'000;
+    item.trace.received_us = 1'011'000;
+    item.trace.decode_us = 5;
+    tracer.complete( item, 20, 1'011'100 );
+
+    const auto snapshot = registry.snapshot();
+    EXPECT_EQ( snapshot.histograms.at( "trace.queue_ns" ).max, 390'000 );
+    EXPECT_EQ( snapshot.histograms.at( "trace.transit_ns" ).max, 500'000 );
+    EXPECT_EQ( snapshot.histograms.at( "trace.end_to_end_ns" ).max, 1'100'000 );
+
+    std::stringstream chrome;
+    tracer.writeChromeTrace( chrome );
+    EXPECT_THAT( chrome.str(), testing::HasSubstr( "\"name\":\"transit\",\"ph\":\"X\",\"pid\":2,"
+                                                   "\"tid\":1,\"ts\":1010500,\"dur\":500}" ) );
+}
+
+TEST( TracerTests, TestIgnoresUntracedItems )
+{
+    Utils::Metrics::Registry registry;
+    Tracer tracer( 4, 1, registry );
+
+    tracer.complete( Item {{}, Utils::Payload( std::string( "contents" ) )}, 20, 1000 );
+    EXPECT_EQ( registry.snapshot().histograms.at( "trace.end_to_end_ns" ).count, 0 );
+}
@@ -1,6 +1,9 @@
 #include "utils/uuid.h"
 
 #include <list>
+#include <set>
+#include <thread>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -42,3 +45,46 @@ TEST( UuidTests, TestUuidUniqueness )
 
     EXPECT_THAT( uuids, SizeIs( num_examples ) ) << "Expected no duplicate UUIDS.";
 }
+
+TEST( UuidTests, TestUuidHexRoundTrip )
+{
+    for( size_t i = 0; i < 100; ++i )
+    {
+        const Uuid uuid = Uuid::random();
+        const auto parsed = Uuid::fromHex( uuid.hex() );
+        ASSERT_TRUE( parsed );
+        EXPECT_EQ( *parsed, uuid );
+        EXPECT_THAT( uuid.hex(), MatchesRegex( "[0-9A-F]{32}" ) );
+    }
+
+    // Zyre formats uuids in uppercase, but accept either case.
+    EXPECT_EQ( Uuid::fromHex( "0123456789abcdefFEDCBA9876543210" ),
+               ( Uuid {0x0123456789abcdefULL, 0xfedcba9876543210ULL} ) );
+    EXPECT_FALSE( Uuid::fromHex( "0123" ) );
+    EXPECT_FALSE( Uuid::fromHex( "0123456789abcdefFEDCBA987654321x" ) );
+}
+
+TEST( UuidTests, TestRandomUuidsAreUniqueAcrossThreads )
+{
+    constexpr size_t num_threads = 4;
+    constexpr size_t num_examples = 10000;
+
+    std::vector<std::vector<Uuid>> generated( num_threads );
+    std::vector<std::thread> threads;
+    for( auto& uuids : generated )
+    {
+        threads.emplace_back( [&uuids] {
+            for( size_t i = 0; i < num_examples; ++i )
+            {
+                uuids.push_back( Uuid::random() );
+            }
+        } );
+    }
+    std::set<Uuid> unique;
+    for( size_t t = 0; t < num_threads; ++t )
+    {
+        threads[t].join();
+        unique.insert( generated[t].begin(), generated[t].end() );
+    }
+    EXPECT_EQ( unique.size(), num_threads * num_examples );
+}